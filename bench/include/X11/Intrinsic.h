@@ -0,0 +1,16 @@
+/* Minimal stand-in for <X11/Intrinsic.h>, so that regularExp.c can be built
+   for the regex benchmark without the X development files. */
+
+#ifndef REBENCH_X11_INTRINSIC_H
+#define REBENCH_X11_INTRINSIC_H
+
+typedef char Boolean;
+
+#ifndef True
+#define True 1
+#define False 0
+#endif
+
+#define XtNumber(arr) ((unsigned int) (sizeof(arr) / sizeof(arr[0])))
+
+#endif
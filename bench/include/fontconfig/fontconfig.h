@@ -0,0 +1,9 @@
+/* Minimal stand-in for <fontconfig/fontconfig.h>, enough for the textBuf.h
+   declarations seen by regularExp.c in the regex benchmark. */
+
+#ifndef REBENCH_FONTCONFIG_H
+#define REBENCH_FONTCONFIG_H
+
+typedef unsigned int FcChar32;
+
+#endif
@@ -0,0 +1,721 @@
+/*******************************************************************************
+*                                                                              *
+* rebench.c -- Regular expression benchmark and regression check               *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+* Nirvana Text Editor                                                          *
+*                                                                              *
+*******************************************************************************/
+
+/*
+** Standalone driver for regularExp.c.  Runs a catalog of expressions (the
+** NEdit regex dialect features plus every pattern of the built-in syntax
+** highlighting sets from highlightData.c) over a synthetic corpus and any
+** files named on the command line, and reports compile time, compiled size
+** and ns/byte for forward and reverse ExecRE scans, and how the compiled
+** regex cache does when each expression is searched for repeatedly.
+**
+** The matches found on the synthetic corpus are reduced to a count and a hash
+** per expression and direction.  "-g file" writes them as the golden match
+** set, "-c file" compares against it and exits with status 1 on any
+** difference.
+**
+** Usage: rebench [-h highlightData.c] [-g|-c golden] [-e auto|backtrack|nfa]
+**                [-r repeats] [-q] [corpus files...]
+*/
+
+#include "../source/regularExp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SYNTH_SIZE (128 * 1024) /* Bytes of synthetic corpus. */
+#define MIN_COMPILE_NS 2000000  /* Time to spend compiling each expression. */
+#define NGROUPS 9               /* Capture groups ExecRE always sets. */
+#define CACHE_LOOKUPS 8         /* Searches per expression, like Find Next. */
+
+typedef struct {
+    const char *name;
+    const char *re;
+    int flags;
+} benchPattern;
+
+typedef struct {
+    long count;
+    unsigned long hash;
+    int status;
+} scanResult;
+
+typedef struct {
+    const char *name;
+    char *text;
+    long len;
+} corpus;
+
+static benchPattern Catalog[] = {
+    {"literal",             "return", REDFLT_STANDARD},
+    {"literal-ci",          "RETURN", REDFLT_CASE_INSENSITIVE},
+    {"inline-ci",           "(?iStrasse|stra\303\237e)", REDFLT_STANDARD},
+    {"alternation",         "if|else|while|for|return|switch", REDFLT_STANDARD},
+    {"word",                "<\\l\\w*>", REDFLT_STANDARD},
+    {"identifier",          "[A-Za-z_][A-Za-z0-9_]*", REDFLT_STANDARD},
+    {"number",              "<(?:0[xX][\\da-fA-F]+|\\d+(?:\\.\\d*)?(?:[eE][+\\-]?\\d+)?)>",
+                            REDFLT_STANDARD},
+    {"dq-string",           "\"(?:[^\\\\\"]|\\\\.)*\"", REDFLT_STANDARD},
+    {"c-comment",           "/\\*(?:.|\\n)*?\\*/", REDFLT_STANDARD},
+    {"line-comment",        "//.*$", REDFLT_STANDARD},
+    {"bol-anchor",          "^\\s*#\\s*\\l+", REDFLT_STANDARD},
+    {"eol-anchor",          "[;{]\\s*$", REDFLT_STANDARD},
+    {"email",               "[\\w.+\\-]+@[\\w\\-]+(?:\\.[\\w\\-]+)+", REDFLT_STANDARD},
+    {"url",                 "<(?:https?|ftp)://[^\\s\"'<>]+", REDFLT_STANDARD},
+    {"lazy",                "\\(.*?\\)", REDFLT_STANDARD},
+    {"greedy-dot",          "=.*;", REDFLT_STANDARD},
+    {"brace-exact",         "\\d{3}", REDFLT_STANDARD},
+    {"brace-range",         "<\\w{4,8}>", REDFLT_STANDARD},
+    {"brace-open",          "a{10,}c", REDFLT_STANDARD},
+    {"brace-lazy",          "\\l{2,5}?\\d", REDFLT_STANDARD},
+    {"backref-word",        "<(\\l+)\\s+\\1>", REDFLT_STANDARD},
+    {"backref-ci",          "(?i<(\\l+)\\s+\\1>)", REDFLT_STANDARD},
+    {"backref-quote",       "(['\"]).*?\\1", REDFLT_STANDARD},
+    {"lookbehind",          "(?<=\\()\\w+", REDFLT_STANDARD},
+    {"neg-lookbehind",      "(?<![\\w.])\\d+", REDFLT_STANDARD},
+    {"lookbehind-var",      "(?<=foo_\\d{1,3}\\()\\w+", REDFLT_STANDARD},
+    {"lookahead",           "\\w+(?=\\()", REDFLT_STANDARD},
+    {"neg-lookahead",       "<\\l+>(?!\\s*[(=])", REDFLT_STANDARD},
+    {"delim-y",             "\\ycount\\y", REDFLT_STANDARD},
+    {"delim-Y",             "\\Y+", REDFLT_STANDARD},
+    {"no-newline",          "(?N.+)", REDFLT_STANDARD},
+    {"newline-class",       "(?n[^;]+);", REDFLT_STANDARD},
+    {"utf8-dot",            "\303.", REDFLT_STANDARD},
+    {"utf8-word",           "\346\227\245\346\234\254\350\252\236", REDFLT_STANDARD},
+    {"captures",            "(\\w+)\\s*=\\s*(\\w+)\\s*\\(([^)]*)\\)", REDFLT_STANDARD},
+    {"nested-star",         "(a+)+b", REDFLT_STANDARD},
+    {"exponential",         "(a|aa)+$", REDFLT_STANDARD},
+    {"no-match",            "zq[xj]{2}", REDFLT_STANDARD},
+    {"empty",               "x*", REDFLT_STANDARD}
+};
+
+static const char *Words[] = {
+    "the", "editor", "buffer", "search", "replace", "count", "value", "naive",
+    "na\303\257ve", "Stra\303\237e", "STRASSE", "\303\251cole", "\303\211COLE",
+    "\346\227\245\346\234\254\350\252\236", "regex", "match", "the", "window"
+};
+
+/* Default of the wordDelimiters resource, as set up in nedit.c */
+static char Delimiters[] = ".,/\\`'!|@#%^&*()-=+{}[]\":;<>?";
+
+static int Quiet = 0;
+
+static double nowNs(void);
+static unsigned long nextRandom(unsigned long *seed);
+static corpus *makeSynthetic(void);
+static corpus *readCorpus(const char *filename);
+static int readHighlightPatterns(const char *filename, benchPattern **patterns);
+static char *readFile(const char *filename, long *length);
+static void scanForward(regexp *re, const corpus *c, scanResult *r);
+static void scanReverse(regexp *re, const corpus *c, scanResult *r);
+static void addMatch(regexp *re, const corpus *c, scanResult *r);
+static void benchCache(const benchPattern *patterns, int nPatterns);
+static char *escapeRE(const char *re, int flags);
+static int checkGolden(const char *filename, char **lines, int nLines);
+static const char *goldenKey(const char *line);
+
+/*
+** regularExp.c only needs Utf8CharLen from textBuf.c, linking textBuf.o
+** would pull in the rest of the editor.  Keep in sync with textBuf.c.
+*/
+int Utf8CharLen(const unsigned char *u)
+{
+    unsigned char u0 = u[0];
+    int ulen = 1;
+    if(u0 >= 240) {
+        ulen = 4;
+    } else if(u0 >= 224) {
+        ulen = 3;
+    } else if(u0 >= 192) {
+        ulen = 2;
+    }
+    return ulen;
+}
+
+int main(int argc, char **argv)
+{
+    const char *highlightFile = "../source/highlightData.c";
+    const char *goldenFile = NULL;
+    benchPattern *patterns, *highlightPatterns = NULL;
+    corpus **corpora;
+    char **golden;
+    int nPatterns, nHighlight, nCorpora = 0, generate = 0, repeats = 1;
+    int i, j, k, failed = 0, errors = 0;
+    long totalSize = 0;
+    double totalCompile = 0.0, totalFW = 0.0, totalRV = 0.0, totalBytes = 0.0;
+
+    SetREDefaultWordDelimiters(Delimiters);
+    corpora = (corpus **)malloc(sizeof(corpus *) * (argc + 1));
+    corpora[nCorpora++] = makeSynthetic();
+
+    for (i = 1; i < argc; i++) {
+    	if (!strcmp(argv[i], "-h") && i + 1 < argc) {
+    	    highlightFile = argv[++i];
+    	} else if ((!strcmp(argv[i], "-g") || !strcmp(argv[i], "-c")) &&
+    	    	i + 1 < argc) {
+    	    generate = argv[i][1] == 'g';
+    	    goldenFile = argv[++i];
+    	} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+    	    i++;
+    	    if (!strcmp(argv[i], "backtrack"))
+    	    	SetREEnginePolicy(RE_ENGINE_BACKTRACK);
+    	    else if (!strcmp(argv[i], "nfa"))
+    	    	SetREEnginePolicy(RE_ENGINE_NFA);
+    	    else
+    	    	SetREEnginePolicy(RE_ENGINE_AUTO);
+    	} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+    	    repeats = atoi(argv[++i]);
+    	    if (repeats < 1)
+    	    	repeats = 1;
+    	} else if (!strcmp(argv[i], "-q")) {
+    	    Quiet = 1;
+    	} else if (argv[i][0] == '-') {
+    	    fprintf(stderr, "Usage: %s [-h highlightData.c] [-g|-c golden] "
+    	    	    "[-e auto|backtrack|nfa] [-r repeats] [-q] [files...]\n",
+    	    	    argv[0]);
+    	    return 2;
+    	} else if ((corpora[nCorpora] = readCorpus(argv[i])) != NULL) {
+    	    nCorpora++;
+    	}
+    }
+
+    /* The catalog followed by the highlighting patterns */
+    nHighlight = readHighlightPatterns(highlightFile, &highlightPatterns);
+    nPatterns = XtNumber(Catalog) + nHighlight;
+    patterns = (benchPattern *)malloc(sizeof(benchPattern) * nPatterns);
+    memcpy(patterns, Catalog, sizeof(Catalog));
+    if (nHighlight > 0)
+    	memcpy(patterns + XtNumber(Catalog), highlightPatterns,
+    	    	sizeof(benchPattern) * nHighlight);
+    golden = (char **)malloc(sizeof(char *) * nPatterns);
+
+    if (!Quiet)
+    	printf("%-32s %-9s %8s %6s %3s %9s %9s %7s\n", "pattern", "corpus",
+    	    	"comp(ns)", "size", "eng", "fwd(ns/B)", "rev(ns/B)", "matches");
+
+    for (i = 0; i < nPatterns; i++) {
+    	char *compileMsg = NULL;
+    	regexp *re;
+    	double start, compileNs;
+    	int nCompiles = 0;
+
+	/* Time compilation until enough has elapsed to be meaningful */
+	start = nowNs();
+	do {
+	    re = CompileRE(patterns[i].re, &compileMsg, patterns[i].flags);
+	    if (re == NULL)
+	    	break;
+	    nCompiles++;
+	    if (nowNs() - start < MIN_COMPILE_NS)
+	    	free(re);
+	    else
+	    	break;
+	} while (1);
+
+	if (re == NULL) {
+	    /* Compile errors are part of the golden set, too */
+	    char *escaped = escapeRE(patterns[i].re, patterns[i].flags);
+	    golden[i] = (char *)malloc(strlen(escaped) + 32);
+	    sprintf(golden[i], "error %s", escaped);
+	    free(escaped);
+	    if (!Quiet)
+	    	printf("%-32.32s compile error: %s\n", patterns[i].name,
+	    	    	compileMsg);
+	    errors++;
+	    continue;
+	}
+	compileNs = (nowNs() - start) / nCompiles;
+	totalCompile += compileNs;
+	totalSize += re->size;
+
+	for (j = 0; j < nCorpora; j++) {
+	    scanResult fw, rv;
+	    double fwNs = 0.0, rvNs = 0.0, t;
+
+	    for (k = 0; k < repeats; k++) {
+	    	t = nowNs();
+	    	scanForward(re, corpora[j], &fw);
+	    	t = nowNs() - t;
+	    	if (k == 0 || t < fwNs)
+	    	    fwNs = t;
+	    	t = nowNs();
+	    	scanReverse(re, corpora[j], &rv);
+	    	t = nowNs() - t;
+	    	if (k == 0 || t < rvNs)
+	    	    rvNs = t;
+	    }
+	    totalFW += fwNs;
+	    totalRV += rvNs;
+	    totalBytes += corpora[j]->len;
+
+	    if (j == 0) {
+	    	char *escaped = escapeRE(patterns[i].re, patterns[i].flags);
+	    	golden[i] = (char *)malloc(strlen(escaped) + 96);
+	    	sprintf(golden[i], "%ld %08lx %d %ld %08lx %d %s", fw.count,
+	    	    	fw.hash, fw.status, rv.count, rv.hash, rv.status, escaped);
+	    	free(escaped);
+	    }
+	    if (!Quiet)
+	    	printf("%-32.32s %-9.9s %8.0f %6ld %3s %9.2f %9.2f %7ld%s\n",
+	    	    	patterns[i].name, corpora[j]->name, compileNs, re->size,
+	    	    	re->engine == RE_ENGINE_NFA ? "nfa" : "bt",
+	    	    	fwNs / (corpora[j]->len + 1), rvNs / (corpora[j]->len + 1),
+	    	    	fw.count, fw.status != REEXEC_OK || rv.status != REEXEC_OK ?
+	    	    	" (gave up)" : "");
+	}
+	free(re);
+    }
+
+    printf("%d expressions (%d failed to compile), %d corpora: "
+    	    "compile %.0f ns avg, %ld bytes compiled, "
+    	    "forward %.2f ns/B, reverse %.2f ns/B\n",
+    	    nPatterns, errors, nCorpora,
+    	    totalCompile / (nPatterns - errors > 0 ? nPatterns - errors : 1),
+    	    totalSize, totalFW / (totalBytes + 1), totalRV / (totalBytes + 1));
+    if (!Quiet)
+    	benchCache(patterns, nPatterns);
+
+    if (goldenFile != NULL && generate) {
+    	FILE *fp = fopen(goldenFile, "w");
+    	if (fp == NULL) {
+    	    perror(goldenFile);
+    	    return 2;
+	}
+	for (i = 0; i < nPatterns; i++)
+	    fprintf(fp, "%s\n", golden[i]);
+	fclose(fp);
+    } else if (goldenFile != NULL) {
+    	failed = checkGolden(goldenFile, golden, nPatterns);
+    }
+    return failed ? 1 : 0;
+}
+
+/*
+** Look up each expression in the compiled regex cache CACHE_LOOKUPS times
+** in a row, as repeated searches for the same text do, and report the cache
+** statistics and the time per lookup.
+*/
+static void benchCache(const benchPattern *patterns, int nPatterns)
+{
+    RECacheStats before, after;
+    char *compileMsg;
+    regexp *re;
+    double start, lookupNs;
+    int i, k;
+
+    FlushRECache();
+    GetRECacheStats(&before);
+    start = nowNs();
+    for (i = 0; i < nPatterns; i++) {
+    	for (k = 0; k < CACHE_LOOKUPS; k++) {
+	    re = CompileCachedRE(patterns[i].re, &compileMsg,
+	    	    patterns[i].flags);
+	    ReleaseCachedRE(re);
+	}
+    }
+    lookupNs = (nowNs() - start) / ((double)nPatterns * CACHE_LOOKUPS);
+    GetRECacheStats(&after);
+
+    printf("regex cache: %lu hits, %lu misses, %lu evictions, "
+    	    "%d of %d entries, %.0f ns per lookup\n",
+    	    after.hits - before.hits, after.misses - before.misses,
+    	    after.evictions - before.evictions, after.entries, after.size,
+    	    lookupNs);
+    FlushRECache();
+}
+
+/*
+** Compare the results against the golden file, report differences and
+** return the number of expressions that did not match.
+*/
+static int checkGolden(const char *filename, char **lines, int nLines)
+{
+    char *contents, *line, *eol;
+    const char *key;
+    char **expected;
+    long length;
+    int i, nExpected = 0, failed = 0;
+
+    if ((contents = readFile(filename, &length)) == NULL)
+    	return nLines;
+
+    expected = (char **)malloc(sizeof(char *) * (length + 1));
+    for (line = contents; *line != '\0'; line = eol + 1) {
+    	eol = strchr(line, '\n');
+    	if (eol == NULL)
+    	    eol = line + strlen(line) - 1;
+	else
+	    *eol = '\0';
+	expected[nExpected++] = line;
+    }
+
+    for (i = 0; i < nLines; i++) {
+    	int j, found = 0;
+	key = goldenKey(lines[i]);
+	for (j = 0; j < nExpected; j++) {
+	    if (!strcmp(goldenKey(expected[j]), key)) {
+	    	found = 1;
+	    	if (strcmp(expected[j], lines[i])) {
+	    	    fprintf(stderr, "MISMATCH\n  expected: %s\n  got:      %s\n",
+	    	    	    expected[j], lines[i]);
+	    	    failed++;
+	    	}
+	    	break;
+	    }
+	}
+	if (!found) {
+	    fprintf(stderr, "NOT IN GOLDEN SET: %s\n", lines[i]);
+	    failed++;
+	}
+    }
+
+    if (failed)
+    	fprintf(stderr, "%d of %d expressions differ from %s\n", failed,
+    	    	nLines, filename);
+    else
+    	printf("All %d expressions match %s\n", nLines, filename);
+    free(expected);
+    free(contents);
+    return failed;
+}
+
+/*
+** The key of a golden line is the flags and expression at its end, after the
+** six result fields, or after "error" for an expression that did not compile.
+*/
+static const char *goldenKey(const char *line)
+{
+    int i, fields = strncmp(line, "error ", 6) ? 6 : 1;
+
+    for (i = 0; i < fields && line != NULL; i++)
+    	if ((line = strchr(line, ' ')) != NULL)
+    	    line++;
+    return line != NULL ? line : "";
+}
+
+/*
+** Find all matches front to back, the way Replace All and the highlighting
+** code do, resuming after each match (or one byte on from an empty match).
+*/
+static void scanForward(regexp *re, const corpus *c, scanResult *r)
+{
+    const char *pos = c->text, *end = c->text + c->len;
+
+    r->count = 0;
+    r->hash = 2166136261UL;
+    r->status = REEXEC_OK;
+    while (pos <= end) {
+    	if (!ExecRE(re, pos, NULL, False, pos == c->text ? '\0' : pos[-1],
+    	    	'\0', NULL, c->text, NULL)) {
+    	    r->status = GetREExecStatus();
+    	    break;
+	}
+	addMatch(re, c, r);
+	pos = re->endp[0] > re->startp[0] ? re->endp[0] : re->startp[0] + 1;
+    }
+}
+
+/*
+** Find all matches back to front, the way repeated Find Previous does,
+** restarting one byte before the start of each match.
+*/
+static void scanReverse(regexp *re, const corpus *c, scanResult *r)
+{
+    const char *pos = c->text + c->len;
+
+    r->count = 0;
+    r->hash = 2166136261UL;
+    r->status = REEXEC_OK;
+    while (pos >= c->text) {
+    	if (!ExecRE(re, c->text, pos, True, '\0', '\0', NULL, c->text, NULL)) {
+    	    r->status = GetREExecStatus();
+    	    break;
+	}
+	addMatch(re, c, r);
+	pos = re->startp[0] - 1;
+    }
+}
+
+/*
+** Fold the position of a match, its capture groups and the top branch into
+** the running FNV-1a hash of a scan.
+*/
+static void addMatch(regexp *re, const corpus *c, scanResult *r)
+{
+    long values[2 * NGROUPS + 1];
+    unsigned char *p;
+    int i;
+
+    for (i = 0; i < NGROUPS; i++) {
+    	values[2 * i] = re->startp[i] ? re->startp[i] - c->text : -1;
+    	values[2 * i + 1] = re->endp[i] ? re->endp[i] - c->text : -1;
+    }
+    values[2 * NGROUPS] = re->top_branch;
+
+    for (p = (unsigned char *)values; p < (unsigned char *)(values + 2 * NGROUPS + 1);
+    	    p++)
+    	r->hash = ((r->hash ^ *p) * 16777619UL) & 0xffffffffUL;
+    r->count++;
+}
+
+/*
+** Build a reproducible corpus mixing C-like code, prose with UTF-8 and
+** doubled words, numbers, addresses and long runs that are expensive for
+** backtracking.
+*/
+static corpus *makeSynthetic(void)
+{
+    corpus *c = (corpus *)malloc(sizeof(corpus));
+    unsigned long seed = 12345;
+    char line[512], *p;
+    long len = 0;
+    int i, n;
+
+    c->name = "synthetic";
+    c->text = (char *)malloc(SYNTH_SIZE + sizeof(line) + 1);
+    while (len < SYNTH_SIZE) {
+    	n = (int)(nextRandom(&seed) % 100);
+    	if (n < 40) {
+    	    sprintf(line, "%*sif (count_%lu > %lu) { value = foo_%lu(bar, "
+    	    	    "\"text %lu\\n\"); return value; } /* %s */\n", (int)(n % 4) * 4, "",
+    	    	    nextRandom(&seed) % 100, nextRandom(&seed) % 1000,
+    	    	    nextRandom(&seed) % 50, nextRandom(&seed) % 10,
+    	    	    Words[nextRandom(&seed) % XtNumber(Words)]);
+    	} else if (n < 70) {
+    	    p = line;
+    	    for (i = (int)(nextRandom(&seed) % 16) + 4; i > 0; i--)
+    	    	p += sprintf(p, "%s ", Words[nextRandom(&seed) % XtNumber(Words)]);
+    	    strcpy(p, "\n");
+    	} else if (n < 80) {
+    	    sprintf(line, "#define MAX_%lu 0x%lx // %lu.%lue%lu, 'c' 1,234\n",
+    	    	    nextRandom(&seed) % 100, nextRandom(&seed) % 65536,
+    	    	    nextRandom(&seed) % 10, nextRandom(&seed) % 1000,
+    	    	    nextRandom(&seed) % 20);
+    	} else if (n < 90) {
+    	    sprintf(line, "mail user%lu@example.com or see "
+    	    	    "http://host%lu.example.org/path?q=%lu\n",
+    	    	    nextRandom(&seed) % 1000, nextRandom(&seed) % 100,
+    	    	    nextRandom(&seed) % 10000);
+    	} else {
+    	    n = (int)(nextRandom(&seed) % 40) + 10;
+    	    memset(line, 'a', n);
+    	    strcpy(line + n, nextRandom(&seed) % 2 ? "c\n" : "b\n");
+    	}
+    	strcpy(c->text + len, line);
+    	len += strlen(line);
+    }
+    c->len = len;
+    return c;
+}
+
+static corpus *readCorpus(const char *filename)
+{
+    corpus *c = (corpus *)malloc(sizeof(corpus));
+    const char *base = strrchr(filename, '/');
+
+    c->name = base ? base + 1 : filename;
+    if ((c->text = readFile(filename, &c->len)) == NULL) {
+    	free(c);
+    	return NULL;
+    }
+    return c;
+}
+
+static char *readFile(const char *filename, long *length)
+{
+    FILE *fp = fopen(filename, "rb");
+    char *text;
+
+    if (fp == NULL) {
+    	perror(filename);
+    	return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    *length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    text = (char *)malloc(*length + 1);
+    *length = (long)fread(text, 1, *length, fp);
+    text[*length] = '\0';
+    fclose(fp);
+
+    /* ExecRE stops at a NUL, as does the editor (see NUL substitution) */
+    *length = (long)strlen(text);
+    return text;
+}
+
+/*
+** Extract the start, end and error expressions of every pattern in the
+** DefaultPatternSets table of highlightData.c.  Sub-patterns with the "C"
+** flag hold substitutions rather than expressions and are skipped.
+*/
+static int readHighlightPatterns(const char *filename, benchPattern **patterns)
+{
+    char *source, *s, *sets, *out, *set, *next, *line, *name, *field;
+    long length;
+    int nPatterns = 0, maxPatterns = 256, i;
+
+    if ((source = readFile(filename, &length)) == NULL)
+    	return 0;
+    if ((s = strstr(source, "DefaultPatternSets[] = {")) == NULL) {
+    	fprintf(stderr, "%s: no DefaultPatternSets\n", filename);
+    	free(source);
+    	return 0;
+    }
+    s = strchr(s, '{') + 1;
+
+    /* Un-escape the C string literals, separating the array elements */
+    sets = out = (char *)malloc(length + 1);
+    while (*s != '\0' && *s != '}') {
+    	if (*s == ',') {
+    	    *out++ = '\0';
+	    s++;
+	} else if (*s == '"') {
+	    for (s++; *s != '"' && *s != '\0'; s++) {
+	    	if (*s != '\\') {
+	    	    *out++ = *s;
+		    continue;
+		}
+		switch (*++s) {
+		    case '\n': break;
+		    case 'n': *out++ = '\n'; break;
+		    case 't': *out++ = '\t'; break;
+		    default: *out++ = *s;
+		}
+	    }
+	    if (*s == '"')
+	    	s++;
+	} else {
+	    s++;
+	}
+    }
+    *out++ = '\0';
+    *out = '\0';
+
+    *patterns = (benchPattern *)malloc(sizeof(benchPattern) * maxPatterns);
+    for (set = sets; *set != '\0'; set = next) {
+    	char *setName = set, *end = strchr(set, '{');
+    	next = set + strlen(set) + 1;
+
+	if (end == NULL)
+	    continue;
+	*strchr(set, ':') = '\0';
+
+	for (line = end + 1; *line != '\0' && *line != '}'; ) {
+	    char *re[3] = {NULL, NULL, NULL};
+	    char *flags;
+
+	    line += strspn(line, " \t\n");
+	    if ((field = strchr(line, ':')) == NULL)
+	    	break;
+	    *field++ = '\0';
+	    name = line;
+
+	    /* Start, end and error expressions, with "" for a quote */
+	    for (i = 0; i < 3; i++) {
+	    	field += strspn(field, " \t");
+	    	if (*field == '"') {
+	    	    char *in = ++field;
+		    re[i] = out = field;
+		    while (*in != '\0' && (*in != '"' || in[1] == '"')) {
+		    	if (*in == '"')
+		    	    in++;
+		    	*out++ = *in++;
+		    }
+		    field = in + (*in == '"');
+		    *out = '\0';
+		}
+		field = strchr(field, ':') + 1;
+	    }
+
+	    /* Skip style and parent, then read the flags */
+	    field = strchr(field, ':') + 1;
+	    field = strchr(field, ':') + 1;
+	    flags = field;
+	    line = field + strcspn(field, "\n}");
+	    if (*line == '\n')
+	    	*line++ = '\0';
+	    else {
+	    	*line = '\0';
+	    	line = (char *)"}";
+	    }
+	    if (strchr(flags, 'C') != NULL)
+	    	continue;
+
+	    for (i = 0; i < 3; i++) {
+	    	if (re[i] == NULL || *re[i] == '\0')
+	    	    continue;
+	    	if (nPatterns == maxPatterns) {
+	    	    maxPatterns *= 2;
+	    	    *patterns = (benchPattern *)realloc(*patterns,
+	    	    	    sizeof(benchPattern) * maxPatterns);
+		}
+		out = (char *)malloc(strlen(setName) + strlen(name) + 8);
+		sprintf(out, "%s/%s%s", setName, name,
+			i == 0 ? "" : (i == 1 ? "/end" : "/err"));
+		(*patterns)[nPatterns].name = out;
+		(*patterns)[nPatterns].re = re[i];
+		(*patterns)[nPatterns].flags = REDFLT_STANDARD;
+		nPatterns++;
+	    }
+	}
+    }
+    free(source);
+    return nPatterns;
+}
+
+/*
+** Golden file key for an expression: the flags followed by the expression,
+** with backslashes, newlines and tabs escaped to keep it on one line.
+*/
+static char *escapeRE(const char *re, int flags)
+{
+    char *escaped = (char *)malloc(2 * strlen(re) + 8), *out = escaped;
+
+    out += sprintf(out, "%d ", flags);
+    for (; *re != '\0'; re++) {
+    	if (*re == '\\' || *re == '\n' || *re == '\t') {
+    	    *out++ = '\\';
+    	    *out++ = *re == '\n' ? 'n' : (*re == '\t' ? 't' : '\\');
+	} else {
+	    *out++ = *re;
+	}
+    }
+    *out = '\0';
+    return escaped;
+}
+
+static double nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long nextRandom(unsigned long *seed)
+{
+    *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+    return *seed >> 8;
+}
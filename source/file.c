@@ -42,6 +42,7 @@
 #include "server.h"
 #include "interpret.h"
 #include "editorconfig.h"
+#include "fileWatch.h"
 #include "../util/misc.h"
 #include "../util/DialogF.h"
 #include "../util/fileUtils.h"
@@ -50,6 +51,8 @@
 #include "../util/utils.h"
 #include "../util/nedit_malloc.h"
 #include "../util/libxattr.h"
+#include "../util/unicode.h"
+#include "../util/filehash.h"
 
 #include <errno.h>
 #include <limits.h>
@@ -60,9 +63,14 @@
 #include <ctype.h>
 #include <iconv.h>
 #include <locale.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <poll.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #ifndef __MVS__
 #include <sys/param.h>
 #endif
@@ -74,6 +82,8 @@
 #include <Xm/RowColumn.h>
 #include <Xm/Form.h>
 #include <Xm/Label.h>
+#include <Xm/Scale.h>
+#include <Xm/PushB.h>
 
 #ifdef HAVE_DEBUG_H
 #include "../debug.h"
@@ -271,23 +281,108 @@ static Locale locales[] = {
    system which is slow to process stat requests (which I'm not sure exists) */
 #define MOD_CHECK_INTERVAL 3000
 
+/* Reading or writing a file that takes longer than FILE_JOB_DELAY
+   milliseconds gets a progress dialog, updated every FILE_JOB_UPDATE ms */
+#define FILE_JOB_DELAY 300
+#define FILE_JOB_UPDATE 100
+
+/* Work done by runFileJob on a separate thread */
+typedef void (*FileJobProc)(void *data, FileProgress *progress);
+
+/* State of a file being read or written, while the main thread waits */
+typedef struct {
+    FileJobProc proc;
+    void *data;
+    FileProgress progress;
+    int pipeFDs[2];		/* the thread writes a byte when it is done */
+    int finished;
+    Widget dialog, scale;
+    XtIntervalId timerID;
+} fileJob;
+
+/* The backup file is written again once the changes recorded in the delta
+   file since it was written grow larger than it, and BACKUP_DELTA_MIN */
+#define BACKUP_DELTA_MIN 1048576
+
+/* First line of a backup delta file, followed by the size of the backup file
+   it applies to, and the changes in the format of the undo journal */
+#define BACKUP_DELTA_HEADER "XNEdit backup delta 1\n"
+
+/* A backup file being written on a separate thread, from a copy of the text */
+typedef struct backupJob {
+    WindowInfo *window;		/* NULL when no longer wanted */
+    char *text;
+    int length;
+    char nullSubsChar;
+    char name[MAXPATHLEN];
+    char tmpName[MAXPATHLEN];
+    long deltaOffset;		/* end of the delta file at the copy */
+    int err;
+    pthread_t thread;
+    int pipeFDs[2];
+    XtInputId inputID;
+} backupJob;
+
 static int doSave(WindowInfo *window, Boolean setEncAttr);
 static void safeClose(WindowInfo *window);
 static int doOpen(WindowInfo *window, const char *name, const char *path,
      const char *encoding, const char *filter_name, int flags);
 static void backupFileName(WindowInfo *window, char *name, size_t len);
+static void deltaFileName(WindowInfo *window, char *name, size_t len);
+static int startBackupFile(WindowInfo *window);
+static int openBackupDelta(WindowInfo *window, const char *name, long size);
+static int copyBackupDelta(FILE *from, long offset, FILE *to);
+static void *backupJobThread(void *arg);
+static void backupJobReadProc(XtPointer clientData, int *source,
+        XtInputId *id);
+static void writeBackupJob(backupJob *job);
+static void finishBackupJob(backupJob *job);
+static void recoverBackupDelta(WindowInfo *window);
+static void backupError(WindowInfo *window);
+static void writeChange(FILE *fp, textBuffer *buf, int pos, int nInserted,
+        int nDeleted, const char *deletedText);
+static int replayChanges(FILE *fp, textBuffer *buf, long *end,
+        int *nReplayed);
+static void journalFileName(WindowInfo *window, char *name, size_t len);
+static int writeJournalHeader(WindowInfo *window);
+static void updateJournalHeader(WindowInfo *window);
+static void recoverUndoJournal(WindowInfo *window);
+static void undoJournalError(WindowInfo *window);
+static FILE *openSaveTmpFile(const char *fullname, char *target,
+        char *tmpName);
 static int writeBckVersion(WindowInfo *window);
 static int bckError(WindowInfo *window, const char *errString, const char *file);
 static int fileWasModifiedExternally(WindowInfo *window);
+static int readFollowedFile(WindowInfo *window);
+static char *convertFollowedText(WindowInfo *window, const char *data,
+        size_t length, size_t *used, size_t *textLength);
+static int incompleteUtf8(const char *str, size_t len);
+static void getPanesAtEnd(WindowInfo *window, int *atEnd);
+static void keepPanesAtEnd(WindowInfo *window, const int *atEnd);
 static const char *errorString(void);
 static void addWrapNewlines(WindowInfo *window);
+static int fileContentsChanged(WindowInfo *window, const char *fileName);
 static int cmpWinAgainstFile(WindowInfo *window, const char *fileName);
 static int min(int i1, int i2);
 static void modifiedWindowDestroyedCB(Widget w, XtPointer clientData,
     XtPointer callData);
 static void forceShowLineNumbers(WindowInfo *window);
+static void runFileJob(WindowInfo *window, const char *action,
+        FileJobProc proc, void *data);
+static void *fileJobThread(void *arg);
+static void fileJobReadProc(XtPointer clientData, int *source, XtInputId *id);
+static void fileJobTimerProc(XtPointer clientData, XtIntervalId *id);
+static void fileJobCancelCB(Widget w, XtPointer clientData,
+        XtPointer callData);
+static void createFileJobDialog(WindowInfo *window, fileJob *job,
+        const char *action);
+static void loadFileProc(void *data, FileProgress *progress);
+static void saveFileProc(void *data, FileProgress *progress);
 
 static char* getEncodingAttribute(const char *path);
+static int isUtf8Encoding(const char *encoding);
+static int isAsciiCompatible(const char *encoding);
+static float elapsedMs(struct timespec *start);
 
 
 WindowInfo *EditNewFile(WindowInfo *inWindow, char *geometry, int iconic,
@@ -566,6 +661,12 @@ void RevertToSaved(WindowInfo *window, char *newEncoding)
         return;
     }
     
+    /* Nothing can be done while the file is still being read or written */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return;
+    }
+    
     /* save insert & scroll positions of all of the panes to restore later */
     for (i=0; i<=window->nPanes; i++) {
     	text = i==0 ? window->textArea : window->textPanes[i-1];
@@ -587,6 +688,7 @@ void RevertToSaved(WindowInfo *window, char *newEncoding)
     
     
     RemoveBackupFile(window);
+    RemoveUndoJournal(window);
     ClearUndoList(window);
     openFlags |= IS_USER_LOCKED(window->lockReasons) && !IS_ENCODING_LOCKED(window->lockReasons) ? PREF_READ_ONLY : 0;
     if (!doOpen(window, name, path, encoding, window->filter, openFlags)) {
@@ -671,6 +773,45 @@ size_t copyBytes(
 
 #define IO_BUFSIZE 2048
 
+/* Arguments and result of loadFileProc */
+typedef struct {
+    Widget shell;
+    const char *path;
+    const char *encoding;
+    const char *filter;
+    FileContent *content;
+    int hash;			/* hash the file as it is read */
+    int result;
+} loadJobData;
+
+/* The text to be saved is read from the text buffer in chunks of this size */
+#define SAVE_CHUNK 65536
+
+/* Arguments and results of saveFileProc */
+typedef struct {
+    FileStream *stream;
+    iconv_t ic;
+    ConvertFunc strconv;
+    const char *text1;		/* the text, before and after the gap of the */
+    size_t length1;		/* text buffer (see BufGetSegments) */
+    const char *text2;
+    size_t length2;
+    char nullSubsChar;
+    int fileFormat;
+    EncError *encErrors;
+    size_t numEncErrors;
+    int skipped;
+    int nonreversible;
+    int unerr;
+    int err;			/* errno of a failed write */
+    int cancelled;
+} saveJobData;
+
+static void writeSaveText(saveJobData *save, FileProgress *progress);
+static int textSegmentsIovec(saveJobData *save, size_t pos, size_t length,
+        struct iovec *iov);
+static int textSegmentsAreUtf8(saveJobData *save, int *isAscii);
+
 static int doOpen(WindowInfo *window, const char *name, const char *path,
      const char *encoding, const char *filter_name, int flags)
 {
@@ -713,9 +854,21 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
     memcpy(fullname, path, path_len);
     memcpy(fullname+path_len, name, name_len+1);
     
+    /* Read the file on a separate thread, a slow file system or filter
+       shouldn't hold up the other windows */
     FileContent content;
-    if(GetFileContent(window->shell, fullname, encoding, filter_name, &content)) {
-        if(content.err == ENOENT && flags & CREATE) {
+    loadJobData load;
+    load.shell = window->shell;
+    load.path = fullname;
+    load.encoding = encoding;
+    load.filter = filter_name;
+    load.content = &content;
+    load.hash = GetPrefWarnRealFileMods();
+    runFileJob(window, "Opening", loadFileProc, &load);
+    if(load.result) {
+        if(content.cancelled) {
+            return FALSE;
+        } else if(content.err == ENOENT && flags & CREATE) {
             /* Give option to create (or to exit if this is the only window) */
             if (!(flags & SUPPRESS_CREATE_WARN)) {
                 /* on Solaris 2.6, and possibly other OSes, dialog won't 
@@ -756,6 +909,7 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
                 SET_USER_LOCKED(window->lockReasons, TRUE);
             }
 	    UpdateWindowReadOnly(window);
+	    WatchFile(window);
 	    return TRUE;
         } else if(content.isdir) {
             window->filenameSet = FALSE; /* Temp. prevent check for changes. */
@@ -835,6 +989,10 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
     window->device = content.statbuf.st_dev;
     window->inode = content.statbuf.st_ino;
     window->fileMissing = FALSE;
+    window->fileHashed = content.hashed;
+    window->fileHash = content.hash;
+    window->fileHashSize = content.hashSize;
+    window->followSize = content.fileSize;
     
     /* Disable continuous wrapping if the file is too big */
     if(content.length > DISABLE_WRAPPING_THRESHOLD) {
@@ -842,22 +1000,17 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
         window->wrapModeNoneForced = True;
     }
     
-    /* Display the file contents in the text widget */
-    window->ignoreModify = True;
-    BufSetAll(window->buffer, content.content);
-    window->ignoreModify = False;
-    
-    /* Check that the length that the buffer thinks it has is the same
-       as what we gave it.  If not, there were probably nuls in the file.
-       Substitute them with another character.  If that is impossible, warn
-       the user, make the file read-only, and force a substitution */
-    if (window->buffer->length != content.length) {
+    /* If there were nuls in the file, substitute them with another
+       character.  If that is impossible, warn the user, make the file
+       read-only, and force a substitution */
+    if (content.hasNuls) {
         if (!BufSubstituteNullChars(content.content, content.length, window->buffer)) {
             resp = DialogF(DF_ERR, window->shell, 2, "Error while opening File",
                     "Too much binary data in file.  You may view\n"
                     "it, but not modify or re-save its contents.", "View",
                     "Cancel");
             if (resp == 2) {
+                NEditFree(content.content);
                 return FALSE;
             }
 
@@ -869,13 +1022,18 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
             }
             window->buffer->nullSubsChar = (char) 0xfe;
         }
-        window->ignoreModify = True;
-        BufSetAll(window->buffer, content.content);
-        window->ignoreModify = False;
     }
-
-    /* Release the memory that holds fileString */
-    NEditFree(content.content);
+    
+    /* Display the file contents in the text widget.  The text buffer takes
+       over the memory holding them, instead of making a copy */
+    struct timespec phaseStart;
+    clock_gettime(CLOCK_MONOTONIC, &phaseStart);
+    window->ignoreModify = True;
+    BufAdoptAll(window->buffer, content.content, content.length,
+            content.alloc);
+    window->ignoreModify = False;
+    content.phaseTime[LOAD_BUFFER] = elapsedMs(&phaseStart);
+    memcpy(window->loadTime, content.phaseTime, sizeof(window->loadTime));
 
     /* Set window title and file changed flag */
     if ((flags & PREF_READ_ONLY) != 0) {
@@ -897,14 +1055,24 @@ static int doOpen(WindowInfo *window, const char *name, const char *path,
     if(show_infobar) {
         ShowEncodingInfoBar(window, TRUE);
     }
+    
+    /* Report changes made to the file by other programs from now on */
+    WatchFile(window);
+    
+    /* Bring back changes lost in a crash, and start recording new ones */
+    recoverUndoJournal(window);
+    recoverBackupDelta(window);
       
     return TRUE;
 }   
 
-int GetFileContent(Widget shell, const char *path, const char *encoding, const char *filter_name, FileContent *content)
+int GetFileContent(Widget shell, const char *path, const char *encoding, const char *filter_name, FileProgress *progress, int hash, FileContent *content)
 {
     memset(content, 0, sizeof(FileContent));
     
+    struct timespec phaseStart;
+    clock_gettime(CLOCK_MONOTONIC, &phaseStart);
+    
     off_t fileLen, readLen;
     char *fileString;
     char buf[IO_BUFSIZE];
@@ -975,6 +1143,9 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
 #endif
     
     fileLen = content->statbuf.st_size;
+    if(progress) {
+        progress->total = fileLen;
+    }
     
     // create stream object (optionally with filter)
     IOFilter* filter = GetFilterFromName(filter_name);
@@ -982,7 +1153,16 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
     if(filter && filter->cmdin && strlen(filter->cmdin) > 0) {
         filter_cmd = filter->cmdin;
     }
-    stream = filestream_open_r(shell, fp, filter_cmd);
+    stream = filestream_open_r(shell, fp, path, filter_cmd);
+    
+    /* Note what is on the disk, from the bytes read, so that a new
+       modification time can later be told from a real change by hashing
+       the file again.  (Not what a filter made of it.) */
+    HashState *fileHash = NULL;
+    if(hash && !filter_cmd) {
+        fileHash = HashStart();
+        filestream_hash(stream, fileHash);
+    }
     
     // check if the file has the 'charset' exnteded attribute
     if(!encoding) {
@@ -1091,25 +1271,32 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
         filestream_reset(stream, 0);
     }
     
-    /* Allocate space for the whole contents of the file (unfortunately) */
-    size_t strAlloc = fileLen;
+    /* Allocate space for the whole contents of the file.  This memory is
+       taken over by the text buffer, the space left over becomes its gap */
+    size_t strAlloc = fileLen + IO_BUFSIZE;
     fileString = malloc(strAlloc + 1); /* +1 = space for null */
     if (fileString == NULL) {
         filestream_close(stream);
+        HashEnd(fileHash, NULL, NULL);
         content->allocerror = 1;
         return 1;
     }
     
+    /* UTF-8 text needs no conversion, it is only checked after reading */
     iconv_t ic = NULL;
     ConvertFunc strconv = copyBytes;
+    int utf8 = encoding && isUtf8Encoding(encoding);
     if(encoding) {
-        ic = iconv_open("UTF-8", encoding);
-        if(ic == (iconv_t) -1) {
-            filestream_close(stream);
-            free(fileString);
-            return 1;
+        if(!utf8) {
+            ic = iconv_open("UTF-8", encoding);
+            if(ic == (iconv_t) -1) {
+                filestream_close(stream);
+                HashEnd(fileHash, NULL, NULL);
+                free(fileString);
+                return 1;
+            }
+            strconv = (ConvertFunc)iconv;
         }
-        strconv = (ConvertFunc)iconv;
         
         /* set final encoding */
         size_t len = strlen(encoding);
@@ -1131,7 +1318,45 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
     readLen = 0;
     char *outStr = fileString;
     size_t prev = 0;
-    while((r = filestream_read(buf+prev, IO_BUFSIZE-prev, stream)) > 0 && !err) {
+    size_t valid = 0;
+    
+    content->phaseTime[LOAD_DETECT] = elapsedMs(&phaseStart);
+    
+    /* Without a conversion, read straight into the destination.  UTF-8 is
+       checked as it comes in, while a filter still produces the rest. */
+    while(!ic && (r = filestream_read(outStr, strAlloc - readLen, stream)) > 0) {
+        readLen += r;
+        outStr += r;
+        if(utf8) {
+            valid += Utf8Validate(fileString + valid, readLen - valid, NULL);
+        }
+        if(readLen == strAlloc) {
+            /* the file grew, or comes from a filter */
+            strAlloc += strAlloc/2 + IO_BUFSIZE;
+            char *newString = realloc(fileString, strAlloc + 1);
+            if(!newString) {
+                err = 1;
+                content->allocerror = 1;
+                break;
+            }
+            fileString = newString;
+            outStr = fileString + readLen;
+        }
+        
+        if(progress) {
+            progress->done = readLen;
+            if(progress->cancelled) {
+                err = 1;
+                content->cancelled = 1;
+                break;
+            }
+        }
+    }
+    
+    /* (reading and converting are done together, the time counts as
+       conversion) */
+    content->phaseTime[LOAD_READ] = elapsedMs(&phaseStart);
+    while(ic && (r = filestream_read(buf+prev, IO_BUFSIZE-prev, stream)) > 0 && !err) {
         char *str = buf;
         size_t inleft = prev + r;
         size_t outleft = strAlloc - readLen;   
@@ -1201,13 +1426,15 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
                     // either strconv needs more space, or
                     // the unicode replacement character couldn't be stored
                     // -> extend buffer
-                    strAlloc += 512;
+                    strAlloc += strAlloc/2 + 512;
                     size_t outpos = outStr - fileString;
-                    fileString = realloc(fileString, strAlloc + 1);
-                    if(!fileString) {
+                    char *newString = realloc(fileString, strAlloc + 1);
+                    if(!newString) {
                         err = 1;
+                        content->allocerror = 1;
                         break;
                     }
+                    fileString = newString;
                     outStr = fileString + outpos;
                     outleft = strAlloc - readLen;
                 }
@@ -1217,6 +1444,30 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
                 }
             }
         }
+        
+        if(progress) {
+            progress->done += r;
+            if(progress->cancelled) {
+                err = 1;
+                content->cancelled = 1;
+            }
+        }
+    }
+    
+    /* Note where the text read ends in the file, for following it.  What
+       is appended later is read from there on. */
+    content->fileSize = stream->pid == 0 ?
+            ftello(stream->file) - (off_t)prev : -1;
+    
+    /* the hash is of the whole file only if all of it was read */
+    if(fileHash) {
+        uint64_t h;
+        off_t hashSize;
+        if(HashEnd(fileHash, &h, &hashSize) == 0 && !err) {
+            content->hashed = 1;
+            content->hash = h;
+            content->hashSize = hashSize;
+        }
     }
     
     if (filestream_close(stream) != 0) {
@@ -1228,27 +1479,76 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
     if(ic) {
         iconv_close(ic);
     }
-       
-    content->hasBOM = hasBOM;
-    content->skipped = skipped;
     
-    /* Detect and convert DOS and Macintosh format files */
-    if (GetPrefForceOSConversion()) {
-        content->fileFormat = FormatOfFile(fileString);
-        int rLen = readLen;
-        if (content->fileFormat == DOS_FILE_FORMAT) {
-            ConvertFromDosFileString(fileString, &rLen, NULL);
-        } else if (content->fileFormat == MAC_FILE_FORMAT) {
-            ConvertFromMacFileString(fileString, rLen);
+    /* Replace what isn't valid in UTF-8 text, like iconv does, each invalid
+       byte by a (3 byte) replacement character */
+    if(utf8 && !err) {
+        valid += Utf8Validate(fileString + valid, readLen - valid, NULL);
+    } else {
+        valid = readLen;
+    }
+    if(valid < readLen) {
+        size_t nInvalid = 0, pos = valid;
+        while(pos < readLen) {
+            nInvalid++;
+            pos++;
+            pos += Utf8Validate(fileString + pos, readLen - pos, NULL);
+        }
+        
+        strAlloc = readLen + 2*nInvalid + IO_BUFSIZE;
+        char *newString = malloc(strAlloc + 1);
+        if(!newString) {
+            err = 1;
+            content->allocerror = 1;
+        } else {
+            memcpy(newString, fileString, valid);
+            outStr = newString + valid;
+            pos = valid;
+            while(pos < readLen) {
+                // add the invalid byte to the error list
+                if(numEncErrors >= allocEncErrors) {
+                    allocEncErrors += 16;
+                    encErrors = NEditRealloc(encErrors, allocEncErrors * sizeof(EncError));
+                }
+                encErrors[numEncErrors].c = (unsigned char)fileString[pos];
+                encErrors[numEncErrors].pos = outStr - newString;
+                numEncErrors++;
+                skipped++;
+                
+                memcpy(outStr, "\xEF\xBF\xBD", 3);
+                outStr += 3;
+                pos++;
+                
+                size_t v = Utf8Validate(fileString + pos, readLen - pos, NULL);
+                memcpy(outStr, fileString + pos, v);
+                outStr += v;
+                pos += v;
+            }
+            free(fileString);
+            fileString = newString;
+            readLen = outStr - newString;
+            fileString[readLen] = 0;
         }
-        readLen = rLen;
     }
+    content->phaseTime[LOAD_CONVERT] = elapsedMs(&phaseStart);
+       
+    content->hasBOM = hasBOM;
+    content->skipped = skipped;
     
     if(err) {
         free(fileString);
         free(encErrors);
     } else {
+        /* Detect and convert DOS and Macintosh format files */
+        if (GetPrefForceOSConversion()) {
+            content->fileFormat = FormatOfFile(fileString);
+        }
+        readLen = ConvertFromFileFormat(fileString, readLen,
+                content->fileFormat, &content->hasNuls);
+        content->phaseTime[LOAD_LINE_ENDINGS] = elapsedMs(&phaseStart);
+        
         content->content = fileString;
+        content->alloc = strAlloc + 1;
         content->length = readLen;
         content->enc_errors = encErrors;
         content->num_enc_errors = numEncErrors;
@@ -1257,13 +1557,453 @@ int GetFileContent(Widget shell, const char *path, const char *encoding, const c
     return err;
 }
         
+/*
+** Check if the name of a character set is one of the names of UTF-8
+*/
+static int isUtf8Encoding(const char *encoding)
+{
+    return !strcasecmp(encoding, "UTF-8") || !strcasecmp(encoding, "UTF8");
+}
+
+/*
+** Check if text consisting only of ASCII characters is the same in the
+** character set "encoding" as in UTF-8
+*/
+static int isAsciiCompatible(const char *encoding)
+{
+    static const char *prefixes[] = {"UTF-8", "UTF8", "ISO-8859", "ISO8859",
+            "ISO_8859", "CP125", "WINDOWS-125", "KOI8", "ASCII", "US-ASCII",
+            "ANSI_X3.4", "EUC-", "EUC", "GB2312", "GBK", "GB18030", "BIG5",
+            NULL};
+    int i;
+    
+    for (i=0; prefixes[i]; i++) {
+        if (!strncasecmp(encoding, prefixes[i], strlen(prefixes[i])))
+            return True;
+    }
+    return False;
+}
+
+/*
+** Return the milliseconds passed since "start", and set "start" to the
+** current time
+*/
+static float elapsedMs(struct timespec *start)
+{
+    struct timespec now;
+    float ms;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (now.tv_sec - start->tv_sec) * 1000.0f +
+            (now.tv_nsec - start->tv_nsec) / 1000000.0f;
+    *start = now;
+    return ms;
+}
+
+/*
+** Call "proc" with "data" on a separate thread, and return when it is done.
+** In the common case, that is right away.  Otherwise, the document is locked
+** while X events continue to be processed, so that other documents can be
+** used in the meantime, and a dialog shows the progress, with a button for
+** setting progress->cancelled.  "action" ("Opening", "Saving") is the title
+** of the dialog.
+*/
+static void runFileJob(WindowInfo *window, const char *action,
+        FileJobProc proc, void *data)
+{
+    XtAppContext context = XtWidgetToApplicationContext(window->shell);
+    fileJob job;
+    pthread_t thread;
+    struct pollfd pfd;
+    XtInputId inputID;
+    
+    memset(&job, 0, sizeof(job));
+    job.proc = proc;
+    job.data = data;
+    
+    /* If no thread can be started, do the work right here */
+    if (pipe(job.pipeFDs) != 0) {
+        proc(data, &job.progress);
+        return;
+    }
+    if (pthread_create(&thread, NULL, fileJobThread, &job) != 0) {
+        close(job.pipeFDs[0]);
+        close(job.pipeFDs[1]);
+        proc(data, &job.progress);
+        return;
+    }
+    
+    pfd.fd = job.pipeFDs[0];
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, FILE_JOB_DELAY) <= 0) {
+        SET_FILE_BUSY_LOCKED(window->lockReasons, TRUE);
+        UpdateWindowReadOnly(window);
+        createFileJobDialog(window, &job, action);
+        inputID = XtAppAddInput(context, job.pipeFDs[0],
+                (XtPointer)XtInputReadMask, fileJobReadProc, &job);
+        job.timerID = XtAppAddTimeOut(context, FILE_JOB_UPDATE,
+                fileJobTimerProc, &job);
+        
+        while (!job.finished)
+            XtAppProcessEvent(context, XtIMAll);
+        
+        XtRemoveInput(inputID);
+        XtRemoveTimeOut(job.timerID);
+        XtDestroyWidget(XtParent(job.dialog));
+        SET_FILE_BUSY_LOCKED(window->lockReasons, FALSE);
+        UpdateWindowReadOnly(window);
+    }
+    
+    pthread_join(thread, NULL);
+    close(job.pipeFDs[0]);
+    close(job.pipeFDs[1]);
+}
+
+static void *fileJobThread(void *arg)
+{
+    fileJob *job = (fileJob *)arg;
+    
+    job->proc(job->data, &job->progress);
+    while (write(job->pipeFDs[1], "", 1) < 0 && errno == EINTR)
+        ;
+    return NULL;
+}
+
+/*
+** Called on the main thread when the thread of a file job is done
+*/
+static void fileJobReadProc(XtPointer clientData, int *source, XtInputId *id)
+{
+    fileJob *job = (fileJob *)clientData;
+    char byte;
+    
+    if (read(job->pipeFDs[0], &byte, 1) == 1)
+        job->finished = True;
+}
+
+static void fileJobTimerProc(XtPointer clientData, XtIntervalId *id)
+{
+    fileJob *job = (fileJob *)clientData;
+    size_t done = job->progress.done, total = job->progress.total;
+    
+    if (total > 0)
+        XmScaleSetValue(job->scale, done >= total ? 100 :
+                (int)(100.0 * done / total));
+    job->timerID = XtAppAddTimeOut(XtWidgetToApplicationContext(job->scale),
+            FILE_JOB_UPDATE, fileJobTimerProc, job);
+}
+
+static void fileJobCancelCB(Widget w, XtPointer clientData,
+        XtPointer callData)
+{
+    fileJob *job = (fileJob *)clientData;
+    
+    job->progress.cancelled = True;
+}
+
+static void createFileJobDialog(WindowInfo *window, fileJob *job,
+        const char *action)
+{
+    Widget form, label, cancelBtn;
+    XmString s1;
+    Arg args[4];
+    int ac;
+    char title[MAXPATHLEN + 16];
+    
+    snprintf(title, sizeof(title), "%s %s", action, window->filename);
+    ac = 0;
+    XtSetArg(args[ac], XmNautoUnmanage, False); ac++;
+    XtSetArg(args[ac], XmNtitle, title); ac++;
+    form = CreateFormDialog(window->shell, "fileProgress", args, ac);
+    XtVaSetValues(form, XmNmarginWidth, 6, XmNmarginHeight, 6, NULL);
+    
+    label = XtVaCreateManagedWidget("label", xmLabelWidgetClass, form,
+            XmNlabelString, s1=XmStringCreateSimple(title),
+            XmNalignment, XmALIGNMENT_BEGINNING,
+            XmNtopAttachment, XmATTACH_FORM,
+            XmNleftAttachment, XmATTACH_FORM,
+            XmNrightAttachment, XmATTACH_FORM, NULL);
+    XmStringFree(s1);
+    
+    job->scale = XtVaCreateManagedWidget("progress", xmScaleWidgetClass, form,
+            XmNorientation, XmHORIZONTAL,
+            XmNminimum, 0,
+            XmNmaximum, 100,
+            XmNvalue, 0,
+            XmNshowValue, True,
+            XmNeditable, False,
+            XmNslidingMode, XmTHERMOMETER,
+            XmNscaleWidth, 300,
+            XmNtopAttachment, XmATTACH_WIDGET,
+            XmNtopWidget, label,
+            XmNleftAttachment, XmATTACH_FORM,
+            XmNrightAttachment, XmATTACH_FORM, NULL);
+    
+    cancelBtn = XtVaCreateManagedWidget("cancel", xmPushButtonWidgetClass,
+            form,
+            XmNlabelString, s1=XmStringCreateSimple("Cancel"),
+            XmNtopAttachment, XmATTACH_WIDGET,
+            XmNtopWidget, job->scale,
+            XmNtopOffset, 6,
+            XmNleftAttachment, XmATTACH_POSITION,
+            XmNleftPosition, 35,
+            XmNrightAttachment, XmATTACH_POSITION,
+            XmNrightPosition, 65,
+            XmNbottomAttachment, XmATTACH_FORM, NULL);
+    XmStringFree(s1);
+    XtAddCallback(cancelBtn, XmNactivateCallback, fileJobCancelCB, job);
+    XtVaSetValues(form, XmNcancelButton, cancelBtn, NULL);
+    AddMotifCloseCallback(XtParent(form), (XtCallbackProc)fileJobCancelCB,
+            job);
+    
+    job->dialog = form;
+    ManageDialogCenteredOnPointer(form);
+}
+
+static void loadFileProc(void *data, FileProgress *progress)
+{
+    loadJobData *load = (loadJobData *)data;
+    
+    load->result = GetFileContent(load->shell, load->path, load->encoding,
+            load->filter, progress, load->hash, load->content);
+}
+
+/*
+** Write the text to be saved (writeSaveText), and make sure it reached the
+** disk before the file replaces the old one
+*/
+static void saveFileProc(void *data, FileProgress *progress)
+{
+    saveJobData *save = (saveJobData *)data;
+    
+    writeSaveText(save, progress);
+    if(!save->err && !save->cancelled && save->stream->pid == 0 &&
+            (fflush(save->stream->file) != 0 ||
+             fsync(fileno(save->stream->file)) != 0)) {
+        save->err = errno;
+    }
+}
+
+/*
+** Convert the text to be saved to its encoding and line endings and write
+** it.  The text is read from the text buffer in chunks of SAVE_CHUNK
+** characters, without a copy of all of it.  If it needs no conversion at
+** all, it is written straight from the buffer.
+*/
+static void writeSaveText(saveJobData *save, FileProgress *progress)
+{
+    size_t total = save->length1 + save->length2;
+    size_t pos = 0;
+    
+    save->encErrors = NEditCalloc(ENC_ERROR_LIST_LEN, sizeof(EncError));
+    progress->total = total;
+    
+    if(!save->ic && save->fileFormat == UNIX_FILE_FORMAT &&
+            save->nullSubsChar == '\0') {
+        while(pos < total) {
+            struct iovec iov[2];
+            size_t len = total - pos;
+            size_t w;
+            if(len > SAVE_CHUNK * 16) {
+                len = SAVE_CHUNK * 16;
+            }
+            w = filestream_writev(iov, textSegmentsIovec(save, pos, len, iov),
+                    save->stream);
+            if(w == 0) {
+                save->err = errno;
+                return;
+            }
+            pos += w;
+            
+            progress->done = pos;
+            if(progress->cancelled) {
+                save->cancelled = 1;
+                return;
+            }
+        }
+        return;
+    }
+    
+    char conv[2*SAVE_CHUNK + 8]; /* (line endings can double the length, and
+                                    an incomplete character is carried over
+                                    to the next chunk) */
+    char buf[IO_BUFSIZE];
+    size_t carry = 0;
+    size_t convPos = 0; /* position of conv in the converted text */
+    size_t allocEncErrors = ENC_ERROR_LIST_LEN;
+    char subsChar = save->nullSubsChar;
+    
+    while(pos < total) {
+        size_t n = total - pos > SAVE_CHUNK ? SAVE_CHUNK : total - pos;
+        struct iovec iov[2];
+        int nSegs = textSegmentsIovec(save, pos, n, iov);
+        pos += n;
+        
+        /* put back substituted nul characters, and convert line endings,
+           reading straight from the text buffer */
+        size_t len = carry;
+        for(int i=0;i<nSegs;i++) {
+            len += ConvertToFileFormat(iov[i].iov_base, iov[i].iov_len,
+                    save->fileFormat, subsChar, conv + len);
+        }
+        
+        char *in = conv;
+        size_t inleft = len;
+        while(!save->ic && inleft > 0) {
+            size_t w = filestream_write(in, inleft, save->stream);
+            if(w == 0) {
+                save->err = errno;
+                return;
+            }
+            in += w;
+            inleft -= w;
+        }
+        
+        while(save->ic && inleft > 0) {
+            char *out = buf;
+            size_t outleft = IO_BUFSIZE;
+            size_t rc = save->strconv(save->ic, &in, &inleft, &out, &outleft);
+            
+            if(outleft < IO_BUFSIZE) {
+                filestream_write(buf, IO_BUFSIZE - outleft, save->stream);
+            }
+            
+            if(rc != (size_t)-1) {
+                /* add # of nonreversible conversions */
+                save->nonreversible += rc;
+                continue;
+            }
+            
+            size_t skip;
+            switch (errno) {
+            case EINVAL:
+                if(pos < total) {
+                    /* the character continues in the next chunk */
+                    goto nextChunk;
+                }
+                /* fall through */
+            case EILSEQ:
+                /* An invalid multibyte sequence is encountered in the input */
+                skip = Utf8CharLen((const unsigned char*)in);
+                if(skip > inleft) {
+                    skip = inleft;
+                }
+                
+                // add unconvertible character to the error list
+                if(save->numEncErrors >= allocEncErrors) {
+                    allocEncErrors += 16;
+                    save->encErrors = NEditRealloc(save->encErrors, allocEncErrors * sizeof(EncError));
+                }
+                memcpy(save->encErrors[save->numEncErrors].str, in, skip);
+                if(skip < 4) {
+                    save->encErrors[save->numEncErrors].str[skip] = 0;
+                }
+                save->encErrors[save->numEncErrors].pos = convPos + (in - conv);
+                save->numEncErrors++;
+                
+                ++save->skipped;
+                in += skip;
+                inleft -= skip;
+                break;
+            case E2BIG:
+                /* Conversion succeeded but output buffer is full */
+                break;
+            default:
+                /* Unknown error encountered, give up on this chunk */
+                ++save->unerr;
+                inleft = 0;
+            }
+        }
+nextChunk:
+        memmove(conv, in, inleft);
+        carry = inleft;
+        convPos += in - conv;
+        
+        progress->done = pos;
+        if(progress->cancelled) {
+            save->cancelled = 1;
+            return;
+        }
+    }
+    
+    if(save->ic) {
+        /* be sure to flush out any partially converted input */
+        char *out = buf;
+        size_t outleft = IO_BUFSIZE;
+        save->strconv(save->ic, NULL, NULL, &out, &outleft);
+        if(outleft < IO_BUFSIZE) {
+            filestream_write(buf, IO_BUFSIZE - outleft, save->stream);
+        }
+    }
+}
+
+/*
+** Fill "iov" with the parts of the text buffer holding "length" characters
+** of the text to be saved, starting at "pos", and return their number
+*/
+static int textSegmentsIovec(saveJobData *save, size_t pos, size_t length,
+        struct iovec *iov)
+{
+    int n = 0;
+    
+    if(pos < save->length1) {
+        iov[n].iov_base = (char *)save->text1 + pos;
+        iov[n].iov_len = save->length1 - pos < length ?
+                save->length1 - pos : length;
+        pos += iov[n].iov_len;
+        length -= iov[n].iov_len;
+        n++;
+    }
+    if(length > 0) {
+        iov[n].iov_base = (char *)save->text2 + (pos - save->length1);
+        iov[n].iov_len = length;
+        n++;
+    }
+    return n;
+}
+
+/*
+** Check if the text to be saved is valid UTF-8, also if the gap of the text
+** buffer splits a character.  "isAscii" is set if it is pure ASCII.
+*/
+static int textSegmentsAreUtf8(saveJobData *save, int *isAscii)
+{
+    int ascii1, ascii2, asciiSplit = 1;
+    size_t valid1 = Utf8Validate(save->text1, save->length1, &ascii1);
+    size_t skip = 0;
+    
+    if(valid1 < save->length1) {
+        /* the character at the end of text1 must be completed by text2 */
+        char split[8];
+        size_t tail = save->length1 - valid1;
+        size_t n2 = save->length2 < 3 ? save->length2 : 3;
+        if(tail > 3) {
+            return FALSE;
+        }
+        memcpy(split, save->text1 + valid1, tail);
+        memcpy(split + tail, save->text2, n2);
+        if(Utf8Validate(split, tail + n2, &asciiSplit) == 0) {
+            return FALSE;
+        }
+        skip = Utf8CharLen((const unsigned char*)split) - tail;
+        asciiSplit = 0;
+    }
+    
+    if(Utf8Validate(save->text2 + skip, save->length2 - skip, &ascii2) !=
+            save->length2 - skip) {
+        return FALSE;
+    }
+    *isAscii = ascii1 && ascii2 && asciiSplit;
+    return TRUE;
+}
+
 int IncludeFile(WindowInfo *window, const char *name, const char *encoding, const char *filter_name)
 {
     int err = 0;
     
     /* Open the file */
     FileContent content;
-    if(GetFileContent(window->shell, name, encoding, filter_name, &content)) {
+    if(GetFileContent(window->shell, name, encoding, filter_name, NULL, 0, &content)) {
         int filenameSet = window->filenameSet;
         if(content.isdir) {
             window->filenameSet = FALSE; /* Temp. prevent check for changes. */
@@ -1311,7 +2051,8 @@ int IncludeFile(WindowInfo *window, const char *name, const char *encoding, cons
      
     if(!err) {
         /* If the file contained ascii nulls, re-map them */
-        if (!BufSubstituteNullChars(content.content, content.length, window->buffer))
+        if (content.hasNuls &&
+                !BufSubstituteNullChars(content.content, content.length, window->buffer))
         {
             DialogF(DF_ERR, window->shell, 1, "Error opening File",
                     "Too much binary data in file", "OK");
@@ -1367,6 +2108,13 @@ int CloseFileAndWindow(WindowInfo *window, int preResponse)
 { 
     int response, stat;
     
+    /* The document can't go away while its file is read or written, the
+       user can cancel that first */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return FALSE;
+    }
+    
     /* Make sure that the window is not in iconified state */
     if (window->fileChanged)
     	RaiseDocumentWindow(window);
@@ -1423,7 +2171,15 @@ int SaveWindow(WindowInfo *window)
 {
     int stat;
     
+    /* A file still being read or written can't be saved yet (the busy lock
+       would otherwise pass for a read-only file below) */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return FALSE;
+    }
+    
     /* Try to ensure our information is up-to-date */
+    ReadFileWatchEvents();
     CheckForChangesToFile(window);
     
     /* Return success if the file is normal & unchanged or is a
@@ -1473,6 +2229,12 @@ int SaveWindowAs(WindowInfo *window, FileSelection *file)
     WindowInfo *otherWindow;
     char fullname[MAXPATHLEN];
     
+    /* Wait for a save in progress to finish */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return FALSE;
+    }
+    
     /* Get the new name for the file */
     FileSelection newFile;
     if (!file) {
@@ -1570,6 +2332,7 @@ int SaveWindowAs(WindowInfo *window, FileSelection *file)
 
     /* Change the name of the file and save it under the new name */
     RemoveBackupFile(window);
+    RemoveUndoJournal(window);
     strcpy(window->filename, filename);
     strcpy(window->path, pathname);
     window->fileMode = 0;
@@ -1630,11 +2393,10 @@ static int getBOM(char *encoding, char **bom)
 
 static int doSave(WindowInfo *window, Boolean setEncAttr)
 {
-    char *fileString = NULL;
-    char fullname[MAXPATHLEN];
+    char fullname[MAXPATHLEN], target[MAXPATHLEN], tmpName[MAXPATHLEN];
     struct stat statbuf;
     FILE *fp;
-    int fileLen, result;
+    int result, closeErr, inPlace = FALSE;
     
     iconv_t ic = NULL;
     ConvertFunc strconv = copyBytes;
@@ -1686,8 +2448,15 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
         window->filenameSet = filenameSet;
     }
     
-    /* open the file */
-    fp = fopen(fullname, "wb");
+    /* The text is written to a new file next to the old one, which replaces
+       it only once all of it was written.  A failed or cancelled save leaves
+       the old file as it was.  Only if no such file can be made, the file is
+       overwritten in place. */
+    fp = openSaveTmpFile(fullname, target, tmpName);
+    if (fp == NULL) {
+        inPlace = TRUE;
+        fp = fopen(fullname, "wb");
+    }
     if (fp == NULL)
     {
         result = DialogF(DF_WARN, window->shell, 2, "Error saving File",
@@ -1702,26 +2471,31 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
         return FALSE;
     }
     
-    /* get the text buffer contents and its length */
-    fileString = BufGetAll(window->buffer);
-    fileLen = window->buffer->length;
-    
-    /* If null characters are substituted for, put them back */
-    BufUnsubstituteNullChars(fileString, window->buffer);
+    /* The text is written from the text buffer, which must stay in place
+       until then.  Null characters substituted for are put back, and line
+       endings converted, along the way (see saveFileProc) */
+    saveJobData save;
+    int textLength1, textLength2;
+    memset(&save, 0, sizeof(save));
+    BufFreeze(window->buffer);
+    BufGetSegments(window->buffer, &save.text1, &textLength1, &save.text2,
+            &textLength2);
+    save.length1 = textLength1;
+    save.length2 = textLength2;
+    save.nullSubsChar = window->buffer->nullSubsChar;
+    save.fileFormat = window->fileFormat;
     
-    /* If the file is to be saved in DOS or Macintosh format, reconvert */
-    if (window->fileFormat == DOS_FILE_FORMAT)
-    {
-        if (!ConvertToDosFileString(&fileString, &fileLen))
-        {
-            DialogF(DF_ERR, window->shell, 1, "Out of Memory",
-                    "Out of memory!  Try\nsaving in Unix format", "OK");
-            fclose(fp);
-            return FALSE;
+    /* Valid UTF-8 text needs no conversion to UTF-8, and neither does pure
+       ASCII text to a character set containing ASCII */
+    if(ic) {
+        int ascii;
+        if(textSegmentsAreUtf8(&save, &ascii) &&
+                (isUtf8Encoding(window->encoding) ||
+                (ascii && isAsciiCompatible(window->encoding)))) {
+            iconv_close(ic);
+            ic = NULL;
+            strconv = copyBytes;
         }
-    } else if (window->fileFormat == MAC_FILE_FORMAT)
-    { 
-        ConvertToMacFileString(fileString, fileLen);
     }
 
     /* write to the file */
@@ -1732,90 +2506,41 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
     }
     FileStream *stream = filestream_open_w(window->shell, fp, filter_cmd);
     
+    /* Note what is written to the disk, as doOpen does, from the bytes
+       written.  (A filter writes the file itself.) */
+    HashState *fileHash = NULL;
+    if(!filter_cmd && GetPrefWarnRealFileMods()) {
+        fileHash = HashStart();
+        filestream_hash(stream, fileHash);
+    }
+    
     /* write bom if requsted */
     if(window->bom) {
         char *bom;
         int bomLen = getBOM(window->encoding, &bom);
         if(bomLen > 0) {
             if(filestream_write(bom, bomLen, stream) != bomLen) {
-                fileLen = 0;
+                save.length1 = save.length2 = 0;
             }
         }
     }
     
-    EncError *encErrors = NEditCalloc(ENC_ERROR_LIST_LEN, sizeof(EncError));
-    size_t numEncErrors = 0;
-    size_t allocEncErrors = ENC_ERROR_LIST_LEN;
-    
-    /* convert text if required and write it to the file */
-    int skipped = 0;
-    int nonreversible = 0;
-    int unerr = 0;
-    char buf[IO_BUFSIZE];
-    char *in = fileString;
-    size_t inleft = fileLen;
-    while(in) {
-        char *out = buf;
-        size_t outleft = IO_BUFSIZE;
-        size_t w = outleft;
-        if (inleft == 0) {
-            /* be sure to flush out any partially converted input */
-            in = NULL;
-        }
-        size_t rc = strconv(ic, &in, &inleft, &out, &outleft);
-        w -= outleft;
-        
-        if(w > 0) {
-            filestream_write(buf, w, stream);
-        }
-        
-        if(rc == (size_t)-1) {
-            size_t skip;
-            switch (errno) {
-            case EILSEQ:
-            case EINVAL:
-                /* An invalid multibyte sequence is encountered in the input */
-                skip = Utf8CharLen((const unsigned char*)in);
-                
-                // add unconvertible character to the error list
-                if(numEncErrors >= allocEncErrors) {
-                    allocEncErrors += 16;
-                    encErrors = NEditRealloc(encErrors, allocEncErrors * sizeof(EncError));
-                }
-                memcpy(encErrors[numEncErrors].str, in, skip);
-                if(skip < 4) {
-                    encErrors[numEncErrors].str[skip] = 0;
-                }
-                encErrors[numEncErrors].pos = in - fileString;
-                numEncErrors++;
-                
-                
-                ++skipped;
-                in += skip;
-                if(inleft >= skip) {
-                    inleft -= skip;
-                } else {
-                    inleft = 0;
-                }
-                break;
-            case E2BIG:
-                /* Conversion succeeded but output buffer is full */
-                break;
-            default:
-            	/* Unknown error encountered */
-            	++unerr;
-            }
-        }
-
-        if (inleft == 0) {
-        	/* add # of nonreversible conversions */
-        	nonreversible += rc;
-        }
-    }
+    /* convert text if required and write it to the file, on a separate
+       thread like reading it (see doOpen) */
+    save.stream = stream;
+    save.ic = ic;
+    save.strconv = strconv;
+    runFileJob(window, "Saving", saveFileProc, &save);
+    BufThaw(window->buffer);
+    EncError *encErrors = save.encErrors;
+    size_t numEncErrors = save.numEncErrors;
+    int skipped = save.skipped;
+    int nonreversible = save.nonreversible;
+    int unerr = save.unerr;
 
     unsigned int eresp = 0;
     int show_infobar = FALSE;
-    if (skipped > 0 || nonreversible > 0 || unerr > 0) {
+    if (!save.cancelled && (skipped > 0 || nonreversible > 0 || unerr > 0)) {
     	/*
         eresp = DialogF(DF_WARN, window->shell, 2, "Encoding warning",
                 "%d non-convertible characters skipped\n"
@@ -1837,16 +2562,53 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
         iconv_close(ic);
     }
     
-    if (ferror(fp))
+    if (ferror(fp) || save.err)
     {
+        if (save.err)
+            errno = save.err;
         DialogF(DF_ERR, window->shell, 1, "Error saving File",
                 "%s not saved:\n%s", "OK", window->filename, errorString());
     }
 
-    if (ferror(fp) || eresp == 2) {
+    /* A failed or cancelled save leaves no partial file behind.  (Written
+       in place, the old contents are gone anyway, and the part written is
+       kept.) */
+    if (ferror(fp) || save.err || eresp == 2 || save.cancelled) {
         filestream_close(stream);
-        remove(fullname);
-        NEditFree(fileString);
+        HashEnd(fileHash, NULL, NULL);
+        if (!inPlace)
+            remove(tmpName);
+        return FALSE;
+    }
+    
+    /* close the file, once an output filter finished writing it, and put it
+       in the place of the old one */
+    closeErr = filestream_close(stream);
+    if (closeErr == FILESTREAM_FILTER_FAILED)
+    {
+        DialogF(DF_ERR, window->shell, 1, "Error saving File",
+                "%s not saved:\nThe filter command reported a failed exit "
+                "status", "OK", window->filename);
+        HashEnd(fileHash, NULL, NULL);
+        if (!inPlace)
+            remove(tmpName);
+        return FALSE;
+    }
+    if (closeErr != 0)
+    {
+        DialogF(DF_ERR, window->shell, 1, "Error closing File",
+                "Error closing file:\n%s", "OK", errorString());
+        HashEnd(fileHash, NULL, NULL);
+        if (!inPlace)
+            remove(tmpName);
+        return FALSE;
+    }
+    if (!inPlace && rename(tmpName, target) != 0)
+    {
+        DialogF(DF_ERR, window->shell, 1, "Error saving File",
+                "%s not saved:\n%s", "OK", window->filename, errorString());
+        HashEnd(fileHash, NULL, NULL);
+        remove(tmpName);
         return FALSE;
     }
     
@@ -1887,18 +2649,6 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
             free(fileAttr);
         }
     }
-    
-    /* close the file */
-    if (filestream_close(stream) != 0)
-    {
-        DialogF(DF_ERR, window->shell, 1, "Error closing File",
-                "Error closing file:\n%s", "OK", errorString());
-        NEditFree(fileString);
-        return FALSE;
-    }
-
-    /* free the text buffer copy returned from XmTextGetString */
-    NEditFree(fileString);
 
     /* success, file was written */
     SetWindowModified(window, FALSE);
@@ -1909,6 +2659,7 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
         window->fileMissing = FALSE;
         window->device = statbuf.st_dev;
         window->inode = statbuf.st_ino;
+        window->followSize = filter_cmd ? -1 : statbuf.st_size;
     } else {
         /* This needs to produce an error message -- the file can't be 
             accessed! */
@@ -1918,6 +2669,14 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
         window->inode = 0;
     }
     
+    /* the hash of what was written (see above) */
+    window->fileHashed = HashEnd(fileHash, &window->fileHash,
+            &window->fileHashSize) == 0 && !window->fileMissing;
+    
+    /* the journal now starts from the saved file */
+    StartUndoJournal(window);
+    WatchFile(window);
+    
     // show infobar, if needed
     ShowEncodingInfoBar(window, show_infobar);
 
@@ -1925,75 +2684,135 @@ static int doSave(WindowInfo *window, Boolean setEncAttr)
 }
 
 /*
-** Create a backup file for the current window.  The name for the backup file
-** is generated using the name and path stored in the window and adding a
-** tilde (~) on UNIX and underscore (_) on VMS to the beginning of the name.  
+** Make a new file to save "fullname" to, in the same directory as the file
+** it replaces, and return it open for writing.  "target" is set to the file
+** to replace (the file a symbolic link points to), and "tmpName" to the name
+** of the new file.  The new file gets the permissions, owner and extended
+** attributes (like the charset, ACLs or security label) of the old one.
+** Returns NULL if no new file can be made, or the old file shouldn't be
+** replaced by another, because it has more than one (hard) link, or
+** attributes that can't be copied.
 */
-int WriteBackupFile(WindowInfo *window)
+static FILE *openSaveTmpFile(const char *fullname, char *target,
+        char *tmpName)
 {
-    char *fileString = NULL;
-    char name[MAXPATHLEN];
+    char name[MAXPATHLEN], path[MAXPATHLEN];
+    struct stat statbuf;
+    mode_t mask;
     FILE *fp;
-    int fd, fileLen;
+    int fd, exists;
     
-    /* Generate a name for the autoSave file */
-    backupFileName(window, name, sizeof(name));
-
-    /* remove the old backup file.
-       Well, this might fail - we'll notice later however. */
-    remove(name);
+    if (realpath(fullname, target) == NULL) {
+        if (errno != ENOENT)
+            return NULL;
+        strcpy(target, fullname);       /* a new file */
+    }
+    if (ParseFilename(target, name, path) != 0)
+        return NULL;
+    if (snprintf(tmpName, MAXPATHLEN, "%s.%s.XXXXXX", path, name) >=
+            MAXPATHLEN)
+        return NULL;
     
-    /* open the file, set more restrictive permissions (using default
-        permissions was somewhat of a security hole, because permissions were
-        independent of those of the original file being edited */
-    if ((fd = open(name, O_CREAT|O_EXCL|O_WRONLY, S_IRUSR | S_IWUSR)) < 0
-            || (fp = fdopen(fd, "w")) == NULL)
-    {
-        DialogF(DF_WARN, window->shell, 1, "Error writing Backup",
-                "Unable to save backup for %s:\n%s\n"
-                "Automatic backup is now off", "OK", window->filename,
-                errorString());
-        window->autoSave = FALSE;
-        SetToggleButtonState(window, window->autoSaveItem, FALSE, FALSE);
-        return FALSE;
+    exists = stat(target, &statbuf) == 0;
+    if (exists) {
+        if (statbuf.st_nlink > 1 || !S_ISREG(statbuf.st_mode))
+            return NULL;
+    } else {
+        /* a new file gets the permissions fopen() would give it */
+        mask = umask(0);
+        umask(mask);
+        statbuf.st_mode = 0666 & ~mask;
+        statbuf.st_uid = (uid_t)-1;
+        statbuf.st_gid = (gid_t)-1;
     }
-
-    /* get the text buffer contents and its length */
-    fileString = BufGetAll(window->buffer);
-    fileLen = window->buffer->length;
     
-    /* If null characters are substituted for, put them back */
-    BufUnsubstituteNullChars(fileString, window->buffer);
+    if ((fd = mkstemp(tmpName)) < 0)
+        return NULL;
+    if (fchown(fd, statbuf.st_uid, statbuf.st_gid) != 0)
+        (void)fchown(fd, (uid_t)-1, statbuf.st_gid);
+    if (fchmod(fd, statbuf.st_mode & 07777) != 0 ||
+            (exists && xattr_copy(target, tmpName) != 0) ||
+            (fp = fdopen(fd, "wb")) == NULL) {
+        close(fd);
+        remove(tmpName);
+        return NULL;
+    }
+    return fp;
+}
+
+/*
+** Bring the backup file for the current window up to date.  The name for the
+** backup file is generated using the name and path stored in the window and
+** adding a tilde (~) to the beginning of the name.
+**
+** The backup file holds the whole text only as it was when it was written,
+** which happens on a separate thread.  Changes made since then are added to
+** a delta file next to it (see WriteBackupDelta), so that most of the time
+** only what was changed has to be written out.  Once the delta file grows
+** larger than the backup file, the backup file is written again.
+*/
+int WriteBackupFile(WindowInfo *window)
+{
+    long deltaSize;
     
-    /* add a terminating newline if the file doesn't already have one */
-    if (fileLen != 0 && fileString[fileLen-1] != '\n')
-    	fileString[fileLen++] = '\n'; 	 /* null terminator no longer needed */
+    if (window->backupDelta == NULL)
+        return startBackupFile(window);
     
-    /* write out the file */
-    fwrite(fileString, sizeof(char), fileLen, fp);
-    if (ferror(fp))
-    {
-        DialogF(DF_ERR, window->shell, 1, "Error saving Backup",
-                "Error while saving backup for %s:\n%s\n"
-                "Automatic backup is now off", "OK", window->filename,
-                errorString());
-        fclose(fp);
-        remove(name);
-        NEditFree(fileString);
-        window->autoSave = FALSE;
+    /* Get the changes recorded since the backup file was written out */
+    if (fflush(window->backupDelta) != 0 || ferror(window->backupDelta)) {
+        backupError(window);
         return FALSE;
     }
     
-    /* close the backup file */
-    if (fclose(fp) != 0) {
-	NEditFree(fileString);
-	return FALSE;
-    }
+    /* Replace the backup file, unless that is happening already */
+    deltaSize = ftell(window->backupDelta);
+    if (window->backupJob == NULL && deltaSize > BACKUP_DELTA_MIN &&
+            deltaSize > window->backupSize)
+        return startBackupFile(window);
+    return TRUE;
+}
 
-    /* Free the text buffer copy returned from XmTextGetString */
-    NEditFree(fileString);
+/*
+** Add a change of the text (as passed to SaveUndoInformation) to the delta
+** file of the window's backup.  It reaches the disk with WriteBackupFile.
+*/
+void WriteBackupDelta(WindowInfo *window, int pos, int nInserted,
+	int nDeleted, const char *deletedText)
+{
+    writeChange(window->backupDelta, window->buffer, pos, nInserted,
+            nDeleted, deletedText);
+}
 
-    return TRUE;
+/*
+** Stop recording changes for the backup of this window, leaving the backup
+** and delta files as they are.  A backup file still being written is
+** abandoned.
+*/
+void EndBackupDelta(WindowInfo *window)
+{
+    if (window->backupJob != NULL) {
+        window->backupJob->window = NULL;
+        window->backupJob = NULL;
+    }
+    if (window->backupDelta != NULL) {
+        fclose(window->backupDelta);
+        window->backupDelta = NULL;
+    }
+}
+
+/*
+** Hand the backup delta file and backup job of window "from" over to
+** window "to", when the document moves to a different window
+*/
+void MoveBackupDelta(WindowInfo *from, WindowInfo *to)
+{
+    to->backupDelta = from->backupDelta;
+    to->backupSize = from->backupSize;
+    to->backupJob = from->backupJob;
+    if (to->backupJob != NULL)
+        to->backupJob->window = to;
+    from->backupDelta = NULL;
+    from->backupJob = NULL;
 }
 
 /*
@@ -2003,12 +2822,226 @@ void RemoveBackupFile(WindowInfo *window)
 {
     char name[MAXPATHLEN];
     
+    EndBackupDelta(window);
+    
     /* Don't delete backup files when backups aren't activated. */
     if (window->autoSave == FALSE)
         return;
       
     backupFileName(window, name, sizeof(name));
     remove(name);
+    deltaFileName(window, name, sizeof(name));
+    remove(name);
+}
+
+/*
+** Start writing the whole text to the backup file, on a separate thread.
+** The first time, this also starts the delta file, for changes from now on.
+*/
+static int startBackupFile(WindowInfo *window)
+{
+    backupJob *job = (backupJob *)NEditMalloc(sizeof(backupJob));
+    char name[MAXPATHLEN];
+    
+    job->window = window;
+    job->text = BufGetAll(window->buffer);
+    job->length = window->buffer->length;
+    job->nullSubsChar = window->buffer->nullSubsChar;
+    job->err = 0;
+    backupFileName(window, job->name, sizeof(job->name));
+    snprintf(job->tmpName, sizeof(job->tmpName), "%s.new", job->name);
+    
+    if (window->backupDelta == NULL) {
+        /* remove the old backup file, so it isn't taken for this one */
+        remove(job->name);
+        deltaFileName(window, name, sizeof(name));
+        if (!openBackupDelta(window, name, job->length)) {
+            NEditFree(job->text);
+            NEditFree(job);
+            backupError(window);
+            return FALSE;
+        }
+    }
+    job->deltaOffset = ftell(window->backupDelta);
+    window->backupJob = job;
+    
+    /* If no thread can be started, write the file right here */
+    if (pipe(job->pipeFDs) != 0) {
+        writeBackupJob(job);
+        finishBackupJob(job);
+        return window->autoSave;
+    }
+    if (pthread_create(&job->thread, NULL, backupJobThread, job) != 0) {
+        close(job->pipeFDs[0]);
+        close(job->pipeFDs[1]);
+        writeBackupJob(job);
+        finishBackupJob(job);
+        return window->autoSave;
+    }
+    job->inputID = XtAppAddInput(XtWidgetToApplicationContext(window->shell),
+            job->pipeFDs[0], (XtPointer)XtInputReadMask, backupJobReadProc,
+            job);
+    return TRUE;
+}
+
+/*
+** Create the delta file "name" for a backup file of "size" bytes, and make
+** it the window's delta file.  Returns False on failure.
+*/
+static int openBackupDelta(WindowInfo *window, const char *name, long size)
+{
+    int fd;
+    
+    if ((fd = open(name, O_CREAT|O_TRUNC|O_RDWR, S_IRUSR|S_IWUSR)) < 0)
+        return False;
+    if ((window->backupDelta = fdopen(fd, "w+")) == NULL) {
+        close(fd);
+        return False;
+    }
+    window->backupSize = size;
+    fprintf(window->backupDelta, "%s%ld\n", BACKUP_DELTA_HEADER, size);
+    return !ferror(window->backupDelta);
+}
+
+/*
+** Append the changes recorded in delta file "from" after "offset" to "to".
+** Returns False on failure.
+*/
+static int copyBackupDelta(FILE *from, long offset, FILE *to)
+{
+    char buf[8192];
+    size_t n;
+    
+    if (fflush(from) != 0 || fseek(from, offset, SEEK_SET) != 0)
+        return False;
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+        fwrite(buf, 1, n, to);
+    return !ferror(from) && fflush(to) == 0;
+}
+
+static void *backupJobThread(void *arg)
+{
+    backupJob *job = (backupJob *)arg;
+    
+    writeBackupJob(job);
+    while (write(job->pipeFDs[1], "", 1) < 0 && errno == EINTR)
+        ;
+    return NULL;
+}
+
+/*
+** Called on the main thread when the thread of a backup job is done
+*/
+static void backupJobReadProc(XtPointer clientData, int *source,
+        XtInputId *id)
+{
+    backupJob *job = (backupJob *)clientData;
+    char byte;
+    
+    if (read(job->pipeFDs[0], &byte, 1) != 1)
+        return;
+    XtRemoveInput(job->inputID);
+    pthread_join(job->thread, NULL);
+    close(job->pipeFDs[0]);
+    close(job->pipeFDs[1]);
+    finishBackupJob(job);
+}
+
+/*
+** Write the copy of the text in a backup job to a temporary file, next to
+** the backup file.  Touches nothing but the job, so it can run on a
+** separate thread.
+*/
+static void writeBackupJob(backupJob *job)
+{
+    char *text = job->text;
+    ssize_t n;
+    int i, fd;
+    
+    /* If null characters are substituted for, put them back */
+    if (job->nullSubsChar != '\0') {
+        for (i = 0; i < job->length; i++)
+            if (text[i] == job->nullSubsChar)
+                text[i] = '\0';
+    }
+    
+    /* open the file, set more restrictive permissions (using default
+        permissions was somewhat of a security hole, because permissions were
+        independent of those of the original file being edited */
+    remove(job->tmpName);
+    if ((fd = open(job->tmpName, O_CREAT|O_EXCL|O_WRONLY,
+            S_IRUSR | S_IWUSR)) < 0) {
+        job->err = errno;
+    } else {
+        for (i = 0; i < job->length; i += n) {
+            if ((n = write(fd, text + i, job->length - i)) < 0) {
+                if (errno == EINTR) {
+                    n = 0;
+                    continue;
+                }
+                job->err = errno;
+                break;
+            }
+        }
+        if (close(fd) != 0 && job->err == 0)
+            job->err = errno;
+    }
+    NEditFree(job->text);
+    job->text = NULL;
+}
+
+/*
+** Put the file written by a backup job in place of the backup file, and
+** start a new delta file for it, with the changes that were made while the
+** file was being written.
+*/
+static void finishBackupJob(backupJob *job)
+{
+    WindowInfo *window = job->window;
+    char name[MAXPATHLEN], tmpName[MAXPATHLEN];
+    FILE *oldDelta;
+    
+    if (window == NULL) {
+        remove(job->tmpName);
+        NEditFree(job);
+        return;
+    }
+    window->backupJob = NULL;
+    
+    oldDelta = window->backupDelta;
+    window->backupDelta = NULL;
+    deltaFileName(window, name, sizeof(name));
+    snprintf(tmpName, sizeof(tmpName), "%s.new", name);
+    if (job->err != 0 || !openBackupDelta(window, tmpName, job->length) ||
+            !copyBackupDelta(oldDelta, job->deltaOffset,
+                    window->backupDelta) ||
+            rename(job->tmpName, job->name) != 0 ||
+            rename(tmpName, name) != 0) {
+        int err = job->err != 0 ? job->err : errno;
+        remove(job->tmpName);
+        remove(tmpName);
+        if (window->backupDelta != NULL)
+            fclose(window->backupDelta);
+        window->backupDelta = oldDelta;
+        errno = err;
+        backupError(window);
+    } else
+        fclose(oldDelta);
+    NEditFree(job);
+}
+
+/*
+** Report a failure to write the backup file, and turn off automatic backup
+*/
+static void backupError(WindowInfo *window)
+{
+    DialogF(DF_WARN, window->shell, 1, "Error writing Backup",
+            "Unable to save backup for %s:\n%s\n"
+            "Automatic backup is now off", "OK", window->filename,
+            errorString());
+    EndBackupDelta(window);
+    window->autoSave = FALSE;
+    SetToggleButtonState(window, window->autoSaveItem, FALSE, FALSE);
 }
 
 /*
@@ -2029,6 +3062,323 @@ static void backupFileName(WindowInfo *window, char *name, size_t len)
     }
 }
 
+/*
+** Generate the name of the delta file that goes with the backup file
+*/
+static void deltaFileName(WindowInfo *window, char *name, size_t len)
+{
+    char bckname[MAXPATHLEN];
+    
+    backupFileName(window, bckname, sizeof(bckname));
+    snprintf(name, len, "%s.delta", bckname);
+}
+
+/*
+** Called when a file was read into the window.  If it is a backup file and
+** its delta file is found next to it, offer to apply the changes recorded
+** there, to get the text as it was when it was last backed up.
+*/
+static void recoverBackupDelta(WindowInfo *window)
+{
+    char name[MAXPATHLEN], fullname[MAXPATHLEN], line[64];
+    struct stat statbuf;
+    long size, end;
+    int nReplayed = 0, mismatch;
+    FILE *fp;
+    
+    if (window->filename[0] != '~' || IS_ANY_LOCKED(window->lockReasons))
+        return;
+    
+    /* Look for a delta file for this very version of the backup file */
+    snprintf(fullname, sizeof(fullname), "%s%s", window->path,
+            window->filename);
+    snprintf(name, sizeof(name), "%s.delta", fullname);
+    if ((fp = fopen(name, "r")) == NULL)
+        return;
+    if (fgets(line, sizeof(line), fp) == NULL ||
+            strcmp(line, BACKUP_DELTA_HEADER) != 0 ||
+            fgets(line, sizeof(line), fp) == NULL ||
+            sscanf(line, "%ld", &size) != 1 ||
+            stat(fullname, &statbuf) != 0 || size != (long)statbuf.st_size ||
+            (end = ftell(fp)) < 0 || fgetc(fp) == EOF ||
+            DialogF(DF_QUES, window->shell, 2, "Backup Changes",
+                    "Later changes to this backup are recorded in\n"
+                    "%s.delta.  Apply them?", "Apply", "Don't Apply",
+                    window->filename) != 1) {
+        fclose(fp);
+        return;
+    }
+    fseek(fp, end, SEEK_SET);
+    mismatch = replayChanges(fp, window->buffer, &end, &nReplayed);
+    fclose(fp);
+    
+    if (mismatch)
+        DialogF(DF_WARN, window->shell, 1, "Backup Changes",
+                "Only the first %d changes to %s could be applied.", "OK",
+                nReplayed, window->filename);
+}
+
+/*
+** The undo journal of a document records every change made since the file was
+** last read or saved, so that after a crash they can be replayed on top of the
+** file when it is opened again.  Unlike the backup file, which holds the
+** whole text, the journal only grows by what was changed, and is synced to
+** the disk at the points where the backup file would be written.
+**
+** The journal starts with a line identifying it, and the size and
+** modification time of the file it applies to (in fields of a fixed width,
+** so that they can be updated in place).  Each change follows as a
+** line with the position and the number of deleted and inserted characters,
+** then the deleted and the inserted text.
+*/
+#define JOURNAL_HEADER "XNEdit undo journal 1\n"
+
+/*
+** Start a new undo journal for the current window, for changes from the
+** text as it was just read or saved.  Does nothing when journals are turned
+** off or the text can't be modified.
+*/
+void StartUndoJournal(WindowInfo *window)
+{
+    char name[MAXPATHLEN];
+    int fd;
+    
+    if (!GetPrefUndoJournal() || window->fileMissing ||
+            IS_ANY_LOCKED(window->lockReasons)) {
+        RemoveUndoJournal(window);
+        return;
+    }
+    
+    if (window->undoJournal == NULL) {
+        journalFileName(window, name, sizeof(name));
+        if ((fd = open(name, O_CREAT|O_TRUNC|O_WRONLY, S_IRUSR|S_IWUSR)) < 0
+                || (window->undoJournal = fdopen(fd, "w")) == NULL) {
+            if (fd >= 0)
+                close(fd);
+            undoJournalError(window);
+            return;
+        }
+    } else if (ftruncate(fileno(window->undoJournal), 0) != 0) {
+        undoJournalError(window);
+        return;
+    } else
+        rewind(window->undoJournal);
+    
+    if (!writeJournalHeader(window))
+        undoJournalError(window);
+}
+
+/*
+** Add a change of the text (as passed to SaveUndoInformation) to the undo
+** journal of the window.  It reaches the disk with SyncUndoJournal.
+*/
+void WriteUndoJournal(WindowInfo *window, int pos, int nInserted,
+	int nDeleted, const char *deletedText)
+{
+    writeChange(window->undoJournal, window->buffer, pos, nInserted,
+            nDeleted, deletedText);
+}
+
+/*
+** Add a change of the text in "buf" to an undo journal or backup delta file
+*/
+static void writeChange(FILE *fp, textBuffer *buf, int pos, int nInserted,
+        int nDeleted, const char *deletedText)
+{
+    char *insertedText = BufGetRange(buf, pos, pos + nInserted);
+    
+    fprintf(fp, "%d %d %d\n", pos, nDeleted, nInserted);
+    fwrite(deletedText, sizeof(char), nDeleted, fp);
+    fwrite(insertedText, sizeof(char), nInserted, fp);
+    NEditFree(insertedText);
+}
+
+/*
+** Make sure the changes added to the undo journal are on the disk
+*/
+void SyncUndoJournal(WindowInfo *window)
+{
+    if (window->undoJournal == NULL)
+        return;
+    if (fflush(window->undoJournal) != 0 ||
+            fsync(fileno(window->undoJournal)) != 0 ||
+            ferror(window->undoJournal))
+        undoJournalError(window);
+}
+
+/*
+** Close and remove the undo journal of the window, if it has one
+*/
+void RemoveUndoJournal(WindowInfo *window)
+{
+    char name[MAXPATHLEN];
+    
+    if (window->undoJournal == NULL)
+        return;
+    fclose(window->undoJournal);
+    window->undoJournal = NULL;
+    journalFileName(window, name, sizeof(name));
+    remove(name);
+}
+
+/*
+** Generate the name of the undo journal for this window, which goes next to
+** the backup file
+*/
+static void journalFileName(WindowInfo *window, char *name, size_t len)
+{
+    snprintf(name, len, "%s~%s.journal", window->path, window->filename);
+}
+
+/*
+** Write the first lines of the undo journal, identifying the file it
+** applies to.  Returns False on failure.
+*/
+static int writeJournalHeader(WindowInfo *window)
+{
+    char fullname[MAXPATHLEN];
+    struct stat statbuf;
+    
+    snprintf(fullname, sizeof(fullname), "%s%s", window->path,
+            window->filename);
+    if (stat(fullname, &statbuf) != 0)
+        return False;
+    fprintf(window->undoJournal, "%s%20ld %20ld\n", JOURNAL_HEADER,
+            (long)statbuf.st_size, (long)statbuf.st_mtime);
+    return fflush(window->undoJournal) == 0;
+}
+
+/*
+** Make the undo journal apply to the file as it is now, after what was
+** appended to a followed file was added to the text.  The changes recorded
+** come before the appended text, and apply to the grown file as well.
+*/
+static void updateJournalHeader(WindowInfo *window)
+{
+    long end;
+    
+    if (window->undoJournal == NULL)
+        return;
+    if ((end = ftell(window->undoJournal)) < 0 ||
+            fseek(window->undoJournal, 0, SEEK_SET) != 0 ||
+            !writeJournalHeader(window) ||
+            fseek(window->undoJournal, end, SEEK_SET) != 0)
+        undoJournalError(window);
+}
+
+/*
+** Called when a file was read into the window.  If an undo journal from a
+** session that didn't end normally is found for it, offer to replay the
+** changes it recorded, then go on recording changes in it.
+*/
+static void recoverUndoJournal(WindowInfo *window)
+{
+    char name[MAXPATHLEN], fullname[MAXPATHLEN], line[64];
+    struct stat statbuf;
+    textBuffer *buf = window->buffer;
+    long size, mtime, recoveredEnd;
+    int nRecovered = 0, mismatch;
+    FILE *fp;
+    
+    if (!GetPrefUndoJournal() || IS_ANY_LOCKED(window->lockReasons))
+        return;
+    
+    /* Look for a journal for this very version of the file, with changes */
+    journalFileName(window, name, sizeof(name));
+    snprintf(fullname, sizeof(fullname), "%s%s", window->path,
+            window->filename);
+    if ((fp = fopen(name, "r+")) == NULL) {
+        StartUndoJournal(window);
+        return;
+    }
+    if (fgets(line, sizeof(line), fp) == NULL ||
+            strcmp(line, JOURNAL_HEADER) != 0 ||
+            fgets(line, sizeof(line), fp) == NULL ||
+            sscanf(line, "%ld %ld", &size, &mtime) != 2 ||
+            stat(fullname, &statbuf) != 0 ||
+            size != (long)statbuf.st_size || mtime != (long)statbuf.st_mtime ||
+            (recoveredEnd = ftell(fp)) < 0 || fgetc(fp) == EOF ||
+            DialogF(DF_QUES, window->shell, 2, "Recover Changes",
+                    "Changes to %s were not saved in a session that\n"
+                    "did not end normally.  Recover them?", "Recover",
+                    "Discard", window->filename) != 1) {
+        fclose(fp);
+        StartUndoJournal(window);
+        return;
+    }
+    fseek(fp, recoveredEnd, SEEK_SET);
+    
+    mismatch = replayChanges(fp, buf, &recoveredEnd, &nRecovered);
+    
+    /* Continue the journal after the last change that was replayed */
+    if (fseek(fp, recoveredEnd, SEEK_SET) != 0 ||
+            ftruncate(fileno(fp), recoveredEnd) != 0) {
+        fclose(fp);
+        StartUndoJournal(window);
+    } else
+        window->undoJournal = fp;
+    
+    if (mismatch)
+        DialogF(DF_WARN, window->shell, 1, "Recover Changes",
+                "Only the first %d changes to %s could be recovered.", "OK",
+                nRecovered, window->filename);
+}
+
+/*
+** Apply the changes recorded in an undo journal or backup delta file, from
+** the current position of "fp" on, to "buf".  Stops at a change that was only
+** partly written when the session ended, or one that doesn't fit the text,
+** and returns True in the latter case.  "end" is set to the position after
+** the last change applied, which are counted in "nReplayed".
+*/
+static int replayChanges(FILE *fp, textBuffer *buf, long *end,
+        int *nReplayed)
+{
+    char line[64], *text, *current;
+    int pos, nDeleted, nInserted, mismatch = False;
+    
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%d %d %d", &pos, &nDeleted, &nInserted) != 3 ||
+                pos < 0 || nDeleted < 0 || nInserted < 0 ||
+                pos + nDeleted > buf->length) {
+            mismatch = !feof(fp);
+            break;
+        }
+        text = (char*)NEditMalloc(nDeleted + nInserted + 1);
+        if (fread(text, sizeof(char), nDeleted + nInserted, fp) !=
+                (size_t)(nDeleted + nInserted)) {
+            NEditFree(text);
+            break;
+        }
+        current = BufGetRange(buf, pos, pos + nDeleted);
+        if (memcmp(current, text, nDeleted) != 0) {
+            NEditFree(current);
+            NEditFree(text);
+            mismatch = True;
+            break;
+        }
+        text[nDeleted + nInserted] = '\0';
+        BufReplace(buf, pos, pos + nDeleted, text + nDeleted);
+        NEditFree(current);
+        NEditFree(text);
+        *end = ftell(fp);
+        (*nReplayed)++;
+    }
+    return mismatch;
+}
+
+/*
+** Report a failure to write the undo journal, and stop using it
+*/
+static void undoJournalError(WindowInfo *window)
+{
+    DialogF(DF_WARN, window->shell, 1, "Error writing Journal",
+            "Unable to record changes to %s:\n%s\n"
+            "The undo journal is now off", "OK", window->filename,
+            errorString());
+    RemoveUndoJournal(window);
+}
+
 /*
 ** If saveOldVersion is on, copies the existing version of the file to
 ** <filename>.bck in anticipation of a new version being saved.  Returns
@@ -2378,16 +3728,26 @@ void CheckForChangesToFile(WindowInfo *window)
     XWindowAttributes winAttr;
     Boolean windowIsDestroyed = False;
     
-    if(!window->filenameSet)
+    if(!window->filenameSet || IS_FILE_BUSY_LOCKED(window->lockReasons))
         return;
 
-    /* If last check was very recent, don't impact performance */
+    /* A watched file needs no checking until a change to it is reported.
+       Otherwise, if last check was very recent, don't impact performance */
     timestamp = XtLastTimestampProcessed(XtDisplay(window->shell));
-    if (window == lastCheckWindow &&
-            timestamp - lastCheckTime < MOD_CHECK_INTERVAL)
+    if (window->fileWatched) {
+        if (!window->fileEvent)
+            return;
+    } else {
+        if (window == lastCheckWindow &&
+                timestamp - lastCheckTime < MOD_CHECK_INTERVAL)
+            return;
+        lastCheckWindow = window;
+        lastCheckTime = timestamp;
+    }
+    
+    /* What is appended to a followed file is simply read in */
+    if (window->followFile && readFollowedFile(window))
         return;
-    lastCheckWindow = window;
-    lastCheckTime = timestamp;
 
     /* Update the status, but don't pop up a dialog if we're called
        from a place where the window might be iconic (e.g., from the
@@ -2410,6 +3770,11 @@ void CheckForChangesToFile(WindowInfo *window)
         if (winAttr.map_state != IsViewable)
             silent = 1;
     }
+    
+    /* The reported change is dealt with now, unless it has to wait until
+       the user can be told about it */
+    if (!silent)
+        window->fileEvent = FALSE;
 
     /* Get the file mode and modification time */
     strcpy(fullname, window->path);
@@ -2553,7 +3918,7 @@ void CheckForChangesToFile(WindowInfo *window)
         if (!GetPrefWarnFileMods())
             return;
         if (GetPrefWarnRealFileMods() &&
-	    !cmpWinAgainstFile(window, fullname)) {
+	    !fileContentsChanged(window, fullname)) {
 	    /* Contents hasn't changed. Update the modification time. */
 	    window->lastModTime = statbuf.st_mtime;
 	    return;
@@ -2596,12 +3961,279 @@ static int fileWasModifiedExternally(WindowInfo *window)
     if (window->lastModTime == statbuf.st_mtime)
 	return FALSE;
     if (GetPrefWarnRealFileMods() &&
-	!cmpWinAgainstFile(window, fullname)) {
+	!fileContentsChanged(window, fullname)) {
 	return FALSE;
     }
     return TRUE;
 }
 
+/*
+** Turn following the file of the window on or off.  A followed file is
+** expected to grow, like a log file, and what is appended to it is added to
+** the end of the text as it is written (like "tail -f"), instead of asking
+** to reload it.
+*/
+void SetFollowFile(WindowInfo *window, int state)
+{
+    IOFilter *filter = GetFilterFromName(window->filter);
+    int i, atEnd[MAX_PANES+1];
+    
+    if (state && !window->filenameSet) {
+        DialogF(DF_WARN, window->shell, 1, "Follow File",
+                "%s has never been saved, it has no file to follow",
+                "OK", window->filename);
+        state = False;
+    } else if (state && (window->followSize < 0 ||
+            (filter && filter->cmdin && *filter->cmdin))) {
+        DialogF(DF_WARN, window->shell, 1, "Follow File",
+                "%s is read through a filter,\n"
+                "it can't be followed", "OK", window->filename);
+        state = False;
+    }
+    
+    window->followFile = state;
+    if (IsTopDocument(window))
+        XmToggleButtonSetState(window->followFileItem, state, False);
+    if (!state)
+        return;
+    
+    /* Show the end, and add what was appended since the file was read */
+    for (i=0; i<=window->nPanes; i++)
+        atEnd[i] = True;
+    keepPanesAtEnd(window, atEnd);
+    if (!IS_FILE_BUSY_LOCKED(window->lockReasons))
+        readFollowedFile(window);
+}
+
+/*
+** Add what was appended to the followed file of the window since it was
+** last read to the end of the text, with a single insert, so that syntax
+** highlighting only has to go over the new text.  Panes showing the end of
+** the text keep showing it.  If the file was truncated, or replaced by a new
+** one (rotated), it is read again as a whole.
+**
+** Returns False if the file can no longer be followed, and has to be
+** checked like any other.
+*/
+static int readFollowedFile(WindowInfo *window)
+{
+    char fullname[MAXPATHLEN];
+    struct stat statbuf;
+    FILE *fp;
+    char *data, *text;
+    size_t length, used, textLength;
+    int hasNuls, atEnd[MAX_PANES+1];
+    
+    window->fileEvent = FALSE;
+    snprintf(fullname, sizeof(fullname), "%s%s", window->path,
+            window->filename);
+    
+    /* A rotated file may be gone for a moment, until the new one is made */
+    if (stat(fullname, &statbuf) != 0)
+        return True;
+    
+    if (statbuf.st_dev != window->device || statbuf.st_ino != window->inode ||
+            statbuf.st_size < window->followSize) {
+        /* Don't throw away changes to the text for the new file */
+        if (window->fileChanged) {
+            SetFollowFile(window, False);
+            return False;
+        }
+        getPanesAtEnd(window, atEnd);
+        RevertToSaved(window, NULL);
+        if (IsValidWindow(window))
+            keepPanesAtEnd(window, atEnd);
+        return True;
+    }
+    
+    /* Nothing was appended.  If the file was modified anyway, it was
+       rewritten, check it like any other file. */
+    if (statbuf.st_size == window->followSize)
+        return statbuf.st_mtime == window->lastModTime;
+    
+    /* Read the new part.  Anything appended after the stat() is read with
+       the next change. */
+    length = statbuf.st_size - window->followSize;
+    if ((fp = fopen(fullname, "rb")) == NULL)
+        return True;
+    data = malloc(length);
+    if (data == NULL || fseeko(fp, window->followSize, SEEK_SET) != 0 ||
+            (length = fread(data, 1, length, fp)) == 0) {
+        free(data);
+        fclose(fp);
+        return True;
+    }
+    fclose(fp);
+    
+    /* The \n of a DOS line ending may not have been written yet */
+    if (window->fileFormat == DOS_FILE_FORMAT && data[length-1] == '\r' &&
+            (window->encoding[0] == '\0' ||
+             isAsciiCompatible(window->encoding)))
+        length--;
+    
+    text = convertFollowedText(window, data, length, &used, &textLength);
+    free(data);
+    if (text == NULL) {
+        SetFollowFile(window, False);
+        return False;
+    }
+    textLength = ConvertFromFileFormat(text, textLength, window->fileFormat,
+            &hasNuls);
+    if (hasNuls && !BufSubstituteNullChars(text, textLength, window->buffer)) {
+        free(text);
+        SetFollowFile(window, False);
+        return False;
+    }
+    window->followSize += used;
+    window->lastModTime = statbuf.st_mtime;
+    window->fileHashed = FALSE;
+    
+    /* The text now matches more of the file, it isn't a change to undo
+       or to mark the window modified for.  The undo journal now applies to
+       the grown file. */
+    if (textLength > 0) {
+        int pos = window->buffer->length;
+        getPanesAtEnd(window, atEnd);
+        window->ignoreModify = True;
+        BufInsert(window->buffer, pos, text);
+        window->ignoreModify = False;
+        if (window->backupDelta != NULL)
+            WriteBackupDelta(window, pos, textLength, 0, "");
+        keepPanesAtEnd(window, atEnd);
+        forceShowLineNumbers(window);
+        UpdateStatsLine(window);
+    }
+    updateJournalHeader(window);
+    free(text);
+    return True;
+}
+
+/*
+** Convert "length" bytes appended to the followed file of the window from
+** the encoding of the file, and return the text (without converting line
+** endings), or NULL if the encoding can't be converted.  Bytes which can't
+** be converted are replaced like GetFileContent does.  "used" is set to the
+** number of bytes converted, which leaves out a character of which not all
+** bytes were written yet.
+*/
+static char *convertFollowedText(WindowInfo *window, const char *data,
+        size_t length, size_t *used, size_t *textLength)
+{
+    char *text, *outPtr;
+    size_t pos = 0, v;
+    
+    if (window->encoding[0] == '\0' || isUtf8Encoding(window->encoding)) {
+        /* Each invalid byte becomes a 3 byte replacement character */
+        outPtr = text = malloc(3 * length + 1);
+        if (text == NULL)
+            return NULL;
+        while (pos < length) {
+            v = Utf8Validate(data + pos, length - pos, NULL);
+            memcpy(outPtr, data + pos, v);
+            outPtr += v;
+            pos += v;
+            if (pos == length || incompleteUtf8(data + pos, length - pos))
+                break;
+            memcpy(outPtr, "\xEF\xBF\xBD", 3);
+            outPtr += 3;
+            pos++;
+        }
+    } else {
+        iconv_t ic = iconv_open("UTF-8", window->encoding);
+        char *in = (char *)data;
+        size_t inleft = length, outleft, alloc = 2 * length + 16;
+        
+        if (ic == (iconv_t)-1)
+            return NULL;
+        outPtr = text = malloc(alloc + 1);
+        while (text != NULL && inleft > 0) {
+            outleft = alloc - (outPtr - text);
+            if (iconv(ic, &in, &inleft, &outPtr, &outleft) != (size_t)-1)
+                break;
+            if (errno == E2BIG || (errno == EILSEQ && outleft < 3)) {
+                size_t outPos = outPtr - text;
+                char *newText = realloc(text, 2 * alloc + 1);
+                if (newText == NULL) {
+                    free(text);
+                    text = NULL;
+                    break;
+                }
+                alloc *= 2;
+                text = newText;
+                outPtr = text + outPos;
+            } else if (errno == EILSEQ) {
+                memcpy(outPtr, "\xEF\xBF\xBD", 3);
+                outPtr += 3;
+                in++;
+                inleft--;
+            } else {
+                break; /* EINVAL, the rest of a character is missing */
+            }
+        }
+        iconv_close(ic);
+        if (text == NULL)
+            return NULL;
+        pos = in - data;
+    }
+    *outPtr = '\0';
+    *used = pos;
+    *textLength = outPtr - text;
+    return text;
+}
+
+/*
+** Check if "str" starts with the beginning of a UTF-8 sequence, which
+** continues past its "len" bytes
+*/
+static int incompleteUtf8(const char *str, size_t len)
+{
+    unsigned char c = str[0];
+    size_t i, n;
+    
+    if (c >= 0xC2 && c < 0xE0)
+        n = 2;
+    else if (c >= 0xE0 && c < 0xF0)
+        n = 3;
+    else if (c >= 0xF0 && c < 0xF5)
+        n = 4;
+    else
+        return FALSE;
+    if (len >= n)
+        return FALSE;
+    for (i = 1; i < len; i++)
+        if ((str[i] & 0xC0) != 0x80)
+            return FALSE;
+    return TRUE;
+}
+
+/*
+** Note which panes of the window have the cursor at the end of the text
+** (before adding to it), and move them to the new end afterwards with
+** keepPanesAtEnd
+*/
+static void getPanesAtEnd(WindowInfo *window, int *atEnd)
+{
+    int i;
+    Widget text;
+    
+    for (i=0; i<=window->nPanes; i++) {
+    	text = i==0 ? window->textArea : window->textPanes[i-1];
+        atEnd[i] = TextGetCursorPos(text) == window->buffer->length;
+    }
+}
+
+static void keepPanesAtEnd(WindowInfo *window, const int *atEnd)
+{
+    int i;
+    Widget text;
+    
+    for (i=0; i<=window->nPanes; i++) {
+    	text = i==0 ? window->textArea : window->textPanes[i-1];
+        if (atEnd[i])
+            TextSetCursorPos(text, window->buffer->length);
+    }
+}
+
 /*
 ** Check the read-only or locked status of the window and beep and return
 ** false if the window should not be written in.
@@ -2697,6 +4329,30 @@ static void addWrapNewlines(WindowInfo *window)
     SetToggleButtonState(window, window->continuousWrapItem, False, True);
 }
 
+/*
+** Return True if the contents of the file differ from what was last read or
+** written, rather than just its modification time.  If the file was hashed
+** then, it only has to be hashed again, without looking at the text.
+** Otherwise it is compared with the text, which may have been changed.
+*/
+static int fileContentsChanged(WindowInfo *window, const char *fileName)
+{
+    char message[MAXPATHLEN+50];
+    uint64_t hash;
+    off_t size;
+    int changed;
+    
+    if (!window->fileHashed)
+        return cmpWinAgainstFile(window, fileName) != 0;
+    
+    sprintf(message, "Comparing externally modified %s ...", window->filename);
+    AllWindowsBusy(message);
+    changed = HashFile(fileName, &hash, &size) != 0 ||
+            size != window->fileHashSize || hash != window->fileHash;
+    AllWindowsUnbusy();
+    return changed;
+}
+
 /* 
  * Number of bytes read at once by cmpWinAgainstFile
  */
@@ -2850,6 +4506,12 @@ static const char * GetDefaultEncoding(void) {
 }
 
 const char * DetectEncoding(const char *buf, size_t len, const char *def) {
+    /* Valid UTF-8 (unless a character was cut off at the end) is the
+       common case, checked quickly */
+    if(Utf8Validate(buf, len, NULL) == len) {
+        return "UTF-8";
+    }
+    
     int utf8Err = 0; // number of utf8 encoding errors
     int utf8Mb = 0;  // number of multibyte characters 
     
@@ -47,10 +47,20 @@ typedef struct DefaultEncoding {
     char *encoding;
 } DefaultEncoding;
 
+/* Progress of reading or writing a file, shared with the thread doing it */
+typedef struct FileProgress {
+    volatile size_t done;       /* bytes read or written so far */
+    size_t    total;            /* size of the file (0 if unknown) */
+    volatile int cancelled;     /* set to ask the thread to stop */
+} FileProgress;
+
 typedef struct FileContent {
     struct stat statbuf;
     char      *content;
     size_t    length;
+    size_t    alloc;            /* allocated size of content */
+    int       hasNuls;          /* content contains nul characters */
+    float     phaseTime[N_LOAD_PHASES]; /* milliseconds spent */
     int       readonly;
     int       hasBOM;
     int       fileFormat;
@@ -59,8 +69,13 @@ typedef struct FileContent {
     int       allocerror;
     int       iconverror;
     int       closeerror;
+    int       cancelled;
     int       skipped;
     int       err;
+    int       hashed;           /* hash and hashSize are set */
+    uint64_t  hash;             /* HashBytes of the file as it was read */
+    off_t     hashSize;
+    off_t     fileSize;         /* bytes of the file read, -1 with a filter */
     EncError  *enc_errors;
     size_t    num_enc_errors;
     char      encoding[MAX_ENCODING_LENGTH];
@@ -87,11 +102,21 @@ int PromptForNewFile(WindowInfo *window, char *prompt, FileSelection *file,
     	int *fileFormat);
 int CheckReadOnly(WindowInfo *window);
 void RemoveBackupFile(WindowInfo *window);
+void WriteBackupDelta(WindowInfo *window, int pos, int nInserted,
+	int nDeleted, const char *deletedText);
+void EndBackupDelta(WindowInfo *window);
+void MoveBackupDelta(WindowInfo *from, WindowInfo *to);
+void StartUndoJournal(WindowInfo *window);
+void WriteUndoJournal(WindowInfo *window, int pos, int nInserted,
+	int nDeleted, const char *deletedText);
+void SyncUndoJournal(WindowInfo *window);
+void RemoveUndoJournal(WindowInfo *window);
 void UniqueUntitledName(char *name);
 void CheckForChangesToFile(WindowInfo *window);
+void SetFollowFile(WindowInfo *window, int state);
 
 const char * DetectEncoding(const char *buf, size_t len, const char *def);
 
-int GetFileContent(Widget shell, const char *path, const char *encoding, const char *filter_name, FileContent *content);
+int GetFileContent(Widget shell, const char *path, const char *encoding, const char *filter_name, FileProgress *progress, int hash, FileContent *content);
 
 #endif /* NEDIT_FILE_H_INCLUDED */
@@ -0,0 +1,391 @@
+/*******************************************************************************
+*                                                                              *
+* fileWatch.c -- Nirvana Editor watching open files for external changes      *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+/*
+** The file watcher notices when the files of the open documents are changed
+** by other programs, so that CheckForChangesToFile only has to look at a
+** file after a change to it was reported, rather than each time the window
+** gets the focus or is edited.  On Linux, inotify watches the directory of
+** each file, which also reports files replaced by renaming, deleted, or
+** created, on a file descriptor read as Xt input.  For a symbolic link, the
+** directory of the file it points to is watched.  Files inotify can't watch,
+** files on network and FUSE file systems (where inotify doesn't hear of
+** changes made elsewhere), and all files on other systems, are looked at
+** with stat() every WATCH_POLL_INTERVAL ms instead.
+**
+** A reported change sets the fileEvent flag of the window, and shortly after,
+** the files of the top documents with the flag set are checked.  Documents
+** that aren't on top are checked when they are brought up, except followed
+** files (SetFollowFile), which are read as they grow.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include "fileWatch.h"
+#include "file.h"
+#include "window.h"
+#include "../util/nedit_malloc.h"
+#include "../util/fileUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
+
+#ifdef HAVE_DEBUG_H
+#include "../debug.h"
+#endif
+
+/* Reported changes are checked WATCH_DELAY ms later, so that a burst of them
+   (a program writing the file in pieces) is only checked once */
+#define WATCH_DELAY 100
+
+/* How often files that can't be watched are looked at (ms) */
+#define WATCH_POLL_INTERVAL 3000
+
+#ifdef __linux__
+#define WATCH_EVENTS (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | \
+        IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | \
+        IN_MOVE_SELF | IN_ONLYDIR)
+
+/* File systems (statfs f_type) on which files can change without inotify
+   reporting it: network file systems, and FUSE, which may be one */
+static const unsigned long RemoteFSTypes[] = {
+    0x6969,             /* NFS */
+    0x517B,             /* SMB */
+    0xFF534D42,         /* CIFS */
+    0xFE534D42,         /* SMB2 */
+    0x65735546,         /* FUSE */
+    0x01021997,         /* 9P */
+    0x00C36400,         /* Ceph */
+    0x73757245,         /* Coda */
+    0x5346414F,         /* AFS */
+    0x6B414653,         /* kAFS */
+    0x564C,             /* NCP */
+    0x01161970,         /* GFS2 */
+    0x7461636F          /* OCFS2 */
+};
+#endif
+
+/* A watched file */
+typedef struct {
+    WindowInfo *window;
+    char *name;			/* name of the file in the watched directory
+    				   (of the file a symbolic link points to) */
+    int wd;			/* inotify watch of the directory, or -1
+    				   when the file is polled */
+    int statResult;		/* 0, or the errno of the last stat() */
+    struct stat statbuf;	/* the file when it was last polled */
+} watchEntry;
+
+static void initWatcher(WindowInfo *window);
+static void watchInputProc(XtPointer clientData, int *source, XtInputId *id);
+static void pollTimerProc(XtPointer clientData, XtIntervalId *id);
+static void checkTimerProc(XtPointer clientData, XtIntervalId *id);
+static void reportChange(WindowInfo *window);
+static void pollFile(watchEntry *entry);
+static int statFile(watchEntry *entry);
+#ifdef __linux__
+static void pollDirectory(int wd);
+static int isRemoteFS(const char *path);
+#endif
+
+static watchEntry *Entries = NULL;
+static int NEntries = 0, EntriesSize = 0;
+static XtAppContext Context = NULL;
+static int InotifyFD = -1;
+static XtIntervalId PollTimerID = 0, CheckTimerID = 0;
+
+/*
+** Start watching the file of the window for changes, after it was read or
+** saved, in place of any file watched for it before
+*/
+void WatchFile(WindowInfo *window)
+{
+    char fullname[MAXPATHLEN], resolved[MAXPATHLEN];
+    char name[MAXPATHLEN], dir[MAXPATHLEN];
+    watchEntry *entry;
+    
+    UnwatchFile(window);
+    if (!window->filenameSet)
+        return;
+    initWatcher(window);
+    
+    if (NEntries == EntriesSize) {
+        EntriesSize = EntriesSize == 0 ? 64 : EntriesSize * 2;
+        Entries = (watchEntry *)NEditRealloc(Entries,
+                EntriesSize * sizeof(watchEntry));
+    }
+    entry = &Entries[NEntries++];
+    memset(entry, 0, sizeof(watchEntry));
+    entry->window = window;
+    entry->wd = -1;
+    
+    /* Changes to a symbolic link's file happen in the directory of that
+       file, watch it there */
+    snprintf(fullname, sizeof(fullname), "%s%s", window->path,
+            window->filename);
+    if (realpath(fullname, resolved) == NULL ||
+            ParseFilename(resolved, name, dir) != 0) {
+        strcpy(name, window->filename);
+        strcpy(dir, window->path);
+    }
+    entry->name = NEditStrdup(name);
+#ifdef __linux__
+    if (InotifyFD >= 0 && !isRemoteFS(dir))
+        entry->wd = inotify_add_watch(InotifyFD, dir, WATCH_EVENTS);
+#endif
+    if (entry->wd < 0)
+        pollFile(entry);
+    window->fileWatched = True;
+    window->fileEvent = False;
+}
+
+/*
+** Stop watching the file of the window, when it is closed
+*/
+void UnwatchFile(WindowInfo *window)
+{
+    int i, wd;
+    
+    for (i = 0; i < NEntries; i++)
+        if (Entries[i].window == window)
+            break;
+    if (i == NEntries)
+        return;
+    wd = Entries[i].wd;
+    NEditFree(Entries[i].name);
+    Entries[i] = Entries[--NEntries];
+    window->fileWatched = False;
+    window->fileEvent = False;
+    
+#ifdef __linux__
+    /* Watches of the same directory are shared, keep it if still in use */
+    if (wd >= 0) {
+        for (i = 0; i < NEntries; i++)
+            if (Entries[i].wd == wd)
+                return;
+        inotify_rm_watch(InotifyFD, wd);
+    }
+#endif
+}
+
+/*
+** Take in the changes reported so far, without waiting for the event loop
+** to get to them.  For checks that have to be up to date, like before saving.
+*/
+void ReadFileWatchEvents(void)
+{
+#ifdef __linux__
+    union {
+        struct inotify_event event;
+        char buf[4096];
+    } events;
+    struct inotify_event *event;
+    ssize_t n;
+    char *p;
+    int i;
+    
+    if (InotifyFD < 0)
+        return;
+    while ((n = read(InotifyFD, events.buf, sizeof(events.buf))) > 0) {
+        for (p = events.buf; p < events.buf + n;
+                p += sizeof(struct inotify_event) + event->len) {
+            event = (struct inotify_event *)p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                /* Events were lost, any of the files may have changed */
+                for (i = 0; i < NEntries; i++)
+                    if (Entries[i].wd >= 0)
+                        reportChange(Entries[i].window);
+            } else if (event->mask & (IN_IGNORED | IN_DELETE_SELF |
+                    IN_MOVE_SELF)) {
+                pollDirectory(event->wd);
+            } else if (event->len > 0) {
+                for (i = 0; i < NEntries; i++)
+                    if (Entries[i].wd == event->wd &&
+                            !strcmp(Entries[i].name, event->name))
+                        reportChange(Entries[i].window);
+            }
+        }
+    }
+#endif
+}
+
+/*
+** Set up inotify and the timers the first time a file is watched
+*/
+static void initWatcher(WindowInfo *window)
+{
+    if (Context != NULL)
+        return;
+    Context = XtWidgetToApplicationContext(window->shell);
+#ifdef __linux__
+    InotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (InotifyFD >= 0)
+        XtAppAddInput(Context, InotifyFD, (XtPointer)XtInputReadMask,
+                watchInputProc, NULL);
+#endif
+}
+
+static void watchInputProc(XtPointer clientData, int *source, XtInputId *id)
+{
+    ReadFileWatchEvents();
+}
+
+/*
+** Look at the files that aren't watched by inotify, and report the changed
+** ones
+*/
+static void pollTimerProc(XtPointer clientData, XtIntervalId *id)
+{
+    int i, nPolled = 0;
+    
+    PollTimerID = 0;
+    for (i = 0; i < NEntries; i++) {
+        if (Entries[i].wd >= 0)
+            continue;
+        if (statFile(&Entries[i]))
+            reportChange(Entries[i].window);
+        nPolled++;
+    }
+    if (nPolled > 0)
+        PollTimerID = XtAppAddTimeOut(Context, WATCH_POLL_INTERVAL,
+                pollTimerProc, NULL);
+}
+
+/*
+** Check the files of the top documents with reported changes, which may pop
+** up dialogs.  The user can close windows while one is up, so the list of
+** windows has to be looked at again if the next one went away.
+*/
+static void checkTimerProc(XtPointer clientData, XtIntervalId *id)
+{
+    WindowInfo *window, *next;
+    
+    CheckTimerID = 0;
+    for (window = WindowList; window != NULL; window = next) {
+        next = window->next;
+        if (!window->fileEvent ||
+                (!IsTopDocument(window) && !window->followFile))
+            continue;
+        CheckForChangesToFile(window);
+        if (next != NULL && !IsValidWindow(next))
+            next = WindowList;
+    }
+}
+
+/*
+** Flag a change to the file of the window, and have it checked shortly
+*/
+static void reportChange(WindowInfo *window)
+{
+    window->fileEvent = True;
+    if (CheckTimerID == 0)
+        CheckTimerID = XtAppAddTimeOut(Context, WATCH_DELAY, checkTimerProc,
+                NULL);
+}
+
+/*
+** Poll the file of "entry" from now on, rather than having it watched
+*/
+static void pollFile(watchEntry *entry)
+{
+    entry->wd = -1;
+    statFile(entry);
+    if (PollTimerID == 0)
+        PollTimerID = XtAppAddTimeOut(Context, WATCH_POLL_INTERVAL,
+                pollTimerProc, NULL);
+}
+
+/*
+** Look at the file of "entry", and return True if it changed since the last
+** time
+*/
+static int statFile(watchEntry *entry)
+{
+    char fullname[MAXPATHLEN];
+    struct stat statbuf;
+    int result, changed;
+    
+    snprintf(fullname, sizeof(fullname), "%s%s", entry->window->path,
+            entry->window->filename);
+    result = stat(fullname, &statbuf) == 0 ? 0 : errno;
+    changed = result != entry->statResult || (result == 0 &&
+            (statbuf.st_mtime != entry->statbuf.st_mtime ||
+             statbuf.st_size != entry->statbuf.st_size ||
+             statbuf.st_mode != entry->statbuf.st_mode ||
+             statbuf.st_uid != entry->statbuf.st_uid ||
+             statbuf.st_gid != entry->statbuf.st_gid ||
+             statbuf.st_ino != entry->statbuf.st_ino ||
+             statbuf.st_dev != entry->statbuf.st_dev));
+    entry->statResult = result;
+    if (result == 0)
+        entry->statbuf = statbuf;
+    return changed;
+}
+
+#ifdef __linux__
+/*
+** The directory of inotify watch "wd" was deleted or moved, so its path no
+** longer leads to the files in it.  Poll them instead, from here on.
+*/
+static void pollDirectory(int wd)
+{
+    int i, found = False;
+    
+    for (i = 0; i < NEntries; i++) {
+        if (Entries[i].wd == wd) {
+            pollFile(&Entries[i]);
+            reportChange(Entries[i].window);
+            found = True;
+        }
+    }
+    if (found)
+        inotify_rm_watch(InotifyFD, wd);
+}
+
+/*
+** Check if the directory "path" is on a file system where inotify may miss
+** changes, so that its files have to be polled
+*/
+static int isRemoteFS(const char *path)
+{
+    struct statfs buf;
+    size_t i;
+    
+    if (statfs(path, &buf) != 0)
+        return False;
+    for (i = 0; i < sizeof(RemoteFSTypes) / sizeof(RemoteFSTypes[0]); i++)
+        if ((unsigned long)buf.f_type == RemoteFSTypes[i])
+            return True;
+    return False;
+}
+#endif
@@ -19,6 +19,8 @@
 *                                                                              *
 *******************************************************************************/
 
+#define _GNU_SOURCE /* F_SETPIPE_SZ */
+
 #include "filter.h"
 #include "window.h"
 #include "nedit.h"
@@ -36,8 +38,10 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <sys/wait.h>
+#include <sys/uio.h>
 #include <Xm/XmAll.h>
 
 static IOFilter **filters;
@@ -686,19 +690,19 @@ const char* GetFilterNameForPath(const char *path, const char *filename) {
 
 /* ----------------------------- FileStream -----------------------------*/
 
-typedef struct FilterIOThreadData {
+/* Size of the pipe between a filter command and us, where the system
+   lets it be set.  Larger pipes need fewer reads and context switches. */
+#define FILTER_PIPE_SIZE (1024*1024)
+
+typedef struct FilterWaitData {
     XtAppContext appcontext;
     Widget widget;
-    FILE *file;
-    int fd_in;
-    int fd_out;
     pid_t pid;
-} FilterIOThreadData;
+} FilterWaitData;
 
 typedef struct FilterCmdError {
     Widget w;
     int status;
-    int io_errno;
 } FilterCmdError;
 
 static void filter_command_error(XtPointer clientData, XtIntervalId *id) {
@@ -713,114 +717,40 @@ static void filter_command_error(XtPointer clientData, XtIntervalId *id) {
         }
     }
     if(w) {
-        if(error->io_errno != 0) {
-            (void)DialogF(DF_WARN, error->w, 1, "Command Failure",
-                    "Filter IO Error: %s\n",
-                    "OK",
-                    strerror(error->io_errno));
-        } else {
-            (void)DialogF(DF_WARN, error->w, 1, "Command Failure",
-                    "Filter command reported failed exit status: %d\n",
-                    "OK",
-                    error->status);
-        }
+        (void)DialogF(DF_WARN, error->w, 1, "Command Failure",
+                "Filter command reported failed exit status: %d\n",
+                "OK",
+                error->status);
     }
     
     NEditFree(error);
 }
 
-static void* file_input_thread(void *data) {
-    FilterIOThreadData *stream = data;
-       
-    int ioerror = 0;
-    int io_errno = 0;
-    
-    char buf[16384];
-    size_t r;
-    while((r = fread(buf, 1, 16384, stream->file)) > 0) {
-        char *wbuf = buf;
-        while(r > 0) {
-            ssize_t w = write(stream->fd_in, wbuf, r);
-            if(w <= 0) {
-                ioerror = 1;
-                io_errno = errno;
-                break;
-            }
-            r -= w;
-            wbuf += w;
-        }
-        
-        if(ioerror) {
-            break;
-        }
-    }
-    
-    close(stream->fd_in);
-    
-    int status = -1;
-    waitpid(stream->pid, &status, 0);
-    if(status != 0 || ioerror) {
-        FilterCmdError *error = NEditMalloc(sizeof(FilterCmdError));
-        error->w = stream->widget;
-        error->status = status;
-        error->io_errno = io_errno;
-        XtAppAddTimeOut(
-                stream->appcontext,
-                0,
-                filter_command_error,
-                error);
-    }
-    
-    NEditFree(stream);
-    
-    return NULL;
-}
-
-#define FILTER_IO_BUFSIZE 16384
-
-static void* file_output_thread(void *data) {
-    FilterIOThreadData *stream = data;
-     
-    char buf[FILTER_IO_BUFSIZE];
-    ssize_t r;
-    while((r = read(stream->fd_out, buf, FILTER_IO_BUFSIZE)) > 0) {
-        fwrite(buf, 1, r, stream->file);
-    }
-    
-    close(stream->fd_out);
-    fclose(stream->file);
+/*
+ * waits for the filter command to exit, and reports a failure
+ */
+static void* filter_wait_thread(void *data) {
+    FilterWaitData *filter = data;
     
     int status = -1;
-    waitpid(stream->pid, &status, 0);
+    waitpid(filter->pid, &status, 0);
     if(status != 0) {
         FilterCmdError *error = NEditMalloc(sizeof(FilterCmdError));
-        error->w = stream->widget;
+        error->w = filter->widget;
         error->status = status;
         XtAppAddTimeOut(
-                stream->appcontext,
+                filter->appcontext,
                 0,
                 filter_command_error,
                 error);
     }
     
-    NEditFree(stream);
+    NEditFree(filter);
     
     return NULL;
 }
 
-static int filestream_create_pipes(FileStream *stream) {  
-    if(pipe(stream->pin)) {
-        return 1;
-    }
-    if(pipe(stream->pout)) {
-        close(stream->pin[0]);
-        close(stream->pin[1]);
-        return 1;
-    }
-    return 0;
-}
-
-static FileStream* filestream_open(Widget w, FILE *f, const char *filter_cmd, int mode) {
+static FileStream* filestream_open(Widget w, FILE *f, const char *path, const char *filter_cmd, int mode) {
     FileStream *stream = NEditMalloc(sizeof(FileStream));
     stream->file = f;
     stream->filter_cmd = filter_cmd ? NEditStrdup(filter_cmd) : NULL;
@@ -828,33 +758,76 @@ static FileStream* filestream_open(Widget w, FILE *f, const char *filter_cmd, in
     stream->hdrbufpos = 0;
     stream->hdrbuflen = 0;
     stream->mode = mode;
+    stream->hash = NULL;
+    stream->pos = 0;
+    stream->hashPos = 0;
+    stream->pin[0] = stream->pin[1] = -1;
+    stream->pout[0] = stream->pout[1] = -1;
      
     if(filter_cmd) {
-        if(filestream_create_pipes(stream)) {
+        // The filter command reads the file itself (mode 0) or writes
+        // it (mode 1), the file is its stdin or stdout. Only its other
+        // end is a pipe to us, so the file contents are never copied
+        // through this process.
+        // An input filter gets a file descriptor of its own, read-only,
+        // so that it can neither write the file nor move our offset.
+        int *p = mode == 0 ? stream->pout : stream->pin;
+        int fd_file = -1;
+        if(mode == 0) {
+            fd_file = open(path, O_RDONLY);
+            // the filter continues where the stream stands
+            if(fd_file == -1 || lseek(fd_file, ftello(f), SEEK_SET) == -1) {
+                fprintf(stderr, "Failed to open file for filter: %s\n", strerror(errno));
+                if(fd_file != -1) {
+                    close(fd_file);
+                }
+                NEditFree(stream->filter_cmd);
+                NEditFree(stream);
+                fclose(f);
+                return NULL;
+            }
+        } else {
+            fflush(f);
+            fd_file = fileno(f);
+        }
+        
+        if(pipe(p)) {
+            if(mode == 0) {
+                close(fd_file);
+            }
             NEditFree(stream->filter_cmd);
             NEditFree(stream);
             fclose(f);
             fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
             return NULL;
         }
+#ifdef F_SETPIPE_SZ
+        (void)fcntl(p[0], F_SETPIPE_SZ, FILTER_PIPE_SIZE);
+#endif
              
         pid_t child = fork();
         if(child == 0) { 
             close(STDIN_FILENO);
             close(STDOUT_FILENO);
 
-            // we need stdin, stdout and stderr refer to the previously
-            // created pipes
-            if(dup2(stream->pin[0], STDIN_FILENO) == -1) {
+            // we need stdin and stdout refer to the file and
+            // the pipe
+            int fd_in = mode == 0 ? fd_file : stream->pin[0];
+            int fd_out = mode == 0 ? stream->pout[1] : fd_file;
+            if(dup2(fd_in, STDIN_FILENO) == -1) {
                 perror("dup2");
                 _exit(1);
             }
-            if(dup2(stream->pout[1], STDOUT_FILENO) == -1) {
+            if(dup2(fd_out, STDOUT_FILENO) == -1) {
                 perror("dup2");
                 _exit(1);
             }
 
-            close(stream->pin[1]);
+            close(p[0]);
+            close(p[1]);
+            if(mode == 0) {
+                close(fd_file);
+            }
 
             // execute the command using the shell specified by preferences
             //fprintf(stderr, "info: input filter command: %s\n", filter_cmd);
@@ -866,50 +839,52 @@ static FileStream* filestream_open(Widget w, FILE *f, const char *filter_cmd, in
         } else {
             stream->pid = child;
             
-            FilterIOThreadData *data = NEditMalloc(sizeof(FilterIOThreadData));
+            // close the end of the pipe the filter uses
+            if(mode == 0) {
+                close(stream->pout[1]);
+                stream->pout[1] = -1;
+                close(fd_file);
+            } else {
+                close(stream->pin[0]);
+                stream->pin[0] = -1;
+                
+                // the file isn't written completely before the output
+                // filter exits, filestream_close waits for it
+                return stream;
+            }
+            
+            FilterWaitData *data = NEditMalloc(sizeof(FilterWaitData));
             data->appcontext = XtWidgetToApplicationContext(w);
             data->widget = w;
-            data->file = stream->file;
-            data->fd_in = stream->pin[1];
-            data->fd_out = stream->pout[0];
             data->pid = child;
             
             pthread_t tid;
-            if(pthread_create(&tid, NULL, mode == 0 ? file_input_thread : file_output_thread, data)) {
-                fprintf(stderr, "Errro: cannot create file input thread: %s\n", strerror(errno));
+            if(pthread_create(&tid, NULL, filter_wait_thread, data)) {
+                fprintf(stderr, "Errro: cannot create filter wait thread: %s\n", strerror(errno));
                 NEditFree(data);
-                close(stream->pin[0]);
-                close(stream->pin[1]);
-                close(stream->pout[0]);
-                close(stream->pout[1]);
-                fclose(f);
-                NEditFree(stream->filter_cmd);
-                NEditFree(stream);
-                return NULL;
-            }
-            
-            if(mode == 1) {
-                stream->file = NULL; // file will be closed by file_output_thread
+            } else {
+                pthread_detach(tid);
             }
-            
-            close(stream->pout[1]);
         }
     } 
     
     return stream;
 }
 
-FileStream* filestream_open_r(Widget w, FILE *f, const char *filter_cmd) {
-    return filestream_open(w, f, filter_cmd, 0);
+FileStream* filestream_open_r(Widget w, FILE *f, const char *path,
+        const char *filter_cmd)
+{
+    return filestream_open(w, f, path, filter_cmd, 0);
 }
 
 FileStream* filestream_open_w(Widget w, FILE *f, const char *filter_cmd) {
-    return filestream_open(w, f, filter_cmd, 1);
+    return filestream_open(w, f, NULL, filter_cmd, 1);
 }
 
 int filestream_reset(FileStream *stream, int pos) {
     if(stream->pid == 0) {
         fseek(stream->file, pos, SEEK_SET);
+        stream->pos = pos;
     } else {
         if(pos > stream->hdrbuflen || stream->hdrbufpos > stream->hdrbuflen) {
             return 1;
@@ -919,9 +894,31 @@ int filestream_reset(FileStream *stream, int pos) {
     return 0;
 }
 
+/*
+ * hashes the contents of the file as it is read or written, without a filter
+ * in between (the stream must be at the start of the file), so that it
+ * doesn't have to be read again for it
+ */
+void filestream_hash(FileStream *stream, HashState *hash) {
+    if(stream->pid == 0) {
+        stream->hash = hash;
+    }
+}
+
 size_t filestream_read(void *buffer, size_t nbytes, FileStream *stream) {
     if(stream->pid == 0) {
-        return fread(buffer, 1, nbytes, stream->file);  
+        size_t r = fread(buffer, 1, nbytes, stream->file);
+        // bytes read again after a reset are already hashed
+        off_t end = stream->pos + (off_t)r;
+        if(stream->hash && end > stream->hashPos) {
+            HashUpdate(
+                    stream->hash,
+                    (char*)buffer + (stream->hashPos - stream->pos),
+                    end - stream->hashPos);
+            stream->hashPos = end;
+        }
+        stream->pos = end;
+        return r;
     } else {
         if(stream->hdrbufpos < stream->hdrbuflen) {
             // get bytes from hdrbuf before reading more bytes from the pipe
@@ -964,7 +961,11 @@ size_t filestream_read(void *buffer, size_t nbytes, FileStream *stream) {
 
 size_t filestream_write(const void *buffer, size_t nbytes, FileStream *stream) {
     if(stream->pid == 0) {
-        return fwrite(buffer, 1, nbytes, stream->file);
+        size_t w = fwrite(buffer, 1, nbytes, stream->file);
+        if(stream->hash) {
+            HashUpdate(stream->hash, buffer, w);
+        }
+        return w;
     } else {
         ssize_t w = write(stream->pin[1], buffer, nbytes);
         if(w < 0) {
@@ -974,12 +975,40 @@ size_t filestream_write(const void *buffer, size_t nbytes, FileStream *stream) {
     } 
 }
 
+size_t filestream_writev(const struct iovec *iov, int iovcnt, FileStream *stream) {
+    int fd;
+    if(stream->pid == 0) {
+        // write what is buffered first
+        if(fflush(stream->file)) {
+            return 0;
+        }
+        fd = fileno(stream->file);
+    } else {
+        fd = stream->pin[1];
+    }
+    ssize_t w = writev(fd, iov, iovcnt);
+    if(w < 0) {
+        w = 0;
+    }
+    if(stream->pid == 0 && stream->hash) {
+        size_t left = w;
+        for(int i=0;i<iovcnt && left > 0;i++) {
+            size_t n = iov[i].iov_len < left ? iov[i].iov_len : left;
+            HashUpdate(stream->hash, iov[i].iov_base, n);
+            left -= n;
+        }
+    }
+    return w;
+}
+
+/*
+ * closes the stream, after the output filter command (if any) finished
+ * writing the file: returns FILESTREAM_FILTER_FAILED if it failed
+ */
 int filestream_close(FileStream *stream) {
+    int status = 0;
     if(stream->pid != 0) {
         if(stream->mode == 0) {
-            if(close(stream->pin[0])) {
-                perror("pipe pin[0] close");
-            }
             if(close(stream->pout[0])) {
                 perror("pipe pout[0] close");
             }
@@ -987,12 +1016,21 @@ int filestream_close(FileStream *stream) {
             if(close(stream->pin[1])) {
                 perror("pipe pin[1] close");
             }
+            while(waitpid(stream->pid, &status, 0) == -1) {
+                if(errno != EINTR) {
+                    status = -1;
+                    break;
+                }
+            }
         }
     }
     int err = 0;
     if(stream->file) {
         err = fclose(stream->file);
     }
+    if(status != 0) {
+        err = FILESTREAM_FILTER_FAILED;
+    }
     NEditFree(stream->filter_cmd);
     NEditFree(stream);
     return err;
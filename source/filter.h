@@ -23,12 +23,15 @@
 #define XNEDIT_FILTER_H
 
 #include "nedit.h"
+#include "../util/filehash.h"
 
 #include <X11/Intrinsic.h>
 #include <X11/Xresource.h>
 #include <Xm/Xm.h>
 #include <X11/Xlib.h>
 
+#include <sys/uio.h>
+
 typedef struct IOFilter IOFilter;
 struct IOFilter {
     char *name;
@@ -40,6 +43,9 @@ struct IOFilter {
 };
 
 #define FILESTREAM_HDR_BUFLEN 32768
+
+/* filestream_close result when the output filter command failed */
+#define FILESTREAM_FILTER_FAILED -2
 typedef struct FileStream {
     FILE *file;
     int pin[2];
@@ -50,6 +56,9 @@ typedef struct FileStream {
     size_t hdrbuflen;
     size_t hdrbufpos;
     int mode;
+    HashState *hash;  /* hash of the file contents read or written */
+    off_t pos;        /* position in the file */
+    off_t hashPos;    /* end of the bytes read that were hashed */
 } FileStream;
 
 void FilterSettings(WindowInfo *window);
@@ -66,11 +75,14 @@ IOFilter* GetFilterForPath(const char *path);
 
 const char* GetFilterNameForPath(const char *path, const char *filename);
 
-FileStream* filestream_open_r(Widget w, FILE *f, const char *filter_cmd);
+FileStream* filestream_open_r(Widget w, FILE *f, const char *path,
+        const char *filter_cmd);
 FileStream* filestream_open_w(Widget w, FILE *f, const char *filter_cmd);
 int filestream_reset(FileStream *stream, int pos);
+void filestream_hash(FileStream *stream, HashState *hash);
 size_t filestream_read(void *buffer, size_t nbytes, FileStream *stream);
 size_t filestream_write(const void *buffer, size_t nbytes, FileStream *stream);
+size_t filestream_writev(const struct iovec *iov, int iovcnt, FileStream *stream);
 int filestream_close(FileStream *stream);
 
 
@@ -0,0 +1,1069 @@
+/*******************************************************************************
+*                                                                              *
+* findInFiles.c -- Nirvana Editor search through the files of a directory      *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+/*
+** Find in Files searches every file below a directory for the search string,
+** and lists the matching lines, grep style ("file:line: text"), in a new
+** document.  The directory tree is walked and the files are searched by a
+** pool of worker threads, which share a stack of directories and files still
+** to be looked at.  Matching lines are collected in an output queue, and
+** moved into the results document on the main thread, as they come in, so
+** the first results can be looked at while the search goes on.  Double
+** clicking a line of the results opens the file at that line.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include "findInFiles.h"
+#include "textBuf.h"
+#include "text.h"
+#include "search.h"
+#include "regularExp.h"
+#include "window.h"
+#include "file.h"
+#include "selection.h"
+#include "preferences.h"
+#include "filter.h"
+#include "menu.h"
+#include "../util/DialogF.h"
+#include "../util/misc.h"
+#include "../util/fileUtils.h"
+#include "../util/textfield.h"
+#include "../util/ec_glob.h"
+#include "../util/nedit_malloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/param.h>
+
+#include <Xm/Xm.h>
+#include <Xm/Form.h>
+#include <Xm/Label.h>
+#include <Xm/LabelG.h>
+#include <Xm/PushB.h>
+#include <Xm/RowColumn.h>
+#include <Xm/ToggleB.h>
+
+#ifdef HAVE_DEBUG_H
+#include "../debug.h"
+#endif
+
+/* Maximum number of threads searching the files */
+#define MAX_FIND_THREADS 8
+
+/* Files with a null character in their first BINARY_PROBE_SIZE bytes are
+   taken for binary files, and are not searched */
+#define BINARY_PROBE_SIZE 8192
+
+/* Matching lines longer than this are cut off in the results */
+#define MAX_RESULT_LINE 512
+
+/* A directory or file, still to be searched */
+typedef struct _findItem {
+    struct _findItem *next;
+    int isDir;
+    char path[1];
+} findItem;
+
+typedef struct {
+    WindowInfo *results;	/* document listing the matches, NULL if it
+    				   was closed */
+    char *searchString;
+    int searchType;
+    char *delimiters;
+    char *root;			/* directory searched, without trailing '/' */
+    char **include;		/* file name patterns of the files to search */
+    int nInclude;
+    char **exclude;		/* names of files and directories to skip */
+    int nExclude;
+    pthread_mutex_t lock;	/* protects everything below */
+    pthread_cond_t workAvailable;
+    findItem *stack;		/* directories and files still to search */
+    int nBusy;			/* workers searching an item, which may push
+    				   more items on the stack */
+    int nRunning;		/* worker threads not finished */
+    char *output;		/* results not yet moved into the document */
+    int outputLen, outputAlloc;
+    int nFiles, nFilesMatched, nMatches;
+    int finished;
+    volatile int cancelled;
+    pthread_t *threads;
+    int nThreads;
+    int pipeFDs[2];		/* wakes up the main thread for new output */
+    XtInputId inputID;
+} findJob;
+
+static void createFindInFilesDialog(WindowInfo *window);
+static void findCB(Widget w, XtPointer clientData, XtPointer callData);
+static void stopCB(Widget w, XtPointer clientData, XtPointer callData);
+static void closeCB(Widget w, XtPointer clientData, XtPointer callData);
+static void regexToggleCB(Widget w, XtPointer clientData, XtPointer callData);
+static void fifDestroyCB(Widget w, XtPointer clientData, XtPointer callData);
+static void fifUnmapCB(Widget w, XtPointer clientData, XtPointer callData);
+static Widget createField(Widget form, Widget above, const char *name,
+	const char *label, char mnemonic, const char *value);
+static void setDialogBusy(Bool busy);
+static void saveDialogValues(void);
+static void startFindJob(findJob *job);
+static void cancelFindJob(findJob *job);
+static void finishFindJob(findJob *job);
+static void findReadProc(XtPointer clientData, int *source, XtInputId *id);
+static void *findWorker(void *arg);
+static int findCancelled(void *cbArg);
+static void pushItem(findJob *job, const char *path, int isDir);
+static void searchDirectory(findJob *job, const char *dirPath);
+static void searchFile(findJob *job, const SearchMatcher *matcher,
+	const char *path, char **buf, size_t *bufSize);
+static void appendOutput(findJob *job, const char *text, int length,
+	int nMatches, int nFiles, int nFilesMatched);
+static int matchesGlobs(char **globs, int nGlobs, const char *name,
+	const char *relPath);
+static int globMatch(const char *pattern, const char *string);
+static char **splitGlobs(const char *string, int *nGlobs);
+static void freeGlobs(char **globs, int nGlobs);
+static void freeFindJob(findJob *job);
+static void resultsClickEH(Widget w, XtPointer clientData, XEvent *event,
+	Boolean *continueDispatch);
+static void openResultAtCursor(WindowInfo *window, Widget textW);
+
+static struct {
+    Widget form;
+    Widget shell;
+    Widget findText, regexToggle, caseToggle, wordToggle;
+    Widget dirText, includeText, excludeText;
+    Widget findBtn, stopBtn;
+    WindowInfo *window;
+} fifDialog = {NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL};
+
+/* Dialog settings, kept from one search to the next */
+static char *LastSearch = NULL;
+static char *LastDirectory = NULL;
+static char *LastInclude = NULL;
+static char *LastExclude = NULL;
+static int LastRegex = False, LastCaseSense = False, LastWholeWord = False;
+
+/* The search running in the background (only one at a time) */
+static findJob *FindJob = NULL;
+
+/*
+** Present the Find in Files dialog for window
+*/
+void DoFindInFilesDlog(WindowInfo *window)
+{
+    if (fifDialog.window != window && fifDialog.form) {
+	/* Destroy the dialog owned by the other window (see
+	   EditCustomTitleFormat) */
+	saveDialogValues();
+	XtDestroyWidget(fifDialog.form);
+	fifDialog.form = NULL;
+    }
+    fifDialog.window = window;
+
+    if (fifDialog.form != NULL && XtIsManaged(fifDialog.form)) {
+	RaiseDialogWindow(fifDialog.shell);
+	return;
+    }
+    if (fifDialog.form == NULL)
+	createFindInFilesDialog(window);
+
+    setDialogBusy(FindJob != NULL);
+    ManageDialogCenteredOnPointer(fifDialog.form);
+    XmProcessTraversal(fifDialog.findText, XmTRAVERSE_CURRENT);
+}
+
+/*
+** Called when a window is closed.  Stops the search writing into it, and
+** removes the dialog belonging to it.
+*/
+void RemoveFromFindInFiles(WindowInfo *doomedWindow)
+{
+    if (FindJob != NULL && FindJob->results == doomedWindow) {
+	cancelFindJob(FindJob);
+	FindJob->results = NULL;
+    }
+    if (fifDialog.window == doomedWindow) {
+	if (fifDialog.form != NULL) {
+	    saveDialogValues();
+	    XtDestroyWidget(fifDialog.form);
+	}
+	fifDialog.form = NULL;
+	fifDialog.window = NULL;
+    }
+}
+
+static void createFindInFilesDialog(WindowInfo *window)
+{
+    Widget form, typeBox, buttonForm, closeBtn;
+    XmString s1;
+    Arg args[10];
+    int ac, defaultBtnOffset;
+    Dimension shadowThickness;
+
+    if (LastDirectory == NULL)
+	LastDirectory = NEditStrdup(window->path);
+    if (LastInclude == NULL)
+	LastInclude = NEditStrdup("*");
+    if (LastExclude == NULL)
+	LastExclude = NEditStrdup(".git .svn CVS *.o");
+
+    ac = 0;
+    XtSetArg(args[ac], XmNautoUnmanage, False); ac++;
+    XtSetArg(args[ac], XmNtitle, "Find in Files"); ac++;
+    form = CreateFormDialog(window->shell, "findInFiles", args, ac);
+    fifDialog.form = form;
+    fifDialog.shell = XtParent(form);
+
+    /* Destroy the dialog every time it is unmapped (otherwise it 'sticks'
+       to the window for which it was created originally) */
+    XtAddCallback(form, XmNunmapCallback, fifUnmapCB, NULL);
+    XtAddCallback(form, XmNdestroyCallback, fifDestroyCB, NULL);
+
+    fifDialog.findText = createField(form, NULL, "searchString",
+	    "String to Find:", 'S', LastSearch ? LastSearch : "");
+
+    typeBox = XtVaCreateManagedWidget("searchTypeBox", xmRowColumnWidgetClass,
+	    form,
+	    XmNorientation, XmHORIZONTAL,
+	    XmNpacking, XmPACK_TIGHT,
+	    XmNmarginHeight, 0,
+	    XmNtopAttachment, XmATTACH_WIDGET,
+	    XmNtopWidget, fifDialog.findText,
+	    XmNleftAttachment, XmATTACH_FORM,
+	    XmNleftOffset, 2, NULL);
+    XmAddTabGroup(typeBox);
+    fifDialog.regexToggle = XtVaCreateManagedWidget("regExp",
+	    xmToggleButtonWidgetClass, typeBox,
+	    XmNlabelString, s1=XmStringCreateSimple("Regular Expression"),
+	    XmNmnemonic, 'R',
+	    XmNset, LastRegex, NULL);
+    XmStringFree(s1);
+    XtAddCallback(fifDialog.regexToggle, XmNvalueChangedCallback,
+	    regexToggleCB, NULL);
+    fifDialog.caseToggle = XtVaCreateManagedWidget("caseSensitive",
+	    xmToggleButtonWidgetClass, typeBox,
+	    XmNlabelString, s1=XmStringCreateSimple("Case Sensitive"),
+	    XmNmnemonic, 'C',
+	    XmNset, LastCaseSense, NULL);
+    XmStringFree(s1);
+    fifDialog.wordToggle = XtVaCreateManagedWidget("wholeWord",
+	    xmToggleButtonWidgetClass, typeBox,
+	    XmNlabelString, s1=XmStringCreateSimple("Whole Word"),
+	    XmNmnemonic, 'h',
+	    XmNset, LastWholeWord,
+	    XmNsensitive, !LastRegex, NULL);
+    XmStringFree(s1);
+
+    fifDialog.dirText = createField(form, typeBox, "directory",
+	    "In Directory:", 'D', LastDirectory);
+    fifDialog.includeText = createField(form, fifDialog.dirText, "include",
+	    "Files Named (e.g. *.c *.h, or * for all):", 'N', LastInclude);
+    fifDialog.excludeText = createField(form, fifDialog.includeText,
+	    "exclude", "Skip Files and Directories Named:", 'k', LastExclude);
+
+    buttonForm = XtVaCreateManagedWidget("buttons", xmFormWidgetClass, form,
+	    XmNtopAttachment, XmATTACH_WIDGET,
+	    XmNtopWidget, fifDialog.excludeText,
+	    XmNtopOffset, 6,
+	    XmNleftAttachment, XmATTACH_FORM,
+	    XmNrightAttachment, XmATTACH_FORM,
+	    XmNbottomAttachment, XmATTACH_FORM,
+	    XmNbottomOffset, 4, NULL);
+
+    fifDialog.findBtn = XtVaCreateManagedWidget("find",
+	    xmPushButtonWidgetClass, buttonForm,
+	    XmNhighlightThickness, 2,
+	    XmNlabelString, s1=XmStringCreateSimple("Find"),
+	    XmNshowAsDefault, (short)1,
+	    XmNleftAttachment, XmATTACH_POSITION,
+	    XmNleftPosition, 6,
+	    XmNrightAttachment, XmATTACH_POSITION,
+	    XmNrightPosition, 28,
+	    XmNbottomAttachment, XmATTACH_FORM, NULL);
+    XmStringFree(s1);
+    XtAddCallback(fifDialog.findBtn, XmNactivateCallback, findCB, NULL);
+    XtVaGetValues(fifDialog.findBtn, XmNshadowThickness, &shadowThickness,
+	    NULL);
+    defaultBtnOffset = shadowThickness + 4;
+
+    fifDialog.stopBtn = XtVaCreateManagedWidget("stop",
+	    xmPushButtonWidgetClass, buttonForm,
+	    XmNhighlightThickness, 2,
+	    XmNlabelString, s1=XmStringCreateSimple("Stop"),
+	    XmNmnemonic, 't',
+	    XmNleftAttachment, XmATTACH_POSITION,
+	    XmNleftPosition, 39,
+	    XmNrightAttachment, XmATTACH_POSITION,
+	    XmNrightPosition, 61,
+	    XmNbottomAttachment, XmATTACH_FORM,
+	    XmNbottomOffset, defaultBtnOffset, NULL);
+    XmStringFree(s1);
+    XtAddCallback(fifDialog.stopBtn, XmNactivateCallback, stopCB, NULL);
+
+    closeBtn = XtVaCreateManagedWidget("close",
+	    xmPushButtonWidgetClass, buttonForm,
+	    XmNhighlightThickness, 2,
+	    XmNlabelString, s1=XmStringCreateSimple("Close"),
+	    XmNleftAttachment, XmATTACH_POSITION,
+	    XmNleftPosition, 72,
+	    XmNrightAttachment, XmATTACH_POSITION,
+	    XmNrightPosition, 94,
+	    XmNbottomAttachment, XmATTACH_FORM,
+	    XmNbottomOffset, defaultBtnOffset, NULL);
+    XmStringFree(s1);
+    XtAddCallback(closeBtn, XmNactivateCallback, closeCB, NULL);
+
+    XtVaSetValues(form, XmNdefaultButton, fifDialog.findBtn,
+	    XmNcancelButton, closeBtn, NULL);
+    AddDialogMnemonicHandler(form, FALSE);
+}
+
+/*
+** Create a labeled text field of the dialog below widget "above"
+*/
+static Widget createField(Widget form, Widget above, const char *name,
+	const char *label, char mnemonic, const char *value)
+{
+    Widget labelW, text;
+    XmString s1;
+    Arg args[12];
+    int ac = 0;
+
+    labelW = XtVaCreateManagedWidget("label", xmLabelGadgetClass, form,
+	    XmNlabelString, s1=XmStringCreateSimple((char *)label),
+	    XmNmnemonic, mnemonic,
+	    XmNalignment, XmALIGNMENT_BEGINNING,
+	    XmNtopAttachment, above ? XmATTACH_WIDGET : XmATTACH_FORM,
+	    XmNtopWidget, above,
+	    XmNtopOffset, 6,
+	    XmNleftAttachment, XmATTACH_FORM,
+	    XmNleftOffset, 6, NULL);
+    XmStringFree(s1);
+
+    XtSetArg(args[ac], XmNtraversalOn, True); ac++;
+    XtSetArg(args[ac], XmNhighlightThickness, 2); ac++;
+    XtSetArg(args[ac], XmNcolumns, 50); ac++;
+    XtSetArg(args[ac], XmNtopAttachment, XmATTACH_WIDGET); ac++;
+    XtSetArg(args[ac], XmNtopWidget, labelW); ac++;
+    XtSetArg(args[ac], XmNleftAttachment, XmATTACH_FORM); ac++;
+    XtSetArg(args[ac], XmNrightAttachment, XmATTACH_FORM); ac++;
+    XtSetArg(args[ac], XmNleftOffset, 6); ac++;
+    XtSetArg(args[ac], XmNrightOffset, 6); ac++;
+    text = XNECreateText(form, (char *)name, args, ac);
+    RemapDeleteKey(text);
+    XtManageChild(text);
+    XmAddTabGroup(text);
+    XNETextSetString(text, (char *)value);
+    XtVaSetValues(labelW, XmNuserData, text, NULL); /* mnemonic processing */
+    return text;
+}
+
+static void fifDestroyCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    if (w == fifDialog.form) /* Prevent disconnecting the replacing dialog */
+	fifDialog.form = NULL;
+}
+
+static void fifUnmapCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    if (fifDialog.form == w) {  /* Prevent destroying the replacing dialog */
+	saveDialogValues();
+	XtDestroyWidget(fifDialog.form);
+    }
+}
+
+static void regexToggleCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    /* Regular expressions have their own word boundaries (<, >) */
+    XtSetSensitive(fifDialog.wordToggle, !XmToggleButtonGetState(w));
+}
+
+static void closeCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    XtUnmanageChild(fifDialog.form);
+}
+
+static void stopCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    if (FindJob != NULL)
+	cancelFindJob(FindJob);
+}
+
+static void findCB(Widget w, XtPointer clientData, XtPointer callData)
+{
+    WindowInfo *window = fifDialog.window;
+    char dir[MAXPATHLEN], *dirString, *compileMsg;
+    int searchType, regex, caseSense, wholeWord;
+    regexp *compiledRE;
+    struct stat statbuf;
+    findJob *job;
+
+    if (window == NULL || FindJob != NULL)
+	return;
+    saveDialogValues();
+    if (*LastSearch == '\0') {
+	XBell(TheDisplay, 0);
+	return;
+    }
+
+    regex = XmToggleButtonGetState(fifDialog.regexToggle);
+    caseSense = XmToggleButtonGetState(fifDialog.caseToggle);
+    wholeWord = XmToggleButtonGetState(fifDialog.wordToggle);
+    if (regex)
+	searchType = caseSense ? SEARCH_REGEX : SEARCH_REGEX_NOCASE;
+    else if (wholeWord)
+	searchType = caseSense ? SEARCH_CASE_SENSE_WORD : SEARCH_LITERAL_WORD;
+    else
+	searchType = caseSense ? SEARCH_CASE_SENSE : SEARCH_LITERAL;
+
+    /* Test compile regular expressions here, to present the error, and
+       because the first compile initializes tables the worker threads share */
+    if (regex) {
+	compiledRE = CompileRE(LastSearch, &compileMsg, caseSense ?
+		REDFLT_STANDARD : REDFLT_CASE_INSENSITIVE);
+	if (compiledRE == NULL) {
+	    DialogF(DF_WARN, fifDialog.shell, 1, "Search String",
+		    "Please respecify the search string:\n%s", "OK",
+		    compileMsg);
+	    return;
+	}
+	NEditFree(compiledRE);
+    }
+
+    /* Relative directories are taken from the directory of the document */
+    dirString = LastDirectory;
+    if (*dirString == '\0')
+	dirString = window->path;
+    if (*dirString != '/' && *dirString != '~')
+	snprintf(dir, sizeof(dir), "%s%s", window->path, dirString);
+    else
+	snprintf(dir, sizeof(dir), "%s", dirString);
+    ExpandTilde(dir);
+    NormalizePathname(dir);
+    if (stat(dir, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode)) {
+	DialogF(DF_WARN, fifDialog.shell, 1, "Find in Files",
+		"Can't search %s:\nnot a directory", "OK", dir);
+	return;
+    }
+    while (strlen(dir) > 1 && dir[strlen(dir)-1] == '/')
+	dir[strlen(dir)-1] = '\0';
+
+    job = (findJob *)NEditMalloc(sizeof(findJob));
+    memset(job, 0, sizeof(findJob));
+    job->searchString = NEditStrdup(LastSearch);
+    job->searchType = searchType;
+    job->delimiters = NEditStrdup(GetPrefDelimiters());
+    job->root = NEditStrdup(strcmp(dir, "/") ? dir : "");
+    job->include = splitGlobs(LastInclude, &job->nInclude);
+    job->exclude = splitGlobs(LastExclude, &job->nExclude);
+
+    /* Results go to a new document */
+    job->results = EditNewFile(GetPrefOpenInTab() ? window : NULL, NULL,
+	    False, NULL, window->path);
+    if (job->results == NULL) {
+	freeFindJob(job);
+	return;
+    }
+    CheckCloseDim();
+    XtAddEventHandler(job->results->textArea, ButtonReleaseMask, False,
+	    resultsClickEH, job->results);
+
+    startFindJob(job);
+}
+
+/*
+** Read the settings of the dialog into the Last... variables
+*/
+static void saveDialogValues(void)
+{
+    NEditFree(LastSearch);
+    NEditFree(LastDirectory);
+    NEditFree(LastInclude);
+    NEditFree(LastExclude);
+    LastSearch = XNETextGetString(fifDialog.findText);
+    LastDirectory = XNETextGetString(fifDialog.dirText);
+    LastInclude = XNETextGetString(fifDialog.includeText);
+    LastExclude = XNETextGetString(fifDialog.excludeText);
+    LastRegex = XmToggleButtonGetState(fifDialog.regexToggle);
+    LastCaseSense = XmToggleButtonGetState(fifDialog.caseToggle);
+    LastWholeWord = XmToggleButtonGetState(fifDialog.wordToggle);
+}
+
+static void setDialogBusy(Bool busy)
+{
+    if (fifDialog.form == NULL)
+	return;
+    XtSetSensitive(fifDialog.findBtn, !busy);
+    XtSetSensitive(fifDialog.stopBtn, busy);
+}
+
+/*
+** Start the worker threads of a search, and the input handler which moves
+** their results into the results document.  Without threads, the search is
+** done right away.
+*/
+static void startFindJob(findJob *job)
+{
+    char header[MAXPATHLEN + 64];
+    long nThreads;
+
+    snprintf(header, sizeof(header), "Searching %s for \"%.*s\"\n\n",
+	    *job->root ? job->root : "/", 80, job->searchString);
+    BufInsert(job->results->buffer, 0, header);
+
+    job->pipeFDs[0] = job->pipeFDs[1] = -1;
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->workAvailable, NULL);
+    pushItem(job, job->root, True);
+    FindJob = job;
+
+    nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > MAX_FIND_THREADS)
+	nThreads = MAX_FIND_THREADS;
+    if (nThreads > 0 && pipe(job->pipeFDs) == 0) {
+	fcntl(job->pipeFDs[0], F_SETFL, O_NONBLOCK);
+	fcntl(job->pipeFDs[1], F_SETFL, O_NONBLOCK);
+	job->threads = (pthread_t *)NEditMalloc(nThreads * sizeof(pthread_t));
+	job->nRunning = nThreads;
+	while (job->nThreads < nThreads && pthread_create(
+		&job->threads[job->nThreads], NULL, findWorker, job) == 0)
+	    job->nThreads++;
+	/* account for threads which could not be created */
+	pthread_mutex_lock(&job->lock);
+	job->nRunning -= nThreads - job->nThreads;
+	if (job->nRunning == 0 && job->nThreads > 0) {
+	    job->finished = True;
+	    write(job->pipeFDs[1], "", 1);
+	}
+	pthread_mutex_unlock(&job->lock);
+    }
+
+    if (job->nThreads == 0) {
+	if (job->pipeFDs[0] != -1) {
+	    close(job->pipeFDs[0]);
+	    close(job->pipeFDs[1]);
+	    job->pipeFDs[0] = job->pipeFDs[1] = -1;
+	}
+	job->nRunning = 1;
+	findWorker(job);
+	findReadProc(job, NULL, NULL);
+	return;
+    }
+
+    job->inputID = XtAppAddInput(XtWidgetToApplicationContext(
+	    job->results->shell), job->pipeFDs[0],
+	    (XtPointer)XtInputReadMask, findReadProc, job);
+    setDialogBusy(True);
+    SetModeMessage(job->results, "Searching...");
+}
+
+/*
+** Ask the workers of a search to stop.  They finish the file they are
+** searching, and then exit, which ends the search through findReadProc.
+*/
+static void cancelFindJob(findJob *job)
+{
+    pthread_mutex_lock(&job->lock);
+    job->cancelled = True;
+    pthread_cond_broadcast(&job->workAvailable);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*
+** Called on the main thread when workers have new output, and when the last
+** of them has exited.  Appends the output to the results document.
+*/
+static void findReadProc(XtPointer clientData, int *source, XtInputId *id)
+{
+    findJob *job = (findJob *)clientData;
+    char bytes[64], message[128], *output;
+    int finished, nFiles, nFilesMatched, nMatches;
+
+    if (job->pipeFDs[0] != -1) {
+	while (read(job->pipeFDs[0], bytes, sizeof(bytes)) > 0)
+	    ;
+    }
+
+    pthread_mutex_lock(&job->lock);
+    output = job->output;
+    job->output = NULL;
+    job->outputLen = job->outputAlloc = 0;
+    finished = job->finished;
+    nFiles = job->nFiles;
+    nFilesMatched = job->nFilesMatched;
+    nMatches = job->nMatches;
+    pthread_mutex_unlock(&job->lock);
+
+    if (output != NULL && job->results != NULL)
+	BufInsert(job->results->buffer, job->results->buffer->length, output);
+    NEditFree(output);
+
+    if (finished)
+	finishFindJob(job);
+    else if (job->results != NULL) {
+	snprintf(message, sizeof(message),
+		"Searching... %d matches in %d files, %d files searched",
+		nMatches, nFilesMatched, nFiles);
+	SetModeMessage(job->results, message);
+    }
+}
+
+/*
+** Clean up after the workers of a search have exited, and write the summary
+** line to the results document
+*/
+static void finishFindJob(findJob *job)
+{
+    char summary[160];
+    int i;
+
+    for (i=0; i<job->nThreads; i++)
+	pthread_join(job->threads[i], NULL);
+    if (job->nThreads > 0)
+	XtRemoveInput(job->inputID);
+    FindJob = NULL;
+    setDialogBusy(False);
+
+    if (job->results != NULL) {
+	snprintf(summary, sizeof(summary),
+		"\n%s: %d match%s in %d of %d files searched\n",
+		job->cancelled ? "Search stopped" : "Done",
+		job->nMatches, job->nMatches == 1 ? "" : "es",
+		job->nFilesMatched, job->nFiles);
+	BufInsert(job->results->buffer, job->results->buffer->length,
+		summary);
+	ClearModeMessage(job->results);
+	/* The results are not worth a question when the document is closed */
+	SetWindowModified(job->results, False);
+    }
+    freeFindJob(job);
+}
+
+static void freeFindJob(findJob *job)
+{
+    findItem *item;
+
+    while (job->stack != NULL) {
+	item = job->stack;
+	job->stack = item->next;
+	NEditFree(item);
+    }
+    if (job->pipeFDs[0] != -1) {
+	close(job->pipeFDs[0]);
+	close(job->pipeFDs[1]);
+    }
+    if (job->threads != NULL) {
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->workAvailable);
+    }
+    freeGlobs(job->include, job->nInclude);
+    freeGlobs(job->exclude, job->nExclude);
+    NEditFree(job->threads);
+    NEditFree(job->output);
+    NEditFree(job->searchString);
+    NEditFree(job->delimiters);
+    NEditFree(job->root);
+    NEditFree(job);
+}
+
+/*
+** Worker thread of a search.  Takes directories and files from the stack
+** until the stack is empty, and no other worker is still reading a
+** directory, which could add more.
+*/
+static void *findWorker(void *arg)
+{
+    findJob *job = (findJob *)arg;
+    SearchMatcher *matcher;
+    findItem *item;
+    char *buf = NULL;
+    size_t bufSize = 0;
+
+    SetRECancelProc(findCancelled, job);
+    matcher = CreateSearchMatcher(job->searchString, job->searchType,
+	    job->delimiters);
+
+    for (;;) {
+	pthread_mutex_lock(&job->lock);
+	while (job->stack == NULL && job->nBusy > 0 && !job->cancelled)
+	    pthread_cond_wait(&job->workAvailable, &job->lock);
+	if (job->stack == NULL || job->cancelled) {
+	    pthread_mutex_unlock(&job->lock);
+	    break;
+	}
+	item = job->stack;
+	job->stack = item->next;
+	job->nBusy++;
+	pthread_mutex_unlock(&job->lock);
+
+	if (item->isDir)
+	    searchDirectory(job, item->path);
+	else if (matcher != NULL)
+	    searchFile(job, matcher, item->path, &buf, &bufSize);
+	NEditFree(item);
+
+	pthread_mutex_lock(&job->lock);
+	if (--job->nBusy == 0 && job->stack == NULL)
+	    pthread_cond_broadcast(&job->workAvailable);
+	pthread_mutex_unlock(&job->lock);
+    }
+
+    if (matcher != NULL)
+	FreeSearchMatcher(matcher);
+    NEditFree(buf);
+    SetRECancelProc(NULL, NULL);
+    ReleaseREThreadState();
+
+    pthread_mutex_lock(&job->lock);
+    if (--job->nRunning == 0) {
+	job->finished = True;
+	if (job->pipeFDs[1] != -1)
+	    write(job->pipeFDs[1], "", 1);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+static int findCancelled(void *cbArg)
+{
+    return ((findJob *)cbArg)->cancelled;
+}
+
+static void pushItem(findJob *job, const char *path, int isDir)
+{
+    size_t len = strlen(path);
+    findItem *item = (findItem *)NEditMalloc(sizeof(findItem) + len);
+
+    memcpy(item->path, path, len + 1);
+    item->isDir = isDir;
+    pthread_mutex_lock(&job->lock);
+    item->next = job->stack;
+    job->stack = item;
+    pthread_cond_signal(&job->workAvailable);
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*
+** Put the subdirectories of dirPath and the files to search on the stack.
+** Symbolic links to directories are not followed, they could lead back up
+** the tree.
+*/
+static void searchDirectory(findJob *job, const char *dirPath)
+{
+    char path[MAXPATHLEN];
+    const char *relPath;
+    struct dirent *ent;
+    struct stat statbuf;
+    size_t dirLen = strlen(dirPath), rootLen = strlen(job->root);
+    int isDir, isFile;
+    DIR *dir;
+
+    dir = opendir(*dirPath ? dirPath : "/");
+    if (dir == NULL)
+	return;
+    while ((ent = readdir(dir)) != NULL && !job->cancelled) {
+	if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+	    continue;
+	if (dirLen + strlen(ent->d_name) + 2 > sizeof(path))
+	    continue;
+	snprintf(path, sizeof(path), "%s/%s", dirPath, ent->d_name);
+	relPath = path + rootLen + 1;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	isDir = ent->d_type == DT_DIR;
+	isFile = ent->d_type == DT_REG;
+	if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK)
+#endif
+	{
+	    if (lstat(path, &statbuf) != 0)
+		continue;
+	    if (S_ISLNK(statbuf.st_mode) && stat(path, &statbuf) == 0 &&
+		    S_ISDIR(statbuf.st_mode))
+		continue;
+	    isDir = S_ISDIR(statbuf.st_mode);
+	    isFile = S_ISREG(statbuf.st_mode);
+	}
+
+	if (matchesGlobs(job->exclude, job->nExclude, ent->d_name, relPath))
+	    continue;
+	if (isDir)
+	    pushItem(job, path, True);
+	else if (isFile && matchesGlobs(job->include, job->nInclude,
+		ent->d_name, relPath))
+	    pushItem(job, path, False);
+    }
+    closedir(dir);
+}
+
+/*
+** Search a file, and append its matching lines to the output.  The file is
+** read into *buf (reused from file to file, and grown as needed), because
+** the search routines want null terminated text.
+*/
+static void searchFile(findJob *job, const SearchMatcher *matcher,
+	const char *path, char **buf, size_t *bufSize)
+{
+    char *text, *lineStart, *lineEnd, *countPos, *out = NULL;
+    int fd, beginPos, startPos, endPos, lineNum, nMatches = 0, outLen = 0;
+    int outAlloc = 0, len, textLen;
+    ssize_t nRead;
+    size_t size, total;
+    struct stat statbuf;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1)
+	return;
+    if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) ||
+	    statbuf.st_size >= INT_MAX) {
+	close(fd);
+	return;
+    }
+    size = statbuf.st_size;
+    if (size + 1 > *bufSize) {
+	NEditFree(*buf);
+	*bufSize = size + 1 > 65536 ? size + 1 : 65536;
+	*buf = (char *)NEditMalloc(*bufSize);
+    }
+    text = *buf;
+    for (total = 0; total < size; total += nRead) {
+	nRead = read(fd, text + total, size - total);
+	if (nRead == -1 && errno == EINTR)
+	    nRead = 0;
+	else if (nRead <= 0)
+	    break;
+    }
+    close(fd);
+    text[total] = '\0';
+
+    /* Skip binary files.  A null character further down ends the text. */
+    if (memchr(text, '\0', total < BINARY_PROBE_SIZE ? total :
+	    BINARY_PROBE_SIZE) != NULL) {
+	appendOutput(job, NULL, 0, 0, 1, 0);
+	return;
+    }
+    textLen = strlen(text);
+
+    /* Report every matching line once, counting lines only up to the
+       matches */
+    lineNum = 1;
+    countPos = text;
+    beginPos = 0;
+    while (beginPos <= textLen && !job->cancelled && SearchMatcherNext(
+	    matcher, text, beginPos, -1, &startPos, &endPos)) {
+	for (; countPos < text + startPos; countPos++)
+	    if (*countPos == '\n')
+		lineNum++;
+	for (lineStart = text + startPos; lineStart > text &&
+		lineStart[-1] != '\n'; lineStart--)
+	    ;
+	lineEnd = strchr(text + startPos, '\n');
+	if (lineEnd == NULL)
+	    lineEnd = text + textLen;
+	len = lineEnd - lineStart;
+	if (len > MAX_RESULT_LINE) {
+	    /* don't cut a UTF-8 character in two */
+	    for (len = MAX_RESULT_LINE; len > 0 &&
+		    (lineStart[len] & 0xC0) == 0x80; len--)
+		;
+	}
+
+	if (outLen + (int)strlen(path) + len + 24 > outAlloc) {
+	    outAlloc = 2 * outAlloc + strlen(path) + len + 24;
+	    out = (char *)NEditRealloc(out, outAlloc);
+	}
+	outLen += sprintf(out + outLen, "%s:%d: %.*s\n", path, lineNum, len,
+		lineStart);
+	nMatches++;
+
+	/* continue with the next line */
+	if (*lineEnd == '\0')
+	    break;
+	beginPos = lineEnd + 1 - text;
+    }
+
+    appendOutput(job, out, outLen, nMatches, 1, nMatches > 0);
+    NEditFree(out);
+}
+
+/*
+** Add the results of a file to the output queue, and wake up the main
+** thread if the queue was empty
+*/
+static void appendOutput(findJob *job, const char *text, int length,
+	int nMatches, int nFiles, int nFilesMatched)
+{
+    int wasEmpty;
+
+    pthread_mutex_lock(&job->lock);
+    job->nFiles += nFiles;
+    job->nFilesMatched += nFilesMatched;
+    job->nMatches += nMatches;
+    wasEmpty = job->outputLen == 0;
+    if (length > 0) {
+	if (job->outputLen + length + 1 > job->outputAlloc) {
+	    job->outputAlloc = 2 * job->outputAlloc + length + 1;
+	    job->output = (char *)NEditRealloc(job->output, job->outputAlloc);
+	}
+	memcpy(job->output + job->outputLen, text, length);
+	job->outputLen += length;
+	job->output[job->outputLen] = '\0';
+	if (wasEmpty && job->pipeFDs[1] != -1)
+	    write(job->pipeFDs[1], "", 1);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+/*
+** Whether a file or directory matches one of the patterns of a list.
+** Patterns containing a '/' are matched against the path relative to the
+** directory searched, others against the name only (like in .editorconfig
+** files).
+*/
+static int matchesGlobs(char **globs, int nGlobs, const char *name,
+	const char *relPath)
+{
+    int i;
+
+    for (i=0; i<nGlobs; i++)
+	if (globMatch(globs[i], strchr(globs[i], '/') ? relPath : name))
+	    return True;
+    return False;
+}
+
+static int globMatch(const char *pattern, const char *string)
+{
+    size_t patternLen, stringLen;
+
+    /* ec_glob compiles a regular expression on every call.  Names without
+       wildcards and "*.ext" patterns, which are most of them, are matched
+       directly. */
+    if (strpbrk(pattern, "*?[{\\") == NULL)
+	return !strcmp(pattern, string);
+    if (pattern[0] == '*' && strpbrk(pattern + 1, "*?[{\\/") == NULL) {
+	patternLen = strlen(pattern + 1);
+	stringLen = strlen(string);
+	return stringLen >= patternLen &&
+		!strcmp(string + stringLen - patternLen, pattern + 1);
+    }
+    return ec_glob(pattern, string) == 0;
+}
+
+/*
+** Split a list of patterns separated by white space.  No patterns means
+** all files.
+*/
+static char **splitGlobs(const char *string, int *nGlobs)
+{
+    char **globs;
+    const char *c, *start;
+    int n = 0;
+
+    globs = (char **)NEditMalloc(sizeof(char *) * (strlen(string) / 2 + 1));
+    for (c = string; *c != '\0'; ) {
+	while (*c == ' ' || *c == '\t' || *c == ',')
+	    c++;
+	for (start = c; *c != '\0' && *c != ' ' && *c != '\t' && *c != ','; c++)
+	    ;
+	if (c > start)
+	    globs[n++] = NEditStrndup(start, c - start);
+    }
+    *nGlobs = n;
+    return globs;
+}
+
+static void freeGlobs(char **globs, int nGlobs)
+{
+    int i;
+
+    for (i=0; i<nGlobs; i++)
+	NEditFree(globs[i]);
+    NEditFree(globs);
+}
+
+/*
+** Event handler of the results document, which opens the file of a line
+** when it is double clicked
+*/
+static void resultsClickEH(Widget w, XtPointer clientData, XEvent *event,
+	Boolean *continueDispatch)
+{
+    static Widget lastWidget = NULL;
+    static Time lastTime = 0;
+
+    if (event->xbutton.button != Button1)
+	return;
+    if (w == lastWidget && event->xbutton.time - lastTime <=
+	    (Time)XtGetMultiClickTime(XtDisplay(w))) {
+	lastWidget = NULL;
+	openResultAtCursor((WindowInfo *)clientData, w);
+    } else {
+	lastWidget = w;
+	lastTime = event->xbutton.time;
+    }
+}
+
+static void openResultAtCursor(WindowInfo *window, Widget textW)
+{
+    char filename[MAXPATHLEN], pathname[MAXPATHLEN], *line, *c, *end;
+    int pos, lineNum = 0;
+    WindowInfo *fileWindow;
+    textBuffer *buf = window->buffer;
+
+    pos = TextGetCursorPos(textW);
+    line = BufGetRange(buf, BufStartOfLine(buf, pos), BufEndOfLine(buf, pos));
+
+    /* The file name ends at the first ":<line number>:" */
+    for (c = strchr(line, ':'); c != NULL; c = strchr(c + 1, ':')) {
+	if (isdigit((unsigned char)c[1])) {
+	    lineNum = strtol(c + 1, &end, 10);
+	    if (*end == ':')
+		break;
+	}
+    }
+    if (c == NULL || *line != '/') {
+	NEditFree(line);
+	return;
+    }
+    *c = '\0';
+    if (ParseFilename(line, filename, pathname) != 0) {
+	NEditFree(line);
+	return;
+    }
+    NEditFree(line);
+
+    fileWindow = EditExistingFile(GetPrefOpenInTab() ? window : NULL,
+	    filename, pathname, NULL, GetFilterNameForPath(pathname, filename),
+	    0, NULL, False, NULL, GetPrefOpenInTab(), False);
+    if (fileWindow != NULL)
+	SelectNumberedLine(fileWindow, lineNum);
+    CheckCloseDim();
+}
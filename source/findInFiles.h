@@ -0,0 +1,30 @@
+/*******************************************************************************
+*                                                                              *
+* findInFiles.h -- Nirvana Editor search through the files of a directory      *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+#ifndef XNEDIT_FINDINFILES_H
+#define XNEDIT_FINDINFILES_H
+
+#include "nedit.h"
+
+void DoFindInFilesDlog(WindowInfo *window);
+void RemoveFromFindInFiles(WindowInfo *doomedWindow);
+
+#endif /* XNEDIT_FINDINFILES_H */
@@ -129,6 +129,13 @@ static char * htxt_start [] = {
 "\"main\" window.  It remains running as long as at least one editor window is ",
 "open. ",
 "\n\n",
+"Files are read and saved in the background.  If that takes more than a ",
+"moment, for example with a large file on a slow network file system, a ",
+"dialog shows the progress, and its Cancel button stops it.  The document is ",
+"read-only until then, while other documents can be used as usual. ",
+"Cancelling a save removes the partially written file, and the document keeps ",
+"its unsaved changes. ",
+"\n\n",
 "\01RCreating a New File\01I",
 "\n\n",
 "If you already have an empty (Untitled) window displayed, just begin typing ",
@@ -297,7 +304,25 @@ static char * htxt_search [] = {
 "another dialog where you can pick any document in which the replacement should ",
 "take place. Then press 'Replace' in this dialog to do the replacement. All ",
 "attributes (Regular Expression, Case, etc.) are used as selected in the main ",
-"dialog. ",
+"dialog.  The documents are searched in parallel, and a bar in the dialog ",
+"shows the progress of the replacement.  'Cancel' stops it, leaving the ",
+"documents which were not done yet unchanged. ",
+"\n\n",
+"\01RSearching Multiple Files\01I",
+"\n\n",
+"Find in Files... from the Search menu searches all files in a directory and ",
+"its subdirectories, including files which are not open.  Enter the string to ",
+"find, the directory, and the names of the files to search, separated by ",
+"spaces (for example \"*.c *.h\").  Files and directories named in the last ",
+"field are skipped, like the version control directories by default.  Names ",
+"may use the wildcards of .editorconfig files, and names containing a '/' are ",
+"matched against the path below the searched directory.  Binary files are not ",
+"searched. ",
+"\n\n",
+"The matching lines are listed in a new document, as \"file:line: text\", while ",
+"the search goes on.  Double clicking a line opens the file at that line. ",
+"The 'Stop' button of the dialog ends the search, as does closing the ",
+"document. ",
 "\n\n",
 NULL
 };
@@ -2321,6 +2346,12 @@ static char * htxt_macro_subrs [] = {
 "\01A\01B$line\01A\n",
 "\01ILine number of the cursor position in the current window. ",
 "\n\n",
+"\01A\01B$load_times\01A\n",
+"\01IThe milliseconds spent in each phase of loading the current document, ",
+"as \"detect n read n convert n line_endings n buffer n\": detecting the ",
+"character encoding, reading the file, converting it to UTF-8, converting ",
+"line endings, and filling the text buffer. ",
+"\n\n",
 "\01A\01B$locked\01A\n",
 "\01ITrue if the file has been locked by the user. ",
 "\n\n",
@@ -2397,6 +2428,10 @@ static char * htxt_macro_subrs [] = {
 "\01A\01B$top_line\01A\n",
 "\01IThe line number of the top line of the currently active pane. ",
 "\n\n",
+"\01A\01B$undo_memory\01A\n",
+"\01IThe number of bytes used by the undo and redo information of the current ",
+"document. ",
+"\n\n",
 "\01A\01B$use_tabs\01A\n",
 "\01IWhether the user is allowing the XNEdit to insert tab characters to maintain ",
 "spacing in tab emulation and rectangular dragging operations. (The setting of ",
@@ -3104,6 +3139,11 @@ static char * htxt_actions [] = {
 "0 or less translates to no emulated tabs. Em-tab-distance must ",
 "be smaller than 1000. ",
 "\n\n",
+"\01A\01Bset_follow_file( [0 | 1] )\01A\n",
+"\01ISet whether the file of the current window is followed as it grows. ",
+"A value of 0 turns it off and a value of 1 turns it on. ",
+"If no parameters are supplied the option is toggled. ",
+"\n\n",
 "\01A\01Bset_fonts( font-name, italic-font-name, bold-font-name, bold-italic-font-name )\01A\n",
 "\01ISet all the fonts used for the current window. ",
 "\n\n",
@@ -3628,6 +3668,14 @@ static char * htxt_preferences [] = {
 "file from being modified in this XNEdit session. Note that this is different ",
 "from setting the file protection. ",
 "\n\n",
+"\01A\01BFollow File\01A\n",
+"\01IKeep reading the file as other programs append to it, like \"tail -f\" does, ",
+"for watching log files.  New text is added to the end of the window as it ",
+"is written, without asking to reload the file, and windows showing the end ",
+"of the text keep showing it.  If the file is truncated, or replaced by a new ",
+"one (as log rotation does), it is read again.  Files read through a filter ",
+"can't be followed. ",
+"\n\n",
 "\01RPreferences -> Default Settings Menu\01I",
 "\n\n",
 "Options in the Preferences -> Default Settings menu have the same meaning as ",
@@ -3753,7 +3801,9 @@ static char * htxt_preferences [] = {
 "\n\n",
 "\01KCheck Modified File Contents\01I - ",
 "If external file modification warnings are requested, also check the file ",
-"contents iso. only the modification date. ",
+"contents iso. only the modification date.  The contents are compared with ",
+"what XNEdit last read or wrote, so a file that was only touched, or checked ",
+"out again unchanged, brings up no warning. ",
 "\n\n",
 "\01KOn Exit\01I - ",
 "Ask before exiting when two or more files are open in an XNEdit session ",
@@ -4137,6 +4187,15 @@ static char * htxt_resources [] = {
 "set to False, the \"Case Sensitive\" buttons are independent of the \"Regular ",
 "Expression\" toggle. ",
 "\n\n",
+"\01A\01Bnedit.regexStepBudget\01A: 10000000\n",
+"\01I\n",
+"Maximum number of steps a regular expression search may take, in addition ",
+"to a few steps for every position of the text a match is tried at.  Some ",
+"expressions need exponential time on certain text.  When the limit is ",
+"exceeded, searches report that the pattern is too expensive, and syntax ",
+"highlighting leaves the affected text plain, instead of freezing XNEdit.  Set ",
+"it to 0 to remove the limit. ",
+"\n\n",
 "\01A\01Bnedit.multiClickTime\01A: (system specific)\n",
 "\01I\n",
 "Maximum time in milliseconds allowed between mouse clicks within double and ",
@@ -4148,6 +4207,18 @@ static char * htxt_resources [] = {
 "action.  Set this resource to False if you don't want your selection to be ",
 "touched. ",
 "\n\n",
+"\01A\01Bnedit.undoMemoryLimit\01A: 100000000\n",
+"\01I\n",
+"The number of bytes the undo and redo information of each document may use. ",
+"Past this, the oldest undo steps are dropped.  Older undo steps are kept ",
+"compressed.  Set this resource to 0 for no limit. ",
+"\n\n",
+"\01A\01Bnedit.undoJournal\01A: False\n",
+"\01I\n",
+"Record the changes made to each file in a journal (`~filename.journal`), ",
+"kept on the disk in place of the backup file, and offer to recover them when ",
+"the file is opened after a crash.  See \01QCrash Recovery\01I. ",
+"\n\n",
 "\01A\01Bnedit*scrollBarPlacement\01A: BOTTOM_RIGHT\n",
 "\01I\n",
 "How scroll bars are placed in XNEdit windows, as well as various lists and ",
@@ -5120,6 +5191,19 @@ static char * htxt_recovery [] = {
 "the backup file will be in Unix format, and you will need to open the backup ",
 "file in XNEdit and change the file format back to MS DOS via the Save As... ",
 "dialog (or use the Unix unix2dos command outside of XNEdit). ",
+"\n\n",
+"So that large files can be backed up as often, XNEdit only writes the whole ",
+"backup file now and then, and adds the changes made in between to a second ",
+"file, `~filename.delta`.  When a backup file is opened in XNEdit with its ",
+"delta file next to it, XNEdit offers to apply these changes, to bring back ",
+"the text as it was last backed up.  Renaming the backup file as above ",
+"leaves them out. ",
+"\n\n",
+"With the undoJournal resource set to True (see \01QX Resources\01I), ",
+"XNEdit instead records each change in a journal next to the file, named ",
+"`~filename.journal`, which only grows by what was changed.  When the file is ",
+"opened again after a crash, XNEdit offers to replay the recorded changes on ",
+"top of it.  The recovered changes can be undone like any others. ",
 NULL
 };
 
@@ -1782,6 +1782,16 @@ static int parseString(highlightDataRec *pattern, const char **string,
 	}
     }
     
+    /* If the patterns were too expensive to match here (see SetREStepBudget),
+       leave the rest of the region plain instead of hanging or guessing */
+    if (!anchored && GetREExecStatus() != REEXEC_OK) {
+        fillStyleString(&stringPtr, &stylePtr, *string+length, PLAIN_STYLE,
+                prevChar);
+        *string = stringPtr;
+        *styleString = stylePtr;
+        return False;
+    }
+    
     /* If this is an anchored match (must match on first character), and
        nothing matched, return False */
     if (anchored && stringPtr == *string)
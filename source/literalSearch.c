@@ -0,0 +1,391 @@
+/*******************************************************************************
+*                                                                              *
+* literalSearch.c -- Nirvana Editor literal string search                      *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+/*
+** The search kernel behind literal Find, Replace and incremental search.
+**
+** Case sensitive search strings, and case insensitive ones made of ASCII
+** characters only, always match the same number of bytes.  These are found
+** with Horspool's algorithm, comparing bytes through a folding table and
+** skipping ahead by the byte under the last (or, backwards, the first)
+** pattern position.  Other case insensitive search strings are matched
+** character by character after folding both sides to lower case, so that
+** e.g. "STRASSE" with a capital sharp s finds "straße"; a table of the bytes
+** which can start a match filters the candidate positions.
+**
+** Non-ASCII characters never fold to ASCII ones (the Kelvin sign and the
+** dotted capital I only match themselves), which keeps ASCII search strings
+** on the fast path.  Folding of other characters follows towlower in the
+** locale of the first search.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include "literalSearch.h"
+#include "../util/nedit_malloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <wctype.h>
+#include <pthread.h>
+
+#ifdef HAVE_DEBUG_H
+#include "../debug.h"
+#endif
+
+#define FOLD_TABLE_SIZE 0x800   /* code points with precomputed folding */
+#define TEXT_CHUNK_MIN 256      /* bytes first checked for the end of text */
+#define TEXT_CHUNK_MAX 65536    /* largest chunk checked for the end of text */
+#define RAW_BYTE 0x110000       /* invalid UTF-8 bytes decode to this + byte */
+
+struct _LiteralPattern {
+    unsigned char *bytes;       /* search string, ASCII folded unless case
+                                   sensitive */
+    size_t len;                 /* length of bytes */
+    int caseSense;
+    int fixed;                  /* matches are the bytes, through the
+                                   folding table */
+    unsigned int *chars;        /* folded characters, when not fixed */
+    size_t nChars;
+    unsigned char start[256];   /* bytes which can start a match */
+    size_t skipFw[256];         /* Horspool shifts, forward and backward */
+    size_t skipBw[256];
+};
+
+static void initFoldTables(void);
+static unsigned int foldSlow(unsigned int c);
+static size_t decodeChar(const unsigned char *s, unsigned int *c);
+static void setByte(unsigned char *table, int c, unsigned char value,
+        int caseSense);
+static void setShift(size_t *skip, int c, size_t shift, int caseSense);
+static const char *matchFolded(const LiteralPattern *pattern, const char *s);
+static const char *findFixed(const LiteralPattern *pattern, const char *from,
+        const char *to, const char **matchEnd);
+static const char *findFixedBackward(const LiteralPattern *pattern,
+        const char *first, const char *last, const char **matchEnd);
+
+static unsigned char Identity[256];
+static unsigned char AsciiFold[256];
+static unsigned int FoldTable[FOLD_TABLE_SIZE];
+static pthread_once_t FoldTablesOnce = PTHREAD_ONCE_INIT;
+
+static void initFoldTables(void)
+{
+    unsigned int c;
+
+    for (c = 0; c < 256; c++) {
+        Identity[c] = c;
+        AsciiFold[c] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    for (c = 0; c < FOLD_TABLE_SIZE; c++) {
+        FoldTable[c] = foldSlow(c);
+    }
+}
+
+static unsigned int foldSlow(unsigned int c)
+{
+    wint_t lower;
+
+    if (c < 0x80) {
+        return AsciiFold[c];
+    } else if (c >= RAW_BYTE) {
+        return c;
+    }
+    lower = towlower((wint_t)c);
+    return lower < 0x80 ? c : (unsigned int)lower;
+}
+
+#define foldChar(c) ((c) < FOLD_TABLE_SIZE ? FoldTable[c] : foldSlow(c))
+
+/*
+** Decodes the UTF-8 character at "s".  Bytes which don't start a valid
+** sequence decode on their own, to RAW_BYTE plus the byte value.  Never
+** reads past a NUL.
+*/
+static size_t decodeChar(const unsigned char *s, unsigned int *c)
+{
+    unsigned int value;
+    size_t len, i;
+
+    if (s[0] < 0x80) {
+        *c = s[0];
+        return 1;
+    } else if (s[0] >= 0xC2 && s[0] < 0xE0) {
+        len = 2;
+        value = s[0] & 0x1F;
+    } else if (s[0] >= 0xE0 && s[0] < 0xF0) {
+        len = 3;
+        value = s[0] & 0x0F;
+    } else if (s[0] >= 0xF0 && s[0] < 0xF5) {
+        len = 4;
+        value = s[0] & 0x07;
+    } else {
+        *c = RAW_BYTE + s[0];
+        return 1;
+    }
+    for (i = 1; i < len; i++) {
+        if ((s[i] & 0xC0) != 0x80) {
+            *c = RAW_BYTE + s[0];
+            return 1;
+        }
+        value = (value << 6) | (s[i] & 0x3F);
+    }
+    *c = value;
+    return len;
+}
+
+/* Sets the entries of a byte and, if case insensitive, its other case */
+static void setByte(unsigned char *table, int c, unsigned char value,
+        int caseSense)
+{
+    table[c] = value;
+    if (!caseSense && c >= 'a' && c <= 'z') {
+        table[c - 'a' + 'A'] = value;
+    }
+}
+
+static void setShift(size_t *skip, int c, size_t shift, int caseSense)
+{
+    skip[c] = shift;
+    if (!caseSense && c >= 'a' && c <= 'z') {
+        skip[c - 'a' + 'A'] = shift;
+    }
+}
+
+LiteralPattern *CompileLiteral(const char *searchString, int caseSense)
+{
+    LiteralPattern *pattern = NEditNew(LiteralPattern);
+    const unsigned char *s = (const unsigned char*)searchString;
+    const unsigned char *map;
+    size_t i, len = strlen(searchString);
+    int c;
+
+    pthread_once(&FoldTablesOnce, initFoldTables);
+    map = caseSense ? Identity : AsciiFold;
+
+    memset(pattern, 0, sizeof(LiteralPattern));
+    pattern->len = len;
+    pattern->caseSense = caseSense;
+    pattern->fixed = 1;
+    pattern->bytes = (unsigned char*)NEditMalloc(len + 1);
+    for (i = 0; i <= len; i++) {
+        pattern->bytes[i] = map[s[i]];
+        if (!caseSense && s[i] >= 0x80) {
+            pattern->fixed = 0;
+        }
+    }
+    if (len == 0) {
+        return pattern;
+    }
+
+    if (pattern->fixed) {
+        for (c = 0; c < 256; c++) {
+            pattern->skipFw[c] = len;
+            pattern->skipBw[c] = len;
+        }
+        for (i = 0; i < len - 1; i++) {
+            setShift(pattern->skipFw, pattern->bytes[i], len - 1 - i,
+                    caseSense);
+        }
+        for (i = len - 1; i > 0; i--) {
+            setShift(pattern->skipBw, pattern->bytes[i], i, caseSense);
+        }
+        setByte(pattern->start, pattern->bytes[0], 1, caseSense);
+    } else {
+        pattern->chars = (unsigned int*)NEditMalloc(
+                sizeof(unsigned int) * len);
+        for (i = 0; i < len; ) {
+            unsigned int ch;
+            i += decodeChar(s + i, &ch);
+            pattern->chars[pattern->nChars++] = foldChar(ch);
+        }
+
+        /* Any upper or lower case form of a multi-byte character can be
+           encoded with a different lead byte */
+        c = pattern->chars[0];
+        if (c < 0x80) {
+            setByte(pattern->start, c, 1, 0);
+        } else if (c >= RAW_BYTE) {
+            pattern->start[c - RAW_BYTE] = 1;
+        } else {
+            memset(pattern->start + 0xC2, 1, 0xF5 - 0xC2);
+        }
+    }
+    return pattern;
+}
+
+void FreeLiteral(LiteralPattern *pattern)
+{
+    if (pattern == NULL) {
+        return;
+    }
+    NEditFree(pattern->bytes);
+    NEditFree(pattern->chars);
+    NEditFree(pattern);
+}
+
+/*
+** Returns the end of the match of a case folded pattern at "s", or NULL.
+*/
+static const char *matchFolded(const LiteralPattern *pattern, const char *s)
+{
+    const unsigned char *u = (const unsigned char*)s;
+    unsigned int c;
+    size_t i;
+
+    for (i = 0; i < pattern->nChars; i++) {
+        u += decodeChar(u, &c);
+        if (foldChar(c) != pattern->chars[i]) {
+            return NULL;
+        }
+    }
+    return (const char*)u;
+}
+
+const char *FindLiteral(const LiteralPattern *pattern, const char *from,
+        const char *to, const char **matchEnd)
+{
+    const unsigned char *s;
+    const char *end;
+
+    if (pattern->len == 0) {
+        return NULL;
+    } else if (pattern->fixed) {
+        return findFixed(pattern, from, to, matchEnd);
+    }
+
+    for (s = (const unsigned char*)from; *s != 0; s++) {
+        if (to != NULL && (const char*)s > to) {
+            break;
+        }
+        if (pattern->start[*s] &&
+                (end = matchFolded(pattern, (const char*)s)) != NULL) {
+            *matchEnd = end;
+            return (const char*)s;
+        }
+    }
+    return NULL;
+}
+
+const char *FindLiteralBackward(const LiteralPattern *pattern,
+        const char *first, const char *last, const char **matchEnd)
+{
+    const unsigned char *s;
+    const char *end;
+
+    if (pattern->len == 0 || last < first) {
+        return NULL;
+    } else if (pattern->fixed) {
+        return findFixedBackward(pattern, first, last, matchEnd);
+    }
+
+    for (s = (const unsigned char*)last; ; s--) {
+        if (pattern->start[*s] &&
+                (end = matchFolded(pattern, (const char*)s)) != NULL) {
+            *matchEnd = end;
+            return (const char*)s;
+        }
+        if ((const char*)s == first) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+** Forward Horspool search.  The text is only known to go on as far as it has
+** been checked for its terminating NUL, which is done a chunk at a time so
+** the cost stays proportional to the distance to the match.  Chunks start
+** small, so that closely spaced matches don't each pay for a large one.
+*/
+static const char *findFixed(const LiteralPattern *pattern, const char *from,
+        const char *to, const char **matchEnd)
+{
+    const unsigned char *map = pattern->caseSense ? Identity : AsciiFold;
+    const unsigned char *bytes = pattern->bytes;
+    const unsigned char *s = (const unsigned char*)from;
+    const unsigned char *known = s;
+    size_t len = pattern->len, chunk = TEXT_CHUNK_MIN, i;
+
+    for (;;) {
+        if (to != NULL && (const char*)s > to) {
+            return NULL;
+        }
+        if (s + len > known) {
+            known += strnlen((const char*)known, chunk + len);
+            if (s + len > known) {
+                return NULL;
+            }
+            if (chunk < TEXT_CHUNK_MAX) {
+                chunk *= 2;
+            }
+        }
+        if (map[s[len - 1]] == bytes[len - 1]) {
+            for (i = 0; i < len - 1 && map[s[i]] == bytes[i]; i++);
+            if (i == len - 1) {
+                *matchEnd = (const char*)s + len;
+                return (const char*)s;
+            }
+        }
+        s += pattern->skipFw[s[len - 1]];
+    }
+}
+
+/*
+** Backward Horspool search: the shift is looked up with the text byte under
+** the first pattern position, and is the distance to the nearest other
+** pattern position accepting it.
+*/
+static const char *findFixedBackward(const LiteralPattern *pattern,
+        const char *first, const char *last, const char **matchEnd)
+{
+    const unsigned char *map = pattern->caseSense ? Identity : AsciiFold;
+    const unsigned char *bytes = pattern->bytes;
+    const unsigned char *s;
+    size_t len = pattern->len, i, shift;
+
+    /* Don't let a match run past the end of the text */
+    s = (const unsigned char*)last + strnlen(last, len);
+    if ((size_t)(s - (const unsigned char*)first) < len) {
+        return NULL;
+    }
+    s -= len;
+    if (s > (const unsigned char*)last) {
+        s = (const unsigned char*)last;
+    }
+
+    for (;;) {
+        if (map[s[0]] == bytes[0]) {
+            for (i = 1; i < len && map[s[i]] == bytes[i]; i++);
+            if (i == len) {
+                *matchEnd = (const char*)s + len;
+                return (const char*)s;
+            }
+        }
+        shift = pattern->skipBw[s[0]];
+        if ((size_t)(s - (const unsigned char*)first) < shift) {
+            return NULL;
+        }
+        s -= shift;
+    }
+}
@@ -0,0 +1,46 @@
+/*******************************************************************************
+*                                                                              *
+* literalSearch.h -- Nirvana Editor literal string search                      *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+#ifndef XNEDIT_LITERALSEARCH_H
+#define XNEDIT_LITERALSEARCH_H
+
+#include <stddef.h>
+
+/* A search string prepared for FindLiteral and FindLiteralBackward.  Case
+   insensitive patterns match UTF-8 text character by character after case
+   folding, so a match may differ in length from the search string. */
+typedef struct _LiteralPattern LiteralPattern;
+
+LiteralPattern *CompileLiteral(const char *searchString, int caseSense);
+void FreeLiteral(LiteralPattern *pattern);
+
+/* Searches the NUL terminated text for the first match starting between
+   "from" and "to" (inclusive, NULL for the end of the text).  Returns the
+   start of the match and sets "matchEnd", or returns NULL. */
+const char *FindLiteral(const LiteralPattern *pattern, const char *from,
+        const char *to, const char **matchEnd);
+
+/* Like FindLiteral, but returns the last match starting between "first" and
+   "last", scanning backwards from "last". */
+const char *FindLiteralBackward(const LiteralPattern *pattern,
+        const char *first, const char *last, const char **matchEnd);
+
+#endif /* XNEDIT_LITERALSEARCH_H */
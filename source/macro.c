@@ -339,6 +339,10 @@ static int useTabsMV(WindowInfo *window, DataValue *argList, int nArgs,
     	DataValue *result, char **errMsg);
 static int modifiedMV(WindowInfo *window, DataValue *argList, int nArgs,
     	DataValue *result, char **errMsg);
+static int undoMemoryMV(WindowInfo *window, DataValue *argList, int nArgs,
+    	DataValue *result, char **errMsg);
+static int loadTimesMV(WindowInfo *window, DataValue *argList, int nArgs,
+    	DataValue *result, char **errMsg);
 static int languageModeMV(WindowInfo *window, DataValue *argList, int nArgs,
     	DataValue *result, char **errMsg);
 static int calltipIDMV(WindowInfo *window, DataValue *argList, int nArgs,
@@ -442,8 +446,8 @@ static const char *MacroSubrNames[N_MACRO_SUBRS] = {"length", "get_range", "t_pr
 static BuiltInSubr SpecialVars[] = {cursorMV, lineMV, columnMV,
         fileNameMV, filePathMV, lengthMV, selectionStartMV, selectionEndMV,
         selectionLeftMV, selectionRightMV, wrapMarginMV, tabDistMV,
-        emTabDistMV, useTabsMV, languageModeMV, modifiedMV,
-        statisticsLineMV, incSearchLineMV, showLineNumbersMV,
+        emTabDistMV, useTabsMV, languageModeMV, modifiedMV, undoMemoryMV,
+        loadTimesMV, statisticsLineMV, incSearchLineMV, showLineNumbersMV,
         autoIndentMV, wrapTextMV, highlightSyntaxMV,
         makeBackupCopyMV, incBackupMV, showMatchingMV, matchSyntaxBasedMV,
         overTypeModeMV, readOnlyMV, lockedMV, fileFormatMV,
@@ -460,8 +464,8 @@ static const char *SpecialVarNames[N_SPECIAL_VARS] = {"$cursor", "$line", "$colu
         "$file_name", "$file_path", "$text_length", "$selection_start",
         "$selection_end", "$selection_left", "$selection_right",
         "$wrap_margin", "$tab_dist", "$em_tab_dist", "$use_tabs",
-        "$language_mode", "$modified",
-        "$statistics_line", "$incremental_search_line", "$show_line_numbers",
+        "$language_mode", "$modified", "$undo_memory",
+        "$load_times", "$statistics_line", "$incremental_search_line", "$show_line_numbers",
         "$auto_indent", "$wrap_text", "$highlight_syntax",
         "$make_backup_copy", "$incremental_backup", "$show_matching", "$match_syntax_based",
         "$overtype_mode", "$read_only", "$locked", "$file_format",
@@ -4501,6 +4505,29 @@ static int modifiedMV(WindowInfo *window, DataValue *argList, int nArgs,
     return True;
 }
 
+static int undoMemoryMV(WindowInfo *window, DataValue *argList, int nArgs,
+    	DataValue *result, char **errMsg)
+{
+    result->tag = INT_TAG;
+    result->val.n = window->undoMemUsed + window->redoMemUsed;
+    return True;
+}
+
+static int loadTimesMV(WindowInfo *window, DataValue *argList, int nArgs,
+    	DataValue *result, char **errMsg)
+{
+    char str[200];
+    
+    snprintf(str, sizeof(str),
+            "detect %.3f read %.3f convert %.3f line_endings %.3f buffer %.3f",
+            window->loadTime[LOAD_DETECT], window->loadTime[LOAD_READ],
+            window->loadTime[LOAD_CONVERT], window->loadTime[LOAD_LINE_ENDINGS],
+            window->loadTime[LOAD_BUFFER]);
+    result->tag = STRING_TAG;
+    AllocNStringCpy(&result->val.str, str);
+    return True;
+}
+
 static int languageModeMV(WindowInfo *window, DataValue *argList, int nArgs,
     	DataValue *result, char **errMsg)
 {
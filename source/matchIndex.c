@@ -0,0 +1,540 @@
+/*******************************************************************************
+*                                                                              *
+* matchIndex.c -- Nirvana Editor highlighting of all search matches            *
+*                                                                              *
+* This is free software; you can redistribute it and/or modify it under the    *
+* terms of the GNU General Public License as published by the Free Software    *
+* Foundation; either version 2 of the License, or (at your option) any later   *
+* version. In addition, you may distribute versions of this program linked to  *
+* Motif or Open Motif. See README for details.                                 *
+*                                                                              *
+* This software is distributed in the hope that it will be useful, but WITHOUT *
+* ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or        *
+* FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for    *
+* more details.                                                                *
+*                                                                              *
+* You should have received a copy of the GNU General Public License along with *
+* software; if not, write to the Free Software Foundation, Inc., 59 Temple     *
+* Place, Suite 330, Boston, MA  02111-1307 USA                                 *
+*                                                                              *
+*******************************************************************************/
+
+/*
+** The match index keeps the positions of every match of the last search
+** string in a window, so all of them can be highlighted and the i-search
+** bar can show which match is selected ("3 of 12,408").  The index is
+** filled from an Xt work procedure, a slice at a time, and is kept up to
+** date through a buffer modify callback which only searches the lines
+** around each change again.  Matches are drawn through a rangeset of their
+** own, so the text display colors them like any other rangeset.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "../config.h"
+#endif
+
+#include "matchIndex.h"
+#include "textBuf.h"
+#include "search.h"
+#include "window.h"
+#include "rangeset.h"
+#include "preferences.h"
+#include "colorprofile.h"
+#include "../util/nedit_malloc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Xm/Xm.h>
+#include <Xm/Label.h>
+
+#ifdef HAVE_DEBUG_H
+#include "../debug.h"
+#endif
+
+/* Text searched and matches collected by one call of the work procedure */
+#define FILL_SLICE 262144
+#define FILL_MAX_MATCHES 4096
+
+/* Changes spanning more text than this are not searched again right away,
+   the index is cut back and refilled in the background instead */
+#define MAX_RESCAN 65536
+
+#define MATCH_RANGESET_NAME "search_matches"
+
+typedef struct {
+    int start, end;
+} matchRange;
+
+typedef struct {
+    WindowInfo *window;
+    char *searchString;
+    int searchType;
+    int label;			/* rangeset label, 0 if none was available */
+    matchRange *matches;	/* matches in buffer order, never overlapping */
+    int nMatches;
+    int allocMatches;
+    int fillPos;		/* matches starting before fillPos are known */
+    XtWorkProcId fillProcID;	/* 0 once the whole buffer was searched */
+    const char *fillText;	/* buffer text searched by the work procedure,
+    				   NULL after a change to the buffer */
+} matchIndex;
+
+static matchIndex *createIndex(WindowInfo *window, const char *searchString,
+        int searchType);
+static void freeIndex(matchIndex *index);
+static Rangeset *getRangeset(matchIndex *index);
+static void startFill(matchIndex *index);
+static Boolean fillWorkProc(XtPointer clientData);
+static void addMatch(matchIndex *index, int i, int start, int end);
+static void removeMatches(matchIndex *index, int first, int last);
+static int firstEndingAtOrAfter(matchIndex *index, int pos);
+static int firstStartingAfter(matchIndex *index, int pos);
+static void truncateIndex(matchIndex *index, int pos);
+static void rescanRegion(matchIndex *index, int first, int regionStart,
+        int regionEnd);
+static void matchIndexModifiedCB(int pos, int nInserted, int nDeleted,
+        int nRestyled, const char *deletedText, void *cbArg);
+static void formatCount(char *buf, int n);
+
+/*
+** Highlight all matches of "searchString" in "window" (if the preference
+** is set), replacing any earlier search string.  Does nothing if the same
+** string is already indexed.
+*/
+void SetMatchIndex(WindowInfo *window, const char *searchString,
+        int searchType)
+{
+    matchIndex *index = (matchIndex *)window->matchIndex;
+
+    if (!GetPrefHighlightMatches() || searchString[0] == '\0') {
+        ClearMatchIndex(window);
+        return;
+    }
+    if (index != NULL && index->searchType == searchType &&
+            !strcmp(index->searchString, searchString))
+        return;
+
+    ClearMatchIndex(window);
+    window->matchIndex = createIndex(window, searchString, searchType);
+    UpdateMatchCount(window);
+}
+
+/*
+** Remove the match highlighting from "window" and free the index.
+*/
+void ClearMatchIndex(WindowInfo *window)
+{
+    if (window->matchIndex == NULL)
+        return;
+    freeIndex((matchIndex *)window->matchIndex);
+    window->matchIndex = NULL;
+    UpdateMatchCount(window);
+}
+
+/*
+** Set up the match index of a newly cloned document, whose rangeset table
+** was copied from "orgWin" including the original's match rangeset.
+*/
+void CloneMatchIndex(WindowInfo *window, WindowInfo *orgWin)
+{
+    matchIndex *orgIndex = (matchIndex *)orgWin->matchIndex;
+
+    window->matchIndex = NULL;
+    if (orgIndex == NULL)
+        return;
+    if (orgIndex->label != 0 && window->buffer->rangesetTable != NULL)
+        RangesetForget(window->buffer->rangesetTable, orgIndex->label);
+    SetMatchIndex(window, orgIndex->searchString, orgIndex->searchType);
+}
+
+/*
+** Show the number of matches, and which one is selected, in the incremental
+** search bar.  Like the statistics line, this is updated on every cursor
+** movement.
+*/
+void UpdateMatchCount(WindowInfo *window)
+{
+    matchIndex *index = (matchIndex *)window->matchIndex;
+    char count[64], total[24], current[24];
+    int selStart, selEnd, isRect, rectStart, rectEnd, i;
+    XmString s1;
+
+    if (!IsTopDocument(window) || window->iSearchCountLabel == NULL)
+        return;
+
+    count[0] = '\0';
+    if (index != NULL) {
+        formatCount(total, index->nMatches);
+        i = -1;
+        if (BufGetSelectionPos(window->buffer, &selStart, &selEnd, &isRect,
+                &rectStart, &rectEnd) && !isRect) {
+            i = firstEndingAtOrAfter(index, selEnd);
+            if (i >= index->nMatches || index->matches[i].start != selStart
+                    || index->matches[i].end != selEnd)
+                i = -1;
+        }
+        if (i >= 0) {
+            formatCount(current, i + 1);
+            sprintf(count, "%s of %s%s", current, total,
+                    index->fillProcID ? "+" : "");
+        } else {
+            sprintf(count, "%s%s %s", total, index->fillProcID ? "+" : "",
+                    index->nMatches == 1 ? "match" : "matches");
+        }
+    }
+
+    XtVaSetValues(window->iSearchCountLabel,
+            XmNlabelString, s1=XmStringCreateSimple(count), NULL);
+    XmStringFree(s1);
+}
+
+static matchIndex *createIndex(WindowInfo *window, const char *searchString,
+        int searchType)
+{
+    matchIndex *index = (matchIndex *)NEditMalloc(sizeof(matchIndex));
+    textBuffer *buf = window->buffer;
+    Rangeset *rangeset;
+
+    index->window = window;
+    index->searchString = NEditStrdup(searchString);
+    index->searchType = searchType;
+    index->matches = NULL;
+    index->nMatches = 0;
+    index->allocMatches = 0;
+    index->fillPos = 0;
+    index->fillProcID = 0;
+    index->fillText = NULL;
+
+    /* Without a free rangeset the matches are still counted, just not
+       drawn */
+    index->label = 0;
+    if (buf->rangesetTable == NULL)
+        buf->rangesetTable = RangesetTableAlloc(buf);
+    if (nRangesetsAvailable(buf->rangesetTable) > 0)
+        index->label = RangesetCreate(buf->rangesetTable);
+    rangeset = getRangeset(index);
+    if (rangeset != NULL) {
+        RangesetAssignName(rangeset, MATCH_RANGESET_NAME);
+        if (window->colorProfile && window->colorProfile->hiliteBg)
+            RangesetAssignColorName(rangeset, window->colorProfile->hiliteBg);
+    }
+
+    BufAddModifyCB(buf, matchIndexModifiedCB, index);
+    startFill(index);
+    return index;
+}
+
+static void freeIndex(matchIndex *index)
+{
+    textBuffer *buf = index->window->buffer;
+
+    if (index->fillProcID != 0)
+        XtRemoveWorkProc(index->fillProcID);
+    BufRemoveModifyCB(buf, matchIndexModifiedCB, index);
+    if (getRangeset(index) != NULL)
+        RangesetForget(buf->rangesetTable, index->label);
+    NEditFree(index->matches);
+    NEditFree(index->searchString);
+    NEditFree(index);
+}
+
+/*
+** Return the rangeset drawing the matches, or NULL if there is none (also
+** when a macro destroyed it).
+*/
+static Rangeset *getRangeset(matchIndex *index)
+{
+    RangesetTable *table = index->window->buffer->rangesetTable;
+
+    if (index->label == 0 || table == NULL)
+        return NULL;
+    return RangesetFetch(table, index->label);
+}
+
+static void startFill(matchIndex *index)
+{
+    if (index->fillProcID != 0)
+        return;
+    index->fillProcID = XtAppAddWorkProc(
+            XtWidgetToApplicationContext(index->window->textArea),
+            fillWorkProc, index);
+}
+
+/*
+** Work procedure searching the next slice of the buffer.  Returns True
+** (stopping the work procedure) when the end of the buffer was reached.
+** Only matches starting in the slice are looked for, so a slice takes about
+** the same time however far apart the matches are.
+*/
+static Boolean fillWorkProc(XtPointer clientData)
+{
+    matchIndex *index = (matchIndex *)clientData;
+    WindowInfo *window = index->window;
+    textBuffer *buf = window->buffer;
+    Rangeset *rangeset = getRangeset(index);
+    SearchMatcher *matcher;
+    int pos = index->fillPos, sliceEnd = pos + FILL_SLICE, limit;
+    int nFound = 0, start, end;
+    Boolean done = False;
+
+    /* The text stays where it is until the buffer is changed, moving the
+       gap out of it only once for all the slices */
+    if (index->fillText == NULL)
+        index->fillText = BufAsString(buf);
+    limit = sliceEnd < buf->length ? sliceEnd : -1;
+    matcher = CreateSearchMatcher(index->searchString, index->searchType,
+            GetWindowDelimiters(window));
+
+    while (pos < sliceEnd && nFound < FILL_MAX_MATCHES) {
+        if (pos > buf->length || matcher == NULL ||
+                !SearchMatcherNext(matcher, index->fillText, pos, limit,
+                &start, &end)) {
+            if (limit == -1 || matcher == NULL)
+                done = True;
+            else
+                pos = sliceEnd;
+            break;
+        }
+        /* empty matches (possible with regular expressions) can't be drawn
+           and are not counted */
+        if (end > start) {
+            addMatch(index, index->nMatches, start, end);
+            if (rangeset != NULL)
+                RangesetAddBetween(rangeset, start, end);
+            nFound++;
+        }
+        pos = end > start ? end : start + 1;
+    }
+    index->fillPos = pos;
+    if (matcher != NULL)
+        FreeSearchMatcher(matcher);
+
+    if (done)
+        index->fillProcID = 0;
+    UpdateMatchCount(window);
+    return done;
+}
+
+static void addMatch(matchIndex *index, int i, int start, int end)
+{
+    if (index->nMatches == index->allocMatches) {
+        index->allocMatches = index->allocMatches ?
+                index->allocMatches * 2 : 256;
+        index->matches = (matchRange *)NEditRealloc(index->matches,
+                sizeof(matchRange) * index->allocMatches);
+    }
+    if (i < index->nMatches)
+        memmove(&index->matches[i + 1], &index->matches[i],
+                sizeof(matchRange) * (index->nMatches - i));
+    index->matches[i].start = start;
+    index->matches[i].end = end;
+    index->nMatches++;
+}
+
+static void removeMatches(matchIndex *index, int first, int last)
+{
+    if (last <= first)
+        return;
+    memmove(&index->matches[first], &index->matches[last],
+            sizeof(matchRange) * (index->nMatches - last));
+    index->nMatches -= last - first;
+}
+
+/*
+** Binary searches over the match table.  As matches never overlap, both
+** their start and end positions are in ascending order.
+*/
+static int firstEndingAtOrAfter(matchIndex *index, int pos)
+{
+    int lo = 0, hi = index->nMatches, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->matches[mid].end < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int firstStartingAfter(matchIndex *index, int pos)
+{
+    int lo = 0, hi = index->nMatches, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (index->matches[mid].start <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+** Forget all matches ending after "pos" and let the work procedure find
+** them again.
+*/
+static void truncateIndex(matchIndex *index, int pos)
+{
+    textBuffer *buf = index->window->buffer;
+    Rangeset *rangeset = getRangeset(index);
+    int first = firstEndingAtOrAfter(index, pos + 1);
+
+    if (first < index->nMatches && index->matches[first].start < pos)
+        pos = index->matches[first].start;
+    if (rangeset != NULL)
+        RangesetRemoveBetween(rangeset, pos, buf->length);
+    index->nMatches = first;
+    if (index->fillProcID == 0 || index->fillPos > pos)
+        index->fillPos = pos;
+    startFill(index);
+}
+
+/*
+** Search "regionStart" to "regionEnd" again and insert the matches before
+** index "first".  The caller has already removed the old matches there.
+*/
+static void rescanRegion(matchIndex *index, int first, int regionStart,
+        int regionEnd)
+{
+    WindowInfo *window = index->window;
+    textBuffer *buf = window->buffer;
+    Rangeset *rangeset = getRangeset(index);
+    const char *delimiters = GetWindowDelimiters(window);
+    int copyStart, copyEnd, pos, start, end, last;
+    char *text;
+
+    /* Search a copy of whole lines, so line anchors and word boundaries
+       see the same context as in the buffer, without moving the gap */
+    copyStart = BufStartOfLine(buf, regionStart);
+    copyEnd = BufEndOfLine(buf, regionEnd);
+    text = BufGetRange(buf, copyStart, copyEnd);
+
+    pos = regionStart;
+    while (pos <= regionEnd) {
+        if (index->fillProcID != 0 && pos >= index->fillPos)
+            break;
+        if (!SearchString(text, index->searchString, SEARCH_FORWARD,
+                index->searchType, FALSE, pos - copyStart, &start, &end, NULL,
+                NULL, delimiters))
+            break;
+        start += copyStart;
+        end += copyStart;
+        if (start >= regionEnd ||
+                (index->fillProcID != 0 && start >= index->fillPos))
+            break;
+        if (end > start) {
+            /* a new match reaching past the region replaces the ones it
+               overlaps there */
+            if (end > regionEnd) {
+                last = first;
+                while (last < index->nMatches &&
+                        index->matches[last].start < end)
+                    last++;
+                if (last > first && rangeset != NULL)
+                    RangesetRemoveBetween(rangeset, regionEnd,
+                            index->matches[last - 1].end);
+                removeMatches(index, first, last);
+                regionEnd = end;
+            }
+            addMatch(index, first++, start, end);
+            if (rangeset != NULL)
+                RangesetAddBetween(rangeset, start, end);
+            if (index->fillProcID != 0 && end > index->fillPos)
+                index->fillPos = end;
+        }
+        pos = end > start ? end : start + 1;
+    }
+
+    NEditFree(text);
+}
+
+/*
+** Buffer modify callback keeping the index up to date.  The rangeset was
+** already adjusted by its own (high priority) callback; here the positions
+** of the following matches are shifted, and the lines touched by the change
+** searched again.
+*/
+static void matchIndexModifiedCB(int pos, int nInserted, int nDeleted,
+        int nRestyled, const char *deletedText, void *cbArg)
+{
+    matchIndex *index = (matchIndex *)cbArg;
+    textBuffer *buf = index->window->buffer;
+    Rangeset *rangeset;
+    int delta = nInserted - nDeleted;
+    int first, last, i, regionStart, regionEnd, padding, end;
+
+    if (nInserted == 0 && nDeleted == 0)
+        return;
+    /* a change of the text moves the gap, and maybe the whole text */
+    index->fillText = NULL;
+    if (nInserted == nDeleted && BufCmp(buf, pos, nInserted, deletedText) == 0)
+        return;
+
+    /* Matches touching the changed text are stale, the ones after it move */
+    first = firstEndingAtOrAfter(index, pos);
+    last = firstStartingAfter(index, pos + nDeleted);
+    for (i = last; i < index->nMatches; i++) {
+        index->matches[i].start += delta;
+        index->matches[i].end += delta;
+    }
+    if (index->fillProcID != 0 && index->fillPos > pos)
+        index->fillPos = index->fillPos >= pos + nDeleted ?
+                index->fillPos + delta : pos;
+
+    /* Search the changed lines again.  A literal containing newlines can
+       match across lines, so widen the region by its length. */
+    padding = index->searchType == SEARCH_REGEX ||
+            index->searchType == SEARCH_REGEX_NOCASE ?
+            0 : strlen(index->searchString);
+    regionStart = BufStartOfLine(buf, pos - padding > 0 ? pos - padding : 0);
+    regionEnd = BufEndOfLine(buf, pos + nInserted + padding < buf->length ?
+            pos + nInserted + padding : buf->length);
+    if (first < last) {
+        if (index->matches[first].start < regionStart)
+            regionStart = index->matches[first].start;
+        end = index->matches[last - 1].end;
+        end = end > pos + nDeleted ? end + delta : pos + nInserted;
+        if (end > regionEnd)
+            regionEnd = end;
+    }
+    while (first > 0 && index->matches[first - 1].end > regionStart)
+        regionStart = index->matches[--first].start;
+    while (last < index->nMatches && index->matches[last].start < regionEnd) {
+        if (index->matches[last].end > regionEnd)
+            regionEnd = index->matches[last].end;
+        last++;
+    }
+
+    if (regionEnd - regionStart > MAX_RESCAN) {
+        truncateIndex(index, regionStart);
+    } else {
+        removeMatches(index, first, last);
+        rangeset = getRangeset(index);
+        if (rangeset != NULL)
+            RangesetRemoveBetween(rangeset, regionStart, regionEnd);
+        rescanRegion(index, first, regionStart, regionEnd);
+    }
+    UpdateMatchCount(index->window);
+}
+
+/*
+** Print "n" with thousands separators.
+*/
+static void formatCount(char *buf, int n)
+{
+    char digits[16];
+    int len, i;
+
+    len = sprintf(digits, "%d", n);
+    for (i = 0; i < len; i++) {
+        if (i > 0 && (len - i) % 3 == 0)
+            *buf++ = ',';
+        *buf++ = digits[i];
+    }
+    *buf = '\0';
+}
@@ -49,6 +49,8 @@
 #include "filter.h"
 #include "highlight.h"
 #include "highlightData.h"
+#include "matchIndex.h"
+#include "findInFiles.h"
 #include "interpret.h"
 #include "smartIndent.h"
 #include "windowTitle.h"
@@ -187,6 +189,7 @@ static void keepSearchDlogsDefCB(Widget w, WindowInfo *window,
 	caddr_t callData);
 static void saveSearchHistoryDefCB(Widget w, WindowInfo *window, caddr_t callData);
 static void searchWrapsDefCB(Widget w, WindowInfo *window, caddr_t callData);
+static void highlightMatchesDefCB(Widget w, WindowInfo *window, caddr_t callData);
 static void appendLFCB(Widget w, WindowInfo* window, caddr_t callData);
 static void sortOpenPrevDefCB(Widget w, WindowInfo *window, caddr_t callData);
 static void reposDlogsDefCB(Widget w, WindowInfo *window, caddr_t callData);
@@ -285,6 +288,8 @@ static void startIncrFindAP(Widget w, XEvent *event, String *args,
 	Cardinal *nArgs);
 static void replaceDialogAP(Widget w, XEvent *event, String *args,
 	Cardinal *nArgs);
+static void findInFilesDialogAP(Widget w, XEvent *event, String *args,
+	Cardinal *nArgs);
 static void replaceAP(Widget w, XEvent *event, String *args, Cardinal *nArgs);
 static void replaceAllAP(Widget w, XEvent *event, String *args,
 	Cardinal *nArgs);
@@ -422,6 +427,8 @@ static void setOvertypeModeAP(Widget w, XEvent *event, String *args,
     Cardinal *nArgs);
 static void setLockedAP(Widget w, XEvent *event, String *args,
     Cardinal *nArgs);
+static void setFollowFileAP(Widget w, XEvent *event, String *args,
+    Cardinal *nArgs);
 static void setUseTabsAP(Widget w, XEvent *event, String *args,
     Cardinal *nArgs);
 static void setEmTabDistAP(Widget w, XEvent *event, String *args,
@@ -516,6 +523,7 @@ static XtActionsRec Actions[] = {
     {"replace_find", replaceFindAP},
     {"replace_find_same", replaceFindSameAP},
     {"replace_find_again", replaceFindSameAP},
+    {"find_in_files_dialog", findInFilesDialogAP},
     {"goto-line-number", gotoAP},
     {"goto_line_number", gotoAP},
     {"goto-line-number-dialog", gotoDialogAP},
@@ -591,6 +599,7 @@ static XtActionsRec Actions[] = {
     {"set_match_syntax_based", setMatchSyntaxBasedAP},
     {"set_overtype_mode", setOvertypeModeAP},
     {"set_locked", setLockedAP},
+    {"set_follow_file", setFollowFileAP},
     {"set_tab_dist", setTabDistAP},
     {"set_em_tab_dist", setEmTabDistAP},
     {"set_use_tabs", setUseTabsAP},
@@ -790,6 +799,9 @@ Widget RecreateMenuBar(Widget parent, Widget menuBar, WindowInfo *window, Boolea
     	    doActionCB, "set_overtype_mode", False, SHORT);
     window->readOnlyItem = createMenuToggle(menuPane, "readOnly", "Read Only",
     	    'y', doActionCB, "set_locked", IS_USER_LOCKED(window->lockReasons), FULL);
+    window->followFileItem = createMenuToggle(menuPane, "followFile",
+    	    "Follow File", 'i', doActionCB, "set_follow_file", window->followFile,
+    	    FULL);
 #endif
 
     /* 
@@ -819,6 +831,8 @@ Widget RecreateMenuBar(Widget parent, Widget menuBar, WindowInfo *window, Boolea
     	    replaceSameCB, window, SHORT);
     XtSetSensitive(window->replaceAgainItem, NHist);
     createFakeMenuItem(menuPane, "replaceAgainShift", replaceSameCB, window);
+    createMenuItem(menuPane, "findInFiles", "Find in Files...", 'e',
+    	    doActionCB, "find_in_files_dialog", FULL);
     createMenuSeparator(menuPane, "sep1", FULL);
     createMenuItem(menuPane, "gotoLineNumber", "Goto Line Number...", 'L',
     	    doActionCB, "goto_line_number_dialog", FULL);
@@ -938,6 +952,9 @@ Widget RecreateMenuBar(Widget parent, Widget menuBar, WindowInfo *window, Boolea
     window->saveSearchHistoryDefItem = createMenuToggle(subSubPane,
             "saveSearchHistory", "Save History", 'S',
             (menuCallbackProc)saveSearchHistoryDefCB, window, GetPrefSaveSearchHistory(), SHORT);
+    window->highlightMatchesDefItem = createMenuToggle(subSubPane,
+            "highlightMatches", "Highlight All Matches", 'H',
+            (menuCallbackProc)highlightMatchesDefCB, window, GetPrefHighlightMatches(), SHORT);
     subSubSubPane = createMenu(subSubPane, "defaultSearchStyle",
     	    "Default Search Style", 'D', NULL, FULL);
     XtVaSetValues(subSubSubPane, XmNradioBehavior, True, NULL); 
@@ -1223,6 +1240,9 @@ Widget RecreateMenuBar(Widget parent, Widget menuBar, WindowInfo *window, Boolea
     	    doActionCB, "set_overtype_mode", False, SHORT);
     window->readOnlyItem = createMenuToggle(menuPane, "readOnly", "Read Only",
     	    'y', doActionCB, "set_locked", IS_USER_LOCKED(window->lockReasons), FULL);
+    window->followFileItem = createMenuToggle(menuPane, "followFile",
+    	    "Follow File", 'i', doActionCB, "set_follow_file", window->followFile,
+    	    FULL);
 #endif
 
     /*
@@ -2347,6 +2367,23 @@ static void searchWrapsDefCB(Widget w, WindowInfo *window, caddr_t callData)
     }
 }
 
+static void highlightMatchesDefCB(Widget w, WindowInfo *window, caddr_t callData)
+{
+    WindowInfo *win;
+    int state = XmToggleButtonGetState(w);
+
+    /* Set the preference and make the other windows' menus agree.  Turning
+       it off removes the highlighting, turning it on takes effect with the
+       next search. */
+    SetPrefHighlightMatches(state);
+    for (win=WindowList; win!=NULL; win=win->next) {
+    	if (IsTopDocument(win))
+    	    XmToggleButtonSetState(win->highlightMatchesDefItem, state, False);
+    	if (!state)
+    	    ClearMatchIndex(win);
+    }
+}
+
 static void appendLFCB(Widget w, WindowInfo* window, caddr_t callData)
 {
     WindowInfo *win;
@@ -3540,6 +3577,12 @@ static void replaceDialogAP(Widget w, XEvent *event, String *args,
         event->xbutton.time);
 }
 
+static void findInFilesDialogAP(Widget w, XEvent *event, String *args,
+	Cardinal *nArgs)
+{
+    DoFindInFilesDlog(WidgetToWindow(w));
+}
+
 static void replaceAP(Widget w, XEvent *event, String *args, Cardinal *nArgs)
 {
     WindowInfo *window = WidgetToWindow(w);
@@ -4428,6 +4471,10 @@ static void setIncrementalBackupAP(Widget w, XEvent *event, String *args,
 
     if (IsTopDocument(window))
     	XmToggleButtonSetState(window->autoSaveItem, newState, False);
+
+    /* changes made while backups are off can't be added to the backup */
+    if (!newState)
+        EndBackupDelta(window);
     window->autoSave = newState;
 }
 
@@ -4513,6 +4560,17 @@ static void setLockedAP(Widget w, XEvent *event, String *args,
     UpdateWindowReadOnly(window);
 }
 
+static void setFollowFileAP(Widget w, XEvent *event, String *args,
+    Cardinal *nArgs)
+{
+    WindowInfo *window = WidgetToWindow(w);
+    Boolean newState;
+    
+    ACTION_BOOL_PARAM_OR_TOGGLE(newState, *nArgs, args, window->followFile, "set_follow_file");
+    
+    SetFollowFile(window, newState);
+}
+
 static void setTabDistAP(Widget w, XEvent *event, String *args,
     Cardinal *nArgs)
 {
@@ -671,6 +671,10 @@ int main(int argc, char **argv)
     /* Install word delimiters for regular expression matching */
     SetREDefaultWordDelimiters(GetPrefDelimiters());
     
+    /* Limit the time a pathological regular expression can take */
+    SetREStepBudget(GetPrefRegexStepBudget() > 0 ?
+            (unsigned long)GetPrefRegexStepBudget() : 0);
+    
     /* Read the nedit dynamic database of files for the Open Previous
        command (and eventually other information as well) */
     ReadNEditDB();
@@ -29,6 +29,8 @@
 
 #include "textBuf.h"
 #include "textDisp.h"
+#include <stdio.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include <X11/Intrinsic.h>
@@ -90,6 +92,10 @@ enum virtKeyOverride { VIRT_KEY_OVERRIDE_NEVER, VIRT_KEY_OVERRIDE_AUTO,
     in preferences.c  */
 enum truncSubstitution {TRUNCSUBST_SILENT, TRUNCSUBST_FAIL, TRUNCSUBST_WARN, TRUNCSUBST_IGNORE};
 
+/* Phases of loading a file, timed separately */
+enum loadPhases {LOAD_DETECT, LOAD_READ, LOAD_CONVERT, LOAD_LINE_ENDINGS,
+                 LOAD_BUFFER, N_LOAD_PHASES};
+
 #define NO_FLASH_STRING		"off"
 #define FLASH_DELIMIT_STRING	"delimiter"
 #define FLASH_RANGE_STRING	"range"
@@ -117,6 +123,7 @@ enum truncSubstitution {TRUNCSUBST_SILENT, TRUNCSUBST_FAIL, TRUNCSUBST_WARN, TRU
 #define USER_LOCKED_BIT     0
 #define PERM_LOCKED_BIT     1
 #define TOO_MUCH_BINARY_DATA_LOCKED_BIT 2
+#define FILE_BUSY_LOCKED_BIT 3
 
 #define ENCODING_ERROR_LOCKED_BIT 7
 
@@ -131,6 +138,8 @@ enum truncSubstitution {TRUNCSUBST_SILENT, TRUNCSUBST_FAIL, TRUNCSUBST_WARN, TRU
 #define SET_PERM_LOCKED(reasons, onOrOff) SET_LOCKED_BY_REASON(reasons, onOrOff, PERM_LOCKED_BIT)
 #define IS_TMBD_LOCKED(reasons) (((reasons) & LOCKED_BIT_TO_MASK(TOO_MUCH_BINARY_DATA_LOCKED_BIT)) != 0)
 #define SET_TMBD_LOCKED(reasons, onOrOff) SET_LOCKED_BY_REASON(reasons, onOrOff, TOO_MUCH_BINARY_DATA_LOCKED_BIT)
+#define IS_FILE_BUSY_LOCKED(reasons) (((reasons) & LOCKED_BIT_TO_MASK(FILE_BUSY_LOCKED_BIT)) != 0)
+#define SET_FILE_BUSY_LOCKED(reasons, onOrOff) SET_LOCKED_BY_REASON(reasons, onOrOff, FILE_BUSY_LOCKED_BIT)
 
 #define IS_ENCODING_LOCKED(reasons) (((reasons) & LOCKED_BIT_TO_MASK(ENCODING_ERROR_LOCKED_BIT)) != 0)
 #define SET_ENCODING_LOCKED(reasons, onOrOff) SET_LOCKED_BY_REASON(reasons, onOrOff, ENCODING_ERROR_LOCKED_BIT)
@@ -157,6 +166,13 @@ enum truncSubstitution {TRUNCSUBST_SILENT, TRUNCSUBST_FAIL, TRUNCSUBST_WARN, TRU
 #define DISABLE_COLORPROFILES
 #endif
 
+/* One of the replaced spans of a MULTI_REPLACE undo record */
+typedef struct {
+    int		pos;			/* start of the span in the buffer */
+    int		oldLen;			/* length of the text it replaced */
+    int		newLen;			/* length of the text now there */
+} UndoRange;
+
 /* Record on undo list */
 typedef struct _UndoInfo {
     struct _UndoInfo *next;		/* pointer to the next undo record */
@@ -165,6 +181,14 @@ typedef struct _UndoInfo {
     int		endPos;
     int 	oldLen;
     char	*oldText;
+    UndoRange	*ranges;		/* replaced spans of a MULTI_REPLACE
+    					   record, whose oldText holds only
+    					   the text of these spans */
+    int		nRanges;
+    int		packedLen;		/* size of oldText when it is
+    					   compressed, 0 if it is plain text,
+    					   -1 if it doesn't compress */
+    int		textLen;		/* length of the compressed text */
     short       numOp;                  /* Number of undo records
                                            for this operation.
                                            */
@@ -309,6 +333,7 @@ typedef struct _WindowInfo {
     Widget  	iSearchRegexToggle;
     Widget  	iSearchCaseToggle;
     Widget  	iSearchRevToggle;
+    Widget  	iSearchCountLabel;
     Widget      encodingInfoBar;
     Widget      encInfoBarLabel;
     Widget      encInfoErrorList;
@@ -348,9 +373,11 @@ typedef struct _WindowInfo {
     Widget	replaceMultiFileDlog;	/* Replace in multiple files */
     Widget	replaceMultiFileList;
     Widget	replaceMultiFilePathBtn;
+    Widget	replaceMultiFileProgress;
     Widget	fontDialog;		/* NULL, unless font dialog is up */
     void        *colorDialog;		/* NULL, unless color dialog is up, type colorDialog* */
     Widget	readOnlyItem;		/* menu bar settable widgets... */
+    Widget	followFileItem;
     Widget	autoSaveItem;
     Widget	saveLastItem;
     Widget      openSelItem;
@@ -430,6 +457,7 @@ typedef struct _WindowInfo {
     Widget	keepSearchDlogsDefItem;
     Widget      saveSearchHistoryDefItem;
     Widget	searchWrapsDefItem;
+    Widget	highlightMatchesDefItem;
     Widget      appendLFItem;
     Widget	sortOpenPrevDefItem;
     Widget	allTagsDefItem;
@@ -502,6 +530,11 @@ typedef struct _WindowInfo {
     time_t    	lastModTime; 	    	/* time of last modification to file */
     dev_t       device;                 /*  device where the file resides */
     ino_t       inode;                  /*  file's inode  */
+    Boolean     fileHashed;             /* are fileHash and fileHashSize of
+                                           the file as last read or written
+                                           known? */
+    uint64_t    fileHash;               /* hash (HashFile) of the file */
+    off_t       fileHashSize;           /* size of the file */
     UndoInfo	*undo;			/* info for undoing last operation */
     UndoInfo	*redo;			/* info for redoing last undone op */
     UndoInfo    *undo_batch_begin;      /* last undo item at batch-begin */
@@ -513,9 +546,20 @@ typedef struct _WindowInfo {
     int		autoSaveCharCount;	/* count of single characters typed
     					   since last backup file generated */
     int		autoSaveOpCount;	/* count of editing operations "" */
+    FILE	*undoJournal;		/* log of the changes since the file
+    					   was read or saved, for recovering
+    					   them after a crash (or NULL) */
+    FILE	*backupDelta;		/* changes since the backup file was
+    					   last written (or NULL) */
+    long	backupSize;		/* size of that backup file */
+    struct backupJob *backupJob;	/* backup file being written on a
+    					   separate thread (or NULL) */
+    float	loadTime[N_LOAD_PHASES]; /* milliseconds spent in each
+    					   phase of loading the file */
     int		undoOpCount;		/* count of stored undo operations */
     int		undoMemUsed;		/* amount of memory (in bytes)
     					   dedicated to the undo list */
+    int		redoMemUsed;		/* same for the redo list */
     char	fontName[MAX_FONT_LEN];	/* names of the text fonts in use */
     char	italicFontName[MAX_FONT_LEN];
     char	boldFontName[MAX_FONT_LEN];
@@ -547,6 +591,14 @@ typedef struct _WindowInfo {
     Boolean	filenameSet;		/* is the window still "Untitled"? */ 
     Boolean	fileChanged;		/* has window been modified? */
     Boolean     fileMissing;            /* is the window's file gone? */
+    Boolean     fileWatched;            /* is the file watched for changes
+                                           (see fileWatch.c)? */
+    Boolean     fileEvent;              /* was the file reported changed
+                                           since it was last checked? */
+    Boolean     followFile;             /* is text appended to the file
+                                           added to the window as it comes? */
+    off_t       followSize;             /* how much of the file is in the
+                                           window, for following it */
     int         lockReasons;            /* all ways a file can be locked */
     Boolean	autoSave;		/* is autosave turned on? */
     Boolean	saveOldVersion;		/* keep old version in filename.bck */
@@ -583,10 +635,17 @@ typedef struct _WindowInfo {
     int     	iSearchHistIndex;	/*   find and replace dialogs */
     int     	iSearchStartPos;    	/* start pos. of current incr. search */
     int       	iSearchLastBeginPos;    /* beg. pos. last match of current i.s.*/
+    char	*iSearchLastString;	/* string of the last i.s. step, how */
+    int		iSearchLastType;	/*   it was searched, and whether it */
+    int		iSearchLastDir;		/*   was found, for searching on from */
+    int		iSearchLastWrap;	/*   iSearchLastBeginPos when the */
+    Bool	iSearchLastFound;	/*   string is extended */
     int     	nMarks;     	    	/* number of active bookmarks */
     XtIntervalId markTimeoutID;	    	/* backup timer for mark event handler*/
     Bookmark	markTable[MAX_MARKS];	/* marked locations in window */
     void    	*highlightData; 	/* info for syntax highlighting */
+    void    	*matchIndex;    	/* matches of the last search string,
+    	    	    	    	    	   for highlighting all of them */
     void    	*shellCmdData;  	/* when a shell command is executing,
     	    	    	    	    	   info. about it, otherwise, NULL */
     void    	*macroCmdData;  	/* same for macro commands */
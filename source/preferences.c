@@ -349,6 +349,7 @@ static struct prefData {
     int searchWrapBeep;     	/* 1=beep when search restarts at begin/end */
     int keepSearchDlogs;	/* whether to retain find and replace dialogs */
     int searchWraps;	/* whether to attempt search again if reach bof or eof */
+    int highlightMatches;	/* whether to highlight all search matches */
     int statsLine;		/* whether to show the statistics line */
     int iSearchLine;	    	/* whether to show the incremental search line*/
     int tabBar;			/* whether to show the tab bar */
@@ -437,6 +438,7 @@ static struct prefData {
     int stdOpenDialog;		/* w. to retain redundant text field in Open */
     char tagFile[MAXPATHLEN];	/* name of tags file to look for at startup */
     int maxPrevOpenFiles;   	/* limit to size of Open Previous menu */
+    int regexStepBudget;	/* steps a regex search may take */
     int typingHidesPointer;     /* hide mouse pointer when typing */
     char delimiters[MAX_WORD_DELIMITERS]; /* punctuation characters */
     char shell[MAXPATHLEN + 1]; /* shell to use for executing commands */
@@ -457,6 +459,9 @@ static struct prefData {
     char colorNames[NUM_COLORS][MAX_COLOR_LEN];
     char tooltipBgColor[MAX_COLOR_LEN];
     int  undoModifiesSelection;
+    int  undoMemoryLimit;	/* bytes of undo and redo information kept
+    				   per document */
+    int  undoJournal;		/* log changes for crash recovery */
     int  focusOnRaise;
     int honorSymlinks;
     int truncSubstitution;
@@ -995,6 +1000,8 @@ static PrefDescripRec PrefDescrip[] = {
     	&PrefData.keepSearchDlogs, NULL, True},
     {"searchWraps", "SearchWraps", PREF_BOOLEAN, "True",
     	&PrefData.searchWraps, NULL, True},
+    {"highlightSearchMatches", "HighlightSearchMatches", PREF_BOOLEAN, "True",
+    	&PrefData.highlightMatches, NULL, True},
     {"stickyCaseSenseButton", "StickyCaseSenseButton", PREF_BOOLEAN, "True",
     	&PrefData.stickyCaseSenseBtn, NULL, True},
 #if XmVersion < 1002 /* Flashing is annoying in 1.1 versions */
@@ -1194,6 +1201,8 @@ static PrefDescripRec PrefDescrip[] = {
       (void *)sizeof(PrefData.serverName), False},
     {"maxPrevOpenFiles", "MaxPrevOpenFiles", PREF_INT, "30",
     	&PrefData.maxPrevOpenFiles, NULL, False},
+    {"regexStepBudget", "RegexStepBudget", PREF_INT, "10000000",
+    	&PrefData.regexStepBudget, NULL, False},
     {"bgMenuButton", "BGMenuButton" , PREF_STRING,
 	"~Shift~Ctrl~Meta~Alt<Btn3Down>", PrefData.bgMenuBtn,
       (void *)sizeof(PrefData.bgMenuBtn), False},
@@ -1217,6 +1226,10 @@ static PrefDescripRec PrefDescrip[] = {
 	PrefData.titleFormat, (void *)sizeof(PrefData.titleFormat), True},
     {"undoModifiesSelection", "UndoModifiesSelection", PREF_BOOLEAN,
         "True", &PrefData.undoModifiesSelection, NULL, False},
+    {"undoMemoryLimit", "UndoMemoryLimit", PREF_INT, "100000000",
+    	&PrefData.undoMemoryLimit, NULL, False},
+    {"undoJournal", "UndoJournal", PREF_BOOLEAN, "False",
+    	&PrefData.undoJournal, NULL, False},
     {"focusOnRaise", "FocusOnRaise", PREF_BOOLEAN,
             "False", &PrefData.focusOnRaise, NULL, False},
     {"forceOSConversion", "ForceOSConversion", PREF_BOOLEAN, "True",
@@ -1860,6 +1873,16 @@ int GetPrefSearchWraps(void)
     return PrefData.searchWraps;
 }
 
+void SetPrefHighlightMatches(int state)
+{
+    setIntPref(&PrefData.highlightMatches, state);
+}
+
+int GetPrefHighlightMatches(void)
+{
+    return PrefData.highlightMatches;
+}
+
 void SetPrefStatsLine(int state)
 {
     setIntPref(&PrefData.statsLine, state);
@@ -2404,6 +2427,11 @@ int GetPrefMaxPrevOpenFiles(void)
     return PrefData.maxPrevOpenFiles;
 }
 
+int GetPrefRegexStepBudget(void)
+{
+    return PrefData.regexStepBudget;
+}
+
 int GetPrefTypingHidesPointer(void)
 {
     return(PrefData.typingHidesPointer);
@@ -2447,6 +2475,16 @@ Boolean GetPrefUndoModifiesSelection(void)
     return (Boolean)PrefData.undoModifiesSelection;
 }
 
+int GetPrefUndoMemoryLimit(void)
+{
+    return PrefData.undoMemoryLimit;
+}
+
+Boolean GetPrefUndoJournal(void)
+{
+    return (Boolean)PrefData.undoJournal;
+}
+
 Boolean GetPrefFocusOnRaise(void)
 {
     return (Boolean)PrefData.focusOnRaise;
@@ -72,6 +72,8 @@ void SetPrefKeepSearchDlogs(int state);
 int GetPrefKeepSearchDlogs(void);
 void SetPrefSearchWraps(int state);
 int GetPrefSearchWraps(void);
+void SetPrefHighlightMatches(int state);
+int GetPrefHighlightMatches(void);
 void SetPrefStatsLine(int state);
 int GetPrefStatsLine(void);
 void SetPrefISearchLine(int state);
@@ -183,6 +185,7 @@ int GetPrefMapDelete(void);
 int GetPrefStdOpenDialog(void);
 char *GetPrefDelimiters(void);
 int GetPrefMaxPrevOpenFiles(void);
+int GetPrefRegexStepBudget(void);
 int GetPrefTypingHidesPointer(void);
 int GetEditorConfig(void);
 #ifdef SGI_CUSTOM
@@ -234,6 +237,8 @@ int GetPrefOpenInTab(void);
 void SetPrefUndoModifiesSelection(Boolean);
 void SetPrefOpenInTab(int state);
 Boolean GetPrefUndoModifiesSelection(void);
+int GetPrefUndoMemoryLimit(void);
+Boolean GetPrefUndoJournal(void);
 Boolean GetPrefFocusOnRaise(void);
 Boolean GetPrefHonorSymlinks(void);
 Boolean GetAutoEnableXattr(void);
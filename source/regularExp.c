@@ -109,9 +109,16 @@
  *
  *   match_start     Character that must begin a match; '\0' if none obvious.
  *   anchor          Is the match anchored (at beginning-of-line only)?
+ *   required_off    Offset into `program' of the longest literal string every
+ *                   match must contain (the operand of an EXACTLY node).
+ *   required_len    Length of that literal; 0 if there is none.
+ *   required_min    Minimum and maximum distance in bytes from the start of a
+ *   required_max    match to the start of the literal (max -1: unbounded).
  *
  * `match_start' and `anchor' permit very fast decisions on suitable starting
- * points for a match, considerably reducing the work done by ExecRE. */
+ * points for a match, considerably reducing the work done by ExecRE.  The
+ * required literal lets ExecRE jump from one occurrence of the literal to the
+ * next instead of attempting a match at every position. */
 
 /* STRUCTURE FOR A REGULAR EXPRESSION (regex) `PROGRAM'.
  *
@@ -457,28 +464,37 @@
 #define MAX_COMPILED_SIZE  32767UL  /* Largest size a compiled regex can be.
                                        Probably could be 65535UL. */
 
+/* The work variables of `CompileRE' and `ExecRE' are kept per thread, so
+   that an expression compiled with `CompileRE' can be matched in a worker
+   thread while the main thread searches (see the multi-file Replace All in
+   search.c).  The settings, the default delimiters, the character class
+   tables (built by the first `CompileRE') and the expression cache are
+   shared, and are only changed from the main thread. */
+
+#define RE_TLS static __thread
+
 /* Global work variables for `CompileRE'. */
 
-static unsigned char *Reg_Parse;       /* Input scan ptr (scans user's regex) */
-static int            Total_Paren;     /* Parentheses, (),  counter. */
-static int            Num_Braces;      /* Number of general {m,n} constructs.
+RE_TLS unsigned char *Reg_Parse;       /* Input scan ptr (scans user's regex) */
+RE_TLS int            Total_Paren;     /* Parentheses, (),  counter. */
+RE_TLS int            Num_Braces;      /* Number of general {m,n} constructs.
                                           {m,n} quantifiers of SIMPLE atoms are
                                           not included in this count. */
-static int            Closed_Parens;   /* Bit flags indicating () closure. */
-static int            Paren_Has_Width; /* Bit flags indicating ()'s that are
+RE_TLS int            Closed_Parens;   /* Bit flags indicating () closure. */
+RE_TLS int            Paren_Has_Width; /* Bit flags indicating ()'s that are
                                           known to not match the empty string */
-static unsigned char  Compute_Size;    /* Address of this used as flag. */
-static unsigned char *Code_Emit_Ptr;   /* When Code_Emit_Ptr is set to
+RE_TLS unsigned char  Compute_Size;    /* Address of this used as flag. */
+RE_TLS unsigned char *Code_Emit_Ptr;   /* When Code_Emit_Ptr is set to
                                           &Compute_Size no code is emitted.
                                           Instead, the size of code that WOULD
                                           have been generated is accumulated in
                                           Reg_Size.  Otherwise, Code_Emit_Ptr
                                           points to where compiled regex code is
                                           to be written. */
-static unsigned long  Reg_Size;        /* Size of compiled regex code. */
-static char         **Error_Ptr;       /* Place to store error messages so
+RE_TLS unsigned long  Reg_Size;        /* Size of compiled regex code. */
+RE_TLS char         **Error_Ptr;       /* Place to store error messages so
                                           they can be returned by `CompileRE' */
-static char           Error_Text [128];/* Sting to build error messages in. */
+RE_TLS char           Error_Text [128];/* Sting to build error messages in. */
 
 static unsigned char  White_Space [WHITE_SPACE_SIZE]; /* Arrays used by       */
 static unsigned char  Word_Char   [ALNUM_CHAR_SIZE];  /* functions            */
@@ -488,13 +504,13 @@ static unsigned char  Letter_Char [ALNUM_CHAR_SIZE];  /* init_ansi_classes () */
 
 static unsigned char  ASCII_Digits [] = "0123456789"; /* Same for all */
                                                       /* locales.     */
-static int            Is_Case_Insensitive;
-static int            Match_Newline;
+RE_TLS int            Is_Case_Insensitive;
+RE_TLS int            Match_Newline;
 
 static int            Enable_Counting_Quantifier = 1;
-static unsigned char  Brace_Char;
+RE_TLS unsigned char  Brace_Char;
 static unsigned char  Default_Meta_Char [] = "{.*+?[(|)^<>$";
-static unsigned char *Meta_Char;
+RE_TLS unsigned char *Meta_Char;
 
 typedef struct { long lower; long upper; } len_range;
 
@@ -528,6 +544,8 @@ static unsigned char * shortcut_escape (unsigned char c, int *flag_param,
                                         int emit);
 
 static int             init_ansi_classes  (void);
+static void            find_required_literal (regexp *prog);
+static regexp *        build_nfa       (regexp *prog, unsigned long code_size);
 
 /*----------------------------------------------------------------------*
  * CompileRE
@@ -666,7 +684,152 @@ regexp * CompileRE (const char *exp, char **errorText, int defaultFlags) {
       }
    }
 
-   return (comp_regex);
+   find_required_literal (comp_regex);
+
+   comp_regex->engine = RE_ENGINE_BACKTRACK;
+
+   return (build_nfa (comp_regex, Reg_Size));
+}
+
+/*----------------------------------------------------------------------*
+ * find_required_literal
+ *
+ * Walks the sequence of nodes that every match has to pass through and
+ * records the longest literal string (EXACTLY node) found on it, along
+ * with the minimum and maximum distance in bytes between the start of a
+ * match and the start of that literal.  `ExecRE' uses this to skip over
+ * text that can't possibly contain a match.  The walk stops at anything
+ * it doesn't understand; literals found up to that point are still
+ * required, so this errs on the safe side.
+ *----------------------------------------------------------------------*/
+
+static void find_required_literal (regexp *prog) {
+
+   unsigned char *scan, *next, *atom_node;
+            long  min = 0, max = 0;   /* max < 0 means unbounded */
+            long  len, lower, upper, atom_max;
+            int   op_code;
+
+   prog->required_off = 0;
+   prog->required_len = 0;
+   prog->required_min = 0;
+   prog->required_max = 0;
+
+   scan = (unsigned char *) (prog->program + REGEX_START_OFFSET);
+
+   while (scan != NULL) {
+      op_code = GET_OP_CODE (scan);
+      next    = next_ptr (scan);
+
+      switch (op_code) {
+         case EXACTLY:
+            len = (long) strlen ((char *) OPERAND (scan));
+
+            if (len > prog->required_len && len <= SHRT_MAX) {
+               prog->required_off = (int) (OPERAND (scan) -
+                                           (unsigned char *) prog->program);
+               prog->required_len = (int) len;
+               prog->required_min = min;
+               prog->required_max = max;
+            }
+
+            min += len;
+            if (max >= 0) max += len;
+            break;
+
+         case SIMILAR:
+            len  = (long) strlen ((char *) OPERAND (scan));
+            min += len;
+            if (max >= 0) max += len;
+            break;
+
+         case BOL:
+         case EOL:
+         case BOWORD:
+         case EOWORD:
+         case NOT_BOUNDARY:
+         case NOTHING:
+            break;
+
+         case ANY:
+         case EVERY:
+            /* A UTF-8 character is 1 to 4 bytes long (see Utf8CharLen). */
+            min += 1;
+            if (max >= 0) max += 4;
+            break;
+
+         case ANY_OF:   case ANY_BUT:
+         case DIGIT:    case NOT_DIGIT:
+         case LETTER:   case NOT_LETTER:
+         case SPACE:    case SPACE_NL:
+         case NOT_SPACE: case NOT_SPACE_NL:
+         case WORD_CHAR: case NOT_WORD_CHAR:
+         case IS_DELIM: case NOT_DELIM:
+            min += 1;
+            if (max >= 0) max += 1;
+            break;
+
+         case STAR:     case LAZY_STAR:
+         case PLUS:     case LAZY_PLUS:
+         case QUESTION: case LAZY_QUESTION:
+         case BRACE:    case LAZY_BRACE:
+            /* greedy() steps one byte per match, except for '.' */
+            atom_node = OPERAND (scan);
+            lower     = 0;
+            upper     = 1;
+
+            if (op_code == PLUS || op_code == LAZY_PLUS) {
+               lower = 1;
+               upper = 0;
+            } else if (op_code == STAR || op_code == LAZY_STAR) {
+               upper = 0;
+            } else if (op_code == BRACE || op_code == LAZY_BRACE) {
+               lower     = GET_OFFSET (scan + NEXT_PTR_SIZE);
+               upper     = GET_OFFSET (scan + (2 * NEXT_PTR_SIZE));
+               atom_node = OPERAND (scan + (2 * NEXT_PTR_SIZE));
+            }
+
+            atom_max = (GET_OP_CODE (atom_node) == ANY ||
+                        GET_OP_CODE (atom_node) == EVERY) ? 4 : 1;
+
+            min += lower;
+
+            if (upper == 0) {
+               max = -1;
+            } else if (max >= 0) {
+               max += upper * atom_max;
+            }
+
+            break;
+
+         case BRANCH:
+            if (next == NULL || GET_OP_CODE (next) != BRANCH) {
+               /* No choice, the operand has to match. */
+               next = OPERAND (scan);
+            } else {
+               /* Alternatives (or a complex quantifier): nothing inside is
+                  required, so skip to where the alternatives join. */
+               while (next != NULL && GET_OP_CODE (next) == BRANCH) {
+                  next = next_ptr (next);
+               }
+
+               max = -1;
+            }
+
+            break;
+
+         default:
+            if (op_code > OPEN && op_code < CLOSE + NSUBEXP) {
+               break; /* Capturing parentheses are zero width. */
+            }
+
+            /* END, look-around, back-references, counted constructs... */
+            next = NULL;
+            break;
+      }
+
+      scan = next;
+   }
 }
 
 /*----------------------------------------------------------------------*
@@ -2605,25 +2768,198 @@ static unsigned char * back_ref (
    return ret_val;
 }
 
+/*======================================================================*
+ *  Compiled regex cache
+ *======================================================================*/
+
+/* Searching, replacing and the search related macro routines used to
+   compile the search string again for every single search, which is
+   wasteful when the same expression is applied over and over (Find Again,
+   Replace All, macros looping over search_string()).  The cache below
+   keeps the most recently used compiled expressions, keyed by the
+   expression text and the default flags passed to `CompileRE'.
+
+   Entries handed out by `CompileCachedRE' are reference counted, so an
+   expression that is still in use is never evicted.  A compiled regex also
+   holds the results of its last match (startp, endp, ...), which one user
+   must not overwrite for another.  When an expression is asked for while
+   its entry is in use, as by a macro searching from within a search, an
+   uncached copy is returned.  The same happens
+   if the cache is full of busy entries.  `ReleaseCachedRE' recognizes the
+   copies and frees them. */
+
+#define RE_CACHE_SIZE 32
+
+typedef struct {
+   char          *exp;           /* Expression text (NULL: slot unused) */
+   int            defaultFlags;  /* Flags the expression was compiled with */
+   regexp        *compiled;
+   int            refCount;      /* Number of outstanding CompileCachedRE's */
+   unsigned long  lastUse;       /* Value of RE_Cache_Clock at last use */
+} re_cache_entry;
+
+static re_cache_entry RE_Cache [RE_CACHE_SIZE];
+static unsigned long  RE_Cache_Clock;
+static RECacheStats   RE_Cache_Stats;
+
+static void free_cache_entry (re_cache_entry *entry) {
+
+   NEditFree (entry->exp);
+   NEditFree (entry->compiled);
+   entry->exp      = NULL;
+   entry->compiled = NULL;
+   entry->refCount = 0;
+}
+
+/*----------------------------------------------------------------------*
+ * CompileCachedRE
+ *
+ * Same as `CompileRE', but returns a compiled regex from the process wide
+ * regex cache, if it isn't in use already.  The result must be handed
+ * back with `ReleaseCachedRE' and must never be freed by the caller.
+ *----------------------------------------------------------------------*/
+
+regexp * CompileCachedRE (const char *exp, char **errorText, int defaultFlags) {
+
+   re_cache_entry *entry, *slot = NULL;
+   regexp         *compiled;
+   int             i;
+
+   if (exp == NULL) return CompileRE (exp, errorText, defaultFlags);
+
+   for (i = 0; i < RE_CACHE_SIZE; i++) {
+      entry = &RE_Cache [i];
+
+      if (entry->exp != NULL && entry->defaultFlags == defaultFlags &&
+          strcmp (entry->exp, exp) == 0) {
+
+         entry->lastUse = ++RE_Cache_Clock;
+
+         if (entry->refCount > 0) break; /* In use, compile a copy. */
+
+         entry->refCount++;
+         RE_Cache_Stats.hits++;
+        *errorText = "";
+         return entry->compiled;
+      }
+   }
+
+   if (i < RE_CACHE_SIZE) {
+      RE_Cache_Stats.misses++;
+      return CompileRE (exp, errorText, defaultFlags);
+   }
+
+   RE_Cache_Stats.misses++;
+
+   compiled = CompileRE (exp, errorText, defaultFlags);
+
+   if (compiled == NULL) return NULL;
+
+   /* Find a free slot, or else the least recently used idle entry. */
+
+   for (i = 0; i < RE_CACHE_SIZE; i++) {
+      entry = &RE_Cache [i];
+
+      if (entry->exp == NULL) {
+         slot = entry;
+         break;
+      }
+
+      if (entry->refCount == 0 &&
+          (slot == NULL || entry->lastUse < slot->lastUse)) {
+         slot = entry;
+      }
+   }
+
+   if (slot == NULL) return compiled; /* Everything busy, don't cache. */
+
+   if (slot->exp != NULL) {
+      free_cache_entry (slot);
+      RE_Cache_Stats.evictions++;
+   } else {
+      RE_Cache_Stats.entries++;
+   }
+
+   slot->exp          = NEditStrdup (exp);
+   slot->defaultFlags = defaultFlags;
+   slot->compiled     = compiled;
+   slot->refCount     = 1;
+   slot->lastUse      = ++RE_Cache_Clock;
+
+   return compiled;
+}
+
+/*----------------------------------------------------------------------*
+ * ReleaseCachedRE
+ *
+ * Hands a regex obtained from `CompileCachedRE' back to the cache.
+ *----------------------------------------------------------------------*/
+
+void ReleaseCachedRE (regexp *prog) {
+
+   int i;
+
+   if (prog == NULL) return;
+
+   for (i = 0; i < RE_CACHE_SIZE; i++) {
+      if (RE_Cache [i].compiled == prog) {
+         if (RE_Cache [i].refCount > 0) RE_Cache [i].refCount--;
+         return;
+      }
+   }
+
+   NEditFree (prog); /* Was never cached. */
+}
+
+/*----------------------------------------------------------------------*
+ * FlushRECache
+ *
+ * Discards all idle entries of the regex cache.
+ *----------------------------------------------------------------------*/
+
+void FlushRECache (void) {
+
+   int i;
+
+   for (i = 0; i < RE_CACHE_SIZE; i++) {
+      if (RE_Cache [i].exp != NULL && RE_Cache [i].refCount == 0) {
+         free_cache_entry (&RE_Cache [i]);
+         RE_Cache_Stats.entries--;
+      }
+   }
+}
+
+/*----------------------------------------------------------------------*
+ * GetRECacheStats
+ *
+ * Returns the hit/miss statistics and fill level of the regex cache.
+ *----------------------------------------------------------------------*/
+
+void GetRECacheStats (RECacheStats *stats) {
+
+   *stats      = RE_Cache_Stats;
+   stats->size = RE_CACHE_SIZE;
+}
+
 /*======================================================================*
  *  Regex execution related code
  *======================================================================*/
 
  /* Global work variables for `ExecRE'. */
 
-static unsigned char  *Reg_Input;           /* String-input pointer.         */
-static unsigned char  *Start_Of_String;     /* Beginning of input, for ^     */
+RE_TLS unsigned char  *Reg_Input;           /* String-input pointer.         */
+RE_TLS unsigned char  *Start_Of_String;     /* Beginning of input, for ^     */
                                             /* and < checks.                 */
-static unsigned char  *End_Of_String;       /* Logical end of input (if
+RE_TLS unsigned char  *End_Of_String;       /* Logical end of input (if
    				               supplied, till \0 otherwise)  */
-static unsigned char  *Look_Behind_To;      /* Position till were look behind
+RE_TLS unsigned char  *Look_Behind_To;      /* Position till were look behind
                                                can safely check back         */
-static unsigned char **Start_Ptr_Ptr;       /* Pointer to `startp' array.    */
-static unsigned char **End_Ptr_Ptr;         /* Ditto for `endp'.             */
-static unsigned char  *Extent_Ptr_FW;       /* Forward extent pointer        */
-static unsigned char  *Extent_Ptr_BW;       /* Backward extent pointer       */
-static unsigned char  *Back_Ref_Start [10]; /* Back_Ref_Start [0] and        */
-static unsigned char  *Back_Ref_End   [10]; /* Back_Ref_End [0] are not      */
+RE_TLS unsigned char **Start_Ptr_Ptr;       /* Pointer to `startp' array.    */
+RE_TLS unsigned char **End_Ptr_Ptr;         /* Ditto for `endp'.             */
+RE_TLS unsigned char  *Extent_Ptr_FW;       /* Forward extent pointer        */
+RE_TLS unsigned char  *Extent_Ptr_BW;       /* Backward extent pointer       */
+RE_TLS unsigned char  *Back_Ref_Start [10]; /* Back_Ref_Start [0] and        */
+RE_TLS unsigned char  *Back_Ref_End   [10]; /* Back_Ref_End [0] are not      */
                                             /* used. This simplifies         */
                                             /* indexing.                     */
 /*
@@ -2635,18 +2971,46 @@ static unsigned char  *Back_Ref_End   [10]; /* Back_Ref_End [0] are not      */
  * So 10 000 ought to be safe.
  */
 #define REGEX_RECURSION_LIMIT 10000
-static int Recursion_Count;          /* Recursion counter */
-static int Recursion_Limit_Exceeded; /* Recursion limit exceeded flag */
+RE_TLS int Recursion_Count;          /* Recursion counter */
+RE_TLS int Recursion_Limit_Exceeded; /* Set when matching must be given up
+                                        (recursion limit, step budget or
+                                        cancellation, see Exec_Status) */
+
+/* Work limits of `ExecRE'.  A step is a call of `match' or `greedy', or a
+   text position of the NFA simulation.  A whole `ExecRE' call may take up
+   to Step_Budget steps (0: unlimited), plus Attempt_Steps for every
+   position a match is attempted at, so that the time spent on an expensive
+   expression is bounded by the length of the text searched, and not
+   multiplied by it.  Attempt_Steps is RE_ATTEMPT_STEPS plus a step per node
+   of the program, since trying each alternative of a large alternation at
+   every position is linear, not expensive.  The budget and the cancel procedure are checked every
+   RE_POLL_INTERVAL steps, when Step_Tick runs out. */
+
+#define RE_POLL_INTERVAL 4096
+#define RE_ATTEMPT_STEPS 64
+
+#define CHARGE_STEP (!Recursion_Limit_Exceeded && \
+                     (--Step_Tick > 0 || step_checkpoint ()))
+
+static unsigned long  Step_Budget = RE_DEFAULT_STEP_BUDGET;
+RE_TLS long           Step_Tick;     /* Steps until the next checkpoint. */
+RE_TLS unsigned long  Step_Total;    /* Step number of the next checkpoint. */
+RE_TLS unsigned long  Attempt_Start; /* Step number when the search began. */
+RE_TLS unsigned long  Attempt_Count; /* Positions a match was attempted at. */
+RE_TLS unsigned long  Attempt_Steps; /* Steps allowed per position. */
+RE_TLS RECancelProc   Cancel_Proc = NULL;
+RE_TLS void          *Cancel_Arg  = NULL;
+RE_TLS int            Exec_Status = REEXEC_OK;
 
 #define AT_END_OF_STRING(X) (*(X) == (unsigned char)'\0' ||\
                              (End_Of_String != NULL && (X) >= End_Of_String))
 
 /* static regexp *Cross_Regex_Backref; */
 
-static int Prev_Is_BOL;
-static int Succ_Is_EOL;
-static int Prev_Is_Delim;
-static int Succ_Is_Delim;
+RE_TLS int Prev_Is_BOL;
+RE_TLS int Succ_Is_EOL;
+RE_TLS int Prev_Is_Delim;
+RE_TLS int Succ_Is_Delim;
 
 /* Define a pointer to an array to hold general (...){m,n} counts. */
 
@@ -2654,20 +3018,31 @@ typedef struct brace_counts {
     unsigned long count [1]; /* More unwarranted chumminess with compiler. */
 } brace_counts;
 
-static struct brace_counts *Brace;
+RE_TLS struct brace_counts *Brace;
 
 /* Default table for determining whether a character is a word delimiter. */
 
 static unsigned char  Default_Delimiters [UCHAR_MAX+1] = {0};
 
-static unsigned char *Current_Delimiters;  /* Current delimiter table */
+RE_TLS unsigned char *Current_Delimiters;  /* Current delimiter table */
+
+static int            Engine_Policy = RE_ENGINE_AUTO; /* See RE_ENGINE */
 
 /* Forward declarations of functions used by `ExecRE' */
 
 static int             attempt            (regexp *, unsigned char *);
+static int             forward_literal_search (regexp *, unsigned char *,
+                                               unsigned char *);
+static int             reverse_literal_search (regexp *, unsigned char *,
+                                               unsigned char *);
 static int             match              (unsigned char *, int *);
+static int             step_checkpoint    (void);
+static int             nfa_exec           (regexp *, unsigned char *,
+                                           unsigned char *, int);
 static unsigned long   greedy             (unsigned char *, long);
 static void            adjustcase         (unsigned char *, int, unsigned char);
+static int             next_subst_token   (unsigned char **, unsigned char *,
+                                           unsigned char *);
 static unsigned char * makeDelimiterTable (unsigned char *, unsigned char *);
 
 /*
@@ -2707,6 +3082,8 @@ int ExecRE(regexp *prog, const char* string, const char* end, int reverse,
             unsigned char   tempDelimitTable [256];
                      int    i;
 
+   Exec_Status = REEXEC_OK;
+
    /* Check for valid parameters. */
 
    if (prog == NULL || string == NULL) {
@@ -2764,6 +3141,12 @@ int ExecRE(regexp *prog, const char* string, const char* end, int reverse,
    
    /* Reset the recursion detection flag */
    Recursion_Limit_Exceeded = 0;
+   Step_Tick                = RE_POLL_INTERVAL;
+   Step_Total               = RE_POLL_INTERVAL;
+   Attempt_Start            = 0;
+   Attempt_Count            = 0;
+   Attempt_Steps            = RE_ATTEMPT_STEPS +
+                              (unsigned long) prog->size / NODE_SIZE;
 
    /* Allocate memory for {m,n} construct counting variables if need be. */
 
@@ -2790,6 +3173,28 @@ int ExecRE(regexp *prog, const char* string, const char* end, int reverse,
       *e_ptr++ = (unsigned char *) string;
    }
 
+   /* Regexes that can't take advantage of backtracking run in linear time
+      on the NFA. */
+
+   if (prog->nfa_off != 0 &&
+       (Engine_Policy == RE_ENGINE_NFA ||
+        (Engine_Policy == RE_ENGINE_AUTO && prog->nfa_loops))) {
+
+      if (reverse && End_Of_String != NULL &&
+          (unsigned char *) end > End_Of_String) {
+         end = (const char *) End_Of_String;
+      }
+
+      prog->engine = RE_ENGINE_NFA;
+
+      ret_val = nfa_exec (prog, (unsigned char *) string,
+                          (unsigned char *) end, reverse);
+
+      goto SINGLE_RETURN;
+   }
+
+   prog->engine = RE_ENGINE_BACKTRACK;
+
    if (!reverse) { /* Forward Search */
       if (prog->anchor) {
          /* Search is anchored at BOL */
@@ -2813,6 +3218,14 @@ int ExecRE(regexp *prog, const char* string, const char* end, int reverse,
 
          goto SINGLE_RETURN;
 
+      } else if (prog->required_len > 1 ||
+                 (prog->required_len > 0 && prog->match_start == '\0')) {
+         /* We know a literal that every match must contain. */
+
+         ret_val = forward_literal_search (prog, (unsigned char *) string,
+                                           (unsigned char *) end);
+
+         goto SINGLE_RETURN;
       } else if (prog->match_start != '\0') {
          /* We know what char match must start with. */
 
@@ -2878,6 +3291,15 @@ int ExecRE(regexp *prog, const char* string, const char* end, int reverse,
             goto SINGLE_RETURN;
          }
 
+         goto SINGLE_RETURN;
+      } else if (prog->required_max >= 0 && (prog->required_len > 1 ||
+                 (prog->required_len > 0 && prog->match_start == '\0'))) {
+         /* We know a literal that every match must contain, and how far
+            from the start of the match it can be. */
+
+         ret_val = reverse_literal_search (prog, (unsigned char *) string,
+                                           (unsigned char *) end);
+
          goto SINGLE_RETURN;
       } else if (prog->match_start != '\0') {
          /* We know what char match must start with. */
@@ -2973,6 +3395,162 @@ static int init_ansi_classes (void) {
    return (1);
 }
 
+/*----------------------------------------------------------------------*
+ * find_literal, rfind_literal
+ *
+ * Find the first (last) occurrence of the `len' byte literal `lit'
+ * that starts at or after `from' and ends at or before `limit'.  `limit'
+ * may be NULL, in which case the text is scanned until its logical end.
+ *----------------------------------------------------------------------*/
+
+static unsigned char * find_literal (
+   unsigned char *from,
+   unsigned char *limit,
+   unsigned char *lit,
+   long           len) {
+
+   unsigned char *last_start;
+   size_t         avail;
+
+   if (End_Of_String != NULL && (limit == NULL || limit > End_Of_String)) {
+      limit = End_Of_String;
+   }
+
+   if (limit == NULL) return (unsigned char *) strstr ((char *) from,
+                                                        (char *) lit);
+
+   if (from >= limit) return NULL;
+
+   /* Don't look past a terminating \0 before `limit'. */
+
+   avail = strnlen ((char *) from, (size_t) (limit - from));
+
+   if ((long) avail < len) return NULL;
+
+   last_start = from + avail - len;
+
+   while (from <= last_start) {
+      from = (unsigned char *) memchr (from, *lit,
+                                       (size_t) (last_start - from + 1));
+
+      if (from == NULL) return NULL;
+
+      if (memcmp (from + 1, lit + 1, (size_t) (len - 1)) == 0) return from;
+
+      from++;
+   }
+
+   return NULL;
+}
+
+static unsigned char * rfind_literal (
+   unsigned char *from,
+   unsigned char *limit,
+   unsigned char *lit,
+   long           len) {
+
+   unsigned char *p;
+
+   for (p = limit - len; p >= from; p--) {
+      if (*p == *lit && memcmp (p + 1, lit + 1, (size_t) (len - 1)) == 0) {
+         return p;
+      }
+   }
+
+   return NULL;
+}
+
+/*----------------------------------------------------------------------*
+ * forward_literal_search, reverse_literal_search
+ *
+ * Search loops of `ExecRE' for regexes with a required literal (see
+ * find_required_literal).  Instead of attempting a match at every
+ * position, look for the next occurrence of the literal and only attempt
+ * matches at the positions from where it can be reached.  Positions are
+ * tried in the same order as by the general loops, so the result is the
+ * same.  Returns: 0 failure, 1 success
+ *----------------------------------------------------------------------*/
+
+static int forward_literal_search (
+   regexp        *prog,
+   unsigned char *string,
+   unsigned char *end) {
+
+   unsigned char *lit = (unsigned char *) prog->program + prog->required_off;
+            long  len = prog->required_len;
+            long  min = prog->required_min;
+            long  max = prog->required_max;
+   unsigned char *str = string, *found, *first, *last, *limit = NULL;
+
+   /* Make sure there is enough text to skip over the first `min' bytes. */
+
+   if (End_Of_String != NULL && string + min > End_Of_String) return 0;
+
+   if ((long) strnlen ((char *) string, (size_t) min) < min) return 0;
+
+   /* Matches may not start at or after `end', so there is no point in
+      looking for the literal much beyond it. */
+
+   if (end != NULL && max >= 0) limit = end + max + len;
+
+   while (!Recursion_Limit_Exceeded) {
+      found = find_literal (str + min, limit, lit, len);
+
+      if (found == NULL) return 0;
+
+      first = (max >= 0 && found - max > str) ? found - max : str;
+      last  = found - min;
+
+      for (str = first; str <= last; str++) {
+         if (AT_END_OF_STRING(str) || (end != NULL && str >= end)) return 0;
+
+         if (attempt (prog, str)) return 1;
+
+         if (Recursion_Limit_Exceeded) return 0;
+      }
+   }
+
+   return 0;
+}
+
+static int reverse_literal_search (
+   regexp        *prog,
+   unsigned char *string,
+   unsigned char *end) {
+
+   unsigned char *lit = (unsigned char *) prog->program + prog->required_off;
+            long  len = prog->required_len;
+            long  min = prog->required_min;
+            long  max = prog->required_max;
+   unsigned char *str = end, *found, *first, *last, *limit, *hi;
+
+   /* The literal of a match starting at or before `end' must end before
+      `limit'. Again, don't look past a terminating \0. */
+
+   limit = end + strnlen ((char *) end, (size_t) (max + len));
+
+   if (End_Of_String != NULL && limit > End_Of_String) limit = End_Of_String;
+
+   while (str >= string && !Recursion_Limit_Exceeded) {
+      hi = (limit - str > max + len) ? str + max + len : limit;
+
+      found = rfind_literal (string + min, hi, lit, len);
+
+      if (found == NULL) return 0;
+
+      last  = (found - min < str) ? found - min : str;
+      first = (found - max > string) ? found - max : string;
+
+      for (str = last; str >= first; str--) {
+         if (attempt (prog, str)) return 1;
+
+         if (Recursion_Limit_Exceeded) return 0;
+      }
+   }
+
+   return 0;
+}
+
 /*----------------------------------------------------------------------*
  * attempt - try match at specific point, returns: 0 failure, 1 success
  *----------------------------------------------------------------------*/
@@ -2990,8 +3568,9 @@ static int attempt (regexp *prog, unsigned char *string) {
    s_ptr          = (unsigned char **) prog->startp;
    e_ptr          = (unsigned char **) prog->endp;
 
-   /* Reset the recursion counter. */
+   /* Reset the recursion counter, each attempt adds to the step budget. */
    Recursion_Count = 0;
+   Attempt_Count++;
 
    /* Overhead due to capturing parentheses. */
 
@@ -3042,8 +3621,11 @@ static int match (unsigned char *prog, int *branch_index_param) {
        if (!Recursion_Limit_Exceeded) /* Prevent duplicate errors */
            reg_error("recursion limit exceeded, please respecify expression");
        Recursion_Limit_Exceeded = 1;
+       Exec_Status = REEXEC_TOO_EXPENSIVE;
        MATCH_RETURN (0);
    }
+
+   if (!CHARGE_STEP) MATCH_RETURN (0);
 	    
 
    scan = prog;
@@ -3417,6 +3999,8 @@ static int match (unsigned char *prog, int *branch_index_param) {
                   /* Couldn't or didn't match. */
 
                   if (lazy) {
+                     Reg_Input = save + num_matched; /* Undo failed `next'. */
+
                      if (!greedy (next_op, 1)) MATCH_RETURN (0);
 
                      num_matched++; /* Inch forward. */
@@ -3717,6 +4301,37 @@ static int match (unsigned char *prog, int *branch_index_param) {
    MATCH_RETURN (0);
 }
 
+/*----------------------------------------------------------------------*
+ * step_checkpoint
+ *
+ * Called every RE_POLL_INTERVAL steps of `ExecRE'.  Returns 0 when
+ * matching must be given up because the search used up its step budget,
+ * or because the cancel procedure asked for it.
+ *----------------------------------------------------------------------*/
+
+static int step_checkpoint (void) {
+
+   Step_Tick   = RE_POLL_INTERVAL;
+   Step_Total += RE_POLL_INTERVAL;
+
+   if (Step_Budget != 0 && Step_Total - Step_Tick - Attempt_Start >
+       Step_Budget + Attempt_Count * Attempt_Steps) {
+      Recursion_Limit_Exceeded = 1;
+      Exec_Status = REEXEC_TOO_EXPENSIVE;
+
+      return 0;
+   }
+
+   if (Cancel_Proc != NULL && (*Cancel_Proc) (Cancel_Arg)) {
+      Recursion_Limit_Exceeded = 1;
+      Exec_Status = REEXEC_CANCELLED;
+
+      return 0;
+   }
+
+   return 1;
+}
+
 /*----------------------------------------------------------------------*
  * greedy
  *
@@ -3738,6 +4353,8 @@ static unsigned long greedy (unsigned char *p, long max) {
    register unsigned long  count = REG_ZERO;
    register unsigned long  max_cmp;
 
+   if (!CHARGE_STEP) return REG_ZERO;
+
    input_str = Reg_Input;
    operand   = OPERAND (p); /* Literal char or start of class characters. */
    max_cmp   = (max > 0) ? (unsigned long) max : ULONG_MAX;
@@ -3973,88 +4590,140 @@ static unsigned char * next_ptr (unsigned char *ptr) {
    }
 }
 
-/*
-**  SubstituteRE - Perform substitutions after a `regexp' match.
-**
-**  This function cleanly shortens results of more than max length to max.
-**  To give the caller a chance to react to this the function returns False
-**  on any error. The substitution will still be executed.
-*/
-Boolean SubstituteRE(const regexp* prog, const char* source, char* dest,
-        int max)
-{
+/*----------------------------------------------------------------------*
+ * next_subst_token
+ *
+ * Parses the next token of a substitution string, advancing *src past it.
+ * Returns -2 at the end of the string, -1 for an ordinary character (stored
+ * in *c), or the number of the parenthesized subexpression to insert.  Any
+ * case altering token (\u, \U, \l, \L) in front of it is stored in *chgcase.
+ *----------------------------------------------------------------------*/
 
-   register unsigned char *src;
-            unsigned char *src_alias;
-   register unsigned char *dst;
-   register unsigned char  c;
-   register unsigned char  test;
-   register          int   paren_no;
-   register          int   len;
-   register unsigned char  chgcase;
-   Boolean anyWarnings = False;
+static int next_subst_token (
+   unsigned char **src,
+   unsigned char  *c,
+   unsigned char  *chgcase) {
 
-   if (prog == NULL || source == NULL || dest == NULL) {
-      reg_error ("NULL parm to `SubstituteRE\'");
+   unsigned char *scan = *src;
+   unsigned char *scan_alias;
+   unsigned char  test;
+   int            paren_no = -1;
 
-      return False;
-   }
+   *chgcase = '\0';
 
-   if (U_CHAR_AT (prog->program) != MAGIC) {
-      reg_error ("damaged regexp passed to `SubstituteRE\'");
+   if ((*c = *scan++) == '\0') return -2;
 
-      return False;
-   }
+   if (*c == '\\') {
+      /* Process any case altering tokens, i.e \u, \U, \l, \L. */
 
-   src = (unsigned char *) source;
-   dst = (unsigned char *) dest;
+      if (*scan == 'u' || *scan == 'U' || *scan == 'l' || *scan == 'L') {
+         *chgcase = *scan;
+         scan++;
+         *c = *scan++;
 
-   while ((c = *src++) != '\0') {
-      chgcase  = '\0';
-      paren_no = -1;
+         if (*c == '\0') return -2;
+      }
+   }
 
-      if (c == '\\') {
-         /* Process any case altering tokens, i.e \u, \U, \l, \L. */
+   if (*c == '&') {
+      paren_no = 0;
+   } else if (*c == '\\') {
+      scan_alias = scan;
 
-         if (*src == 'u' || *src == 'U' || *src == 'l' || *src == 'L') {
-            chgcase = *src;
-            src++;
-            c = *src++;
+      if ('1' <= *scan && *scan <=  '9') {
+         paren_no = (int) *scan++ - (int) '0';
 
-            if (c == '\0') break;
-         }
-      }
+      } else if ((test = literal_escape (*scan)) != '\0') {
+         *c = test; scan++;
 
-      if (c == '&') {
-         paren_no = 0;
-      } else if (c == '\\') {
-         /* Can not pass register variable `&src' to function `numeric_escape'
-            so make a non-register copy that we can take the address of. */
+      } else if ((test = numeric_escape (*scan, &scan_alias)) != '\0') {
+         *c   = test;
+         scan = scan_alias; scan++;
 
-         src_alias = src;
+         /* NOTE: if an octal escape for zero is attempted (e.g. \000), it
+            will be treated as a literal string. */
+      } else if (*scan == '\0') {
+         /* If '\' is the last character of the replacement string, it is
+            interpreted as a literal backslash. */
 
-         if ('1' <= *src && *src <=  '9') {
-            paren_no = (int) *src++ - (int) '0';
+         *c = '\\';
+      } else {
+         *c = *scan++; /* Allow any escape sequence (This is  */
+      }                /* INCONSISTENT with the `CompileRE'   */
+   }                   /* mind set of issuing an error!       */
 
-         } else if ((test = literal_escape (*src)) != '\0') {
-            c = test; src++;
+   *src = scan;
 
-         } else if ((test = numeric_escape (*src, &src_alias)) != '\0') {
-            c   = test;
-            src = src_alias; src++;
+   return paren_no;
+}
 
-            /* NOTE: if an octal escape for zero is attempted (e.g. \000), it
-               will be treated as a literal string. */
-         } else if (*src == '\0') {
-            /* If '\' is the last character of the replacement string, it is
-               interpreted as a literal backslash. */
+/*
+**  SubstituteRELength - Length of the result of SubstituteRE.
+**
+**  Returns the number of characters (not counting the terminating NUL)
+**  that SubstituteRE would produce for "source" after the last match of
+**  "prog", so that the caller can size the destination without truncation.
+*/
+int SubstituteRELength(const regexp* prog, const char* source)
+{
+   unsigned char *src;
+   unsigned char  c;
+   unsigned char  chgcase;
+   int            paren_no;
+   int            len = 0;
 
-            c = '\\';
-         } else {
-            c = *src++; /* Allow any escape sequence (This is  */
-         }              /* INCONSISTENT with the `CompileRE'   */
-      }                 /* mind set of issuing an error!       */
+   if (prog == NULL || source == NULL) return 0;
+
+   src = (unsigned char *) source;
+
+   while ((paren_no = next_subst_token (&src, &c, &chgcase)) != -2) {
+      if (paren_no < 0) {
+         len++;
+      } else if (prog->startp [paren_no] != NULL &&
+                 prog->endp   [paren_no] != NULL) {
+         len += prog->endp [paren_no] - prog->startp [paren_no];
+      }
+   }
 
+   return len;
+}
+
+/*
+**  SubstituteRE - Perform substitutions after a `regexp' match.
+**
+**  This function cleanly shortens results of more than max length to max.
+**  To give the caller a chance to react to this the function returns False
+**  on any error. The substitution will still be executed.  Use
+**  SubstituteRELength to find the size needed for the whole result.
+*/
+Boolean SubstituteRE(const regexp* prog, const char* source, char* dest,
+        int max)
+{
+
+            unsigned char *src;
+   register unsigned char *dst;
+            unsigned char  c;
+            unsigned char  chgcase;
+   register          int   paren_no;
+   register          int   len;
+   Boolean anyWarnings = False;
+
+   if (prog == NULL || source == NULL || dest == NULL) {
+      reg_error ("NULL parm to `SubstituteRE\'");
+
+      return False;
+   }
+
+   if (U_CHAR_AT (prog->program) != MAGIC) {
+      reg_error ("damaged regexp passed to `SubstituteRE\'");
+
+      return False;
+   }
+
+   src = (unsigned char *) source;
+   dst = (unsigned char *) dest;
+
+   while ((paren_no = next_subst_token (&src, &c, &chgcase)) != -2) {
       if (paren_no < 0) { /* Ordinary character. */
          if (((char *) dst - (char *) dest) >= (max - 1)) {
             reg_error("replacing expression in `SubstituteRE\' too long; "
@@ -4069,7 +4738,7 @@ Boolean SubstituteRE(const regexp* prog, const char* source, char* dest,
 
          len = prog->endp [paren_no] - prog->startp [paren_no];
 
-         if (((char *) dst + len - (char *) dest) >= max-1) {
+         if (((char *) dst + len - (char *) dest) > max-1) {
             reg_error("replacing expression in `SubstituteRE\' too long; "
                       "truncating");
             anyWarnings = True;
@@ -4176,3 +4845,1106 @@ static unsigned char * makeDelimiterTable (
 void SetREDefaultWordDelimiters (char *delimiters) {
    makeDelimiterTable ((unsigned char *) delimiters, Default_Delimiters);
 }
+
+/*----------------------------------------------------------------------*
+ * SetREStepBudget, SetRECancelProc, GetREExecStatus
+ *
+ * Limit the work of `ExecRE', so that a pathological regex can't freeze
+ * the editor, and report why the last `ExecRE' call gave up.
+ *----------------------------------------------------------------------*/
+
+void SetREStepBudget (unsigned long steps) {
+   Step_Budget = steps;
+}
+
+void SetRECancelProc (RECancelProc proc, void *cbArg) {
+   Cancel_Proc = proc;
+   Cancel_Arg  = cbArg;
+}
+
+int GetREExecStatus (void) {
+   return Exec_Status;
+}
+
+/*======================================================================*
+ *  NFA execution
+ *======================================================================*/
+
+/* The backtracking matcher above can take exponential time on patterns
+ * with nested or alternating loops like `(a|aa)*b', which hangs the whole
+ * editor.  Patterns that don't need backtracking specific features (back
+ * references, look-ahead/behind, counted (...){m,n} constructs) are
+ * therefore also translated into a Thompson style NFA, which `ExecRE' can
+ * simulate in time linear in the length of the text (Pike's algorithm).
+ *
+ * The threads of the simulation are kept in the order in which the
+ * backtracker would try them, so the NFA finds the same match, with the
+ * same captured sub-expressions and `top_branch', as `match' does.  Note
+ * that `.' steps over a whole UTF-8 character but `.*' (greedy) counts
+ * bytes; the NFA mimics both.
+ *
+ * The NFA is appended to the allocation of the compiled regex, so it is
+ * freed together with it. */
+
+#define NFA_BYTE      1  /* Consume byte `c'. */
+#define NFA_BYTE_CI   2  /* Consume a byte that is `c' after tolower(). */
+#define NFA_CLASS     3  /* Consume a byte in class `cls'. */
+#define NFA_DELIM     4  /* Consume a word delimiter (c == 0) or a non
+                            delimiter (c == 1). */
+#define NFA_UTF8      5  /* Consume a UTF-8 lead byte in class `cls' and
+                            skip the rest of the character. */
+#define NFA_SKIP      6  /* Consume any byte (UTF-8 continuation). */
+#define NFA_ASSERT    7  /* Zero width assertion, `c' is the op code. */
+#define NFA_SPLIT     8  /* Continue at `x', then at `y'. */
+#define NFA_JMP       9  /* Continue at `x'. */
+#define NFA_SAVE     10  /* Record position in capture slot `c'. */
+#define NFA_BRANCH   11  /* Record top branch `y' unless already set. */
+#define NFA_MATCH    12  /* Success. */
+
+#define NFA_MAX_INST   16384  /* Larger NFAs are left to the backtracker. */
+#define NFA_MAX_REPEAT    64  /* Largest expanded x{m,n} count. */
+#define NFA_CLASS_SIZE    32  /* Bytes of a 256 bit character class. */
+
+typedef struct {
+   unsigned char  op;
+   unsigned char  c;
+   unsigned short cls;
+            int   x;
+            int   y;
+} nfa_inst;
+
+typedef struct {
+   unsigned char *base;       /* Start of the regex program. */
+            int  *map;        /* Program offset -> first instruction. */
+            int  *queue;      /* Program offsets still to translate. */
+            int   queue_len;
+   nfa_inst      *inst;
+            int   num_inst;
+            int   max_inst;
+   unsigned char *classes;
+            int   num_classes;
+            int   max_classes;
+   unsigned char *top_branch; /* Multi-way BRANCH that sets top_branch. */
+            int   has_loop;
+            int   failed;
+} nfa_builder;
+
+/* Node references are stored as -(offset + 1) until all nodes have been
+   translated, then resolved through `map'. */
+
+static int nfa_ref (nfa_builder *b, unsigned char *node) {
+
+   int offset;
+
+   if (node == NULL) {
+      b->failed = 1;
+      return 0;
+   }
+
+   offset = (int) (node - b->base);
+
+   if (b->map [offset] == -1) {
+      b->map [offset] = -2; /* Queued. */
+      b->queue [b->queue_len++] = offset;
+   }
+
+   return -(offset + 1);
+}
+
+static int nfa_emit (nfa_builder *b, int op, int c, int x, int y) {
+
+   nfa_inst *inst;
+
+   if (b->num_inst >= NFA_MAX_INST) {
+      b->failed = 1;
+      return 0;
+   }
+
+   if (b->num_inst == b->max_inst) {
+      b->max_inst = b->max_inst * 2 + 64;
+      b->inst = (nfa_inst *) NEditRealloc (b->inst,
+                                           sizeof (nfa_inst) * b->max_inst);
+   }
+
+   inst      = &b->inst [b->num_inst];
+   inst->op  = (unsigned char) op;
+   inst->c   = (unsigned char) c;
+   inst->cls = 0;
+   inst->x   = x;
+   inst->y   = y;
+
+   return b->num_inst++;
+}
+
+/* Builds the class of bytes accepted by a single character node, using the
+   same tests as `match' and `greedy'. */
+
+static int nfa_class (nfa_builder *b, unsigned char *node) {
+
+   unsigned char *cls;
+            int   op = GET_OP_CODE (node), i, in;
+
+   if (b->num_classes >= USHRT_MAX) {
+      b->failed = 1;
+      return 0;
+   }
+
+   if (b->num_classes == b->max_classes) {
+      b->max_classes = b->max_classes * 2 + 8;
+      b->classes = (unsigned char *) NEditRealloc (b->classes,
+            (size_t) NFA_CLASS_SIZE * b->max_classes);
+   }
+
+   cls = b->classes + NFA_CLASS_SIZE * b->num_classes;
+   memset (cls, 0, NFA_CLASS_SIZE);
+
+   for (i = 1; i <= UCHAR_MAX; i++) { /* \0 is always the end of string. */
+      switch (op) {
+         case ANY:           in = (i != '\n');                           break;
+         case EVERY:         in = 1;                                     break;
+         case EXACTLY:       in = (i == *OPERAND (node));                break;
+         case SIMILAR:       in = (tolower (i) == *OPERAND (node));      break;
+         case ANY_OF:
+            in = (strchr ((char *) OPERAND (node), i) != NULL);          break;
+         case ANY_BUT:
+            in = (strchr ((char *) OPERAND (node), i) == NULL);          break;
+         case DIGIT:         in = isdigit (i);                           break;
+         case NOT_DIGIT:     in = !isdigit (i) && i != '\n';             break;
+         case LETTER:        in = isalpha (i);                           break;
+         case NOT_LETTER:    in = !isalpha (i) && i != '\n';             break;
+         case SPACE:         in = isspace (i) && i != '\n';              break;
+         case SPACE_NL:      in = isspace (i);                           break;
+         case NOT_SPACE:     in = !isspace (i);                          break;
+         case NOT_SPACE_NL:  in = !isspace (i) || i == '\n';             break;
+         case WORD_CHAR:     in = isalnum (i) || i == '_';               break;
+         case NOT_WORD_CHAR:
+            in = !isalnum (i) && i != '_' && i != '\n';                  break;
+         default:
+            b->failed = 1;
+            return 0;
+      }
+
+      if (in) cls [i >> 3] |= (unsigned char) (1 << (i & 7));
+   }
+
+   return b->num_classes++;
+}
+
+/* Emits an instruction consuming exactly one byte that matches the simple
+   atom `node' (the operand of a simple quantifier). */
+
+static int nfa_emit_atom (nfa_builder *b, unsigned char *node, int x) {
+
+   int pc;
+
+   switch (GET_OP_CODE (node)) {
+      case EXACTLY:
+         return nfa_emit (b, NFA_BYTE, *OPERAND (node), x, 0);
+
+      case SIMILAR:
+         return nfa_emit (b, NFA_BYTE_CI, *OPERAND (node), x, 0);
+
+      case IS_DELIM:
+         return nfa_emit (b, NFA_DELIM, 0, x, 0);
+
+      case NOT_DELIM:
+         return nfa_emit (b, NFA_DELIM, 1, x, 0);
+
+      default:
+         pc = nfa_emit (b, NFA_CLASS, 0, x, 0);
+         if (!b->failed) b->inst [pc].cls = (unsigned short) nfa_class (b, node);
+         return pc;
+   }
+}
+
+/* Translates simple quantifiers x*, x+, x?, x{m,n} and lazy versions. */
+
+static void nfa_quantifier (nfa_builder *b, unsigned char *node,
+                            unsigned char *next) {
+
+   unsigned char *atom_node = OPERAND (node);
+            int   op = GET_OP_CODE (node), lazy = 0, i, split, body;
+            int   target = nfa_ref (b, next);
+            long  min = 0, max = 1;
+
+   switch (op) {
+      case LAZY_STAR:     lazy = 1; /* Fall through */
+      case STAR:          min = 0; max = 0; break;
+      case LAZY_PLUS:     lazy = 1; /* Fall through */
+      case PLUS:          min = 1; max = 0; break;
+      case LAZY_QUESTION: lazy = 1; /* Fall through */
+      case QUESTION:      min = 0; max = 1; break;
+      case LAZY_BRACE:    lazy = 1; /* Fall through */
+      case BRACE:
+         min       = GET_OFFSET (node + NEXT_PTR_SIZE);
+         max       = GET_OFFSET (node + (2 * NEXT_PTR_SIZE));
+         atom_node = OPERAND (node + (2 * NEXT_PTR_SIZE));
+   }
+
+   if (min > NFA_MAX_REPEAT || max > NFA_MAX_REPEAT) {
+      b->failed = 1;
+      return;
+   }
+
+   /* Mandatory repetitions first, each continuing with the next one. */
+
+   for (i = 0; i < min; i++) {
+      nfa_emit_atom (b, atom_node, b->num_inst + 1);
+   }
+
+   if (max == 0) {
+      /* Unbounded: a loop preferring one more repetition (greedy) or
+         leaving the loop (lazy). */
+
+      split = b->num_inst;
+      body  = split + 1;
+
+      if (lazy) {
+         nfa_emit (b, NFA_SPLIT, 0, target, body);
+      } else {
+         nfa_emit (b, NFA_SPLIT, 0, body, target);
+      }
+
+      nfa_emit_atom (b, atom_node, split);
+   } else {
+      /* Up to max - min optional repetitions, nested so that the greedy
+         version prefers more and the lazy version fewer repetitions. */
+
+      for (i = min; i < max; i++) {
+         split = b->num_inst;
+         body  = split + 1;
+
+         if (lazy) {
+            nfa_emit (b, NFA_SPLIT, 0, target, body);
+         } else {
+            nfa_emit (b, NFA_SPLIT, 0, body, target);
+         }
+
+         nfa_emit_atom (b, atom_node, (i + 1 < max) ? body + 1 : target);
+      }
+
+      if (min == max) nfa_emit (b, NFA_JMP, 0, target, 0);
+   }
+}
+
+/* Translates one node of the regex program (plus the string of a literal
+   node), continuing with the node's successor(s) through `nfa_ref'. */
+
+static void nfa_node (nfa_builder *b, unsigned char *node) {
+
+   unsigned char *next = next_ptr (node);
+   unsigned char *operand;
+            int   op = GET_OP_CODE (node), i, lead, branch_no;
+
+   switch (op) {
+      case EXACTLY:
+      case SIMILAR:
+         for (operand = OPERAND (node); *operand != '\0'; operand++) {
+            nfa_emit (b, (op == EXACTLY) ? NFA_BYTE : NFA_BYTE_CI, *operand,
+                      (*(operand + 1) != '\0') ? b->num_inst + 1
+                                               : nfa_ref (b, next), 0);
+         }
+
+         break;
+
+      case ANY:
+      case EVERY:
+         /* The lead byte plus up to three continuation bytes; NFA_UTF8
+            jumps into the chain of NFA_SKIP's as needed. */
+
+         lead = nfa_emit (b, NFA_UTF8, 0, nfa_ref (b, next), 0);
+         if (!b->failed) b->inst [lead].cls = (unsigned short) nfa_class (b, node);
+
+         for (i = 1; i <= 3; i++) {
+            nfa_emit (b, NFA_SKIP, 0, (i < 3) ? lead + i + 1
+                                              : nfa_ref (b, next), 0);
+         }
+
+         break;
+
+      case ANY_OF:   case ANY_BUT:
+      case DIGIT:    case NOT_DIGIT:
+      case LETTER:   case NOT_LETTER:
+      case SPACE:    case SPACE_NL:
+      case NOT_SPACE: case NOT_SPACE_NL:
+      case WORD_CHAR: case NOT_WORD_CHAR:
+      case IS_DELIM: case NOT_DELIM:
+         nfa_emit_atom (b, node, nfa_ref (b, next));
+         break;
+
+      case BOL:
+      case EOL:
+      case BOWORD:
+      case EOWORD:
+      case NOT_BOUNDARY:
+         nfa_emit (b, NFA_ASSERT, op, nfa_ref (b, next), 0);
+         break;
+
+      case STAR:     case LAZY_STAR:
+      case PLUS:     case LAZY_PLUS:
+      case QUESTION: case LAZY_QUESTION:
+      case BRACE:    case LAZY_BRACE:
+         nfa_quantifier (b, node, next);
+         break;
+
+      case NOTHING:
+         nfa_emit (b, NFA_JMP, 0, nfa_ref (b, next), 0);
+         break;
+
+      case BACK:
+         b->has_loop = 1;
+         nfa_emit (b, NFA_JMP, 0, nfa_ref (b, next), 0);
+         break;
+
+      case BRANCH:
+         /* Recording the top branch (see attempt) happens on the way into
+            the alternative's operand. */
+
+         branch_no = -1;
+
+         if (b->top_branch != NULL) {
+            unsigned char *alt = b->top_branch;
+
+            for (i = 0; alt != NULL && GET_OP_CODE (alt) == BRANCH;
+                 i++, alt = next_ptr (alt)) {
+               if (alt == node) {
+                  branch_no = i;
+                  break;
+               }
+            }
+         }
+
+         if (next != NULL && GET_OP_CODE (next) == BRANCH) {
+            /* Try this alternative, then the following ones. */
+            nfa_emit (b, NFA_SPLIT, 0, b->num_inst + 1, nfa_ref (b, next));
+         }
+
+         if (branch_no >= 0) {
+            nfa_emit (b, NFA_BRANCH, 0, nfa_ref (b, OPERAND (node)), branch_no);
+         } else {
+            nfa_emit (b, NFA_JMP, 0, nfa_ref (b, OPERAND (node)), 0);
+         }
+
+         break;
+
+      case END:
+         nfa_emit (b, NFA_MATCH, 0, 0, 0);
+         break;
+
+      default:
+         if (op > OPEN && op < OPEN + NSUBEXP) {
+            nfa_emit (b, NFA_SAVE, 2 * (op - OPEN), nfa_ref (b, next), 0);
+         } else if (op > CLOSE && op < CLOSE + NSUBEXP) {
+            nfa_emit (b, NFA_SAVE, 2 * (op - CLOSE) + 1, nfa_ref (b, next), 0);
+         } else {
+            /* Back-references, look-around, counting: backtracker only. */
+            b->failed = 1;
+         }
+   }
+}
+
+/*----------------------------------------------------------------------*
+ * build_nfa
+ *
+ * Translates the compiled regex into an NFA and appends it to the
+ * allocation of `prog', if the regex only uses features the NFA
+ * supports.  Returns the (possibly moved) compiled regex.
+ *----------------------------------------------------------------------*/
+
+static regexp * build_nfa (regexp *prog, unsigned long code_size) {
+
+   nfa_builder    b;
+   regexp        *new_prog;
+   unsigned char *scan, *next;
+   nfa_inst      *inst;
+            int   i, head = 0;
+            size_t nfa_off, size;
+
+   prog->nfa_off   = 0;
+   prog->nfa_len   = 0;
+   prog->nfa_loops = 0;
+   prog->size      = (long) (sizeof (regexp) + code_size);
+
+   memset (&b, 0, sizeof (b));
+
+   b.base  = (unsigned char *) prog->program;
+   b.map   = (int *) NEditMalloc (sizeof (int) * (code_size + 1));
+   b.queue = (int *) NEditMalloc (sizeof (int) * (code_size + 1));
+
+   for (i = 0; i <= (int) code_size; i++) b.map [i] = -1;
+
+   /* Find the alternatives that `match' reports in `top_branch': the
+      first multi-way BRANCH reached without recursion. */
+
+   scan = b.base + REGEX_START_OFFSET;
+
+   while (scan != NULL && b.top_branch == NULL) {
+      next = next_ptr (scan);
+
+      switch (GET_OP_CODE (scan)) {
+         case BRANCH:
+            if (next != NULL && GET_OP_CODE (next) == BRANCH) {
+               b.top_branch = scan;
+            } else {
+               next = OPERAND (scan);
+            }
+            break;
+
+         case BOL:    case EOL:
+         case BOWORD: case EOWORD: case NOT_BOUNDARY:
+         case EXACTLY: case SIMILAR: case ANY: case EVERY:
+         case ANY_OF:   case ANY_BUT:
+         case DIGIT:    case NOT_DIGIT:
+         case LETTER:   case NOT_LETTER:
+         case SPACE:    case SPACE_NL:
+         case NOT_SPACE: case NOT_SPACE_NL:
+         case WORD_CHAR: case NOT_WORD_CHAR:
+         case IS_DELIM: case NOT_DELIM:
+         case NOTHING:
+            break;
+
+         default:
+            next = NULL;
+      }
+
+      scan = next;
+   }
+
+   /* Translate all reachable nodes. */
+
+   (void) nfa_ref (&b, b.base + REGEX_START_OFFSET);
+
+   while (head < b.queue_len && !b.failed) {
+      b.map [b.queue [head]] = b.num_inst;
+      nfa_node (&b, b.base + b.queue [head]);
+      head++;
+   }
+
+   if (!b.failed) {
+      for (i = 0; i < b.num_inst; i++) {
+         inst = &b.inst [i];
+
+         if (inst->op != NFA_MATCH && inst->x < 0) {
+            inst->x = b.map [-inst->x - 1];
+         }
+
+         if (inst->op == NFA_SPLIT && inst->y < 0) {
+            inst->y = b.map [-inst->y - 1];
+         }
+      }
+
+      /* Append instructions and classes to the compiled regex. */
+
+      nfa_off  = sizeof (regexp) + code_size;
+      nfa_off  = (nfa_off + sizeof (long) - 1) & ~(sizeof (long) - 1);
+      size     = nfa_off + sizeof (nfa_inst) * b.num_inst +
+                 (size_t) NFA_CLASS_SIZE * b.num_classes;
+      new_prog = (regexp *) realloc (prog, size);
+
+      if (new_prog != NULL) {
+         prog = new_prog;
+
+         memcpy ((char *) prog + nfa_off, b.inst,
+                 sizeof (nfa_inst) * b.num_inst);
+
+         if (b.num_classes > 0) {
+            memcpy ((char *) prog + nfa_off + sizeof (nfa_inst) * b.num_inst,
+                    b.classes, (size_t) NFA_CLASS_SIZE * b.num_classes);
+         }
+
+         prog->nfa_off   = (long) nfa_off;
+         prog->nfa_len   = b.num_inst;
+         prog->nfa_loops = (char) b.has_loop;
+         prog->size      = (long) size;
+      }
+   }
+
+   NEditFree (b.map);
+   NEditFree (b.queue);
+   NEditFree (b.inst);
+   NEditFree (b.classes);
+
+   return prog;
+}
+
+/*----------------------------------------------------------------------*
+ * NFA simulation
+ *----------------------------------------------------------------------*/
+
+#define NFA_VISIT          0  /* Stack entry: follow instruction `arg'. */
+#define NFA_RESTORE_SLOT   1  /* Stack entry: capture slot `arg' = `ptr'. */
+#define NFA_RESTORE_BRANCH 2  /* Stack entry: top branch = `arg'. */
+
+typedef struct {
+            int   kind;
+            int   arg;
+   unsigned char *ptr;
+} nfa_stack_entry;
+
+/* Scratch space of the simulation, grown as needed and kept for the next
+   call.  A thread list holds the instruction, top branch and capture slots
+   (slot 0 is the start of the match) of each thread, highest priority
+   first. */
+
+RE_TLS int              *Nfa_Pc [2];
+RE_TLS int              *Nfa_Branch [2];
+RE_TLS unsigned char   **Nfa_Caps [2];
+RE_TLS int               Nfa_Count [2];
+RE_TLS unsigned int     *Nfa_Mark;
+RE_TLS unsigned int      Nfa_Gen;
+RE_TLS nfa_stack_entry  *Nfa_Stack;
+RE_TLS unsigned char   **Nfa_Work;
+RE_TLS unsigned char   **Nfa_Best;
+RE_TLS int               Nfa_Max_Inst  = 0;
+RE_TLS int               Nfa_Max_Slots = 0;
+
+static void nfa_alloc (int num_inst, int num_slots) {
+
+   int i;
+
+   if (num_inst <= Nfa_Max_Inst && num_slots <= Nfa_Max_Slots) return;
+
+   if (num_inst  < Nfa_Max_Inst)  num_inst  = Nfa_Max_Inst;
+   if (num_slots < Nfa_Max_Slots) num_slots = Nfa_Max_Slots;
+
+   for (i = 0; i < 2; i++) {
+      NEditFree (Nfa_Pc [i]);
+      NEditFree (Nfa_Branch [i]);
+      NEditFree (Nfa_Caps [i]);
+
+      Nfa_Pc     [i] = (int *) NEditMalloc (sizeof (int) * num_inst);
+      Nfa_Branch [i] = (int *) NEditMalloc (sizeof (int) * num_inst);
+      Nfa_Caps   [i] = (unsigned char **) NEditMalloc (
+                          sizeof (unsigned char *) * num_inst * num_slots);
+   }
+
+   NEditFree (Nfa_Mark);
+   NEditFree (Nfa_Stack);
+   NEditFree (Nfa_Work);
+   NEditFree (Nfa_Best);
+
+   Nfa_Mark  = (unsigned int *) NEditMalloc (sizeof (unsigned int) * num_inst);
+   Nfa_Stack = (nfa_stack_entry *) NEditMalloc (
+                  sizeof (nfa_stack_entry) * (num_inst + 1));
+   Nfa_Work  = (unsigned char **) NEditMalloc (
+                  sizeof (unsigned char *) * num_slots);
+   Nfa_Best  = (unsigned char **) NEditMalloc (
+                  sizeof (unsigned char *) * num_slots);
+
+   memset (Nfa_Mark, 0, sizeof (unsigned int) * num_inst);
+   Nfa_Gen = 0;
+
+   Nfa_Max_Inst  = num_inst;
+   Nfa_Max_Slots = num_slots;
+}
+
+/*----------------------------------------------------------------------*
+ * ReleaseREThreadState
+ *
+ * Frees the scratch space the calling thread used for matching.  Worker
+ * threads call this before they exit.
+ *----------------------------------------------------------------------*/
+
+void ReleaseREThreadState (void) {
+
+   int i;
+
+   for (i = 0; i < 2; i++) {
+      NEditFree (Nfa_Pc [i]);
+      NEditFree (Nfa_Branch [i]);
+      NEditFree (Nfa_Caps [i]);
+      Nfa_Pc [i] = NULL; Nfa_Branch [i] = NULL; Nfa_Caps [i] = NULL;
+   }
+
+   NEditFree (Nfa_Mark);
+   NEditFree (Nfa_Stack);
+   NEditFree (Nfa_Work);
+   NEditFree (Nfa_Best);
+   Nfa_Mark  = NULL;
+   Nfa_Stack = NULL;
+   Nfa_Work  = NULL;
+   Nfa_Best  = NULL;
+
+   Nfa_Max_Inst  = 0;
+   Nfa_Max_Slots = 0;
+}
+
+/* Starts filling a thread list. */
+
+static void nfa_clear (int list) {
+
+   Nfa_Count [list] = 0;
+
+   if (++Nfa_Gen == 0) {
+      memset (Nfa_Mark, 0, sizeof (unsigned int) * Nfa_Max_Inst);
+      Nfa_Gen = 1;
+   }
+}
+
+/* Zero width assertions, exactly as in `match'. */
+
+static int nfa_assert (int op, unsigned char *pos) {
+
+   int prev_is_delim, current_is_delim;
+
+   switch (op) {
+      case BOL:
+         if (pos == Start_Of_String) return Prev_Is_BOL;
+
+         return *(pos - 1) == '\n';
+
+      case EOL:
+         return *pos == '\n' || (AT_END_OF_STRING (pos) && Succ_Is_EOL);
+   }
+
+   if (pos == Start_Of_String) {
+      prev_is_delim = Prev_Is_Delim;
+   } else {
+      prev_is_delim = Current_Delimiters [*(pos - 1)];
+   }
+
+   if (AT_END_OF_STRING (pos)) {
+      current_is_delim = Succ_Is_Delim;
+   } else {
+      current_is_delim = Current_Delimiters [*pos];
+   }
+
+   switch (op) {
+      case BOWORD:       return  prev_is_delim && !current_is_delim;
+      case EOWORD:       return !prev_is_delim &&  current_is_delim;
+      case NOT_BOUNDARY: return !(prev_is_delim ^ current_is_delim);
+   }
+
+   return 0;
+}
+
+/* Adds the threads reachable from instruction `pc' without consuming input
+   to `list', in priority order.  Instructions that were already reached
+   by a thread of higher priority are skipped. */
+
+static void nfa_add_thread (
+   nfa_inst       *inst,
+   int             list,
+   int             pc,
+   unsigned char  *pos,
+   unsigned char **caps,
+   int             branch,
+   int             num_slots) {
+
+   nfa_stack_entry *sp = Nfa_Stack;
+   unsigned char  **work = Nfa_Work;
+   nfa_inst        *ip;
+            int      n;
+
+   memcpy (work, caps, sizeof (unsigned char *) * num_slots);
+
+   sp->kind = NFA_VISIT;
+   sp->arg  = pc;
+   sp++;
+
+   while (sp > Nfa_Stack) {
+      sp--;
+
+      if (sp->kind == NFA_RESTORE_SLOT) {
+         work [sp->arg] = sp->ptr;
+         continue;
+      } else if (sp->kind == NFA_RESTORE_BRANCH) {
+         branch = sp->arg;
+         continue;
+      }
+
+      pc = sp->arg;
+
+      for (;;) {
+         if (Nfa_Mark [pc] == Nfa_Gen) break;
+
+         Nfa_Mark [pc] = Nfa_Gen;
+         ip = &inst [pc];
+
+         switch (ip->op) {
+            case NFA_JMP:
+               pc = ip->x;
+               continue;
+
+            case NFA_SPLIT:
+               sp->kind = NFA_VISIT;
+               sp->arg  = ip->y;
+               sp++;
+               pc = ip->x;
+               continue;
+
+            case NFA_SAVE:
+               sp->kind = NFA_RESTORE_SLOT;
+               sp->arg  = ip->c;
+               sp->ptr  = work [ip->c];
+               sp++;
+               work [ip->c] = pos;
+               pc = ip->x;
+               continue;
+
+            case NFA_BRANCH:
+               if (branch < 0) {
+                  sp->kind = NFA_RESTORE_BRANCH;
+                  sp->arg  = branch;
+                  sp++;
+                  branch = ip->y;
+               }
+
+               pc = ip->x;
+               continue;
+
+            case NFA_ASSERT:
+               if (nfa_assert (ip->c, pos)) {
+                  pc = ip->x;
+                  continue;
+               }
+
+               break;
+
+            default:
+               n = Nfa_Count [list]++;
+               Nfa_Pc     [list] [n] = pc;
+               Nfa_Branch [list] [n] = branch;
+               memcpy (Nfa_Caps [list] + (size_t) n * num_slots, work,
+                       sizeof (unsigned char *) * num_slots);
+         }
+
+         break;
+      }
+   }
+}
+
+/* Adds a thread starting a match at `pos' to `list'. */
+
+static void nfa_add_start (
+   nfa_inst      *inst,
+   int            list,
+   unsigned char *pos,
+   int            num_slots) {
+
+   int i;
+
+   for (i = 0; i < num_slots; i++) Nfa_Work [i] = NULL;
+
+   Nfa_Work [0] = pos;
+
+   nfa_add_thread (inst, list, 0, pos, Nfa_Work, -1, num_slots);
+}
+
+/* Returns the first position at or after `pos' where a forward search may
+   start a match (see the search loops of `ExecRE'), or NULL if there is
+   none.  `lit_until' remembers up to where the last occurrence of the
+   required literal allows matches to start. */
+
+static unsigned char * nfa_next_start (
+   regexp         *prog,
+   unsigned char  *string,
+   unsigned char  *end,
+   unsigned char  *pos,
+   unsigned char **lit_until) {
+
+   unsigned char *lit   = (unsigned char *) prog->program + prog->required_off;
+   unsigned char *limit = NULL, *found;
+            long  min   = prog->required_min;
+            long  max   = prog->required_max;
+
+   if (end != NULL && max >= 0) limit = end + max + prog->required_len;
+
+   for (;; pos++) {
+      if (end != NULL && pos >= end + (prog->anchor ? 1 : 0)) return NULL;
+
+      if (prog->anchor) {
+         if (pos == string || *(pos - 1) == '\n') return pos;
+      } else if (prog->required_len > 0) {
+         if (*lit_until == NULL || pos > *lit_until) {
+            if (End_Of_String != NULL && pos + min > End_Of_String) {
+               return NULL;
+            }
+
+            if ((long) strnlen ((char *) pos, (size_t) min) < min) return NULL;
+
+            found = find_literal (pos + min, limit, lit, prog->required_len);
+
+            if (found == NULL) return NULL;
+
+            if (max >= 0 && found - max > pos) pos = found - max;
+
+            *lit_until = found - min;
+
+            if (end != NULL && pos >= end) return NULL;
+         }
+
+         return pos;
+      } else if (prog->match_start == '\0' ||
+                 *pos == (unsigned char) prog->match_start) {
+         return pos;
+      }
+
+      if (AT_END_OF_STRING (pos)) return NULL;
+   }
+}
+
+/* Can a reverse search start a match at `pos'? */
+
+static int nfa_reverse_start (regexp *prog, unsigned char *string,
+                              unsigned char *pos) {
+
+   if (prog->anchor) return pos == string || *(pos - 1) == '\n';
+
+   if (prog->match_start != '\0') {
+      return *pos == (unsigned char) prog->match_start;
+   }
+
+   return 1;
+}
+
+/*----------------------------------------------------------------------*
+ * nfa_run
+ *
+ * Runs the NFA over the text starting at `pos'.  A forward search starts
+ * threads wherever `nfa_next_start' allows, with lower priority than
+ * the threads of earlier starts, and stops starting threads after the
+ * first match.  A reverse search starts threads at the allowed positions
+ * from `pos' to `last', with higher priority than the threads of earlier
+ * starts.  Returns the end of the best match (its captures are in
+ * `Nfa_Best') or NULL.
+ *----------------------------------------------------------------------*/
+
+static unsigned char * nfa_run (
+   regexp        *prog,
+   unsigned char *string,
+   unsigned char *end,
+   unsigned char *pos,
+   unsigned char *last,
+   int            reverse,
+   int           *best_branch) {
+
+   nfa_inst      *inst   = (nfa_inst *) ((char *) prog + prog->nfa_off);
+   unsigned char *class_base = (unsigned char *) (inst + prog->nfa_len);
+   unsigned char *best   = NULL, *next_start = NULL, *lit_until = NULL;
+   unsigned char *cls;
+   unsigned char **caps;
+            int   num_slots = 2 * (Total_Paren + 1);
+            int   cur = 0, nxt = 1, i, pc, len, matched = 0;
+   nfa_inst      *ip;
+
+   nfa_alloc (prog->nfa_len, num_slots);
+
+   nfa_clear (cur);
+
+   if (reverse) {
+      if (nfa_reverse_start (prog, string, pos)) {
+         nfa_add_start (inst, cur, pos, num_slots);
+      }
+   } else {
+      next_start = nfa_next_start (prog, string, end, pos, &lit_until);
+
+      if (next_start == NULL) return NULL;
+
+      pos = next_start;
+      nfa_add_start (inst, cur, pos, num_slots);
+   }
+
+   for (;;) {
+      /* The simulation takes linear time, so the step budget doesn't
+         apply, but it can be cancelled. */
+
+      Attempt_Start = Step_Total - Step_Tick;
+
+      if (!CHARGE_STEP) return NULL;
+
+      nfa_clear (nxt);
+
+      /* Matches starting later are preferred by reverse searches. */
+
+      if (reverse && pos < last && !AT_END_OF_STRING (pos) &&
+          nfa_reverse_start (prog, string, pos + 1)) {
+         nfa_add_start (inst, nxt, pos + 1, num_slots);
+      }
+
+      for (i = 0; i < Nfa_Count [cur]; i++) {
+         pc   = Nfa_Pc [cur] [i];
+         ip   = &inst [pc];
+         caps = Nfa_Caps [cur] + (size_t) i * num_slots;
+
+         if (ip->op == NFA_MATCH) {
+            /* Threads of lower priority can't beat this match. */
+
+            best        = pos;
+            matched     = 1;
+           *best_branch = Nfa_Branch [cur] [i];
+            memcpy (Nfa_Best, caps, sizeof (unsigned char *) * num_slots);
+
+            break;
+         }
+
+         if (AT_END_OF_STRING (pos)) continue;
+
+         switch (ip->op) {
+            case NFA_BYTE:
+               if (*pos != ip->c) continue;
+               break;
+
+            case NFA_BYTE_CI:
+               if (tolower (*pos) != ip->c) continue;
+               break;
+
+            case NFA_CLASS:
+               cls = class_base + NFA_CLASS_SIZE * ip->cls;
+               if (!(cls [*pos >> 3] & (1 << (*pos & 7)))) continue;
+               break;
+
+            case NFA_DELIM:
+               if ((Current_Delimiters [*pos] ? 0 : 1) != ip->c) continue;
+               break;
+
+            case NFA_UTF8:
+               cls = class_base + NFA_CLASS_SIZE * ip->cls;
+               if (!(cls [*pos >> 3] & (1 << (*pos & 7)))) continue;
+
+               len = Utf8CharLen (pos);
+
+               if (len > 1 && len <= 4) {
+                  nfa_add_thread (inst, nxt, pc + 5 - len, pos + 1, caps,
+                                  Nfa_Branch [cur] [i], num_slots);
+                  continue;
+               }
+
+               break;
+
+            case NFA_SKIP:
+               break;
+         }
+
+         nfa_add_thread (inst, nxt, ip->x, pos + 1, caps,
+                         Nfa_Branch [cur] [i], num_slots);
+      }
+
+      if (AT_END_OF_STRING (pos)) break;
+
+      pos++;
+
+      /* Forward searches prefer matches starting earlier. */
+
+      if (!reverse && !matched && next_start != NULL) {
+         if (next_start < pos) {
+            next_start = nfa_next_start (prog, string, end, pos, &lit_until);
+         }
+
+         if (next_start == pos) nfa_add_start (inst, nxt, pos, num_slots);
+      }
+
+      cur = nxt;
+      nxt = 1 - cur;
+
+      if (Nfa_Count [cur] == 0) {
+         if (reverse) {
+            if (pos > last) break;
+         } else {
+            if (matched) break;
+
+            /* Nothing in progress: skip to where the next match may
+               start. */
+
+            if (next_start == NULL) break;
+
+            if (next_start > pos) {
+               pos = next_start;
+               nfa_clear (cur);
+               nfa_add_start (inst, cur, pos, num_slots);
+            }
+         }
+      }
+   }
+
+   return best;
+}
+
+/*----------------------------------------------------------------------*
+ * nfa_exec - `ExecRE' using the NFA, returns: 0 failure, 1 success
+ *----------------------------------------------------------------------*/
+
+static int nfa_exec (
+   regexp        *prog,
+   unsigned char *string,
+   unsigned char *end,
+   int            reverse) {
+
+   unsigned char *lit = (unsigned char *) prog->program + prog->required_off;
+            long  len = prog->required_len;
+            long  min = prog->required_min;
+            long  max = prog->required_max;
+   unsigned char *found = NULL, *lo, *hi, *limit = NULL, *top, *lit_found;
+            int   branch = -1, i, use_lit;
+            long  window = 64;
+
+   if (!reverse) {
+      found = nfa_run (prog, string, end, string, NULL, 0, &branch);
+   } else {
+      /* Run the NFA over windows of increasing size, going backwards from
+         `end', until one contains the start of a match.  If a required
+         literal is known (see reverse_literal_search) the windows are the
+         ranges from where its occurrences can be reached. */
+
+      use_lit = !prog->anchor && max >= 0 &&
+                (len > 1 || (len > 0 && prog->match_start == '\0'));
+
+      if (use_lit) {
+         limit = end + strnlen ((char *) end, (size_t) (max + len));
+
+         if (End_Of_String != NULL && limit > End_Of_String) {
+            limit = End_Of_String;
+         }
+      }
+
+      hi = end;
+
+      while (hi >= string) {
+         if (use_lit) {
+            top       = (limit - hi > max + len) ? hi + max + len : limit;
+            lit_found = rfind_literal (string + min, top, lit, len);
+
+            if (lit_found == NULL) break;
+
+            if (lit_found - min < hi) hi = lit_found - min;
+
+            lo = (lit_found - max > string) ? lit_found - max : string;
+         } else {
+            lo = (hi - string > window) ? hi - window : string;
+         }
+
+         found = nfa_run (prog, string, end, lo, hi, 1, &branch);
+
+         if (found != NULL || lo == string || Recursion_Limit_Exceeded) break;
+
+         hi      = lo - 1;
+         window *= 4;
+      }
+   }
+
+   for (i = 0; i <= Total_Paren; i++) {
+      if (found != NULL) {
+         prog->startp [i] = (char *) Nfa_Best [2 * i];
+         prog->endp   [i] = (char *) Nfa_Best [2 * i + 1];
+      } else {
+         prog->startp [i] = NULL;
+         prog->endp   [i] = NULL;
+      }
+   }
+
+   if (found == NULL) return 0;
+
+   prog->endp [0]   = (char *) found;
+   prog->extentpBW  = prog->startp [0];
+   prog->extentpFW  = (char *) found;
+   prog->top_branch = (branch < 0) ? 0 : branch;
+
+   return 1;
+}
+
+/* Selects the matching engine used by `ExecRE' (see RE_ENGINE). */
+
+void SetREEnginePolicy (int policy) {
+
+   Engine_Policy = policy;
+}
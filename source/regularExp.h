@@ -49,6 +49,16 @@ typedef struct regexp {
                                Used by syntax highlighting only. */
    char  match_start;       /* Internal use only. */
    char  anchor;            /* Internal use only. */
+   int   required_off;      /* Internal use only. */
+   int   required_len;      /* Internal use only. */
+   long  required_min;      /* Internal use only. */
+   long  required_max;      /* Internal use only. */
+   long  nfa_off;           /* Internal use only. */
+   int   nfa_len;           /* Internal use only. */
+   char  nfa_loops;         /* Internal use only. */
+   long  size;              /* Bytes allocated for the compiled regex. */
+   char  engine;            /* Engine used by the last `ExecRE' call, one of
+                               RE_ENGINE_BACKTRACK or RE_ENGINE_NFA. */
    char  program [1];       /* Unwarranted chumminess with compiler. */
 } regexp;
 
@@ -60,6 +70,21 @@ typedef enum {
   /* REDFLT_MATCH_NEWLINE = 2    Currently not used. */ 
 } RE_DEFAULT_FLAG;
 
+/* Matching engines.  Regexes without back-references, look-around or counted
+   repetition can be run by a linear-time NFA simulation instead of the
+   backtracking matcher.  With RE_ENGINE_AUTO the NFA is used for such regexes
+   when they contain loops (where backtracking may go exponential). */
+
+typedef enum {
+  RE_ENGINE_AUTO      = 0,
+  RE_ENGINE_BACKTRACK = 1,
+  RE_ENGINE_NFA       = 2
+} RE_ENGINE;
+
+/* Selects the engine policy used by `ExecRE'. */
+
+void SetREEnginePolicy (int policy);
+
 /* Compiles a regular expression into the internal format used by `ExecRE'. */
 
 regexp * CompileRE (
@@ -67,6 +92,34 @@ regexp * CompileRE (
    char **errorText,   /* Text of any error message produced. */
    int  defaultFlags); /* Flags for default RE-operation */
 
+/* Statistics of the compiled regex cache (see `CompileCachedRE'). */
+
+typedef struct {
+   unsigned long hits;       /* Lookups satisfied from the cache. */
+   unsigned long misses;     /* Lookups that had to compile. */
+   unsigned long evictions;  /* Entries dropped to make room. */
+   int           entries;    /* Entries currently cached. */
+   int           size;       /* Maximum number of cached entries. */
+} RECacheStats;
+
+/* Like `CompileRE', but returns a compiled regex from a bounded LRU cache
+   keyed by expression and default flags (or a private copy while the cached
+   one is in use).  The result must be released with `ReleaseCachedRE'
+   instead of being freed. */
+
+regexp * CompileCachedRE (
+   const char  *exp,
+   char **errorText,
+   int  defaultFlags);
+
+void ReleaseCachedRE (regexp *prog);
+
+/* Drops all unused entries from the regex cache. */
+
+void FlushRECache (void);
+
+void GetRECacheStats (RECacheStats *stats);
+
 /* Match a `regexp' structure against a string. */
 
 int ExecRE (
@@ -90,6 +143,9 @@ int ExecRE (
 Boolean SubstituteRE(const regexp* prog, const char* source, char* dest,
         int max);
 
+/* Length of the text `SubstituteRE' would produce without a size limit. */
+int SubstituteRELength(const regexp* prog, const char* source);
+
 /* Builds a default delimiter table that persists across `ExecRE' calls that
    is identical to `delimiters'.  Pass NULL for "default default" set of
    delimiters. */
@@ -97,4 +153,31 @@ Boolean SubstituteRE(const regexp* prog, const char* source, char* dest,
 void SetREDefaultWordDelimiters (
    char *delimiters);
 
+/* Limits on the work done by `ExecRE'.  When a search takes more than the
+   step budget (0 for no limit), plus a few steps for every position a match
+   was tried at, or the cancel procedure returns True, `ExecRE' gives up and
+   returns 0; `GetREExecStatus' then tells why. */
+
+#define RE_DEFAULT_STEP_BUDGET 10000000UL
+
+typedef enum {
+  REEXEC_OK            = 0,
+  REEXEC_TOO_EXPENSIVE = 1, /* Step budget or recursion limit exceeded. */
+  REEXEC_CANCELLED     = 2  /* Cancel procedure returned True. */
+} RE_EXEC_STATUS;
+
+typedef int (*RECancelProc) (void *cbArg);
+
+void SetREStepBudget (unsigned long steps);
+
+void SetRECancelProc (RECancelProc proc, void *cbArg);
+
+int GetREExecStatus (void);
+
+/* The work state of `CompileRE' and `ExecRE', and the cancel procedure, are
+   per thread.  Worker threads that matched expressions (compiled in the same
+   thread with `CompileRE', not taken from the cache) call this before they
+   exit to free their scratch space. */
+void ReleaseREThreadState (void);
+
 #endif /* NEDIT_REGULAREXP_H_INCLUDED */
@@ -32,9 +32,12 @@
 
 #include "search.h"
 #include "regularExp.h"
+#include "literalSearch.h"
+#include "matchIndex.h"
 #include "textBuf.h"
 #include "text.h"
 #include "nedit.h"
+#include "undo.h"
 #include "server.h"
 #include "window.h" 
 #include "userCmds.h" 
@@ -61,6 +64,8 @@
 #include <wctype.h>
 #include <wchar.h>
 #include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/param.h>
 #include <Xm/Xm.h>
@@ -78,6 +83,7 @@
 #include <Xm/Text.h>
 #include <Xm/ToggleB.h>
 #include <Xm/List.h>
+#include <Xm/Scale.h>
 #include <X11/Xatom.h>		/* for getting selection */
 #include <X11/keysym.h>
 #include <X11/X.h>		/* " " */
@@ -113,12 +119,71 @@ typedef struct {
     int cbCount;
 } SearchSelectedCallData;
 
+/* A search string prepared for Replace All, or a search from a worker thread
+   (see CreateSearchMatcher), which looks for the matches one after another.
+   Those prepared for worker threads (isPrivate) are compiled just for them,
+   rather than taken from the shared caches */
+struct _SearchMatcher {
+    regexp *compiledRE;			/* for regular expressions */
+    const LiteralPattern *pattern;	/* for literal searches */
+    int wordSearch;
+    const char *delimiters;
+    int cignoreL, cignoreR;		/* see searchLiteralWord */
+    int isPrivate;
+};
+
+/* A document in which a multi-document Replace All takes place.  A worker
+   thread substitutes the matches in a copy of its text, the main thread
+   puts the result into the document */
+typedef struct {
+    WindowInfo *window;		/* NULL once the document is closed */
+    char *text;			/* copy of the text, scanned by a worker */
+    char *delimiters;
+    Bool pending;		/* result not yet put into the document */
+    Bool changed;		/* document modified while it was scanned */
+    char *result;		/* see ReplaceAllInString */
+    int copyStart, copyEnd, replacementLen;
+    UndoRange *ranges;
+    int nRanges;
+    int execStatus;		/* see GetREExecStatus */
+} replaceAllDoc;
+
+/* A multi-document Replace All, see rMultiFileReplaceCB */
+typedef struct {
+    WindowInfo *window;		/* owner of the dialog, NULL once closed */
+    char *searchString, *replaceString;
+    int searchType;
+    replaceAllDoc *docs;
+    int nDocs;
+    int nextDoc;		/* next document for a worker to take */
+    int nDone;			/* documents finished by the main thread */
+    volatile int cancelled;
+    pthread_mutex_t lock;	/* protects nextDoc */
+    pthread_t *threads;
+    int nThreads;
+    int pipeFDs[2];		/* workers pass finished documents back */
+    XtInputId inputID;
+    Bool replaceFailed, noWritableLeft, aborted;
+} replaceAllJob;
+
+/* Upper limit for the number of worker threads of a multi-document
+   Replace All */
+#define MAX_REPLACE_THREADS 8
+
 /* History mechanism for search and replace strings */
 static char *SearchHistory[MAX_SEARCH_HISTORY];
 static char *ReplaceHistory[MAX_SEARCH_HISTORY];
 static int SearchTypeHistory[MAX_SEARCH_HISTORY];
 static int HistStart = 0;
 
+/* Set when the last regular expression search was given up, because the
+   expression was too expensive to match (see SetREStepBudget) */
+static int SearchAborted = FALSE;
+
+/* The running multi-document Replace All, if any.  Its dialog is modal, so
+   there is only one at a time */
+static replaceAllJob *MultiReplaceJob = NULL;
+
 static int textFieldNonEmpty(Widget w);
 static void setTextField(WindowInfo* window, Time time, Widget textField);
 static void getSelectionCB(Widget w, XtPointer selectionInfo, Atom *selection,
@@ -177,6 +242,16 @@ static void rMultiFileDeselectAllCB(Widget w, WindowInfo *window,
 static void rMultiFilePathCB(Widget w, WindowInfo *window,  
 	XmAnyCallbackStruct *callData);
 static void uploadFileListItems(WindowInfo* window, Bool replace);
+static void startReplaceAllJob(replaceAllJob *job);
+static void *replaceAllWorker(void *arg);
+static int replaceAllCancelled(void *cbArg);
+static void replaceAllReadProc(XtPointer clientData, int *source,
+	XtInputId *id);
+static void replaceAllDocModifiedCB(int pos, int nInserted, int nDeleted,
+	int nRestyled, const char *deletedText, void *cbArg);
+static void applyReplaceAllDoc(replaceAllJob *job, replaceAllDoc *doc);
+static void finishReplaceAllJob(replaceAllJob *job);
+static void setMultiReplaceBusy(WindowInfo *window, Bool busy);
 static int countWindows(void);
 static int countWritableWindows(void);
 static void collectWritableWindows(WindowInfo* window);
@@ -210,6 +285,14 @@ static int searchLiteral(const char *string, const char *searchString, int caseS
 static int searchLiteralWord(const char *string, const char *searchString, int caseSense,
  	int direction, int wrap, int beginPos, int *startPos, int *endPos, 
         const char * delimiters);
+static const char *findLiteralWord(const LiteralPattern *pattern,
+	const char *string, const char *first, const char *last, int backward,
+	const char *delimiters, int cignore_L, int cignore_R,
+	const char **matchEnd);
+static const LiteralPattern *getLiteralPattern(const char *searchString,
+	int caseSense);
+static void literalWordEnds(const char *searchString, const char *delimiters,
+	int *cignore_L, int *cignore_R);
 static int searchRegex(const char *string, const char *searchString, int direction,
 	int wrap, int beginPos, int *startPos, int *endPos, int *searchExtentBW,
 	int *searchExtentFW, const char *delimiters, int defaultFlags);
@@ -228,9 +311,31 @@ static int findMatchingChar(WindowInfo *window, char toMatch,
 	void *toMatchStyle, int charPos, int startLimit, int endLimit, 
 	int *matchPos);
 static Boolean replaceUsingRE(const char* searchStr, const char* replaceStr,
-        const char* sourceStr, int beginPos, char* destStr, int maxDestLen,
-        int prevChar, const char* delimiters, int defaultFlags);
+        const char* sourceStr, int beginPos, char** destStr, int prevChar,
+        const char* delimiters, int defaultFlags);
+static char *replaceAllInString(const char *inString, const char *searchString,
+	const char *replaceString, int searchType, int *copyStart,
+	int *copyEnd, int *replacementLength, const char *delimiters,
+	UndoRange **ranges, int *nRanges);
+static int initReplaceMatcher(SearchMatcher *matcher,
+	const char *searchString, int searchType, const char *delimiters,
+	int isPrivate);
+static void freeReplaceMatcher(SearchMatcher *matcher);
+static int nextReplaceMatch(const SearchMatcher *matcher, const char *string,
+	int beginPos, int limitPos, int *startPos, int *endPos);
+static char *replaceAllMatches(const SearchMatcher *matcher,
+	const char *inString, const char *replaceString, int *copyStart,
+	int *copyEnd, int *replacementLength, UndoRange **ranges,
+	int *nRanges, const volatile int *cancel);
+static int finishReplaceAll(WindowInfo *window, char *newFileString,
+	int copyStart, int copyEnd, int replacementLen, UndoRange *ranges,
+	int nRanges);
+static void addUndoRange(UndoRange **ranges, int *nRanges, int *nAlloc,
+	int pos, int oldLen, int newLen);
 static void enableFindAgainCmds(void);
+static int regexSearchAborted(void);
+static void searchFailedDialog(const WindowInfo *window);
+static void iSearchShowAborted(WindowInfo *window);
 static void saveSearchHistory(const char *searchString,
         const char *replaceString, int searchType, int isIncremental);
 static int historyIndex(int nCycles);
@@ -255,6 +360,10 @@ static void iSearchTryBeepOnWrap(WindowInfo *window, int direction,
       	int beginPos, int startPos); 
 static void iSearchRecordLastBeginPos(WindowInfo *window, int direction, 
 	int initPos); 
+static int iSearchCanResume(WindowInfo *window, const char *searchString,
+	int searchType, int direction, int searchWrap);
+static void iSearchRecordStep(WindowInfo *window, const char *searchString,
+	int searchType, int direction, int searchWrap, int found);
 static Boolean prefOrUserCancelsSubst(const Widget parent,
         const Display* display);
 
@@ -720,6 +829,24 @@ void DoReplaceMultiFileDlog(WindowInfo *window)
 void RemoveFromMultiReplaceDialog(WindowInfo *doomedWindow)
 {
     WindowInfo *w;
+    int i;
+    
+    /* A running replacement must neither touch the document, nor report to
+       the dialog once it is gone */
+    if (MultiReplaceJob != NULL) {
+       for (i = 0; i < MultiReplaceJob->nDocs; ++i) {
+          if (MultiReplaceJob->docs[i].window == doomedWindow) {
+             if (MultiReplaceJob->docs[i].pending)
+                BufRemoveModifyCB(doomedWindow->buffer,
+                      replaceAllDocModifiedCB, &MultiReplaceJob->docs[i]);
+             MultiReplaceJob->docs[i].window = NULL;
+          }
+       }
+       if (MultiReplaceJob->window == doomedWindow) {
+          MultiReplaceJob->cancelled = True;
+          MultiReplaceJob->window = NULL;
+       }
+    }
     
     for (w=WindowList; w!=NULL; w=w->next) 
        if (w->writableWindows) 
@@ -1446,6 +1573,7 @@ void CreateReplaceMultiFileDlog(WindowInfo *window)
     XmString	st1;
     Widget	list, label1, form, pathBtn;
     Widget	btnForm, replaceBtn, selectBtn, deselectBtn, cancelBtn;
+    Widget	progress;
     Dimension	shadowThickness;
     
     argcnt = 0;
@@ -1620,6 +1748,27 @@ void CreateReplaceMultiFileDlog(WindowInfo *window)
        (XtCallbackProc)rMultiFileCancelCB, window);
     XtManageChild(cancelBtn);
     
+    /* Progress of a running replacement, above the buttons */
+    argcnt = 0;
+    XtSetArg(args[argcnt], XmNtraversalOn, False); argcnt++;
+    XtSetArg(args[argcnt], XmNleftAttachment, XmATTACH_FORM); argcnt++;
+    XtSetArg(args[argcnt], XmNrightAttachment, XmATTACH_FORM); argcnt++;
+    XtSetArg(args[argcnt], XmNtopAttachment, XmATTACH_NONE); argcnt++;
+    XtSetArg(args[argcnt], XmNbottomAttachment, XmATTACH_WIDGET); argcnt++;
+    XtSetArg(args[argcnt], XmNbottomWidget, btnForm); argcnt++;
+    XtSetArg(args[argcnt], XmNleftOffset, 10); argcnt++;
+    XtSetArg(args[argcnt], XmNrightOffset, 10); argcnt++;
+    XtSetArg(args[argcnt], XmNbottomOffset, 6); argcnt++;
+    XtSetArg(args[argcnt], XmNorientation, XmHORIZONTAL); argcnt++;
+    XtSetArg(args[argcnt], XmNminimum, 0); argcnt++;
+    XtSetArg(args[argcnt], XmNmaximum, 100); argcnt++;
+    XtSetArg(args[argcnt], XmNshowValue, False); argcnt++;
+    XtSetArg(args[argcnt], XmNeditable, False); argcnt++;
+    XtSetArg(args[argcnt], XmNslidingMode, XmTHERMOMETER); argcnt++;
+    XtSetArg(args[argcnt], XmNsensitive, False); argcnt++;
+    progress = XmCreateScale(form, "progress", args, argcnt);
+    XtManageChild(progress);
+    
     /* The list of files */
     argcnt = 0;
     XtSetArg(args[argcnt], XmNtraversalOn, True); argcnt++;
@@ -1627,7 +1776,7 @@ void CreateReplaceMultiFileDlog(WindowInfo *window)
     XtSetArg(args[argcnt], XmNbottomAttachment, XmATTACH_WIDGET); argcnt++;
     XtSetArg(args[argcnt], XmNleftAttachment, XmATTACH_FORM); argcnt++;
     XtSetArg(args[argcnt], XmNrightAttachment, XmATTACH_FORM); argcnt++;
-    XtSetArg(args[argcnt], XmNbottomWidget, btnForm); argcnt++;
+    XtSetArg(args[argcnt], XmNbottomWidget, progress); argcnt++;
     XtSetArg(args[argcnt], XmNtopWidget, label1); argcnt++;
     XtSetArg(args[argcnt], XmNleftOffset, 10); argcnt++;
     XtSetArg(args[argcnt], XmNvisibleItemCount, 10); argcnt++;
@@ -1656,6 +1805,7 @@ void CreateReplaceMultiFileDlog(WindowInfo *window)
     window->replaceMultiFileDlog = form;
     window->replaceMultiFileList = list;
     window->replaceMultiFilePathBtn = pathBtn;
+    window->replaceMultiFileProgress = progress;
        
     /* Install a handler that frees the list of writable windows when
        the dialog is unmapped. */
@@ -1836,6 +1986,8 @@ static void freeWritableWindowsCB(Widget w, WindowInfo* window,
                                   XmAnyCallbackStruct *callData)
 {
     window = WidgetToWindow(w);
+    if (MultiReplaceJob != NULL && MultiReplaceJob->window == window)
+	MultiReplaceJob->cancelled = True;
     NEditFree(window->writableWindows);
     window->writableWindows = NULL;
     window->nWritableWindows = 0;
@@ -1918,12 +2070,15 @@ static void rMultiFileReplaceCB(Widget w, WindowInfo *window,
 {
     char 	searchString[SEARCHMAX], replaceString[SEARCHMAX];
     int 	direction, searchType;
-    char 	*params[4];
+    const char	*delimiters;
     int 	nSelected, i;
     WindowInfo 	*writableWin;
-    Bool 	replaceFailed, noWritableLeft;
+    replaceAllJob *job;
+    replaceAllDoc *doc;
 
     window = WidgetToWindow(w);
+    if (MultiReplaceJob != NULL)
+	return;
     nSelected = 0;
     for (i=0; i<window->nWritableWindows; ++i)
        if (XmListPosSelected(window->replaceMultiFileList, i+1))
@@ -1963,65 +2118,317 @@ static void rMultiFileReplaceCB(Widget w, WindowInfo *window,
     /* Set the initial focus of the dialog back to the search string */
     resetReplaceTabGroup(window);
     
-    params[0] = searchString;
-    params[1] = replaceString;
-    params[2] = searchTypeArg(searchType);
-
-    replaceFailed = True;
-    noWritableLeft = True;
-    /* Perform the replacements and mark the selected files (history) */
+    /* Mark the selected files (history), and collect the ones still
+       writable.  If the file status has changed or the file was locked in
+       the mean time (possible due to Lesstif modal dialog bug), we just skip
+       the window. */
+    job = (replaceAllJob *)NEditCalloc(1, sizeof(replaceAllJob));
+    job->docs = (replaceAllDoc *)NEditCalloc(window->nWritableWindows,
+	    sizeof(replaceAllDoc));
+    job->noWritableLeft = True;
     for (i=0; i<window->nWritableWindows; ++i) {
 	writableWin = window->writableWindows[i];
 	if (XmListPosSelected(window->replaceMultiFileList, i+1)) {
-	/* First check again whether the file is still writable. If the
-	   file status has changed or the file was locked in the mean time
-	   (possible due to Lesstif modal dialog bug), we just skip the 
-	   window. */
 	    if (!IS_ANY_LOCKED(writableWin->lockReasons)) {
-		noWritableLeft = False;
+		job->noWritableLeft = False;
 		writableWin->multiFileReplSelected = True;
-		writableWin->multiFileBusy = True; /* Avoid multi-beep/dialog */
-		writableWin->replaceFailed = False;
-		XtCallActionProc(writableWin->lastFocus, "replace_all",
-		    callData->event, params, 3);
-		writableWin->multiFileBusy = False;
-		if (!writableWin->replaceFailed)
-		    replaceFailed = False;
+		doc = &job->docs[job->nDocs++];
+		doc->window = writableWin;
+		doc->text = BufGetAll(writableWin->buffer);
+		delimiters = GetWindowDelimiters(writableWin);
+		if (delimiters == NULL && !isRegexType(searchType))
+		    delimiters = GetPrefDelimiters();
+		if (delimiters != NULL)
+		    doc->delimiters = NEditStrdup(delimiters);
+		doc->pending = True;
+		doc->execStatus = REEXEC_OK;
+		BufAddModifyCB(writableWin->buffer, replaceAllDocModifiedCB,
+			doc);
 	    }
 	} else {
 	    writableWin->multiFileReplSelected = False;
 	}
-    }                          
-        
-    if (!XmToggleButtonGetState(window->replaceKeepBtn)) {
-       /* Pop down both replace dialogs. */
-       unmanageReplaceDialogs(window);
-    } else {
-       /* pow down only the file selection dialog */
-       XtUnmanageChild(window->replaceMultiFileDlog);
     }
     
-    /* We suppressed multiple beeps/dialogs. If there wasn't any file in
-       which the replacement succeeded, we should still warn the user */
-    if (replaceFailed) {
-	if (GetPrefSearchDlogs()) {
-	    if (noWritableLeft) {
-		DialogF(DF_INF, window->shell, 1, "Read-only Files",
-                        "All selected files have become read-only.", "OK");
-	    } else {
-		DialogF(DF_INF, window->shell, 1, "String not found",
-                        "String was not found", "OK");
-            }
+    saveSearchHistory(searchString, replaceString, searchType, FALSE);
+    job->window = window;
+    job->searchString = NEditStrdup(searchString);
+    job->replaceString = NEditStrdup(replaceString);
+    job->searchType = searchType;
+    startReplaceAllJob(job);
+}
+
+/*
+** Start the substitutions of a multi-document Replace All on a pool of worker
+** threads, which scan the documents in parallel.  The results are put into
+** the documents by replaceAllReadProc, as the workers finish them.  Without
+** threads, everything is done right away.
+*/
+static void startReplaceAllJob(replaceAllJob *job)
+{
+    long nThreads;
+    int i;
+    
+    job->replaceFailed = True;
+    job->pipeFDs[0] = job->pipeFDs[1] = -1;
+    pthread_mutex_init(&job->lock, NULL);
+    MultiReplaceJob = job;
+    
+    nThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > MAX_REPLACE_THREADS)
+	nThreads = MAX_REPLACE_THREADS;
+    if (nThreads > job->nDocs)
+	nThreads = job->nDocs;
+    if (nThreads > 0 && pipe(job->pipeFDs) == 0) {
+	job->threads = (pthread_t *)NEditMalloc(nThreads * sizeof(pthread_t));
+	while (job->nThreads < nThreads && pthread_create(
+		&job->threads[job->nThreads], NULL, replaceAllWorker, job) == 0)
+	    job->nThreads++;
+    }
+    
+    if (job->nThreads == 0) {
+	if (job->pipeFDs[0] != -1) {
+	    close(job->pipeFDs[0]);
+	    close(job->pipeFDs[1]);
+	    job->pipeFDs[0] = job->pipeFDs[1] = -1;
+	}
+	replaceAllWorker(job);
+	for (i=0; i<job->nDocs; i++)
+	    applyReplaceAllDoc(job, &job->docs[i]);
+	job->nDone = job->nDocs;
+	finishReplaceAllJob(job);
+	return;
+    }
+    
+    job->inputID = XtAppAddInput(XtWidgetToApplicationContext(
+	    job->window->shell), job->pipeFDs[0], (XtPointer)XtInputReadMask,
+	    replaceAllReadProc, job);
+    setMultiReplaceBusy(job->window, True);
+}
+
+/*
+** Worker thread of a multi-document Replace All.  Takes documents from the
+** job until none are left, and passes each one back to the main thread when
+** its substitutions are done.  Nothing here may touch the windows, or any
+** other state of the main thread.
+*/
+static void *replaceAllWorker(void *arg)
+{
+    replaceAllJob *job = (replaceAllJob *)arg;
+    replaceAllDoc *doc;
+    SearchMatcher matcher;
+    int i;
+    
+    SetRECancelProc(replaceAllCancelled, job);
+    for (;;) {
+	pthread_mutex_lock(&job->lock);
+	i = job->nextDoc < job->nDocs ? job->nextDoc++ : -1;
+	pthread_mutex_unlock(&job->lock);
+	if (i < 0)
+	    break;
+	
+	doc = &job->docs[i];
+	if (!job->cancelled && initReplaceMatcher(&matcher, job->searchString,
+		job->searchType, doc->delimiters, TRUE)) {
+	    doc->result = replaceAllMatches(&matcher, doc->text,
+		    job->replaceString, &doc->copyStart, &doc->copyEnd,
+		    &doc->replacementLen, &doc->ranges, &doc->nRanges,
+		    &job->cancelled);
+	    if (matcher.compiledRE != NULL)
+		doc->execStatus = GetREExecStatus();
+	    freeReplaceMatcher(&matcher);
+	}
+	NEditFree(doc->text);
+	doc->text = NULL;
+	
+	if (job->pipeFDs[1] != -1) {
+	    while (write(job->pipeFDs[1], &i, sizeof(i)) == -1 &&
+		    errno == EINTR)
+		;
+	}
+    }
+    SetRECancelProc(NULL, NULL);
+    ReleaseREThreadState();
+    return NULL;
+}
+
+static int replaceAllCancelled(void *cbArg)
+{
+    return ((replaceAllJob *)cbArg)->cancelled;
+}
+
+/*
+** Called when worker threads of a multi-document Replace All have finished
+** documents.  Puts their results into the documents, and updates the
+** progress bar in the dialog.
+*/
+static void replaceAllReadProc(XtPointer clientData, int *source,
+	XtInputId *id)
+{
+    replaceAllJob *job = (replaceAllJob *)clientData;
+    int finished[64], nRead, i;
+    
+    nRead = read(job->pipeFDs[0], finished, sizeof(finished));
+    if (nRead == -1) {
+	if (errno != EINTR && errno != EAGAIN)
+	    perror("xnedit: Error reading replacement results");
+	return;
+    }
+    
+    for (i=0; i<nRead/(int)sizeof(int); i++) {
+	applyReplaceAllDoc(job, &job->docs[finished[i]]);
+	job->nDone++;
+    }
+    
+    if (job->nDone == job->nDocs)
+	finishReplaceAllJob(job);
+    else if (job->window != NULL)
+	XmScaleSetValue(job->window->replaceMultiFileProgress,
+		100 * job->nDone / job->nDocs);
+}
+
+/*
+** Modify callback of the documents of a multi-document Replace All, noting
+** that the text no longer is the one the workers scan.
+*/
+static void replaceAllDocModifiedCB(int pos, int nInserted, int nDeleted,
+	int nRestyled, const char *deletedText, void *cbArg)
+{
+    if (nInserted != 0 || nDeleted != 0)
+	((replaceAllDoc *)cbArg)->changed = True;
+}
+
+/*
+** Put the result of a worker into its document, unless the replacement was
+** cancelled or the document closed.  A document changed in the mean time
+** gets its replacement done over again, here in the main thread.
+*/
+static void applyReplaceAllDoc(replaceAllJob *job, replaceAllDoc *doc)
+{
+    WindowInfo *window = doc->window;
+    
+    if (window != NULL)
+	BufRemoveModifyCB(window->buffer, replaceAllDocModifiedCB, doc);
+    doc->pending = False;
+    
+    if (window == NULL || job->cancelled ||
+	    IS_ANY_LOCKED(window->lockReasons)) {
+	NEditFree(doc->result);
+	NEditFree(doc->ranges);
+    } else {
+	window->multiFileBusy = True; /* Avoid multi-beep/dialog */
+	window->replaceFailed = False;
+	if (doc->changed) {
+	    NEditFree(doc->result);
+	    NEditFree(doc->ranges);
+	    ReplaceAll(window, job->searchString, job->replaceString,
+		    job->searchType);
 	} else {
-           XBell(TheDisplay, 0);
-        }
+	    SearchAborted = doc->execStatus != REEXEC_OK;
+	    finishReplaceAll(window, doc->result, doc->copyStart,
+		    doc->copyEnd, doc->replacementLen, doc->ranges,
+		    doc->nRanges);
+	}
+	window->multiFileBusy = False;
+	if (!window->replaceFailed)
+	    job->replaceFailed = False;
+	if (SearchAborted)
+	    job->aborted = True;
+    }
+    doc->result = NULL;
+    doc->ranges = NULL;
+}
+
+/*
+** Clean up after all documents of a multi-document Replace All are done,
+** and pop down the dialogs.
+*/
+static void finishReplaceAllJob(replaceAllJob *job)
+{
+    WindowInfo *window = job->window;
+    int i;
+    
+    for (i=0; i<job->nThreads; i++)
+	pthread_join(job->threads[i], NULL);
+    if (job->inputID != 0)
+	XtRemoveInput(job->inputID);
+    if (job->pipeFDs[0] != -1) {
+	close(job->pipeFDs[0]);
+	close(job->pipeFDs[1]);
+    }
+    MultiReplaceJob = NULL;
+    
+    if (window != NULL) {
+	setMultiReplaceBusy(window, False);
+	if (job->cancelled) {
+	    /* pop down the multi-window replace dialog */
+	    XtUnmanageChild(window->replaceMultiFileDlog);
+	} else if (!XmToggleButtonGetState(window->replaceKeepBtn)) {
+	    /* Pop down both replace dialogs. */
+	    unmanageReplaceDialogs(window);
+	} else {
+	    /* pow down only the file selection dialog */
+	    XtUnmanageChild(window->replaceMultiFileDlog);
+	}
+    
+	/* We suppressed multiple beeps/dialogs. If there wasn't any file in
+	   which the replacement succeeded, we should still warn the user */
+	if (job->replaceFailed && !job->cancelled) {
+	    if (job->aborted) {
+		SearchAborted = TRUE;
+		searchFailedDialog(window);
+	    } else if (GetPrefSearchDlogs()) {
+		if (job->noWritableLeft) {
+		    DialogF(DF_INF, window->shell, 1, "Read-only Files",
+			    "All selected files have become read-only.", "OK");
+		} else {
+		    DialogF(DF_INF, window->shell, 1, "String not found",
+			    "String was not found", "OK");
+		}
+	    } else {
+		XBell(TheDisplay, 0);
+	    }
+	}
     }
+    
+    for (i=0; i<job->nDocs; i++)
+	NEditFree(job->docs[i].delimiters);
+    NEditFree(job->docs);
+    NEditFree(job->threads);
+    NEditFree(job->searchString);
+    NEditFree(job->replaceString);
+    pthread_mutex_destroy(&job->lock);
+    NEditFree(job);
+}
+
+/*
+** While a multi-document Replace All is running, its dialog only shows the
+** progress and lets the user cancel.
+*/
+static void setMultiReplaceBusy(WindowInfo *window, Bool busy)
+{
+    Widget dialog = window->replaceMultiFileDlog;
+    
+    XtSetSensitive(XtNameToWidget(dialog, "buttons.replace"), !busy);
+    XtSetSensitive(XtNameToWidget(dialog, "buttons.select"), !busy);
+    XtSetSensitive(XtNameToWidget(dialog, "buttons.deselect"), !busy);
+    XtSetSensitive(window->replaceMultiFileList, !busy);
+    XtSetSensitive(window->replaceMultiFilePathBtn, !busy);
+    XmScaleSetValue(window->replaceMultiFileProgress, 0);
+    XtSetSensitive(window->replaceMultiFileProgress, busy);
 }
 
 static void rMultiFileCancelCB(Widget w, WindowInfo *window, caddr_t callData) 
 {
     window = WidgetToWindow(w);
 
+    /* Stop a running replacement; the dialog goes down once the workers
+       are done with the documents they are scanning */
+    if (MultiReplaceJob != NULL && MultiReplaceJob->window == window) {
+	MultiReplaceJob->cancelled = True;
+	return;
+    }
+
     /* Set the initial focus of the dialog back to the search string	*/
     resetReplaceTabGroup(window);
 
@@ -2657,7 +3064,7 @@ static int getReplaceDlogInfo(WindowInfo *window, int *direction,
       }
       /* If the search type is a regular expression, test compile it 
          immediately and present error messages */
-      compiledRE = CompileRE(replaceText, &compileMsg, regexDefault);
+      compiledRE = CompileCachedRE(replaceText, &compileMsg, regexDefault);
       if (compiledRE == NULL) {
    	  DialogF(DF_WARN, XtParent(window->replaceDlog), 1, "Search String",
                   "Please respecify the search string:\n%s", "OK", compileMsg);
@@ -2665,7 +3072,7 @@ static int getReplaceDlogInfo(WindowInfo *window, int *direction,
 	  NEditFree(replaceWithText);
  	  return FALSE;
       }
-      NEditFree(compiledRE);
+      ReleaseCachedRE(compiledRE);
     } else {
       if(XmToggleButtonGetState(window->replaceCaseToggle)) {
       	if(XmToggleButtonGetState(window->replaceWordToggle))
@@ -2736,13 +3143,13 @@ static int getFindDlogInfo(WindowInfo *window, int *direction,
       }
       /* If the search type is a regular expression, test compile it 
          immediately and present error messages */
-      compiledRE = CompileRE(findText, &compileMsg, regexDefault);
+      compiledRE = CompileCachedRE(findText, &compileMsg, regexDefault);
       if (compiledRE == NULL) {
    	  DialogF(DF_WARN, XtParent(window->findDlog), 1, "Regex Error",
                   "Please respecify the search string:\n%s", "OK", compileMsg);
  	  return FALSE;
       }
-      NEditFree(compiledRE);
+      ReleaseCachedRE(compiledRE);
     } else {
       if(XmToggleButtonGetState(window->findCaseToggle)) {
       	if(XmToggleButtonGetState(window->findWordToggle))
@@ -2801,6 +3208,9 @@ int SearchAndSelect(WindowInfo *window, int direction, const char *searchString,
 
     /* Save a copy of searchString in the search history */
     saveSearchHistory(searchString, NULL, searchType, FALSE);
+    
+    /* highlight all occurrences of the search string */
+    SetMatchIndex(window, searchString, searchType);
         
     /* set the position to start the search so we don't find the same
        string that was found on the last search	*/
@@ -3014,6 +3424,7 @@ void EndISearch(WindowInfo *window)
     
     /* Forget the starting position used for the current run of searches */
     window->iSearchStartPos = -1;
+    ForgetISearchStep(window);
     
     /* Mark the end of incremental search history overwriting */
     saveSearchHistory("", NULL, 0, FALSE);
@@ -3024,7 +3435,8 @@ void EndISearch(WindowInfo *window)
 
 /* 
 ** Reset window->iSearchLastBeginPos to the resulting initial
-** search begin position for incremental searches.
+** search begin position for incremental searches, and forget the last
+** step of the search (see iSearchCanResume).
 */
 static void iSearchRecordLastBeginPos(WindowInfo *window, int direction, 
 	int initPos) 
@@ -3032,8 +3444,57 @@ static void iSearchRecordLastBeginPos(WindowInfo *window, int direction,
     window->iSearchLastBeginPos = initPos;
     if (direction == SEARCH_BACKWARD) 
       	window->iSearchLastBeginPos--;
+    ForgetISearchStep(window);
 }      
 
+/*
+** Whether the incremental search for "searchString" can go on from the
+** match of the previous search string (iSearchLastBeginPos).  That is the
+** case when the previous string is the start of this one, searched for the
+** same way in an unchanged buffer: every match of the longer string is a
+** match of the shorter one, so none comes before the previous match in the
+** search direction (wrapping around at the end of the text).  This holds
+** for literal searches only.  Buffers with escape sequences are left out,
+** because their search positions are not buffer positions.
+*/
+static int iSearchCanResume(WindowInfo *window, const char *searchString,
+	int searchType, int direction, int searchWrap)
+{
+    const char *lastString = window->iSearchLastString;
+    
+    return lastString != NULL &&
+	    (searchType == SEARCH_LITERAL || searchType == SEARCH_CASE_SENSE) &&
+	    searchType == window->iSearchLastType &&
+	    direction == window->iSearchLastDir &&
+	    searchWrap == window->iSearchLastWrap &&
+	    window->buffer->num_ansi_escpos == 0 &&
+	    !strncmp(searchString, lastString, strlen(lastString));
+}
+
+/*
+** Remember the search string of an incremental search step, and whether
+** it was found, for iSearchCanResume
+*/
+static void iSearchRecordStep(WindowInfo *window, const char *searchString,
+	int searchType, int direction, int searchWrap, int found)
+{
+    NEditFree(window->iSearchLastString);
+    window->iSearchLastString = NEditStrdup(searchString);
+    window->iSearchLastType = searchType;
+    window->iSearchLastDir = direction;
+    window->iSearchLastWrap = searchWrap;
+    window->iSearchLastFound = found;
+}
+
+/*
+** Forget the last incremental search step, e.g. because the text changed
+*/
+void ForgetISearchStep(WindowInfo *window)
+{
+    NEditFree(window->iSearchLastString);
+    window->iSearchLastString = NULL;
+}
+
 /*
 ** Search for "searchString" in "window", and select the matching text in
 ** the window when found (or beep or put up a dialog if not found).  If
@@ -3054,6 +3515,10 @@ int SearchAndSelectIncremental(WindowInfo *window, int direction,
     }
     beginPos = window->iSearchStartPos;
 
+    /* highlight all occurrences of the search string (or, when the string
+       is empty, remove the highlighting) */
+    SetMatchIndex(window, searchString, searchType);
+
     /* If the search string is empty, beep eventually if text wrapped
        back to the initial position, re-init iSearchLastBeginPos, 
        clear the selection, set the cursor back to what would be the 
@@ -3081,12 +3546,31 @@ int SearchAndSelectIncremental(WindowInfo *window, int direction,
     if (direction == SEARCH_BACKWARD)
 	beginPos--;
 
+    /* When characters were added to the search string, search on from the
+       match of the shorter string, or don't search at all if it wasn't
+       found.  So typing a string only searches as far as the next match. */
+    if (iSearchCanResume(window, searchString, searchType, direction,
+	    searchWrap)) {
+	if (!window->iSearchLastFound) {
+	    iSearchRecordStep(window, searchString, searchType, direction,
+		    searchWrap, FALSE);
+	    XBell(TheDisplay, 0);
+	    return FALSE;
+	}
+	beginPos = window->iSearchLastBeginPos;
+    }
+
     /* do the search.  SearchWindow does appropriate dialogs and beeps */
     if (!SearchWindow(window, direction, searchString, searchType, searchWrap,
-	    beginPos, &startPos, &endPos, NULL, NULL))
+	    beginPos, &startPos, &endPos, NULL, NULL)) {
+	iSearchRecordStep(window, searchString, searchType, direction,
+		searchWrap, FALSE);
 	return FALSE;
+    }
 
     window->iSearchLastBeginPos = startPos;
+    iSearchRecordStep(window, searchString, searchType, direction, searchWrap,
+	    TRUE);
 
     /* if the search matched an empty string (possible with regular exps)
        beginning at the start of the search, go to the next occurrence,
@@ -3310,13 +3794,13 @@ static void iSearchTextValueChangedCB(Widget w, WindowInfo *window,
     if (isRegexType(searchType)) {
 	regexp *compiledRE = NULL;
 	char *compileMsg;
-	compiledRE = CompileRE(searchString, &compileMsg, 
+	compiledRE = CompileCachedRE(searchString, &compileMsg, 
 	                       defaultRegexFlags(searchType));
 	if (compiledRE == NULL) {
 	    NEditFree(searchString);
 	    return;
 	}
-	NEditFree(compiledRE);
+	ReleaseCachedRE(compiledRE);
     }
     
     /* Call the incremental search action proc to do the searching and
@@ -3708,17 +4192,18 @@ int ReplaceAndSearch(WindowInfo *window, int direction, const char *searchString
 			       &searchExtentFW)) {
 	/* replace the text */
 	if (isRegexType(searchType)) {
-    	    char replaceResult[SEARCHMAX+1], *foundString;
+    	    char *replaceResult, *foundString;
 	    foundString = BufGetRange(window->buffer, searchExtentBW,
 				      searchExtentFW+1);
     	    replaceUsingRE(searchString, replaceString, foundString,
 		    startPos-searchExtentBW,
-		    replaceResult, SEARCHMAX, startPos == 0 ? '\0' :
+		    &replaceResult, startPos == 0 ? '\0' :
 		    BufGetCharacter(window->buffer, startPos-1),
 		    GetWindowDelimiters(window), defaultRegexFlags(searchType));
 	    NEditFree(foundString);
     	    BufReplace(window->buffer, startPos, endPos, replaceResult);
     	    replaceLen = strlen(replaceResult);
+	    NEditFree(replaceResult);
 	} else {
             BufReplace(window->buffer, startPos, endPos, replaceString);
             replaceLen = strlen(replaceString);
@@ -3776,16 +4261,17 @@ int SearchAndReplace(WindowInfo *window, int direction, const char *searchString
     
     /* replace the text */
     if (isRegexType(searchType)) {
-    	char replaceResult[SEARCHMAX], *foundString;
+    	char *replaceResult, *foundString;
 	foundString = BufGetRange(window->buffer, searchExtentBW, searchExtentFW+1);
     	replaceUsingRE(searchString, replaceString, foundString,
 		startPos - searchExtentBW,
-		replaceResult, SEARCHMAX, startPos == 0 ? '\0' :
+		&replaceResult, startPos == 0 ? '\0' :
 		BufGetCharacter(window->buffer, startPos-1),
 		GetWindowDelimiters(window), defaultRegexFlags(searchType));
 	NEditFree(foundString);
     	BufReplace(window->buffer, startPos, endPos, replaceResult);
     	replaceLen = strlen(replaceResult);
+	NEditFree(replaceResult);
     } else {
     	BufReplace(window->buffer, startPos, endPos, replaceString);
     	replaceLen = strlen(replaceString);
@@ -3883,6 +4369,8 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
     Boolean substSuccess = False;
     Boolean anyFound = False;
     Boolean cancelSubst = True;
+    UndoRange *ranges = NULL;
+    int nRanges = 0, rangesAlloc = 0;
     
     /* save a copy of search and replace strings in the search history */
     saveSearchHistory(searchString, replaceString, searchType, FALSE);
@@ -3955,11 +4443,11 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
 
 	/* replace the string and compensate for length change */
 	if (isRegexType(searchType)) {
-    	    char replaceResult[SEARCHMAX], *foundString;
+    	    char *replaceResult, *foundString;
 	    foundString = BufGetRange(tempBuf, extentBW+realOffset,
 		    extentFW+realOffset+1);
             substSuccess = replaceUsingRE(searchString, replaceString,
-                    foundString, startPos - extentBW, replaceResult, SEARCHMAX,
+                    foundString, startPos - extentBW, &replaceResult,
                     0 == (startPos + realOffset)
                         ? '\0'
                         : BufGetCharacter(tempBuf, startPos + realOffset - 1),
@@ -3967,13 +4455,14 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
 	    NEditFree(foundString);
 
             if (!substSuccess) {
-                /*  The substitution failed. Primary reason for this would be
-                    a result string exceeding SEARCHMAX. */
+                /*  The substitution failed. The result is sized to fit,
+                    so this means the match string was damaged. */
 
                 cancelSubst = prefOrUserCancelsSubst(window->shell, TheDisplay);
 
                 if (cancelSubst) {
                     /*  No point in trying other substitutions.  */
+                    NEditFree(replaceResult);
                     break;
                 }
             }
@@ -3981,12 +4470,15 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
     	    BufReplace(tempBuf, startPos+realOffset, endPos+realOffset,
     		    replaceResult);
     	    replaceLen = strlen(replaceResult);
+	    NEditFree(replaceResult);
         } else {
             /* at this point plain substitutions (should) always work */
     	    BufReplace(tempBuf, startPos+realOffset, endPos+realOffset,
     		    replaceString);
             substSuccess = True;
         }
+	addUndoRange(&ranges, &nRanges, &rangesAlloc, selStart+startPos,
+		endPos-startPos, replaceLen);
 
     	realOffset += replaceLen - (endPos - startPos);
     	/* start again after match unless match was empty, then endPos+1 */
@@ -4002,8 +4494,11 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
             /*  Either the substitution was successful (the common case) or the
                 user does not care and wants to have a faulty replacement.  */
 
-            /* replace the selected range in the real buffer */
+            /* replace the selected range in the real buffer, keeping just
+               the replaced spans for undo */
+            SetUndoRanges(window, ranges, nRanges);
             BufReplace(window->buffer, selStart, selEnd, BufAsString(tempBuf));
+            SetUndoRanges(window, NULL, 0);
 
             /* set the insert point at the end of the last replacement */
             TextSetCursorPos(window->lastFocus, selStart + cursorPos + realOffset);
@@ -4016,7 +4511,7 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
         }
     } else {
         /*  Nothing found, tell the user about it  */
-    	if (GetPrefSearchDlogs()) {
+    	if (GetPrefSearchDlogs() || SearchAborted) {
     	    /* Avoid bug in Motif 1.1 by putting away search dialog
     	       before DialogF */
     	    if (window->findDlog && XtIsManaged(window->findDlog) &&
@@ -4025,13 +4520,13 @@ void ReplaceInSelection(const WindowInfo* window, const char* searchString,
     	    if (window->replaceDlog && XtIsManaged(window->replaceDlog) &&
     	    	    !XmToggleButtonGetState(window->replaceKeepBtn))
     		unmanageReplaceDialogs(window);
-   	    DialogF(DF_INF, window->shell, 1, "String not found",
-                "String was not found", "OK");
+   	    searchFailedDialog(window);
     	} else
     	    XBell(TheDisplay, 0);
     }
 
     BufFree(tempBuf);
+    NEditFree(ranges);
     return;
 }
 
@@ -4044,7 +4539,8 @@ int ReplaceAll(WindowInfo *window, const char *searchString,
 {
     const char *fileString;
     char *newFileString;
-    int copyStart, copyEnd, replacementLen;
+    int copyStart, copyEnd, replacementLen, nRanges;
+    UndoRange *ranges;
     
     /* reject empty string */
     if (*searchString == '\0')
@@ -4056,35 +4552,51 @@ int ReplaceAll(WindowInfo *window, const char *searchString,
     /* view the entire text buffer from the text area widget as a string */
     fileString = BufAsString(window->buffer);
 
-    newFileString = ReplaceAllInString(fileString, searchString, replaceString,
+    newFileString = replaceAllInString(fileString, searchString, replaceString,
 	    searchType, &copyStart, &copyEnd, &replacementLen,
-	    GetWindowDelimiters(window));
+	    GetWindowDelimiters(window), &ranges, &nRanges);
 
+    return finishReplaceAll(window, newFileString, copyStart, copyEnd,
+	    replacementLen, ranges, nRanges);
+}    
+
+/*
+** Put the result of Replace All in "window" into the text, or tell the user
+** that nothing was replaced if "newFileString" is NULL.  Frees newFileString
+** and ranges.
+*/
+static int finishReplaceAll(WindowInfo *window, char *newFileString,
+	int copyStart, int copyEnd, int replacementLen, UndoRange *ranges,
+	int nRanges)
+{
     if (newFileString == NULL) {
         if (window->multiFileBusy) {
             window->replaceFailed = TRUE; /* only needed during multi-file 
                                              replacements */
-        } else if (GetPrefSearchDlogs()) {
+        } else if (GetPrefSearchDlogs() || SearchAborted) {
     	    if (window->findDlog && XtIsManaged(window->findDlog) &&
     	    	    !XmToggleButtonGetState(window->findKeepBtn))
     		XtUnmanageChild(window->findDlog);
     	    if (window->replaceDlog && XtIsManaged(window->replaceDlog) &&
     	    	    !XmToggleButtonGetState(window->replaceKeepBtn))
     		unmanageReplaceDialogs(window);
-   	    DialogF(DF_INF, window->shell, 1, "String not found",
-                "String was not found", "OK");
+   	    searchFailedDialog(window);
     	} else
     	    XBell(TheDisplay, 0);
 	return FALSE;
     }
     
-    /* replace the contents of the text widget with the substituted text */
+    /* replace the contents of the text widget with the substituted text,
+       keeping just the replaced spans for undo */
+    SetUndoRanges(window, ranges, nRanges);
     BufReplace(window->buffer, copyStart, copyEnd, newFileString);
+    SetUndoRanges(window, NULL, 0);
     
     /* Move the cursor to the end of the last replacement */
     TextSetCursorPos(window->lastFocus, copyStart + replacementLen);
 
     NEditFree(newFileString);
+    NEditFree(ranges);
     return TRUE;	
 }    
 
@@ -4093,100 +4605,271 @@ int ReplaceAll(WindowInfo *window, const char *searchString,
 ** and return an allocated string covering the range between the start of the
 ** first replacement (returned in "copyStart", and the end of the last
 ** replacement (returned in "copyEnd")
+**
+** The text is scanned once, appending to an output buffer which grows as
+** needed.  For regular expressions, the expression is compiled once and each
+** substitution is expanded from the match just made, sized to fit.
 */
 char *ReplaceAllInString(const char *inString, const char *searchString,
 	const char *replaceString, int searchType, int *copyStart,
 	int *copyEnd, int *replacementLength, const char *delimiters)
 {
-    int beginPos, startPos, endPos, lastEndPos;
-    int found, nFound, removeLen, replaceLen, copyLen, addLen;
-    char *outString, *fillPtr;
-    int searchExtentBW, searchExtentFW;
+    return replaceAllInString(inString, searchString, replaceString,
+	    searchType, copyStart, copyEnd, replacementLength, delimiters,
+	    NULL, NULL);
+}
+
+/*
+** ReplaceAllInString, also returning the replaced spans for undo in "ranges"
+** (allocated, NULL if nothing was replaced) and "nRanges", if not NULL.
+*/
+static char *replaceAllInString(const char *inString, const char *searchString,
+	const char *replaceString, int searchType, int *copyStart,
+	int *copyEnd, int *replacementLength, const char *delimiters,
+	UndoRange **ranges, int *nRanges)
+{
+    SearchMatcher matcher;
+    char *outString;
+    
+    if (ranges != NULL) {
+	*ranges = NULL;
+	*nRanges = 0;
+    }
     
     /* reject empty string */
     if (*searchString == '\0')
     	return NULL;
     
-    /* rehearse the search first to determine the size of the buffer needed
-       to hold the substituted text.  No substitution done here yet */
-    replaceLen = strlen(replaceString);
-    found = TRUE;
-    nFound = 0;
-    removeLen = 0;
-    addLen = 0;
-    beginPos = 0;
-    *copyStart = -1;
-    while (found) {
-    	found = SearchString(inString, searchString, SEARCH_FORWARD, searchType,
-		FALSE, beginPos, &startPos, &endPos, &searchExtentBW, 
-                &searchExtentFW, delimiters);
-	if (found) {
-	    if (*copyStart < 0)
-	    	*copyStart = startPos;
-    	    *copyEnd = endPos;
-    	    /* start next after match unless match was empty, then endPos+1 */
-    	    beginPos = (startPos == endPos) ? endPos+1 : endPos;
-	    nFound++;
-	    removeLen += endPos - startPos;
-	    if (isRegexType(searchType)) {
-    		char replaceResult[SEARCHMAX];
-    		replaceUsingRE(searchString, replaceString, &inString[searchExtentBW],
- 			startPos-searchExtentBW,
-     			replaceResult, SEARCHMAX, startPos == 0 ? '\0' :
-			inString[startPos-1], delimiters,
-                        defaultRegexFlags(searchType));
-    		addLen += strlen(replaceResult);
-    	    } else
-    	    	addLen += replaceLen;
-	    if (inString[endPos] == '\0')
-		break;
-	}
+    /* compile the search string once for all of the matches.  As elsewhere,
+       errors in the expression are assumed to have been reported earlier */
+    SearchAborted = FALSE;
+    if (!initReplaceMatcher(&matcher, searchString, searchType, delimiters,
+	    FALSE))
+	return NULL;
+    
+    outString = replaceAllMatches(&matcher, inString, replaceString,
+	    copyStart, copyEnd, replacementLength, ranges, nRanges, NULL);
+    if (outString == NULL && matcher.compiledRE != NULL)
+	regexSearchAborted();
+    freeReplaceMatcher(&matcher);
+    return outString;
+}
+
+/*
+** Prepare "searchString" for finding all of its matches with
+** nextReplaceMatch.  With "isPrivate", the search string is compiled just
+** for the caller, which may be a worker thread, instead of being taken from
+** the caches of the main thread.  Returns FALSE if a regular expression
+** doesn't compile.
+*/
+static int initReplaceMatcher(SearchMatcher *matcher,
+	const char *searchString, int searchType, const char *delimiters,
+	int isPrivate)
+{
+    char *compileMsg;
+    int caseSense;
+    
+    matcher->compiledRE = NULL;
+    matcher->pattern = NULL;
+    matcher->delimiters = delimiters;
+    matcher->isPrivate = isPrivate;
+    if (isRegexType(searchType)) {
+	if (isPrivate)
+	    matcher->compiledRE = CompileRE(searchString, &compileMsg,
+		    defaultRegexFlags(searchType));
+	else
+	    matcher->compiledRE = CompileCachedRE(searchString, &compileMsg,
+		    defaultRegexFlags(searchType));
+	return matcher->compiledRE != NULL;
+    }
+    
+    caseSense = searchType == SEARCH_CASE_SENSE ||
+	    searchType == SEARCH_CASE_SENSE_WORD;
+    matcher->pattern = isPrivate ? CompileLiteral(searchString, caseSense) :
+	    getLiteralPattern(searchString, caseSense);
+    matcher->wordSearch = searchType == SEARCH_CASE_SENSE_WORD ||
+	    searchType == SEARCH_LITERAL_WORD;
+    if (matcher->wordSearch) {
+	if (matcher->delimiters == NULL)
+	    matcher->delimiters = GetPrefDelimiters();
+	literalWordEnds(searchString, matcher->delimiters, &matcher->cignoreL,
+		&matcher->cignoreR);
     }
-    if (nFound == 0)
+    return TRUE;
+}
+
+static void freeReplaceMatcher(SearchMatcher *matcher)
+{
+    if (matcher->isPrivate) {
+	NEditFree(matcher->compiledRE);
+	FreeLiteral((LiteralPattern *)matcher->pattern);
+    } else if (matcher->compiledRE != NULL)
+	ReleaseCachedRE(matcher->compiledRE);
+}
+
+/*
+** Prepare "searchString" for searching from threads other than the main one,
+** with SearchMatcherNext.  The first regular expression must have been
+** compiled in the main thread already (for the character class tables).
+** Returns NULL if a regular expression doesn't compile.  "delimiters" must
+** stay valid while the matcher is in use, and NULL stands for the default
+** set only with regular expressions.
+*/
+SearchMatcher *CreateSearchMatcher(const char *searchString, int searchType,
+	const char *delimiters)
+{
+    SearchMatcher *matcher = (SearchMatcher*)NEditMalloc(sizeof(SearchMatcher));
+    
+    if (*searchString == '\0' ||
+	    !initReplaceMatcher(matcher, searchString, searchType, delimiters,
+	    TRUE)) {
+	NEditFree(matcher);
 	return NULL;
+    }
+    return matcher;
+}
+
+void FreeSearchMatcher(SearchMatcher *matcher)
+{
+    freeReplaceMatcher(matcher);
+    NEditFree(matcher);
+}
+
+/*
+** Forward search without wrapping for "matcher" in "string", which must be
+** null terminated.  Only matches starting before "limitPos" are found, or
+** anywhere if it is -1 (they may still end after it).  Regular expression
+** searches may have been given up, see GetREExecStatus.
+*/
+int SearchMatcherNext(const SearchMatcher *matcher, const char *string,
+	int beginPos, int limitPos, int *startPos, int *endPos)
+{
+    return nextReplaceMatch(matcher, string, beginPos, limitPos, startPos,
+	    endPos);
+}
+
+/*
+** Find the next match of "matcher" in "string", starting at "beginPos", and
+** before "limitPos" (-1 for no limit).
+*/
+static int nextReplaceMatch(const SearchMatcher *matcher, const char *string,
+	int beginPos, int limitPos, int *startPos, int *endPos)
+{
+    const char *match, *matchEnd, *last = NULL;
+    
+    if (limitPos >= 0) {
+	if (beginPos >= limitPos)
+	    return FALSE;
+	last = string + limitPos - 1;
+    }
+    if (matcher->compiledRE != NULL) {
+	if (!ExecRE(matcher->compiledRE, string + beginPos,
+		last == NULL ? NULL : last + 1, FALSE,
+		beginPos == 0 ? '\0' : string[beginPos-1], '\0',
+		matcher->delimiters, string, NULL))
+	    return FALSE;
+	*startPos = matcher->compiledRE->startp[0] - string;
+	*endPos = matcher->compiledRE->endp[0] - string;
+	return TRUE;
+    }
     
-    /* Allocate a new buffer to hold all of the new text between the first
-       and last substitutions */
-    copyLen = *copyEnd - *copyStart;
-    outString = (char*)NEditMalloc(copyLen - removeLen + addLen + 1);
+    if (matcher->wordSearch)
+	match = findLiteralWord(matcher->pattern, string, string + beginPos,
+		last, FALSE, matcher->delimiters, matcher->cignoreL,
+		matcher->cignoreR, &matchEnd);
+    else
+	match = FindLiteral(matcher->pattern, string + beginPos, last,
+		&matchEnd);
+    if (match == NULL)
+	return FALSE;
+    *startPos = match - string;
+    *endPos = matchEnd - string;
+    return TRUE;
+}
+
+/*
+** The scan of ReplaceAllInString, substituting the matches of "matcher".
+** Doesn't use any state of the main thread, so that worker threads can run
+** it too.  Besides when nothing matched, returns NULL when the search was
+** given up, because a regular expression was too expensive to match (see
+** GetREExecStatus) or "cancel" (if not NULL) was set.
+*/
+static char *replaceAllMatches(const SearchMatcher *matcher,
+	const char *inString, const char *replaceString, int *copyStart,
+	int *copyEnd, int *replacementLength, UndoRange **ranges,
+	int *nRanges, const volatile int *cancel)
+{
+    regexp *compiledRE = matcher->compiledRE;
+    int beginPos, startPos, endPos, lastEndPos;
+    int found, replaceLen, addLen, outLen, outAlloc, rangesAlloc = 0;
+    char *outString;
     
-    /* Scan through the text buffer again, substituting the replace string
-       and copying the part between replaced text to the new buffer  */
-    found = TRUE;
+    if (ranges != NULL) {
+	*ranges = NULL;
+	*nRanges = 0;
+    }
+    
+    replaceLen = strlen(replaceString);
+    outString = NULL;
+    outLen = 0;
+    outAlloc = 0;
     beginPos = 0;
     lastEndPos = 0;
-    fillPtr = outString;
-    while (found) {
-    	found = SearchString(inString, searchString, SEARCH_FORWARD, searchType,
-		FALSE, beginPos, &startPos, &endPos, &searchExtentBW,
-                &searchExtentFW, delimiters);
-	if (found) {
-	    if (beginPos != 0) {
-		memcpy(fillPtr, &inString[lastEndPos], startPos - lastEndPos);
-		fillPtr += startPos - lastEndPos;
-	    }
-	    if (isRegexType(searchType)) {
-    		char replaceResult[SEARCHMAX];
-    		replaceUsingRE(searchString, replaceString, &inString[searchExtentBW],
-			startPos-searchExtentBW, 
-    			replaceResult, SEARCHMAX, startPos == 0 ? '\0' :
-			inString[startPos-1], delimiters,
-	      	      	defaultRegexFlags(searchType));
-    		replaceLen = strlen(replaceResult);
-    		memcpy(fillPtr, replaceResult, replaceLen);
-	    } else {
-		memcpy(fillPtr, replaceString, replaceLen);
+    *copyStart = -1;
+    for (;;) {
+	found = (cancel == NULL || !*cancel) && nextReplaceMatch(matcher,
+		inString, beginPos, -1, &startPos, &endPos);
+	if (!found) {
+	    if ((cancel != NULL && *cancel) ||
+		    (compiledRE != NULL && GetREExecStatus() != REEXEC_OK)) {
+		/* don't leave a partial replacement behind */
+		NEditFree(outString);
+		if (ranges != NULL) {
+		    NEditFree(*ranges);
+		    *ranges = NULL;
+		    *nRanges = 0;
+		}
+		return NULL;
 	    }
-	    fillPtr += replaceLen;
-	    lastEndPos = endPos;
-	    /* start next after match unless match was empty, then endPos+1 */
-	    beginPos = (startPos == endPos) ? endPos+1 : endPos;
-	    if (inString[endPos] == '\0')
-		break;
+	    break;
 	}
+	
+	if (*copyStart < 0) {
+	    *copyStart = startPos;
+	    lastEndPos = startPos;
+	}
+	*copyEnd = endPos;
+	
+	/* make room for the text since the last match and the replacement */
+	addLen = compiledRE != NULL ?
+		SubstituteRELength(compiledRE, replaceString) : replaceLen;
+	if (outLen + (startPos - lastEndPos) + addLen + 1 > outAlloc) {
+	    outAlloc = 2 * outAlloc + (startPos - lastEndPos) + addLen + 256;
+	    outString = (char*)NEditRealloc(outString, outAlloc);
+	}
+	memcpy(outString + outLen, &inString[lastEndPos], startPos - lastEndPos);
+	outLen += startPos - lastEndPos;
+	if (compiledRE != NULL)
+	    SubstituteRE(compiledRE, replaceString, outString + outLen,
+		    addLen + 1);
+	else
+	    memcpy(outString + outLen, replaceString, replaceLen);
+	if (ranges != NULL)
+	    addUndoRange(ranges, nRanges, &rangesAlloc, startPos,
+		    endPos - startPos, addLen);
+	outLen += addLen;
+	lastEndPos = endPos;
+	
+	/* start next after match unless match was empty, then endPos+1 */
+	beginPos = (startPos == endPos) ? endPos+1 : endPos;
+	if (inString[endPos] == '\0')
+	    break;
     }
-    *fillPtr = '\0';
-    *replacementLength = fillPtr - outString;
+    if (outString == NULL)
+	return NULL;
+    
+    outString[outLen] = '\0';
+    *replacementLength = outLen;
     return outString;
 }
 
@@ -4263,7 +4946,7 @@ int SearchWindow(WindowInfo *window, int direction, const char *searchString,
     	    	!XmToggleButtonGetState(window->replaceKeepBtn))
     	    unmanageReplaceDialogs(window);
         if (!found) {
-            if (searchWrap) {
+            if (searchWrap && !SearchAborted) {
 		if (direction == SEARCH_FORWARD && beginPos != 0) {
 		    if(GetPrefBeepOnSearchWrap()) {
 			XBell(TheDisplay, 0);
@@ -4298,14 +4981,8 @@ int SearchWindow(WindowInfo *window, int direction, const char *searchString,
 	    }
             translatePosAndRestoreBuf(window->buffer, esc, found, startPos, endPos, extentBW, extentFW);
             esc = NULL;
-            if (!found) {
-		if (GetPrefSearchDlogs()) {
-		    DialogF(DF_INF, window->shell, 1, "String not found",
-                    "String was not found","OK");
-		} else {
-		    XBell(TheDisplay, 0);
-		}
-	    }
+            if (!found)
+                searchFailedDialog(window);
 	}
     } else { /* incremental search */
         if (outsideBounds && searchWrap) {
@@ -4319,8 +4996,11 @@ int SearchWindow(WindowInfo *window, int direction, const char *searchString,
 	    extentBW, extentFW, GetWindowDelimiters(window));
 	if (found) {
 	    iSearchTryBeepOnWrap(window, direction, beginPos, *startPos);
-	} else
+	} else {
 	    XBell(TheDisplay, 0);
+	    if (SearchAborted)
+		iSearchShowAborted(window);
+	}
     }
     
     translatePosAndRestoreBuf(window->buffer, esc, found, startPos, endPos, extentBW, extentFW);
@@ -4341,6 +5021,8 @@ int SearchString(const char *string, const char *searchString, int direction,
        int searchType, int wrap, int beginPos, int *startPos, int *endPos,
        int *searchExtentBW, int *searchExtentFW, const char *delimiters)
 {
+    SearchAborted = FALSE;
+    
     switch (searchType) {
       case SEARCH_CASE_SENSE_WORD:
       	 return searchLiteralWord(string, searchString, TRUE,  direction, wrap,
@@ -4406,284 +5088,172 @@ static int searchLiteralWord(const char *string, const char *searchString, int c
 	int direction, int wrap, int beginPos, int *startPos, int *endPos, 
         const char * delimiters)
 {
-/* This is critical code for the speed of searches.			    */
-/* For efficiency, we define the macro DOSEARCH with the guts of the search */
-/* routine and repeat it, changing the parameters of the outer loop for the */
-/* searching, forwards, backwards, and before and after the begin point	    */
-#define DOSEARCHWORD() \
-    if (*filePtr == *ucString || *filePtr == *lcString) { \
-	/* matched first character */ \
-	ucPtr = ucString; \
-	lcPtr = lcString; \
-	tempPtr = filePtr; \
-	while (*tempPtr == *ucPtr || *tempPtr == *lcPtr || (*ucPtr == 0 && *lcPtr != 0)) { \
-            if(*ucPtr == 0 && ucMatch) ucSkipped++; \
-            ucMatch = *tempPtr == *ucPtr; \
-            lcMatch = *tempPtr == *lcPtr; \
-            tempPtr++; ucPtr++; lcPtr++; \
-	    if (   *ucPtr == 0 && *lcPtr == 0 /* matched whole string */ \
-		&& (cignore_R ||\
-		    isspace((unsigned char)*tempPtr) ||\
-		    strchr(delimiters, *tempPtr) ) \
-		    /* next char right delimits word ? */ \
-		&& (cignore_L ||\
-                    filePtr==string || /* border case */ \
-                    isspace((unsigned char)filePtr[-1]) ||\
-                    strchr(delimiters,filePtr[-1]) ))\
-                    /* next char left delimits word ? */ { \
-		*startPos = filePtr - string; \
-		*endPos = tempPtr - string; \
-		return TRUE; \
-	    } \
-	} \
-    }
-
-    register const char *filePtr, *tempPtr, *ucPtr, *lcPtr;
-    char lcString[SEARCHMAX], ucString[SEARCHMAX];
-    int ucSkipped = 0;
-    int lcMatch = 0;
-    int ucMatch = 0;
-						
-    int cignore_L=0, cignore_R=0;
-		
-    /* SEARCHMAX was fine in the original NEdit, but it should be done away 
-       with now that searching can be done from macros without limits. 
-       Returning search failure here is cheating users.  This limit is not 
-       documented. */
+    const LiteralPattern *pattern;
+    const char *match = NULL, *matchEnd;
     size_t searchStringLen = strlen(searchString);
-    if (searchStringLen >= SEARCHMAX)
-	return FALSE;
-    
+    int cignore_L=0, cignore_R=0;
+
+    if (searchStringLen == 0)
+    	return FALSE;
+
     /* If there is no language mode, we use the default list of delimiters */
     if (delimiters==NULL) delimiters = GetPrefDelimiters();
-		
-    if (   isspace((unsigned char)*searchString) 
-	|| strchr(delimiters, *searchString))
-	cignore_L=1;
-
-    if (   isspace((unsigned char)searchString[strlen(searchString)-1])
-	|| strchr(delimiters, searchString[strlen(searchString)-1]) )
-	cignore_R=1;
-   
-    if (caseSense) {
-        memcpy(ucString, searchString, searchStringLen+1);
-        memcpy(lcString, searchString, searchStringLen+1);
-    } else {
-    	UpCaseString(ucString, searchString, True);
-    	DownCaseString(lcString, searchString, True);
-    }
+    literalWordEnds(searchString, delimiters, &cignore_L, &cignore_R);
+
+    pattern = getLiteralPattern(searchString, caseSense);
 
     if (direction == SEARCH_FORWARD) {
 	/* search from beginPos to end of string */
-	for (filePtr=string+beginPos; *filePtr!=0; filePtr++) {
-      	    DOSEARCHWORD() 
-	}
-	if (!wrap)
-	    return FALSE;
-
+	match = findLiteralWord(pattern, string, string+beginPos, NULL, FALSE,
+		delimiters, cignore_L, cignore_R, &matchEnd);
 	/* search from start of file to beginPos */
-	for (filePtr=string; filePtr<=string+beginPos; filePtr++) {
-      	    DOSEARCHWORD() 
-	}
-	return FALSE;
+	if (match == NULL && wrap)
+	    match = findLiteralWord(pattern, string, string, string+beginPos,
+		    FALSE, delimiters, cignore_L, cignore_R, &matchEnd);
     } else {
 	/* SEARCH_BACKWARD */
 	/* search from beginPos to start of file. A negative begin pos */
 	/* says begin searching from the far end of the file */
-	if (beginPos >= 0) {
-	    for (filePtr=string+beginPos; filePtr>=string; filePtr--) {
-	    	DOSEARCHWORD() 
-	    }
-	}
-	if (!wrap)
-	    return FALSE;
+	if (beginPos >= 0)
+	    match = findLiteralWord(pattern, string, string, string+beginPos,
+		    TRUE, delimiters, cignore_L, cignore_R, &matchEnd);
 	/* search from end of file to beginPos */
 	/*... this strlen call is extreme inefficiency, but it's not obvious */
 	/* how to get the text string length from the text widget (under 1.1)*/
-	for (filePtr=string+strlen(string); filePtr>=string+beginPos; filePtr--) {
-      	    DOSEARCHWORD() 
-	}
-	return FALSE;
+	if (match == NULL && wrap)
+	    match = findLiteralWord(pattern, string,
+		    string + (beginPos>0 ? beginPos : 0), string+strlen(string),
+		    TRUE, delimiters, cignore_L, cignore_R, &matchEnd);
     }
+    if (match == NULL)
+	return FALSE;
+    *startPos = match - string;
+    *endPos = matchEnd - string;
+    return TRUE;
 }
 
+/*
+** Which ends of "searchString" need no word delimiter next to them in the
+** text, because they are delimiters or white space themselves (see
+** searchLiteralWord).
+*/
+static void literalWordEnds(const char *searchString, const char *delimiters,
+	int *cignore_L, int *cignore_R)
+{
+    size_t searchStringLen = strlen(searchString);
 
-#ifdef USE_STRSTR
+    *cignore_L = isspace((unsigned char)*searchString) ||
+	    strchr(delimiters, *searchString) != NULL;
+    *cignore_R = isspace((unsigned char)searchString[searchStringLen-1]) ||
+	    strchr(delimiters, searchString[searchStringLen-1]) != NULL;
+}
 
-static int searchLiteral(const char *string, const char *searchString, int caseSense, 
-	int direction, int wrap, int beginPos, int *startPos, int *endPos,
-	int *searchExtentBW, int *searchExtentFW)
+/*
+** Finds the first (or with "backward", the last) match of "pattern" starting
+** between "first" and "last" which is delimited as a word, see
+** searchLiteralWord.  "last" may be NULL for the end of the text when
+** searching forward.
+*/
+static const char *findLiteralWord(const LiteralPattern *pattern,
+	const char *string, const char *first, const char *last, int backward,
+	const char *delimiters, int cignore_L, int cignore_R,
+	const char **matchEnd)
 {
-    if(direction == SEARCH_FORWARD) {
-        const char *beginString = string + beginPos;
-        char *s = caseSense ? strstr(beginString, searchString) : strcasestr(beginString, searchString);
-        if(s) {
-            /* search from beginPos to end of string */
-            *startPos = s - string;
-            *endPos = *startPos + strlen(searchString);
-            if (searchExtentBW != NULL) {
-                *searchExtentBW = *startPos;
-            }
-            if (searchExtentFW != NULL) {
-                *searchExtentFW = *endPos;
-            }
-            return True;
-        } else if(wrap && beginPos > 0) {
-            /* search from start of file to beginPos */
-            s = caseSense ? strstr(string, searchString) : strcasestr(string, searchString);
-            int start = s - string;
-            if(start < beginPos) {
-                *startPos = start;
-                *endPos = *startPos + (int)strlen(searchString);
-                if (searchExtentBW != NULL) {
-                    *searchExtentBW = *startPos;
-                }
-                if (searchExtentFW != NULL) {
-                    *searchExtentFW = *endPos;
-                }
-            }
-        }
-    } else {
-        /* SEARCH_BACKWARD */
-	/* search from beginPos to start of file.  A negative begin pos	*/
-	/* says begin searching from the far end of the file            */
-        int begin = beginPos >= 0 ? beginPos : (int)strlen(string);
-        char *result = NULL;
-        char *s = NULL;
-        const char *str = string;
-        while((s = caseSense ? strstr(str, searchString) : strcasestr(str, searchString)) != NULL) {
-            str = s+1;
-            int pos = s - string;
-            if(pos >= begin) {
-                break;
-            }
-            result = s;
-        }
-        if(result) {
-            *startPos = result - string;
-            *endPos = *startPos + (int)strlen(searchString);
-            if (searchExtentBW != NULL) {
-                *searchExtentBW = *startPos;
-            }
-            if (searchExtentFW != NULL) {
-                *searchExtentFW = *endPos;
-            }
-            return True;
-        } else if(wrap && beginPos > 0) {
-            str = string + beginPos;
-            while((s = caseSense ? strstr(str, searchString) : strcasestr(str, searchString)) != NULL) {
-                str = s+1;
-                result = s;
-            }
-            if(result) {
-                *startPos = result - string;
-                *endPos = *startPos + (int)strlen(searchString);
-                if (searchExtentBW != NULL) {
-                    *searchExtentBW = *startPos;
-                }
-                if (searchExtentFW != NULL) {
-                    *searchExtentFW = *endPos;
-                }
-                return True;
-            }
-        }
-        
+    const char *match;
+
+    while (last == NULL || first <= last) {
+	match = backward ? FindLiteralBackward(pattern, first, last, matchEnd) :
+		FindLiteral(pattern, first, last, matchEnd);
+	if (match == NULL)
+	    return NULL;
+	if (   (cignore_R ||
+		isspace((unsigned char)**matchEnd) ||
+		strchr(delimiters, **matchEnd))
+		/* next char right delimits word ? */
+	    && (cignore_L ||
+		match==string || /* border case */
+		isspace((unsigned char)match[-1]) ||
+		strchr(delimiters, match[-1])))
+		/* next char left delimits word ? */
+	    return match;
+	if (backward) {
+	    if (match == first)
+		return NULL;
+	    last = match - 1;
+	} else {
+	    first = match + 1;
+	}
     }
-    return False;
+    return NULL;
 }
 
-#else
+/*
+** Returns the search string prepared for the literal search kernel.  The
+** last one is kept, as Replace All and repeated Find Again search for the
+** same string over and over.
+*/
+static const LiteralPattern *getLiteralPattern(const char *searchString,
+	int caseSense)
+{
+    static LiteralPattern *lastPattern = NULL;
+    static char *lastString = NULL;
+    static int lastCaseSense;
+
+    if (lastPattern == NULL || caseSense != lastCaseSense ||
+	    strcmp(searchString, lastString)) {
+	FreeLiteral(lastPattern);
+	NEditFree(lastString);
+	lastPattern = CompileLiteral(searchString, caseSense);
+	lastString = NEditStrdup(searchString);
+	lastCaseSense = caseSense;
+    }
+    return lastPattern;
+}
 
+/*
+** Searches for a literal string, case insensitive searches folding UTF-8
+** characters to lower case (see literalSearch.c).  Find, Replace All and
+** incremental search all come through here.
+*/
 static int searchLiteral(const char *string, const char *searchString, int caseSense, 
 	int direction, int wrap, int beginPos, int *startPos, int *endPos,
 	int *searchExtentBW, int *searchExtentFW)
 {
-/* This is critical code for the speed of searches.			    */
-/* For efficiency, we define the macro DOSEARCH with the guts of the search */
-/* routine and repeat it, changing the parameters of the outer loop for the */
-/* searching, forwards, backwards, and before and after the begin point	    */
-#define DOSEARCH() \
-    if (*filePtr == *ucString || *filePtr == *lcString) { \
-	/* matched first character */ \
-	ucPtr = ucString; \
-	lcPtr = lcString; \
-	tempPtr = filePtr; \
-        ucSkipped = 0; \
-	while (*tempPtr == *ucPtr || *tempPtr == *lcPtr || (*ucPtr == 0 && *lcPtr != 0)) { \
-            if(*ucPtr == 0 && ucMatch) ucSkipped++; \
-            ucMatch = *tempPtr == *ucPtr; \
-            lcMatch = *tempPtr == *lcPtr; \
-	    tempPtr++; ucPtr++; lcPtr++; \
-	    if (*ucPtr == 0 && *lcPtr == 0) { \
-		/* matched whole string */ \
-		*startPos = filePtr - string; \
-		*endPos = tempPtr - string - ucSkipped; \
-		if (searchExtentBW != NULL) \
-		    *searchExtentBW = *startPos; \
-		if (searchExtentFW != NULL) \
-		    *searchExtentFW = *endPos; \
-		return TRUE; \
-	    } \
-	} \
-    } \
-
-    register const char *filePtr, *tempPtr, *ucPtr, *lcPtr;
-    char lcString[SEARCHMAX], ucString[SEARCHMAX];
-    int ucSkipped = 0;
-    int lcMatch = 0;
-    int ucMatch = 0;
-    size_t searchLen = strlen(searchString);
-
-    /* SEARCHMAX was fine in the original NEdit, but it should be done away with
-       now that searching can be done from macros without limits.  Returning
-       search failure here is cheating users.  This limit is not documented. */
-    if (searchLen >= SEARCHMAX)
-	return FALSE;
-    
-    if (caseSense) {
-        memcpy(ucString, searchString, searchLen+1);
-        memcpy(lcString, searchString, searchLen+1);
-    } else {
-    	UpCaseString(ucString, searchString, True);
-    	DownCaseString(lcString, searchString, False);
-    }
+    const LiteralPattern *pattern = getLiteralPattern(searchString, caseSense);
+    const char *match = NULL, *matchEnd;
 
     if (direction == SEARCH_FORWARD) {
 	/* search from beginPos to end of string */
-	for (filePtr=string+beginPos; *filePtr!=0; filePtr++) {
-	    DOSEARCH()
-	}
-	if (!wrap)
-	    return FALSE;
+	match = FindLiteral(pattern, string+beginPos, NULL, &matchEnd);
 	/* search from start of file to beginPos	*/
-	for (filePtr=string; filePtr<=string+beginPos; filePtr++) {
-	    DOSEARCH()
-	}
-	return FALSE;
+	if (match == NULL && wrap)
+	    match = FindLiteral(pattern, string, string+beginPos, &matchEnd);
     } else {
     	/* SEARCH_BACKWARD */
 	/* search from beginPos to start of file.  A negative begin pos	*/
 	/* says begin searching from the far end of the file		*/
-	if (beginPos >= 0) {
-	    for (filePtr=string+beginPos; filePtr>=string; filePtr--) {
-		DOSEARCH()
-	    }
-	}
-	if (!wrap)
-	    return FALSE;
+	if (beginPos >= 0)
+	    match = FindLiteralBackward(pattern, string, string+beginPos,
+		    &matchEnd);
 	/* search from end of file to beginPos */
 	/*... this strlen call is extreme inefficiency, but it's not obvious */
 	/* how to get the text string length from the text widget (under 1.1)*/
-	for (filePtr=string+strlen(string);
-		filePtr>=string+beginPos; filePtr--) {
-	    DOSEARCH()
-	}
-	return FALSE;
+	if (match == NULL && wrap)
+	    match = FindLiteralBackward(pattern,
+		    string + (beginPos>0 ? beginPos : 0), string+strlen(string),
+		    &matchEnd);
     }
+    if (match == NULL)
+	return FALSE;
+    *startPos = match - string;
+    *endPos = matchEnd - string;
+    if (searchExtentBW != NULL)
+	*searchExtentBW = *startPos;
+    if (searchExtentFW != NULL)
+	*searchExtentFW = *endPos;
+    return TRUE;
 }
 
-#endif
-
 static int searchRegex(const char *string, const char *searchString, int direction,
 	int wrap, int beginPos, int *startPos, int *endPos, int *searchExtentBW,
 	int *searchExtentFW, const char *delimiters, int defaultFlags)
@@ -4708,7 +5278,7 @@ static int forwardRegexSearch(const char *string, const char *searchString, int
     /* compile the search string for searching with ExecRE.  Note that
        this does not process errors from compiling the expression.  It
        assumes that the expression was checked earlier. */
-    compiledRE = CompileRE(searchString, &compileMsg, defaultFlags);
+    compiledRE = CompileCachedRE(searchString, &compileMsg, defaultFlags);
     if (compiledRE == NULL)
 	return FALSE;
 
@@ -4722,13 +5292,13 @@ static int forwardRegexSearch(const char *string, const char *searchString, int
 	    *searchExtentFW = compiledRE->extentpFW - string;
 	if (searchExtentBW != NULL)
            *searchExtentBW = compiledRE->extentpBW - string;
-	NEditFree(compiledRE);
+	ReleaseCachedRE(compiledRE);
 	return TRUE;
     }
     
-    /* if wrap turned off, we're done */
-    if (!wrap) {
-    	NEditFree(compiledRE);
+    /* if wrap turned off or the search was given up, we're done */
+    if (!wrap || regexSearchAborted()) {
+    	ReleaseCachedRE(compiledRE);
 	return FALSE;
     }
     
@@ -4741,11 +5311,12 @@ static int forwardRegexSearch(const char *string, const char *searchString, int
        	    *searchExtentFW = compiledRE->extentpFW - string;
 	if (searchExtentBW != NULL)
 	    *searchExtentBW = compiledRE->extentpBW - string;
-	NEditFree(compiledRE);
+	ReleaseCachedRE(compiledRE);
 	return TRUE;
     }
 
-    NEditFree(compiledRE);
+    regexSearchAborted();
+    ReleaseCachedRE(compiledRE);
     return FALSE;
 }
 
@@ -4758,7 +5329,7 @@ static int backwardRegexSearch(const char *string, const char *searchString, int
     int length;
 
     /* compile the search string for searching with ExecRE */
-    compiledRE = CompileRE(searchString, &compileMsg, defaultFlags);
+    compiledRE = CompileCachedRE(searchString, &compileMsg, defaultFlags);
     if (compiledRE == NULL)
 	return FALSE;
 
@@ -4773,14 +5344,14 @@ static int backwardRegexSearch(const char *string, const char *searchString, int
 		*searchExtentFW = compiledRE->extentpFW - string;
 	    if (searchExtentBW != NULL)
 		*searchExtentBW = compiledRE->extentpBW - string;
-	    NEditFree(compiledRE);
+	    ReleaseCachedRE(compiledRE);
 	    return TRUE;
 	}
     }
     
-    /* if wrap turned off, we're done */
-    if (!wrap) {
-    	NEditFree(compiledRE);
+    /* if wrap turned off or the search was given up, we're done */
+    if (!wrap || regexSearchAborted()) {
+    	ReleaseCachedRE(compiledRE);
     	return FALSE;
     }
     
@@ -4797,13 +5368,60 @@ static int backwardRegexSearch(const char *string, const char *searchString, int
 	    *searchExtentFW = compiledRE->extentpFW - string;
 	if (searchExtentBW != NULL)
 	    *searchExtentBW = compiledRE->extentpBW - string;
-	NEditFree(compiledRE);
+	ReleaseCachedRE(compiledRE);
 	return TRUE;
     }
-    NEditFree(compiledRE);
+    regexSearchAborted();
+    ReleaseCachedRE(compiledRE);
     return FALSE;
 }
 
+/*
+** Checks if the last regular expression search gave up instead of finishing,
+** and remembers it for searchFailedDialog.
+*/
+static int regexSearchAborted(void)
+{
+    if (GetREExecStatus() != REEXEC_OK)
+        SearchAborted = TRUE;
+    return SearchAborted;
+}
+
+/*
+** Tell the user that the last search failed, or that it was given up because
+** the regular expression was too expensive.
+*/
+static void searchFailedDialog(const WindowInfo *window)
+{
+    if (SearchAborted) {
+        DialogF(DF_WARN, window->shell, 1, "Pattern too expensive",
+                "Pattern too expensive:\nthe search was stopped because the "
+                "regular expression\ntakes too long to match.", "OK");
+    } else if (GetPrefSearchDlogs()) {
+        DialogF(DF_INF, window->shell, 1, "String not found",
+                "String was not found", "OK");
+    } else {
+        XBell(TheDisplay, 0);
+    }
+}
+
+/*
+** Tell the user that an incremental search was given up, because the regular
+** expression was too expensive, in the place of the match count of the
+** incremental search bar.  (A dialog would take the keyboard focus away from
+** the search text being typed.)
+*/
+static void iSearchShowAborted(WindowInfo *window)
+{
+    XmString s1;
+    
+    if (window->iSearchCountLabel == NULL)
+	return;
+    XtVaSetValues(window->iSearchCountLabel, XmNlabelString,
+	    s1=XmStringCreateSimple("Pattern too expensive"), NULL);
+    XmStringFree(s1);
+}
+
 static int check_len(const char *in, int len) {
     for(int i=0;i<len;i++) {
         if(in[i] == 0) return i;
@@ -4981,27 +5599,48 @@ static int searchMatchesSelection(WindowInfo *window, const char *searchString,
 ** to make the match in the first place, it re-compiles the expression
 ** and redoes the search on the already-matched string.  This allows the
 ** code to continue using strings to represent the search and replace
-** items.
+** items.  The result is returned in "destStr", allocated to fit, and must
+** be freed by the caller.
 */  
 
 static Boolean replaceUsingRE(const char* searchStr, const char* replaceStr,
-        const char* sourceStr, int beginPos, char* destStr,
-        int maxDestLen, int prevChar, const char* delimiters,
-        int defaultFlags)
+        const char* sourceStr, int beginPos, char** destStr, int prevChar,
+        const char* delimiters, int defaultFlags)
 {
     regexp *compiledRE;
     char *compileMsg;
     Boolean substResult = False;
+    int substLen;
     
-    compiledRE = CompileRE(searchStr, &compileMsg, defaultFlags);
+    compiledRE = CompileCachedRE(searchStr, &compileMsg, defaultFlags);
     ExecRE(compiledRE, sourceStr+beginPos, NULL, False, prevChar, '\0',
             delimiters, sourceStr, NULL);
-    substResult = SubstituteRE(compiledRE, replaceStr, destStr, maxDestLen);
-    NEditFree(compiledRE);
+    substLen = SubstituteRELength(compiledRE, replaceStr);
+    *destStr = (char*)NEditMalloc(substLen + 1);
+    **destStr = '\0';
+    substResult = SubstituteRE(compiledRE, replaceStr, *destStr, substLen + 1);
+    ReleaseCachedRE(compiledRE);
 
     return substResult;
 }
 
+/*
+** Append a replaced span to a growing array of undo ranges.
+*/
+static void addUndoRange(UndoRange **ranges, int *nRanges, int *nAlloc,
+	int pos, int oldLen, int newLen)
+{
+    if (*nRanges == *nAlloc) {
+	*nAlloc = *nAlloc == 0 ? 64 : *nAlloc * 2;
+	*ranges = (UndoRange*)NEditRealloc(*ranges,
+		*nAlloc * sizeof(UndoRange));
+    }
+    (*ranges)[*nRanges].pos = pos;
+    (*ranges)[*nRanges].oldLen = oldLen;
+    (*ranges)[*nRanges].newLen = newLen;
+    (*nRanges)++;
+}
+
 /*
 ** Enable commands for repeating the last search/replace
 */
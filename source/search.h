@@ -69,8 +69,18 @@ int SearchString(const char *string, const char *searchString, int direction,
 char *ReplaceAllInString(const char *inString, const char *searchString,
 	const char *replaceString, int searchType, int *copyStart,
 	int *copyEnd, int *replacementLength, const char *delimiters);
+
+/* Search strings prepared for searching in worker threads */
+typedef struct _SearchMatcher SearchMatcher;
+SearchMatcher *CreateSearchMatcher(const char *searchString, int searchType,
+	const char *delimiters);
+void FreeSearchMatcher(SearchMatcher *matcher);
+int SearchMatcherNext(const SearchMatcher *matcher, const char *string,
+	int beginPos, int limitPos, int *startPos, int *endPos);
+
 void BeginISearch(WindowInfo *window, int direction);
 void EndISearch(WindowInfo *window);
+void ForgetISearchStep(WindowInfo *window);
 void SetISearchTextCallbacks(WindowInfo *window);
 void FlashMatching(WindowInfo *window, Widget textW);
 void SelectToMatchingCharacter(WindowInfo *window);
@@ -189,6 +189,8 @@ textBuffer *BufCreatePreallocated(int requestedSize)
     buf->ansi_escpos = NULL;
     buf->alloc_ansi_escpos = 0;
     buf->num_ansi_escpos = 0;
+    buf->frozen = 0;
+    buf->frozenText = NULL;
     return buf;
 }
 
@@ -208,6 +210,7 @@ void BufFree(textBuffer *buf)
     	NEditFree(buf->preDeleteProcs);
     	NEditFree(buf->preDeleteCbArgs);
     }
+    NEditFree(buf->frozenText);
     NEditFree(buf);
 }
 
@@ -227,6 +230,40 @@ char *BufGetAll(textBuffer *buf)
     return text;
 }
 
+/*
+** Get the contents of a text buffer without copying them, as the text before
+** the gap (text1, length1) and the text after it (text2, length2).  The
+** pointers stay valid until the buffer is modified, or its gap is moved by
+** BufAsString (see BufFreeze).
+*/
+void BufGetSegments(const textBuffer *buf, const char **text1, int *length1,
+        const char **text2, int *length2)
+{
+    *text1 = buf->buf;
+    *length1 = buf->gapStart;
+    *text2 = &buf->buf[buf->gapEnd];
+    *length2 = buf->length - buf->gapStart;
+}
+
+/*
+** Keep the text of a buffer in place, for example while another thread reads
+** it through BufGetSegments.  Until BufThaw is called, BufAsString returns a
+** copy of the text instead of moving the gap.  The buffer must not be
+** modified while it is frozen.  Calls can be nested.
+*/
+void BufFreeze(textBuffer *buf)
+{
+    buf->frozen++;
+}
+
+void BufThaw(textBuffer *buf)
+{
+    if (--buf->frozen == 0) {
+        NEditFree(buf->frozenText);
+        buf->frozenText = NULL;
+    }
+}
+
 /*
 ** Get the entire contents of a text buffer as a single string.  The gap is
 ** moved so that the buffer data can be accessed as a single contiguous
@@ -243,6 +280,13 @@ const char *BufAsString(textBuffer *buf)
     int leftLen = buf->gapStart;
     int rightLen = bufLen - leftLen;
 
+    /* the gap can't move while the buffer is frozen, use a copy */
+    if (buf->frozen) {
+        if (buf->frozenText == NULL)
+            buf->frozenText = BufGetAll(buf);
+        return buf->frozenText;
+    }
+
     /* find where best to put the gap to minimise memory movement */
     if (leftLen != 0 && rightLen != 0) {
         leftLen = (leftLen < rightLen) ? 0 : bufLen;
@@ -393,6 +437,39 @@ void BufSetAll(textBuffer *buf, const char *text)
     NEditFree(deletedText);
 }
 
+/*
+** Replace the entire contents of the text buffer, like BufSetAll, with the
+** "length" characters of "text", taking over the memory "text" points to
+** instead of copying it.  "text" must have been allocated with NEditMalloc,
+** with room for "allocated" characters (at least length + 1), and must not
+** contain nul characters.  The unused space after the text becomes the gap.
+*/
+void BufAdoptAll(textBuffer *buf, char *text, int length, int allocated)
+{
+    int deletedLength;
+    char *deletedText;
+
+    callPreDeleteCBs(buf, 0, buf->length);
+    
+    /* Save information for redisplay, and get rid of the old buffer */
+    deletedText = BufGetAll(buf);
+    deletedLength = buf->length;
+    NEditFree(buf->buf);
+    
+    buf->buf = text;
+    buf->buf[allocated - 1] = '\0';
+    buf->length = length;
+    buf->gapStart = length;
+    buf->gapEnd = allocated - 1;
+    
+    /* Zero all of the existing selections */
+    updateSelections(buf, 0, deletedLength, 0);
+    
+    /* Call the saved display routine(s) to update the screen */
+    callModifyCBs(buf, 0, deletedLength, length, 0, deletedText);
+    NEditFree(deletedText);
+}
+
 /*
 ** Return a copy of the text between "start" and "end" character positions
 ** from text buffer "buf".  Positions start at 0, and the range does not
@@ -29,6 +29,7 @@
 
 #include <fontconfig/fontconfig.h>
 #include <wchar.h>
+#include <sys/types.h>
 
 /* Maximum length in characters of a tab or control character expansion
    of a single buffer character */
@@ -97,6 +98,10 @@ typedef struct _textBuffer {
     size_t *ansi_escpos;        /* indices of all ansi escape positions */
     size_t alloc_ansi_escpos;   /* ansi_escpos allocation size */
     size_t num_ansi_escpos;     /* number of ansi escape sequences */
+    int frozen;                 /* the text must stay in place, see
+                                   BufFreeze */
+    char *frozenText;           /* copy of the text returned by BufAsString
+                                   while the buffer is frozen */
 } textBuffer;
 
 typedef struct EscSeqStr {
@@ -116,10 +121,15 @@ textBuffer *BufCreate(void);
 textBuffer *BufCreatePreallocated(int requestedSize);
 void BufFree(textBuffer *buf);
 char *BufGetAll(textBuffer *buf);
+void BufGetSegments(const textBuffer *buf, const char **text1, int *length1,
+        const char **text2, int *length2);
+void BufFreeze(textBuffer *buf);
+void BufThaw(textBuffer *buf);
 const char *BufAsString(textBuffer *buf);
 const char *BufAsStringCleaned(textBuffer *buf, EscSeqArray **esc);
 void BufReintegrateEscSeq(textBuffer *buf, EscSeqArray *escseq);
 void BufSetAll(textBuffer *buf, const char *text);
+void BufAdoptAll(textBuffer *buf, char *text, int length, int allocated);
 char* BufGetRange(const textBuffer* buf, int start, int end);
 const char* BufGetRange2(const textBuffer* buf, ssize_t start, ssize_t end, char **free_str);
 char BufGetCharacter(const textBuffer* buf, int pos);
@@ -55,6 +55,15 @@
 #define FORWARD 1
 #define REVERSE 2
 
+/* Records further down the undo or redo list than UNDO_PACK_AFTER, holding
+   at least UNDO_PACK_MIN bytes of text, keep their text compressed */
+#define UNDO_PACK_AFTER 8
+#define UNDO_PACK_MIN 256
+
+#define PACK_HASH_BITS 12       /* size of the compressor's match table */
+#define PACK_MIN_MATCH 4
+#define PACK_MAX_OFFSET 65535
+
 static void addUndoItem(WindowInfo *window, UndoInfo *undo);
 static void addRedoItem(WindowInfo *window, UndoInfo *redo);
 static void removeUndoItem(WindowInfo *window);
@@ -62,8 +71,27 @@ static void removeRedoItem(WindowInfo *window);
 static void appendDeletedText(WindowInfo *window, const char *deletedText,
 	int deletedLen, int direction);
 static void trimUndoList(WindowInfo *window, int maxLength);
+static void trimUndoMemory(WindowInfo *window, int limit);
+static void freeUndoRecordsAfter(WindowInfo *window, UndoInfo *lastRec);
 static int determineUndoType(int nInserted, int nDeleted);
+static int saveUndoRanges(UndoInfo *undo, int pos, int nInserted,
+	int nDeleted, const char *deletedText);
+static int restoreUndoText(WindowInfo *window, UndoInfo *undo);
 static void freeUndoRecord(UndoInfo *undo);
+static void packOldRecord(UndoInfo *list, int *memUsed);
+static void packUndoRecord(UndoInfo *undo, int *memUsed);
+static void unpackUndoRecord(UndoInfo *undo, int *memUsed);
+static char *unpackedText(const UndoInfo *undo);
+static int packText(const char *text, int len, unsigned char *packed);
+static int packSequence(unsigned char *packed, const char *literals,
+	int nLiterals, int offset, int matchLen);
+static void unpackText(const unsigned char *packed, int packedLen,
+	char *text);
+
+/* Replaced spans announced by SetUndoRanges for the next modification */
+static const WindowInfo *RangesWindow = NULL;
+static const UndoRange *Ranges = NULL;
+static int NRanges = 0;
 
 static void doUndo(WindowInfo *window, int isBatch, size_t *cursors, int cursorIndex)
 {
@@ -82,10 +110,7 @@ static void doUndo(WindowInfo *window, int isBatch, size_t *cursors, int cursorI
     undo->inUndo = True;
        
     /* use the saved undo information to reverse changes */
-    BufReplace(window->buffer, undo->startPos, undo->endPos,
-    	    (undo->oldText != NULL ? undo->oldText : ""));
-    
-    restoredTextLength = undo->oldText != NULL ? strlen(undo->oldText) : 0;
+    restoredTextLength = restoreUndoText(window, undo);
     int diff = restoredTextLength;
     if(diff == 0) {
         diff = undo->startPos - undo->endPos;
@@ -173,10 +198,7 @@ static void doRedo(WindowInfo *window, int isBatch, size_t *cursors, int cursorI
     redo->inUndo = True;
     
     // use the saved redo information to reverse changes
-    BufReplace(window->buffer, redo->startPos, redo->endPos,
-    	    (redo->oldText != NULL ? redo->oldText : ""));
-       
-    restoredTextLength = redo->oldText != NULL ? strlen(redo->oldText) : 0;
+    restoredTextLength = restoreUndoText(window, redo);
     if (!window->buffer->primary.selected || GetPrefUndoModifiesSelection()) {
 	// position the cursor in the focus pane after the changed text
         // to show the user where the undo was done
@@ -326,6 +348,10 @@ void SaveUndoInformation(WindowInfo *window, int pos, int nInserted,
     undo = (UndoInfo *)NEditMalloc(sizeof(UndoInfo));
     undo->oldLen = 0;
     undo->oldText = NULL;
+    undo->ranges = NULL;
+    undo->nRanges = 0;
+    undo->packedLen = 0;
+    undo->textLen = 0;
     undo->type = newType;
     undo->inUndo = False;
     undo->numOp = numOp;
@@ -333,8 +359,12 @@ void SaveUndoInformation(WindowInfo *window, int pos, int nInserted,
     undo->startPos = pos;
     undo->endPos = pos + nInserted;
 
-    /* if text was deleted, save it */
-    if (nDeleted > 0) {
+    /* if text was deleted, save it.  If the modification was announced as
+       a set of separate replacements, only the replaced spans are kept */
+    if (RangesWindow == window && saveUndoRanges(undo, pos, nInserted,
+	    nDeleted, deletedText)) {
+	RangesWindow = NULL;
+    } else if (nDeleted > 0) {
 	undo->oldLen = nDeleted + 1;	/* +1 is for null at end */
 	undo->oldText = (char*)NEditMalloc(nDeleted + 1);
 	strcpy(undo->oldText, deletedText);
@@ -379,6 +409,21 @@ void ClearRedoList(WindowInfo *window)
     	removeRedoItem(window);
 }
 
+/*
+** Announce that the next modification of "window" replaces the whole range
+** between (or around) the separate spans "ranges", positioned as before the
+** change.  The undo record then keeps just the text of those spans instead
+** of the whole range.  "ranges" must stay valid until the modification is
+** made, after which this should be called again with NULL to cancel it in
+** case the modification was not recorded.
+*/
+void SetUndoRanges(const WindowInfo *window, const UndoRange *ranges, int nRanges)
+{
+    RangesWindow = ranges != NULL ? window : NULL;
+    Ranges = ranges;
+    NRanges = nRanges;
+}
+
 /*
 ** Add an undo record (already allocated by the caller) to the window's undo
 ** list if the item pushes the undo operation or character counts past the
@@ -401,6 +446,9 @@ static void addUndoItem(WindowInfo *window, UndoInfo *undo)
     window->undoOpCount++;
     window->undoMemUsed += undo->oldLen;
     
+    /* Compress the text of the record moving past the recent ones */
+    packOldRecord(window->undo, &window->undoMemUsed);
+    
     /* Trim the list if it exceeds any of the limits */
     if (window->undoOpCount > GetPrefUndoOpLimit())
     	trimUndoList(window, GetPrefUndoOpTrimTo());
@@ -408,6 +456,9 @@ static void addUndoItem(WindowInfo *window, UndoInfo *undo)
     	trimUndoList(window, GetPrefUndoWorryTrimTo());
     if (window->undoMemUsed > GetPrefUndoPurgeLimit())
     	trimUndoList(window, GetPrefUndoPurgeTrimTo());
+    if (GetPrefUndoMemoryLimit() > 0 && window->undoMemUsed +
+	    window->redoMemUsed > GetPrefUndoMemoryLimit())
+	trimUndoMemory(window, GetPrefUndoMemoryLimit());
 }
 
 /*
@@ -424,6 +475,8 @@ static void addRedoItem(WindowInfo *window, UndoInfo *redo)
     /* Add the item to the beginning of the list */
     redo->next = window->redo;
     window->redo = redo;
+    window->redoMemUsed += redo->oldLen;
+    packOldRecord(window->redo, &window->redoMemUsed);
 }
 
 /*
@@ -459,6 +512,7 @@ static void removeRedoItem(WindowInfo *window)
     UndoInfo *redo = window->redo;
     
     /* Remove and free the item */
+    window->redoMemUsed -= redo->oldLen;
     window->redo = redo->next;
     freeUndoRecord(redo);
     
@@ -481,6 +535,10 @@ static void appendDeletedText(WindowInfo *window, const char *deletedText,
     UndoInfo *undo = window->undo;
     char *comboText;
 
+    /* the record may have been compressed before undo brought it back to
+       the front of the list */
+    unpackUndoRecord(undo, &window->undoMemUsed);
+
     /* re-allocate, adding space for the new character(s) */
     comboText = (char*)NEditMalloc(undo->oldLen + deletedLen);
 
@@ -494,7 +552,7 @@ static void appendDeletedText(WindowInfo *window, const char *deletedText,
     }
 
     /* keep track of the additional memory now used by the undo list */
-    window->undoMemUsed++;
+    window->undoMemUsed += deletedLen;
 
     /* free the old saved text and attach the new */
     NEditFree(undo->oldText);
@@ -509,7 +567,7 @@ static void appendDeletedText(WindowInfo *window, const char *deletedText,
 static void trimUndoList(WindowInfo *window, int maxLength)
 {
     int i;
-    UndoInfo *u, *lastRec;
+    UndoInfo *u;
     
     if (window->undo == NULL)
     	return;
@@ -519,8 +577,39 @@ static void trimUndoList(WindowInfo *window, int maxLength)
     if (u == NULL)
     	return;
     
-    /* Trim off all subsequent entries */
-    lastRec = u;
+    freeUndoRecordsAfter(window, u);
+}
+
+/*
+** Trim records off of the END of the undo list, until the undo and redo
+** lists together use no more than limit bytes.  The most recent record is
+** always kept.
+*/
+static void trimUndoMemory(WindowInfo *window, int limit)
+{
+    UndoInfo *lastRec;
+    int used;
+    
+    if (window->undo == NULL)
+    	return;
+    
+    used = window->redoMemUsed + window->undo->oldLen;
+    for (lastRec = window->undo; lastRec->next != NULL;
+	    lastRec = lastRec->next) {
+	used += lastRec->next->oldLen;
+	if (used > limit)
+	    break;
+    }
+    freeUndoRecordsAfter(window, lastRec);
+}
+
+/*
+** Free the undo records following lastRec
+*/
+static void freeUndoRecordsAfter(WindowInfo *window, UndoInfo *lastRec)
+{
+    UndoInfo *u;
+    
     while (lastRec->next != NULL) {
 	u = lastRec->next;
 	lastRec->next = u->next;
@@ -561,11 +650,296 @@ static int determineUndoType(int nInserted, int nDeleted)
     }
 }
 
+/*
+** Fill in a MULTI_REPLACE record from the spans announced with SetUndoRanges,
+** storing the replaced text of each span and its position after the change.
+** Returns False, leaving the record alone, if the spans don't describe the
+** modification.
+*/
+static int saveUndoRanges(UndoInfo *undo, int pos, int nInserted,
+	int nDeleted, const char *deletedText)
+{
+    int i, textLen = 0, offset = 0, prevEnd = pos;
+    char *fill;
+    
+    /* the spans must be in order, inside the deleted range, and add up to
+       the change in length */
+    for (i=0; i<NRanges; i++) {
+	if (Ranges[i].pos < prevEnd ||
+		Ranges[i].pos + Ranges[i].oldLen > pos + nDeleted)
+	    return False;
+	prevEnd = Ranges[i].pos + Ranges[i].oldLen;
+	textLen += Ranges[i].oldLen;
+	offset += Ranges[i].newLen - Ranges[i].oldLen;
+    }
+    if (NRanges == 0 || nInserted != nDeleted + offset)
+	return False;
+    
+    undo->type = MULTI_REPLACE;
+    undo->nRanges = NRanges;
+    undo->ranges = (UndoRange*)NEditMalloc(NRanges * sizeof(UndoRange));
+    undo->oldText = fill = (char*)NEditMalloc(textLen + 1);
+    offset = 0;
+    for (i=0; i<NRanges; i++) {
+	memcpy(fill, deletedText + Ranges[i].pos - pos, Ranges[i].oldLen);
+	fill += Ranges[i].oldLen;
+	undo->ranges[i] = Ranges[i];
+	undo->ranges[i].pos += offset;
+	offset += Ranges[i].newLen - Ranges[i].oldLen;
+    }
+    *fill = '\0';
+    undo->oldLen = textLen + 1 + NRanges * sizeof(UndoRange);
+    return True;
+}
+
+/*
+** Replace the text covered by an undo (or redo) record with the text saved in
+** it, and return the length of the restored text.  A MULTI_REPLACE record has
+** only the text of the replaced spans, the rest is taken from the buffer, and
+** the record saved for reversing the operation is made compact in turn.
+*/
+static int restoreUndoText(WindowInfo *window, UndoInfo *undo)
+{
+    UndoRange *reverse;
+    const UndoRange *r;
+    const char *oldText;
+    char *current, *text, *fill, *unpacked;
+    int i, len, prevEnd;
+    
+    unpacked = unpackedText(undo);
+    if (undo->type != MULTI_REPLACE) {
+	oldText = unpacked != NULL ? unpacked : undo->oldText;
+	len = oldText != NULL ? strlen(oldText) : 0;
+	BufReplace(window->buffer, undo->startPos, undo->endPos,
+    		(oldText != NULL ? oldText : ""));
+	NEditFree(unpacked);
+	return len;
+    }
+    
+    len = undo->endPos - undo->startPos;
+    for (i=0; i<undo->nRanges; i++)
+	len += undo->ranges[i].oldLen - undo->ranges[i].newLen;
+    current = BufGetRange(window->buffer, undo->startPos, undo->endPos);
+    text = fill = (char*)NEditMalloc(len + 1);
+    reverse = (UndoRange*)NEditMalloc(undo->nRanges * sizeof(UndoRange));
+    oldText = unpacked != NULL ? unpacked : undo->oldText;
+    prevEnd = undo->startPos;
+    for (i=0; i<undo->nRanges; i++) {
+	r = &undo->ranges[i];
+	memcpy(fill, current + prevEnd - undo->startPos, r->pos - prevEnd);
+	fill += r->pos - prevEnd;
+	memcpy(fill, oldText, r->oldLen);
+	fill += r->oldLen;
+	oldText += r->oldLen;
+	prevEnd = r->pos + r->newLen;
+	reverse[i].pos = r->pos;
+	reverse[i].oldLen = r->newLen;
+	reverse[i].newLen = r->oldLen;
+    }
+    memcpy(fill, current + prevEnd - undo->startPos, undo->endPos - prevEnd);
+    text[len] = '\0';
+    NEditFree(current);
+    NEditFree(unpacked);
+    
+    SetUndoRanges(window, reverse, undo->nRanges);
+    BufReplace(window->buffer, undo->startPos, undo->endPos, text);
+    SetUndoRanges(window, NULL, 0);
+    NEditFree(reverse);
+    NEditFree(text);
+    return len;
+}
+
 static void freeUndoRecord(UndoInfo *undo)
 {
     if (undo == NULL)
     	return;
     	
     NEditFree(undo->oldText);
+    NEditFree(undo->ranges);
     NEditFree(undo);
 }
+
+/*
+** Compress the text of the record UNDO_PACK_AFTER places down an undo or
+** redo list ("memUsed" is the memory count of the list).  As records are
+** added one at a time, each one gets there once, unless the list is cut
+** short before.
+*/
+static void packOldRecord(UndoInfo *list, int *memUsed)
+{
+    int i;
+    
+    for (i=0; i<UNDO_PACK_AFTER && list!=NULL; i++)
+	list = list->next;
+    if (list != NULL && list->packedLen == 0 && list->oldText != NULL)
+	packUndoRecord(list, memUsed);
+}
+
+/*
+** Replace the text of an undo record by its compressed form, if that saves
+** enough memory to be worth it
+*/
+static void packUndoRecord(UndoInfo *undo, int *memUsed)
+{
+    int textLen = strlen(undo->oldText), packedLen;
+    unsigned char *packed;
+    
+    if (textLen < UNDO_PACK_MIN) {
+	undo->packedLen = -1;
+	return;
+    }
+    packed = (unsigned char*)NEditMalloc(textLen + textLen/255 + 16);
+    packedLen = packText(undo->oldText, textLen, packed);
+    if (packedLen > textLen - textLen/8) {
+	NEditFree(packed);
+	undo->packedLen = -1;
+	return;
+    }
+    
+    packed = (unsigned char*)NEditRealloc(packed, packedLen);
+    *memUsed += packedLen - (textLen + 1);
+    undo->oldLen += packedLen - (textLen + 1);
+    NEditFree(undo->oldText);
+    undo->oldText = (char*)packed;
+    undo->packedLen = packedLen;
+    undo->textLen = textLen;
+}
+
+/*
+** Turn a compressed undo record back into one with plain text
+*/
+static void unpackUndoRecord(UndoInfo *undo, int *memUsed)
+{
+    char *text = unpackedText(undo);
+    
+    if (text == NULL)
+	return;
+    *memUsed += undo->textLen + 1 - undo->packedLen;
+    undo->oldLen += undo->textLen + 1 - undo->packedLen;
+    NEditFree(undo->oldText);
+    undo->oldText = text;
+    undo->packedLen = 0;
+}
+
+/*
+** Return a (null terminated) copy of the compressed text of an undo record,
+** or NULL if the text isn't compressed
+*/
+static char *unpackedText(const UndoInfo *undo)
+{
+    char *text;
+    
+    if (undo->packedLen <= 0)
+	return NULL;
+    text = (char*)NEditMalloc(undo->textLen + 1);
+    unpackText((const unsigned char*)undo->oldText, undo->packedLen, text);
+    text[undo->textLen] = '\0';
+    return text;
+}
+
+/*
+** Compress "len" bytes of "text" into "packed", which must have room for
+** len + len/255 + 16 bytes, and return the compressed size.  The format is
+** the one of LZ4 blocks: a sequence of literal bytes and a match (a copy of
+** earlier output), repeated.  Each sequence starts with a byte holding the
+** number of literals and the match length - 4 in its upper and lower four
+** bits, with 15 meaning that more bytes of the length follow, up to one
+** below 255.  Then come the literals, the distance back to the match in two
+** bytes (low byte first), and the rest of the match length.  The last
+** sequence only has literals.
+*/
+static int packText(const char *text, int len, unsigned char *packed)
+{
+    const unsigned char *t = (const unsigned char *)text;
+    int table[1 << PACK_HASH_BITS];
+    int pos = 0, anchor = 0, nPacked = 0, cand, matchLen;
+    unsigned int seq, candSeq, hash;
+    
+    memset(table, -1, sizeof(table));
+    while (pos + PACK_MIN_MATCH <= len) {
+	memcpy(&seq, t + pos, sizeof(seq));
+	hash = (seq * 2654435761U) >> (32 - PACK_HASH_BITS);
+	cand = table[hash];
+	table[hash] = pos;
+	if (cand >= 0 && pos - cand <= PACK_MAX_OFFSET) {
+	    memcpy(&candSeq, t + cand, sizeof(candSeq));
+	    if (candSeq == seq) {
+		for (matchLen = PACK_MIN_MATCH; pos + matchLen < len &&
+			t[cand + matchLen] == t[pos + matchLen]; matchLen++)
+		    ;
+		nPacked += packSequence(packed + nPacked, text + anchor,
+			pos - anchor, pos - cand, matchLen);
+		pos += matchLen;
+		anchor = pos;
+		continue;
+	    }
+	}
+	pos++;
+    }
+    return nPacked + packSequence(packed + nPacked, text + anchor,
+	    len - anchor, 0, 0);
+}
+
+/*
+** Write one sequence of the compressed format (see packText), without a
+** match if matchLen is 0.  Returns the number of bytes written.
+*/
+static int packSequence(unsigned char *packed, const char *literals,
+	int nLiterals, int offset, int matchLen)
+{
+    unsigned char *out = packed + 1;
+    int rest;
+    
+    *packed = (nLiterals < 15 ? nLiterals : 15) << 4;
+    if (nLiterals >= 15) {
+	for (rest = nLiterals - 15; rest >= 255; rest -= 255)
+	    *out++ = 255;
+	*out++ = rest;
+    }
+    memcpy(out, literals, nLiterals);
+    out += nLiterals;
+    if (matchLen == 0)
+	return out - packed;
+    
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+    matchLen -= PACK_MIN_MATCH;
+    *packed |= matchLen < 15 ? matchLen : 15;
+    if (matchLen >= 15) {
+	for (rest = matchLen - 15; rest >= 255; rest -= 255)
+	    *out++ = 255;
+	*out++ = rest;
+    }
+    return out - packed;
+}
+
+/*
+** Expand text compressed by packText
+*/
+static void unpackText(const unsigned char *packed, int packedLen,
+	char *text)
+{
+    const unsigned char *in = packed, *end = packed + packedLen;
+    int token, len, offset;
+    
+    while (in < end) {
+	token = *in++;
+	len = token >> 4;
+	if (len == 15)
+	    do len += *in; while (*in++ == 255);
+	memcpy(text, in, len);
+	text += len;
+	in += len;
+	if (in >= end)
+	    break;
+	
+	offset = in[0] | in[1] << 8;
+	in += 2;
+	len = token & 15;
+	if (len == 15)
+	    do len += *in; while (*in++ == 255);
+	/* the match may overlap the text it produces */
+	for (len += PACK_MIN_MATCH; len > 0; len--, text++)
+	    *text = text[-offset];
+    }
+}
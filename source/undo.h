@@ -30,7 +30,7 @@
 #include "nedit.h"
 
 enum undoTypes {UNDO_NOOP, ONE_CHAR_INSERT, ONE_CHAR_REPLACE, ONE_CHAR_DELETE,
-		BLOCK_INSERT, BLOCK_REPLACE, BLOCK_DELETE};
+		BLOCK_INSERT, BLOCK_REPLACE, BLOCK_DELETE, MULTI_REPLACE};
 
 void Undo(WindowInfo *window);
 void Redo(WindowInfo *window);
@@ -38,5 +38,6 @@ void SaveUndoInformation(WindowInfo *window, int pos, int nInserted,
 	int nDeleted, const char *deletedText);
 void ClearUndoList(WindowInfo *window);
 void ClearRedoList(WindowInfo *window);
+void SetUndoRanges(const WindowInfo *window, const UndoRange *ranges, int nRanges);
 
 #endif /* NEDIT_UNDO_H_INCLUDED */
@@ -55,6 +55,9 @@
 #include "interpret.h"
 #include "rangeset.h"
 #include "highlightData.h"
+#include "matchIndex.h"
+#include "findInFiles.h"
+#include "fileWatch.h"
 #include "../util/clearcase.h"
 #include "../util/misc.h"
 #include "../util/fileUtils.h"
@@ -386,6 +389,7 @@ WindowInfo *CreateWindow(const char *name, char *geometry, int iconic)
     window->findRegexToggle = NULL;
     window->replaceMultiFileDlog = NULL;
     window->replaceMultiFilePathBtn = NULL;
+    window->replaceMultiFileProgress = NULL;
     window->replaceMultiFileList = NULL;
     window->multiFileReplSelected = FALSE;
     window->multiFileBusy = FALSE;
@@ -424,8 +428,19 @@ WindowInfo *CreateWindow(const char *name, char *geometry, int iconic)
     window->nPanes = 0;
     window->autoSaveCharCount = 0;
     window->autoSaveOpCount = 0;
+    window->undoJournal = NULL;
+    window->backupDelta = NULL;
+    window->backupSize = 0;
+    window->backupJob = NULL;
+    window->fileWatched = FALSE;
+    window->fileEvent = FALSE;
+    window->followFile = FALSE;
+    window->followSize = 0;
+    window->fileHashed = FALSE;
+    memset(window->loadTime, 0, sizeof(window->loadTime));
     window->undoOpCount = 0;
     window->undoMemUsed = 0;
+    window->redoMemUsed = 0;
     CLEAR_ALL_LOCKS(window->lockReasons);
     window->indentStyle = GetPrefAutoIndent(PLAIN_LANGUAGE_MODE);
     window->autoSave = GetPrefAutoSave();
@@ -478,12 +493,14 @@ WindowInfo *CreateWindow(const char *name, char *geometry, int iconic)
     window->nMarks = 0;
     window->markTimeoutID = 0;
     window->highlightData = NULL;
+    window->matchIndex = NULL;
     window->shellCmdData = NULL;
     window->macroCmdData = NULL;
     window->smartIndentData = NULL;
     window->languageMode = PLAIN_LANGUAGE_MODE;
     window->iSearchHistIndex = 0;
     window->iSearchStartPos = -1;
+    window->iSearchLastString = NULL;
     window->replaceLastRegexCase   = TRUE;
     window->replaceLastLiteralCase = FALSE;
     window->iSearchLastRegexCase   = TRUE;
@@ -1118,6 +1135,19 @@ static void createSearchForm(WindowInfo *window)
             NULL);
     XmStringFree(s1);
 
+    window->iSearchCountLabel = XtVaCreateManagedWidget("iSearchCountLabel",
+            xmLabelWidgetClass, window->iSearchForm,
+            XmNlabelString, s1=XmStringCreateSimple(""),
+            XmNmarginHeight, 0,
+            XmNrightAttachment, XmATTACH_WIDGET,
+            XmNrightWidget, window->iSearchClearButton,
+            XmNrightOffset, 2,
+            XmNtopAttachment, XmATTACH_FORM,
+            XmNtopOffset, 1, /* see openmotif note above */
+            XmNbottomAttachment, XmATTACH_FORM,
+            NULL);
+    XmStringFree(s1);
+
     window->iSearchText = XtVaCreateManagedWidget("iSearchText",
             XNEtextfieldWidgetClass, window->iSearchForm,
             XmNmarginHeight, 1,
@@ -1125,7 +1155,7 @@ static void createSearchForm(WindowInfo *window)
             XmNleftAttachment, XmATTACH_WIDGET,
             XmNleftWidget, window->iSearchFindButton,
             XmNrightAttachment, XmATTACH_WIDGET,
-            XmNrightWidget, window->iSearchClearButton,
+            XmNrightWidget, window->iSearchCountLabel,
             /* XmNrightOffset, 5, */
             XmNtopAttachment, XmATTACH_FORM,
             XmNtopOffset, 0, /* see openmotif note above */
@@ -1383,6 +1413,15 @@ void CloseWindow(WindowInfo *window)
     /* Free smart indent macro programs */
     EndSmartIndent(window);
     
+    /* Stop indexing and highlighting search matches */
+    ClearMatchIndex(window);
+    ForgetISearchStep(window);
+    
+    /* The changes were saved or abandoned, the journal isn't needed */
+    RemoveUndoJournal(window);
+    EndBackupDelta(window);
+    UnwatchFile(window);
+    
     /* Clean up macro references to the doomed window.  If a macro is
        executing, stop it.  If macro is calling this (closing its own
        window), leave the window alive until the macro completes */
@@ -1401,6 +1440,7 @@ void CloseWindow(WindowInfo *window)
        but LessTif doesn't even (always) honor application modalness, so
        there can be more than one dialog. */
     RemoveFromMultiReplaceDialog(window);
+    RemoveFromFindInFiles(window);
     
     /* Destroy the file closed property for this file */
     DeleteFileClosedProperty(window);
@@ -2973,6 +3013,9 @@ static void movedCB(Widget w, WindowInfo *window, XtPointer callData)
     /* update line and column nubers in statistics line */
     UpdateStatsLine(window);
     
+    /* update the number of the selected search match */
+    UpdateMatchCount(window);
+    
     /* Check the character before the cursor for matchable characters */
     FlashMatching(window, w);
     
@@ -3029,6 +3072,10 @@ static void modifiedCB(int pos, int nInserted, int nDeleted, int nRestyled,
 	}
     }
 
+    /* a changed text may have matches an incremental search skipped */
+    if (nDeleted != 0 || nInserted != 0)
+        ForgetISearchStep(window);
+
     /* When the program needs to make a change to a text area without without
        recording it for undo or marking file as changed it sets ignoreModify */
     if (window->ignoreModify || (nDeleted == 0 && nInserted == 0))
@@ -3040,12 +3087,20 @@ static void modifiedCB(int pos, int nInserted, int nDeleted, int nRestyled,
     /* Save information for undoing this operation (this call also counts
        characters and editing operations for triggering autosave */
     SaveUndoInformation(window, pos, nInserted, nDeleted, deletedText);
-    
-    /* Trigger automatic backup if operation or character limits reached */
-    if (window->autoSave &&
+    if (window->undoJournal != NULL)
+        WriteUndoJournal(window, pos, nInserted, nDeleted, deletedText);
+    if (window->backupDelta != NULL)
+        WriteBackupDelta(window, pos, nInserted, nDeleted, deletedText);
+    
+    /* Trigger automatic backup if operation or character limits reached.
+       With a journal, only what was added to it needs to reach the disk */
+    if ((window->autoSave || window->undoJournal != NULL) &&
             (window->autoSaveCharCount > AUTOSAVE_CHAR_LIMIT ||
              window->autoSaveOpCount > AUTOSAVE_OP_LIMIT)) {
-        WriteBackupFile(window);
+        if (window->undoJournal != NULL)
+            SyncUndoJournal(window);
+        else
+            WriteBackupFile(window);
         window->autoSaveCharCount = 0;
         window->autoSaveOpCount = 0;
     }
@@ -4043,6 +4098,7 @@ WindowInfo* CreateDocument(WindowInfo* shellWindow, const char* name)
     window->findRegexToggle = NULL;
     window->replaceMultiFileDlog = NULL;
     window->replaceMultiFilePathBtn = NULL;
+    window->replaceMultiFileProgress = NULL;
     window->replaceMultiFileList = NULL;
     window->showLineNumbers = GetPrefLineNums();
     window->showStats = GetPrefStatsLine();
@@ -4082,8 +4138,19 @@ WindowInfo* CreateDocument(WindowInfo* shellWindow, const char* name)
     window->nPanes = 0;
     window->autoSaveCharCount = 0;
     window->autoSaveOpCount = 0;
+    window->undoJournal = NULL;
+    window->backupDelta = NULL;
+    window->backupSize = 0;
+    window->backupJob = NULL;
+    window->fileWatched = FALSE;
+    window->fileEvent = FALSE;
+    window->followFile = FALSE;
+    window->followSize = 0;
+    window->fileHashed = FALSE;
+    memset(window->loadTime, 0, sizeof(window->loadTime));
     window->undoOpCount = 0;
     window->undoMemUsed = 0;
+    window->redoMemUsed = 0;
     window->undo_op_batch_size = 0;
     CLEAR_ALL_LOCKS(window->lockReasons);
     window->indentStyle = GetPrefAutoIndent(PLAIN_LANGUAGE_MODE);
@@ -4130,12 +4197,14 @@ WindowInfo* CreateDocument(WindowInfo* shellWindow, const char* name)
     window->nMarks = 0;
     window->markTimeoutID = 0;
     window->highlightData = NULL;
+    window->matchIndex = NULL;
     window->shellCmdData = NULL;
     window->macroCmdData = NULL;
     window->smartIndentData = NULL;
     window->languageMode = PLAIN_LANGUAGE_MODE;
     window->iSearchHistIndex = 0;
     window->iSearchStartPos = -1;
+    window->iSearchLastString = NULL;
     window->replaceLastRegexCase   = TRUE;
     window->replaceLastLiteralCase = FALSE;
     window->iSearchLastRegexCase   = TRUE;
@@ -4821,6 +4890,7 @@ void RefreshMenuToggleStates(WindowInfo *window)
     XmToggleButtonSetState(window->overtypeModeItem, window->overstrike, False);
     XmToggleButtonSetState(window->matchSyntaxBasedItem, window->matchSyntaxBased, False);
     XmToggleButtonSetState(window->readOnlyItem, IS_USER_LOCKED(window->lockReasons), False);
+    XmToggleButtonSetState(window->followFileItem, window->followFile, False);
 
     XtSetSensitive(window->smartIndentItem, 
             SmartIndentMacrosAvailable(LanguageModeName(window->languageMode)));
@@ -5200,6 +5270,7 @@ void RefreshWindowStates(WindowInfo *window)
     } else {
     	UpdateStatsLine(window);
     }
+    UpdateMatchCount(window);
     
     UpdateWindowReadOnly(window);
     UpdateWindowTitle(window);
@@ -5419,6 +5490,7 @@ static void cloneDocument(WindowInfo *window, WindowInfo *orgWin)
     */
     window->buffer->rangesetTable =
 	    RangesetTableClone(orgWin->buffer->rangesetTable, window->buffer);
+    CloneMatchIndex(window, orgWin);
 
     /* Syntax highlighting */    
     window->languageMode = orgWin->languageMode;
@@ -5430,13 +5502,27 @@ static void cloneDocument(WindowInfo *window, WindowInfo *orgWin)
     window->filenameSet = orgWin->filenameSet;
     window->fileFormat = orgWin->fileFormat;
     window->lastModTime = orgWin->lastModTime;
+    window->fileHashed = orgWin->fileHashed;
+    window->fileHash = orgWin->fileHash;
+    window->fileHashSize = orgWin->fileHashSize;
+    window->followFile = orgWin->followFile;
+    window->followSize = orgWin->followSize;
     window->fileChanged = orgWin->fileChanged;
     window->fileMissing = orgWin->fileMissing;
     window->lockReasons = orgWin->lockReasons;
     window->autoSaveCharCount = orgWin->autoSaveCharCount;
     window->autoSaveOpCount = orgWin->autoSaveOpCount;
+    
+    /* the journal of unsaved changes moves with the document */
+    window->undoJournal = orgWin->undoJournal;
+    orgWin->undoJournal = NULL;
+    MoveBackupDelta(orgWin, window);
+    WatchFile(window);
+    window->fileEvent = orgWin->fileEvent;
+    memcpy(window->loadTime, orgWin->loadTime, sizeof(window->loadTime));
     window->undoOpCount = orgWin->undoOpCount;
     window->undoMemUsed = orgWin->undoMemUsed;
+    window->redoMemUsed = orgWin->redoMemUsed;
     window->autoSave = orgWin->autoSave;
     window->saveOldVersion = orgWin->saveOldVersion;
     window->wrapMode = orgWin->wrapMode;
@@ -5511,10 +5597,19 @@ static UndoInfo *cloneUndoItems(UndoInfo *orgList)
 	clone = (UndoInfo *)NEditMalloc(sizeof(UndoInfo));
 	memcpy(clone, undo, sizeof(UndoInfo));
 
-	if (undo->oldText) {
+	if (undo->oldText && undo->packedLen > 0) {
+	    clone->oldText = (char*)NEditMalloc(undo->packedLen);
+	    memcpy(clone->oldText, undo->oldText, undo->packedLen);
+	} else if (undo->oldText) {
 	    clone->oldText = (char*)NEditMalloc(strlen(undo->oldText)+1);
 	    strcpy(clone->oldText, undo->oldText);
 	}
+	if (undo->ranges) {
+	    clone->ranges = (UndoRange*)NEditMalloc(
+		    undo->nRanges * sizeof(UndoRange));
+	    memcpy(clone->ranges, undo->ranges,
+		    undo->nRanges * sizeof(UndoRange));
+	}
 	clone->next = NULL;
 
 	if (last)
@@ -5572,6 +5667,13 @@ WindowInfo *DetachDocument(WindowInfo *window)
     if (NDocuments(window) < 2)
     	return NULL;
 
+    /* the clone would take over the document while its file is read or
+       written, and the original can't be closed */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return NULL;
+    }
+
     /* raise another document in the same shell window if the window
        being detached is the top document */
     if (IsTopDocument(window)) {
@@ -5639,6 +5741,12 @@ WindowInfo *MoveDocument(WindowInfo *toWindow, WindowInfo *window)
 {
     WindowInfo *win = NULL, *cloneWin;
 
+    /* see DetachDocument */
+    if (IS_FILE_BUSY_LOCKED(window->lockReasons)) {
+        XBell(TheDisplay, 0);
+        return NULL;
+    }
+
     /* prepare to move document */
     if (NDocuments(window) < 2) {
     	/* hide the window to make it look like we are moving */
@@ -6421,6 +6529,7 @@ void ReloadWindowResources(WindowInfo *window, Boolean updateMenuBar)
     UpdateWidgetsHierarchy(window->iSearchForm, dw.form, &dw);
     clearCompositeWidget(window->iSearchForm);
     createSearchForm(window);
+    UpdateMatchCount(window);
     
     Widget tabbar = window->tabBar;
     Widget tabform = XtParent(tabbar);
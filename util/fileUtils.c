@@ -38,6 +38,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <errno.h>
 #include <X11/Intrinsic.h>
@@ -537,6 +538,130 @@ int FormatOfFile(const char *fileString)
     return UNIX_FILE_FORMAT;
 }
 
+/*
+** Find the first of the characters c1 and c2 (which may be the same) in
+** text[pos] to text[length-1], and return its position, or length if there
+** is none.  Text is looked at 8 bytes at a time, and only the words which
+** contain one of the characters are looked at byte by byte.
+*/
+static size_t findChars(const char *text, size_t pos, size_t length, char c1,
+        char c2)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t p1 = ones * (unsigned char)c1, p2 = ones * (unsigned char)c2;
+    uint64_t w, x1, x2;
+    
+    while(pos + sizeof(uint64_t) <= length) {
+        /* a byte of x1 or x2 is 0 where the word has c1 or c2 */
+        memcpy(&w, text + pos, sizeof(uint64_t));
+        x1 = w ^ p1;
+        x2 = w ^ p2;
+        if((((x1 - ones) & ~x1) | ((x2 - ones) & ~x2)) & highs) {
+            break;
+        }
+        pos += sizeof(uint64_t);
+    }
+    
+    /* (the test above has no false positives, this stops within the word) */
+    while(pos < length && text[pos] != c1 && text[pos] != c2) {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+** Converts text of "length" characters (which may be the entire contents of a
+** file) in file format "format" to Unix format, in place, and returns its new
+** length.  In DOS format, CR LF pairs become LF, in Macintosh format each CR
+** becomes LF.  In the same pass, "hasNuls" is set if the text contains nul
+** characters.  The text is terminated with a nul, it must have room for it.
+*/
+size_t ConvertFromFileFormat(char *text, size_t length, int format,
+        int *hasNuls)
+{
+    size_t in = 0, out = 0, next;
+    int nuls = 0;
+    char c;
+    
+    if(format == UNIX_FILE_FORMAT) {
+        *hasNuls = memchr(text, '\0', length) != NULL;
+        text[length] = '\0';
+        return length;
+    }
+    
+    /* Copy the text between the characters to convert in whole runs */
+    while(in < length) {
+        next = findChars(text, in, length, '\r', nuls ? '\r' : '\0');
+        if(out != in) {
+            memmove(text + out, text + in, next - in);
+        }
+        out += next - in;
+        in = next;
+        if(in == length) {
+            break;
+        }
+        
+        c = text[in++];
+        if(c == '\0') {
+            nuls = 1;
+        } else if(format == MAC_FILE_FORMAT) {
+            c = '\n';
+        } else if(in < length && text[in] == '\n') {
+            c = '\n';
+            in++;
+        }
+        text[out++] = c;
+    }
+    text[out] = '\0';
+    *hasNuls = nuls;
+    return out;
+}
+
+/*
+** Converts Unix format text of "length" characters to file format "format",
+** and at the same time puts back nul characters which were substituted with
+** "nullSubsChar" (if not nul itself).  The converted text is written to
+** "out", which must have room for 2*length characters, and its length is
+** returned.
+*/
+size_t ConvertToFileFormat(const char *text, size_t length, int format,
+        char nullSubsChar, char *out)
+{
+    size_t in = 0, outLen = 0, next;
+    char c1, c2, c;
+    
+    if(format == UNIX_FILE_FORMAT && nullSubsChar == '\0') {
+        memcpy(out, text, length);
+        return length;
+    }
+    c1 = format == UNIX_FILE_FORMAT ? nullSubsChar : '\n';
+    c2 = nullSubsChar != '\0' ? nullSubsChar : c1;
+    
+    while(in < length) {
+        next = findChars(text, in, length, c1, c2);
+        memcpy(out + outLen, text + in, next - in);
+        outLen += next - in;
+        in = next;
+        if(in == length) {
+            break;
+        }
+        
+        c = text[in++];
+        if(c == nullSubsChar && nullSubsChar != '\0') {
+            c = '\0';
+        } else if(c == '\n') {
+            if(format == DOS_FILE_FORMAT) {
+                out[outLen++] = '\r';
+            } else if(format == MAC_FILE_FORMAT) {
+                c = '\r';
+            }
+        }
+        out[outLen++] = c;
+    }
+    return outLen;
+}
+
 /*
 ** Converts a string (which may represent the entire contents of the file)
 ** from DOS or Macintosh format to Unix format.  Conversion is done in-place.
@@ -551,34 +676,24 @@ int FormatOfFile(const char *fileString)
 void ConvertFromDosFileString(char *fileString, int *length, 
     char* pendingCR)
 {
-    char *outPtr = fileString;
-    char *inPtr = fileString;
-    if (pendingCR) *pendingCR = 0;
-    while (inPtr < fileString + *length) {
-    	if (*inPtr == '\r') {
-	    if (inPtr < fileString + *length - 1) {
-		if (*(inPtr + 1) == '\n')
-		    inPtr++;
-	    } else {
-		if (pendingCR) {
-		    *pendingCR = *inPtr;
-		    break; /* Don't copy this trailing '\r' */
-		}
-	    }
-	}
-	*outPtr++ = *inPtr++;
+    int hasNuls;
+    
+    if (pendingCR) {
+        *pendingCR = 0;
+        if (*length > 0 && fileString[*length - 1] == '\r') {
+            *pendingCR = '\r';
+            (*length)--; /* Don't copy this trailing '\r' */
+        }
     }
-    *outPtr = '\0';
-    *length = outPtr - fileString;
+    *length = ConvertFromFileFormat(fileString, *length, DOS_FILE_FORMAT,
+            &hasNuls);
 }
 void ConvertFromMacFileString(char *fileString, int length)
 {
-    char *inPtr = fileString;
-    while (inPtr < fileString + length) {
-        if (*inPtr == '\r' )
-            *inPtr = '\n';
-        inPtr++;
-    }
+    size_t pos = 0, len = length;
+    
+    while ((pos = findChars(fileString, pos, len, '\r', '\r')) < len)
+        fileString[pos++] = '\n';
 }
 
 /*
@@ -586,25 +701,17 @@ void ConvertFromMacFileString(char *fileString, int length)
 ** Unix to DOS format.  String is re-allocated (with malloc), and length is
 ** modified.  If allocation fails, which it may, because this can potentially
 ** be a huge hunk of memory, returns FALSE and no conversion is done.
-**
-** This could be done more efficiently by asking doSave to allocate some
-** extra memory for this, and only re-allocating if it wasn't enough.  If
-** anyone cares about the performance or the potential for running out of
-** memory on a save, it should probably be redone.
 */
 int ConvertToDosFileString(char **fileString, int *length)
 {
-    char *outPtr, *outString;
-    char *inPtr = *fileString;
-    int inLength = *length;
-    int outLength = 0;
+    char *outString;
+    size_t pos = 0, len = *length;
+    int outLength = *length;
 
     /* How long a string will we need? */
-    while (inPtr < *fileString + inLength) {
-    	if (*inPtr == '\n')
-	    outLength++;
-	inPtr++;
-	outLength++;
+    while ((pos = findChars(*fileString, pos, len, '\n', '\n')) < len) {
+        outLength++;
+        pos++;
     }
     
     /* Allocate the new string */
@@ -613,14 +720,9 @@ int ConvertToDosFileString(char **fileString, int *length)
 	return FALSE;
     
     /* Do the conversion, free the old string */
-    inPtr = *fileString;
-    outPtr = outString;
-    while (inPtr < *fileString + inLength) {
-    	if (*inPtr == '\n')
-	    *outPtr++ = '\r';
-	*outPtr++ = *inPtr++;
-    }
-    *outPtr = '\0';
+    ConvertToFileFormat(*fileString, *length, DOS_FILE_FORMAT, '\0',
+            outString);
+    outString[outLength] = '\0';
     NEditFree(*fileString);
     *fileString = outString;
     *length = outLength;
@@ -633,13 +735,10 @@ int ConvertToDosFileString(char **fileString, int *length)
 */
 void ConvertToMacFileString(char *fileString, int length)
 {
-    char *inPtr = fileString;
+    size_t pos = 0, len = length;
     
-    while (inPtr < fileString + length) {
-	if (*inPtr == '\n' )
-            *inPtr = '\r';
-	inPtr++;
-    }
+    while ((pos = findChars(fileString, pos, len, '\n', '\n')) < len)
+        fileString[pos++] = '\r';
 }
 
 /*
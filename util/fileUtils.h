@@ -27,6 +27,8 @@
 #ifndef NEDIT_FILEUTILS_H_INCLUDED
 #define NEDIT_FILEUTILS_H_INCLUDED
 
+#include <stddef.h>
+
 enum fileFormats {UNIX_FILE_FORMAT, DOS_FILE_FORMAT, MAC_FILE_FORMAT};
 
 int ParseFilename(const char *fullname, char *filename, char *pathname);
@@ -38,6 +40,10 @@ int CompressPathname(char *pathname);
 int ResolvePath(const char * pathIn, char * pathResolved); 
 
 int FormatOfFile(const char *fileString);
+size_t ConvertFromFileFormat(char *text, size_t length, int format,
+        int *hasNuls);
+size_t ConvertToFileFormat(const char *text, size_t length, int format,
+        char nullSubsChar, char *out);
 void ConvertFromDosFileString(char *inString, int *length, 
      char* pendingCR);
 void ConvertFromMacFileString(char *fileString, int length);
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2025 Olaf Wintermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "filehash.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define HASH_CHUNK_SIZE 1048576
+
+/* data smaller than this is hashed on the calling thread only */
+#define HASH_PARALLEL_MIN (16 * HASH_CHUNK_SIZE)
+
+#define HASH_MAX_THREADS 8
+
+/* files smaller than this are read instead of mapped */
+#define HASH_MMAP_MIN 65536
+
+/* XXH64, see https://github.com/Cyan4973/xxHash */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh64_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+    
+    if(len >= 32) {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p+8));
+            v3 = xxh64_round(v3, read64(p+16));
+            v4 = xxh64_round(v4, read64(p+24));
+            p += 32;
+        } while(p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    
+    h += (uint64_t)len;
+    while(p + 8 <= end) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if(p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while(p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+    
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+typedef struct HashJob {
+    const unsigned char *data;
+    size_t len;
+    uint64_t *chunkHashes;
+    size_t first;
+    size_t end;
+} HashJob;
+
+static void hash_chunks(HashJob *job) {
+    for(size_t i=job->first;i<job->end;i++) {
+        size_t offset = i * HASH_CHUNK_SIZE;
+        size_t len = job->len - offset;
+        if(len > HASH_CHUNK_SIZE) {
+            len = HASH_CHUNK_SIZE;
+        }
+        job->chunkHashes[i] = xxh64(job->data + offset, len, 0);
+    }
+}
+
+static void* hash_thread(void *data) {
+    hash_chunks(data);
+    return NULL;
+}
+
+uint64_t HashBytes(const void *data, size_t len) {
+    size_t nchunks = len / HASH_CHUNK_SIZE + (len % HASH_CHUNK_SIZE != 0);
+    uint64_t stackHashes[16];
+    uint64_t *chunkHashes = nchunks > 16 ?
+            malloc(nchunks * sizeof(uint64_t)) : stackHashes;
+    if(!chunkHashes) {
+        return xxh64(data, len, 0);
+    }
+    
+    HashJob jobs[HASH_MAX_THREADS];
+    pthread_t threads[HASH_MAX_THREADS];
+    int nthreads = 1;
+    if(len >= HASH_PARALLEL_MIN) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > HASH_MAX_THREADS ? HASH_MAX_THREADS :
+                (ncpu < 1 ? 1 : (int)ncpu);
+    }
+    
+    /* the calling thread does the first part itself */
+    size_t perThread = (nchunks + nthreads - 1) / nthreads;
+    int started = 0;
+    for(int i=0;i<nthreads;i++) {
+        jobs[i].data = data;
+        jobs[i].len = len;
+        jobs[i].chunkHashes = chunkHashes;
+        jobs[i].first = i * perThread;
+        jobs[i].end = jobs[i].first + perThread;
+        if(jobs[i].first > nchunks) {
+            jobs[i].first = nchunks;
+        }
+        if(jobs[i].end > nchunks) {
+            jobs[i].end = nchunks;
+        }
+        if(i > 0) {
+            if(pthread_create(&threads[i], NULL, hash_thread, &jobs[i])) {
+                break;
+            }
+            started = i;
+        }
+    }
+    hash_chunks(&jobs[0]);
+    for(int i=started+1;i<nthreads;i++) {
+        /* no thread could be started for these */
+        hash_chunks(&jobs[i]);
+    }
+    for(int i=1;i<=started;i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    uint64_t hash = xxh64(chunkHashes, nchunks * sizeof(uint64_t), len);
+    if(chunkHashes != stackHashes) {
+        free(chunkHashes);
+    }
+    return hash;
+}
+
+struct HashState {
+    unsigned char *chunk;   /* the data of the chunk not yet complete */
+    size_t chunkLen;
+    uint64_t *chunkHashes;
+    size_t nchunks;
+    size_t alloc;
+    uint64_t len;
+    int error;
+};
+
+HashState* HashStart(void) {
+    HashState *state = calloc(1, sizeof(HashState));
+    if(!state) {
+        return NULL;
+    }
+    state->chunk = malloc(HASH_CHUNK_SIZE);
+    state->chunkHashes = malloc(16 * sizeof(uint64_t));
+    if(!state->chunk || !state->chunkHashes) {
+        free(state->chunk);
+        free(state->chunkHashes);
+        free(state);
+        return NULL;
+    }
+    state->alloc = 16;
+    return state;
+}
+
+static void hash_add_chunk(HashState *state, const unsigned char *data, size_t len) {
+    if(state->nchunks == state->alloc) {
+        size_t newAlloc = 2 * state->alloc;
+        uint64_t *newHashes = realloc(state->chunkHashes,
+                newAlloc * sizeof(uint64_t));
+        if(!newHashes) {
+            state->error = ENOMEM;
+            return;
+        }
+        state->chunkHashes = newHashes;
+        state->alloc = newAlloc;
+    }
+    state->chunkHashes[state->nchunks++] = xxh64(data, len, 0);
+}
+
+void HashUpdate(HashState *state, const void *data, size_t len) {
+    const unsigned char *p = data;
+    
+    state->len += len;
+    
+    /* complete the chunk started before */
+    if(state->chunkLen > 0) {
+        size_t n = HASH_CHUNK_SIZE - state->chunkLen;
+        if(n > len) {
+            n = len;
+        }
+        memcpy(state->chunk + state->chunkLen, p, n);
+        state->chunkLen += n;
+        p += n;
+        len -= n;
+        if(state->chunkLen < HASH_CHUNK_SIZE) {
+            return;
+        }
+        hash_add_chunk(state, state->chunk, HASH_CHUNK_SIZE);
+        state->chunkLen = 0;
+    }
+    
+    /* whole chunks are hashed where they are */
+    while(len >= HASH_CHUNK_SIZE) {
+        hash_add_chunk(state, p, HASH_CHUNK_SIZE);
+        p += HASH_CHUNK_SIZE;
+        len -= HASH_CHUNK_SIZE;
+    }
+    if(len > 0) {
+        memcpy(state->chunk, p, len);
+        state->chunkLen = len;
+    }
+}
+
+int HashEnd(HashState *state, uint64_t *hash, off_t *size) {
+    if(!state) {
+        return ENOMEM;
+    }
+    
+    if(state->chunkLen > 0) {
+        hash_add_chunk(state, state->chunk, state->chunkLen);
+    }
+    int err = state->error;
+    if(!err && hash) {
+        *hash = xxh64(state->chunkHashes, state->nchunks * sizeof(uint64_t),
+                state->len);
+    }
+    if(!err && size) {
+        *size = state->len;
+    }
+    
+    free(state->chunkHashes);
+    free(state->chunk);
+    free(state);
+    return err;
+}
+
+int HashFile(const char *path, uint64_t *hash, off_t *size) {
+    struct stat s;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return errno;
+    }
+    if(fstat(fd, &s)) {
+        int err = errno;
+        close(fd);
+        return err;
+    }
+    
+    int err = 0;
+    size_t len = s.st_size;
+    void *data = NULL;
+    if(len >= HASH_MMAP_MIN) {
+        data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            data = NULL;
+        } else {
+#ifdef MADV_SEQUENTIAL
+            madvise(data, len, MADV_SEQUENTIAL);
+#endif
+            *hash = HashBytes(data, len);
+            munmap(data, len);
+        }
+    }
+    if(!data) {
+        /* small file, or not mappable: read it */
+        char *buf = malloc(len + 1);
+        if(!buf) {
+            close(fd);
+            return ENOMEM;
+        }
+        size_t pos = 0;
+        while(pos < len) {
+            ssize_t r = read(fd, buf + pos, len - pos);
+            if(r < 0 && errno == EINTR) {
+                continue;
+            }
+            if(r <= 0) {
+                err = r < 0 ? errno : EIO;
+                break;
+            }
+            pos += r;
+        }
+        if(!err) {
+            *hash = HashBytes(buf, len);
+        }
+        free(buf);
+    }
+    close(fd);
+    
+    if(size) {
+        *size = s.st_size;
+    }
+    return err;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2025 Olaf Wintermann
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef XNEDIT_FILEHASH_H
+#define XNEDIT_FILEHASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * computes a 64 bit hash of len bytes of data
+ *
+ * the data is hashed in chunks of HASH_CHUNK_SIZE bytes with XXH64,
+ * and the hashes of the chunks are hashed again, so that large data can be
+ * hashed on several threads, with the same result
+ */
+uint64_t HashBytes(const void *data, size_t len);
+
+/*
+ * computes the HashBytes hash of the contents of a file, and returns its
+ * size in size (if not NULL)
+ *
+ * returns 0 on success, or an errno value
+ */
+int HashFile(const char *path, uint64_t *hash, off_t *size);
+
+/*
+ * state of a HashBytes hash computed from data passed in pieces
+ */
+typedef struct HashState HashState;
+
+/*
+ * starts hashing data passed in pieces, returns NULL if out of memory
+ */
+HashState* HashStart(void);
+
+/*
+ * adds the next len bytes of data to the hash
+ */
+void HashUpdate(HashState *state, const void *data, size_t len);
+
+/*
+ * frees the hash state, and returns the HashBytes hash of all the data
+ * in hash, and its length in size (if not NULL)
+ *
+ * state may be NULL, and hash NULL if the hash isn't needed
+ * returns 0 on success, or an errno value
+ */
+int HashEnd(HashState *state, uint64_t *hash, off_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* XNEDIT_FILEHASH_H */
@@ -228,6 +228,54 @@ int xattr_remove(const char *path, const char *name) {
     return ret;
 }
 
+static int copy_attr(const char *from, const char *to, const char *name) {
+    ssize_t len = getxattr(from, name, NULL, 0);
+    if(len < 0) {
+        return 1;
+    }
+    
+    // room for the value, and for the value 'to' already has
+    char *buf = malloc(2 * len + 1);
+    if(!buf) {
+        return 1;
+    }
+    int ret = 0;
+    ssize_t vlen = getxattr(from, name, buf, len);
+    if(vlen != len) {
+        ret = 1;
+    } else if(getxattr(to, name, buf + len, len) != len ||
+            memcmp(buf, buf + len, len))
+    {
+        // (a new file may have some already, like its security label)
+        ret = setxattr(to, name, buf, len, 0) ? 1 : 0;
+    }
+    free(buf);
+    return ret;
+}
+
+int xattr_copy(const char *from, const char *to) {
+    // all namespaces, unlike xattr_list: ACLs and security labels as well
+    ssize_t len = listxattr(from, NULL, 0);
+    if(len <= 0) {
+        return len == 0 || errno == ENOTSUP ? 0 : 1;
+    }
+    
+    char *list = malloc(len);
+    if(!list) {
+        return 1;
+    }
+    int ret = 0;
+    ssize_t listlen = listxattr(from, list, len);
+    if(listlen < 0) {
+        ret = 1;
+    }
+    for(char *name = list;!ret && name < list + listlen;name += strlen(name) + 1) {
+        ret = copy_attr(from, to, name);
+    }
+    free(list);
+    return ret;
+}
+
 #endif /* Linux */
 
 #ifdef __APPLE__
@@ -599,6 +647,36 @@ int xattr_remove(const char *path, const char *name) {
 
 #endif /* unsupported platform */
 
+#ifndef __linux__
+
+int xattr_copy(const char *from, const char *to) {
+    ssize_t nelm;
+    char **names = xattr_list(from, &nelm);
+    if(nelm < 0) {
+#ifdef XATTR_SUPPORTED
+        return errno == ENOTSUP ? 0 : 1;
+#else
+        return 0;
+#endif
+    }
+    
+    int ret = 0;
+    for(ssize_t i=0;!ret && i<nelm;i++) {
+        ssize_t len;
+        char *value = xattr_get(from, names[i], &len);
+        if(!value) {
+            ret = 1;
+            break;
+        }
+        ret = xattr_set(to, names[i], value, len) ? 1 : 0;
+        free(value);
+    }
+    xattr_free_list(names, nelm);
+    return ret;
+}
+
+#endif /* not Linux */
+
 void xattr_free_list(char **attrnames, ssize_t nelm) {
     if(attrnames) {
         for(int i=0;i<nelm;i++) {
@@ -40,6 +40,12 @@ int xattr_remove(const char *path, const char *name);
 
 void xattr_free_list(char **attrnames, ssize_t nelm);
 
+/*
+ * Copies the extended attributes of 'from' to 'to'. Returns 0 if all of them
+ * were copied, or there are none.
+ */
+int xattr_copy(const char *from, const char *to);
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,7 @@
 #include "unicode.h"
 
 #include <stdlib.h>
+#include <stdint.h>
 
 #ifdef __APPLE__
 #include <CoreFoundation/CoreFoundation.h>
@@ -44,3 +45,66 @@ char* StringNFD2NFC(const char *str) {
 }
 
 #endif
+
+
+size_t Utf8Validate(const char *str, size_t len, int *isAscii) {
+    const unsigned char *s = (const unsigned char*)str;
+    size_t i = 0;
+    int ascii = 1;
+    
+    while(i < len) {
+        // skip ASCII text one word at a time
+        if(i + sizeof(uint64_t) <= len) {
+            uint64_t w;
+            memcpy(&w, s + i, sizeof(uint64_t));
+            if((w & 0x8080808080808080ULL) == 0) {
+                i += sizeof(uint64_t);
+                continue;
+            }
+        }
+        
+        unsigned char c = s[i];
+        if(c < 0x80) {
+            i++;
+            continue;
+        }
+        
+        // number of continuation bytes
+        size_t n;
+        if(c >= 0xC2 && c <= 0xDF) {
+            n = 1;
+        } else if(c >= 0xE0 && c <= 0xEF) {
+            n = 2;
+        } else if(c >= 0xF0 && c <= 0xF4) {
+            n = 3;
+        } else {
+            break; // continuation byte, overlong 2 byte form or > U+10FFFF
+        }
+        if(i + n >= len) {
+            break; // truncated
+        }
+        
+        unsigned char c1 = s[i+1];
+        if((c1 & 0xC0) != 0x80
+                || (c == 0xE0 && c1 < 0xA0)  // overlong
+                || (c == 0xED && c1 > 0x9F)  // surrogate
+                || (c == 0xF0 && c1 < 0x90)  // overlong
+                || (c == 0xF4 && c1 > 0x8F)) // > U+10FFFF
+        {
+            break;
+        }
+        if(n > 1 && (s[i+2] & 0xC0) != 0x80) {
+            break;
+        }
+        if(n > 2 && (s[i+3] & 0xC0) != 0x80) {
+            break;
+        }
+        ascii = 0;
+        i += n + 1;
+    }
+    
+    if(isAscii) {
+        *isAscii = ascii;
+    }
+    return i;
+}
@@ -39,6 +39,15 @@ extern "C" {
 char* StringNFD2NFC(const char *str);
 #endif
 
+/*
+ * checks if str is valid UTF-8 and returns the length of the valid part
+ * (len, if it is valid as a whole)
+ *
+ * if isAscii is not NULL, it is set to 1 if the valid part contains only
+ * ASCII characters
+ */
+size_t Utf8Validate(const char *str, size_t len, int *isAscii);
+
 #ifdef __cplusplus
 }
 #endif